@@ -37,6 +37,7 @@
 #include <TelepathyQt/PendingReady>
 #include <TelepathyQt/ReadinessHelper>
 
+#include <QHash>
 #include <QQueue>
 #include <QSet>
 #include <QTimer>
@@ -62,6 +63,11 @@ struct TP_QT_NO_EXPORT AccountManager::Private
     QSet<QString> getAccountPathsFromProps(const QVariantMap &props);
     void addAccountForPath(const QString &accountObjectPath);
 
+    AccountSetPtr sharedAccountSet(const QString &key, const QVariantMap &filter);
+    AccountSetPtr sharedAccountSet(const QString &key, const AccountFilterConstPtr &filter);
+    AccountSetPtr lookupAccountSet(const QString &key);
+    void insertAccountSet(const QString &key, const AccountSetPtr &set);
+
     // Public object
     AccountManager *parent;
 
@@ -84,6 +90,10 @@ struct TP_QT_NO_EXPORT AccountManager::Private
     QHash<QString, AccountPtr> incompleteAccounts;
     QHash<QString, AccountPtr> accounts;
     QStringList supportedAccountProperties;
+
+    // The sets returned by the predefined views, shared for as long as someone uses them. They
+    // are not kept alive from here, as each of them keeps the manager alive.
+    QHash<QString, WeakPtr<AccountSet> > accountSets;
 };
 
 static const int maxReintrospectionRetries = 5;
@@ -229,6 +239,56 @@ void AccountManager::Private::addAccountForPath(const QString &path)
     incompleteAccounts.insert(path, account);
 }
 
+AccountSetPtr AccountManager::Private::sharedAccountSet(const QString &key,
+        const QVariantMap &filter)
+{
+    AccountSetPtr set = lookupAccountSet(key);
+    if (!set) {
+        set = parent->filterAccounts(filter);
+        if (parent->isReady(FeatureCore)) {
+            insertAccountSet(key, set);
+        }
+    }
+    return set;
+}
+
+AccountSetPtr AccountManager::Private::sharedAccountSet(const QString &key,
+        const AccountFilterConstPtr &filter)
+{
+    AccountSetPtr set = lookupAccountSet(key);
+    if (!set) {
+        set = parent->filterAccounts(filter);
+        if (parent->isReady(FeatureCore)) {
+            insertAccountSet(key, set);
+        }
+    }
+    return set;
+}
+
+AccountSetPtr AccountManager::Private::lookupAccountSet(const QString &key)
+{
+    AccountSetPtr set;
+
+    if (accountSets.contains(key)) {
+        set = AccountSetPtr(accountSets.value(key));
+    }
+
+    return set;
+}
+
+void AccountManager::Private::insertAccountSet(const QString &key, const AccountSetPtr &set)
+{
+    // Drop the sets nobody uses anymore while at it, so they don't pile up
+    QMutableHashIterator<QString, WeakPtr<AccountSet> > i(accountSets);
+    while (i.hasNext()) {
+        i.next();
+        if (!AccountSetPtr(i.value())) {
+            i.remove();
+        }
+    }
+    accountSets.insert(key, WeakPtr<AccountSet>(set));
+}
+
 /**
  * \class AccountManager
  * \ingroup clientam
@@ -255,6 +315,10 @@ void AccountManager::Private::addAccountForPath(const QString &path)
  *
  * A signal is emitted to indicate that accounts are added. See newCreated() for more details.
  *
+ * The AccountSet objects returned by the predefined views (validAccounts(), onlineAccounts(),
+ * textChatAccounts(), accountsByProtocol() and so on) are shared: as long as a set is in use,
+ * calling the same method again returns it instead of building a new one.
+ *
  * \section am_usage_sec Usage
  *
  * \subsection am_create_sec Creating an AccountManager object
@@ -536,7 +600,7 @@ AccountSetPtr AccountManager::validAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("valid"), true);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("validAccounts"), filter);
 }
 
 /**
@@ -550,7 +614,7 @@ AccountSetPtr AccountManager::invalidAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("valid"), false);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("invalidAccounts"), filter);
 }
 
 /**
@@ -564,7 +628,7 @@ AccountSetPtr AccountManager::enabledAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("enabled"), true);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("enabledAccounts"), filter);
 }
 
 /**
@@ -578,7 +642,7 @@ AccountSetPtr AccountManager::disabledAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("enabled"), false);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("disabledAccounts"), filter);
 }
 
 /**
@@ -592,7 +656,7 @@ AccountSetPtr AccountManager::onlineAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("online"), true);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("onlineAccounts"), filter);
 }
 
 /**
@@ -606,7 +670,7 @@ AccountSetPtr AccountManager::offlineAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("online"), false);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("offlineAccounts"), filter);
 }
 
 /**
@@ -630,7 +694,7 @@ AccountSetPtr AccountManager::textChatAccounts() const
 
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::textChat());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("textChatAccounts"), filter);
 }
 
 /**
@@ -654,7 +718,7 @@ AccountSetPtr AccountManager::textChatroomAccounts() const
 
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::textChatroom());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("textChatroomAccounts"), filter);
 }
 
 /**
@@ -678,7 +742,7 @@ AccountSetPtr AccountManager::audioCallAccounts() const
 
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::audioCall());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("audioCallAccounts"), filter);
 }
 
 /**
@@ -702,7 +766,7 @@ AccountSetPtr AccountManager::videoCallAccounts() const
 
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::videoCall());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("videoCallAccounts"), filter);
 }
 
 /**
@@ -726,7 +790,7 @@ AccountSetPtr AccountManager::streamedMediaCallAccounts() const
 
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::streamedMediaCall());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("streamedMediaCallAccounts"), filter);
 }
 
 /**
@@ -750,7 +814,7 @@ AccountSetPtr AccountManager::streamedMediaAudioCallAccounts() const
 
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::streamedMediaAudioCall());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("streamedMediaAudioCallAccounts"), filter);
 }
 
 /**
@@ -774,7 +838,7 @@ AccountSetPtr AccountManager::streamedMediaVideoCallAccounts() const
 
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::streamedMediaVideoCall());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("streamedMediaVideoCallAccounts"), filter);
 }
 
 /**
@@ -799,7 +863,7 @@ AccountSetPtr AccountManager::streamedMediaVideoCallWithAudioAccounts() const
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(
             RequestableChannelClassSpec::streamedMediaVideoCallWithAudio());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("streamedMediaVideoCallWithAudioAccounts"), filter);
 }
 
 /**
@@ -823,7 +887,7 @@ AccountSetPtr AccountManager::fileTransferAccounts() const
 
     AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
     filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::fileTransfer());
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("fileTransferAccounts"), filter);
 }
 
 /**
@@ -845,7 +909,7 @@ AccountSetPtr AccountManager::accountsByProtocol(
 
     QVariantMap filter;
     filter.insert(QLatin1String("protocolName"), protocolName);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("accountsByProtocol:") + protocolName, filter);
 }
 
 /**
@@ -22,6 +22,12 @@
 
 #include <TelepathyQt/AccountPropertyFilter>
 
+#include <QList>
+#include <QMetaProperty>
+#include <QPair>
+#include <QSet>
+#include <QVariant>
+
 namespace Tp
 {
 
@@ -30,11 +36,13 @@ class ConnectionCapabilities;
 struct TP_QT_NO_EXPORT AccountSet::Private
 {
     class AccountWrapper;
+    struct CompiledFilter;
 
     Private(AccountSet *parent, const AccountManagerPtr &accountManager,
             const AccountFilterConstPtr &filter);
     Private(AccountSet *parent, const AccountManagerPtr &accountManager,
             const QVariantMap &filter);
+    ~Private();
 
     void init();
     void connectSignals();
@@ -45,20 +53,53 @@ struct TP_QT_NO_EXPORT AccountSet::Private
     void filterAccount(const AccountPtr &account);
     bool accountMatchFilter(AccountWrapper *account);
 
+    CompiledFilter compileFilter(const AccountFilterConstPtr &filter);
+    void addFilterDependency(const QMetaProperty &property);
+    bool filterDependsOn(const QString &propertyName) const;
+
     AccountSet *parent;
     AccountManagerPtr accountManager;
     AccountFilterConstPtr filter;
+    CompiledFilter *compiledFilter;
+    // Account properties the filter result may change with, all of them if filterDependsOnAll
+    QSet<QString> filterDependencies;
+    bool filterDependsOnAll;
     QHash<QString, AccountWrapper *> wrappers;
     QHash<QString, AccountPtr> accounts;
     bool ready;
 };
 
+// The filter with the property names resolved against Account's meta-object, so matching an
+// account doesn't need any string lookup. Filters it doesn't know about are called as is.
+struct TP_QT_NO_EXPORT AccountSet::Private::CompiledFilter
+{
+    enum Type {
+        Property,
+        And,
+        Or,
+        Not,
+        Opaque
+    };
+
+    CompiledFilter()
+        : type(Opaque)
+    {
+    }
+
+    bool matches(const AccountPtr &account) const;
+
+    Type type;
+    QList<QPair<QMetaProperty, QVariant> > properties;
+    QList<CompiledFilter> children;
+    AccountFilterConstPtr filter;
+};
+
 class TP_QT_NO_EXPORT AccountSet::Private::AccountWrapper : public QObject
 {
     Q_OBJECT
 
 public:
-    AccountWrapper(const AccountPtr &account, QObject *parent = 0);
+    AccountWrapper(const AccountPtr &account, AccountSet::Private *set, QObject *parent = 0);
     ~AccountWrapper();
 
     AccountPtr account() const { return mAccount; }
@@ -77,6 +118,7 @@ private Q_SLOTS:
 
 private:
     AccountPtr mAccount;
+    AccountSet::Private *mSet;
 };
 
 } // Tp
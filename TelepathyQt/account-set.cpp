@@ -29,10 +29,14 @@
 #include "TelepathyQt/debug-internal.h"
 
 #include <TelepathyQt/Account>
+#include <TelepathyQt/AccountCapabilityFilter>
 #include <TelepathyQt/AccountFilter>
 #include <TelepathyQt/AccountManager>
+#include <TelepathyQt/AndFilter>
 #include <TelepathyQt/ConnectionCapabilities>
 #include <TelepathyQt/ConnectionManager>
+#include <TelepathyQt/NotFilter>
+#include <TelepathyQt/OrFilter>
 
 namespace Tp
 {
@@ -43,6 +47,8 @@ AccountSet::Private::Private(AccountSet *parent,
     : parent(parent),
       accountManager(accountManager),
       filter(filter),
+      compiledFilter(0),
+      filterDependsOnAll(false),
       ready(false)
 {
     init();
@@ -53,6 +59,8 @@ AccountSet::Private::Private(AccountSet *parent,
         const QVariantMap &filterMap)
     : parent(parent),
       accountManager(accountManager),
+      compiledFilter(0),
+      filterDependsOnAll(false),
       ready(false)
 {
     AccountPropertyFilterPtr propertyFilter = AccountPropertyFilter::create();
@@ -64,9 +72,15 @@ AccountSet::Private::Private(AccountSet *parent,
     init();
 }
 
+AccountSet::Private::~Private()
+{
+    delete compiledFilter;
+}
+
 void AccountSet::Private::init()
 {
     if (filter->isValid()) {
+        compiledFilter = new CompiledFilter(compileFilter(filter));
         connectSignals();
         insertAccounts();
         ready = true;
@@ -110,7 +124,7 @@ void AccountSet::Private::removeAccount(const Tp::AccountPtr &account)
 
 void AccountSet::Private::wrapAccount(const AccountPtr &account)
 {
-    AccountWrapper *wrapper = new AccountWrapper(account, parent);
+    AccountWrapper *wrapper = new AccountWrapper(account, this, parent);
     parent->connect(wrapper,
             SIGNAL(accountRemoved(Tp::AccountPtr)),
             SLOT(onAccountRemoved(Tp::AccountPtr)));
@@ -153,13 +167,129 @@ bool AccountSet::Private::accountMatchFilter(AccountWrapper *wrapper)
         return true;
     }
 
-    return filter->matches(wrapper->account());
+    return compiledFilter->matches(wrapper->account());
+}
+
+AccountSet::Private::CompiledFilter AccountSet::Private::compileFilter(
+        const AccountFilterConstPtr &filter)
+{
+    CompiledFilter compiled;
+    compiled.filter = filter;
+
+    const AccountFilter *f = filter.data();
+    if (const GenericPropertyFilter<Account> *propertyFilter =
+            dynamic_cast<const GenericPropertyFilter<Account> *>(f)) {
+        QList<QPair<QMetaProperty, QVariant> > properties;
+        QVariantMap filterMap = propertyFilter->filter();
+        for (QVariantMap::const_iterator i = filterMap.constBegin();
+                i != filterMap.constEnd(); ++i) {
+            int index = Account::staticMetaObject.indexOfProperty(i.key().toLatin1().constData());
+            if (index == -1) {
+                // Possibly a dynamic property, let the filter look it up
+                filterDependsOnAll = true;
+                return compiled;
+            }
+
+            QMetaProperty property = Account::staticMetaObject.property(index);
+            properties << qMakePair(property, i.value());
+            addFilterDependency(property);
+        }
+
+        compiled.type = CompiledFilter::Property;
+        compiled.properties = properties;
+    } else if (const AndFilter<Account> *andFilter =
+            dynamic_cast<const AndFilter<Account> *>(f)) {
+        compiled.type = CompiledFilter::And;
+        foreach (const AccountFilterConstPtr &child, andFilter->filters()) {
+            compiled.children << compileFilter(child);
+        }
+    } else if (const OrFilter<Account> *orFilter =
+            dynamic_cast<const OrFilter<Account> *>(f)) {
+        compiled.type = CompiledFilter::Or;
+        foreach (const AccountFilterConstPtr &child, orFilter->filters()) {
+            compiled.children << compileFilter(child);
+        }
+    } else if (const NotFilter<Account> *notFilter =
+            dynamic_cast<const NotFilter<Account> *>(f)) {
+        compiled.type = CompiledFilter::Not;
+        compiled.children << compileFilter(notFilter->filter());
+    } else if (dynamic_cast<const AccountCapabilityFilter *>(f)) {
+        filterDependencies.insert(QLatin1String("capabilities"));
+    } else {
+        // Nothing is known about what the filter looks at
+        filterDependsOnAll = true;
+    }
+
+    return compiled;
+}
+
+void AccountSet::Private::addFilterDependency(const QMetaProperty &property)
+{
+    QString name = QLatin1String(property.name());
+    filterDependencies.insert(name);
+
+    // These are only set once, when the account is introspected
+    if (name == QLatin1String("cmName") ||
+        name == QLatin1String("protocolName") ||
+        name == QLatin1String("uniqueIdentifier")) {
+        return;
+    }
+
+    // Properties without a change notification signal may change along with any other
+    if (!property.hasNotifySignal()) {
+        filterDependsOnAll = true;
+    }
+}
+
+bool AccountSet::Private::filterDependsOn(const QString &propertyName) const
+{
+    return filterDependsOnAll || filterDependencies.contains(propertyName);
+}
+
+bool AccountSet::Private::CompiledFilter::matches(const AccountPtr &account) const
+{
+    switch (type) {
+        case Property:
+            for (QList<QPair<QMetaProperty, QVariant> >::const_iterator i = properties.constBegin();
+                    i != properties.constEnd(); ++i) {
+                if (i->first.read(account.data()) != i->second) {
+                    return false;
+                }
+            }
+            return true;
+
+        case And:
+            for (QList<CompiledFilter>::const_iterator i = children.constBegin();
+                    i != children.constEnd(); ++i) {
+                if (!i->matches(account)) {
+                    return false;
+                }
+            }
+            return true;
+
+        case Or:
+            for (QList<CompiledFilter>::const_iterator i = children.constBegin();
+                    i != children.constEnd(); ++i) {
+                if (i->matches(account)) {
+                    return true;
+                }
+            }
+            return false;
+
+        case Not:
+            return !children.first().matches(account);
+
+        case Opaque:
+        default:
+            return filter->matches(account);
+    }
 }
 
 AccountSet::Private::AccountWrapper::AccountWrapper(
-        const AccountPtr &account, QObject *parent)
+        const AccountPtr &account, AccountSet::Private *set, QObject *parent)
     : QObject(parent),
-      mAccount(account)
+      mAccount(account),
+      mSet(set)
 {
     connect(account.data(),
             SIGNAL(removed()),
@@ -184,13 +314,18 @@ void AccountSet::Private::AccountWrapper::onAccountRemoved()
 void AccountSet::Private::AccountWrapper::onAccountPropertyChanged(
         const QString &propertyName)
 {
-    emit accountPropertyChanged(mAccount, propertyName);
+    // Changes to properties the filter doesn't look at can't change whether the account matches
+    if (mSet->filterDependsOn(propertyName)) {
+        emit accountPropertyChanged(mAccount, propertyName);
+    }
 }
 
 void AccountSet::Private::AccountWrapper::onAccountCapalitiesChanged(
         const ConnectionCapabilities &caps)
 {
-    emit accountCapabilitiesChanged(mAccount, caps);
+    if (mSet->filterDependsOn(QLatin1String("capabilities"))) {
+        emit accountCapabilitiesChanged(mAccount, caps);
+    }
 }
 
 /**
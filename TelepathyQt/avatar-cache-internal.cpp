@@ -0,0 +1,419 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/avatar-cache-internal.h"
+
+#include "TelepathyQt/_gen/avatar-cache-internal.moc.hpp"
+
+#include "TelepathyQt/debug-internal.h"
+
+#include <TelepathyQt/Utils>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QPair>
+#include <QTemporaryFile>
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <utime.h>
+#endif
+
+namespace Tp
+{
+
+static const qint64 defaultMaxSize = 64 * 1024 * 1024;
+static const int defaultMaxAge = 90 * 24 * 60 * 60;
+// How stale the last use time stored on disk can get before it's refreshed on a cache hit
+static const int touchInterval = 24 * 60 * 60;
+
+static qint64 currentTime()
+{
+    return QDateTime::currentDateTime().toTime_t();
+}
+
+AvatarCacheWorker::AvatarCacheWorker()
+    : QObject()
+{
+}
+
+AvatarCacheWorker::~AvatarCacheWorker()
+{
+}
+
+void AvatarCacheWorker::scanDirectory(const QString &path)
+{
+    AvatarCacheIndex index;
+
+    // Avatars are stored as <escaped token> files, with the MIME type in <escaped token>.mime
+    QDir dir(path);
+    QFileInfoList files = dir.entryInfoList(QDir::Files | QDir::NoDotAndDotDot);
+    QSet<QString> mimeTypeFileNames;
+    foreach (const QFileInfo &info, files) {
+        if (info.suffix() == QLatin1String("mime")) {
+            mimeTypeFileNames.insert(info.fileName());
+        }
+    }
+
+    foreach (const QFileInfo &info, files) {
+        QString fileName = info.fileName();
+        QString mimeTypeFileName = fileName + QLatin1String(".mime");
+        if (!mimeTypeFileNames.contains(mimeTypeFileName)) {
+            continue;
+        }
+
+        QFile mimeTypeFile(dir.filePath(mimeTypeFileName));
+        if (!mimeTypeFile.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        QString mimeType = QString(QLatin1String(mimeTypeFile.readAll()));
+        mimeTypeFile.close();
+
+        index.insert(fileName, AvatarCacheEntry(mimeType, info.size(),
+                    info.lastModified().toTime_t()));
+    }
+
+    emit directoryScanned(path, index);
+}
+
+void AvatarCacheWorker::writeAvatar(const QString &path, const QString &fileName,
+        const QByteArray &data, const QString &mimeType)
+{
+    bool success = QDir().mkpath(path);
+
+    QString avatarFileName = QString(QLatin1String("%1/%2")).arg(path).arg(fileName);
+    QString mimeTypeFileName = QString(QLatin1String("%1.mime")).arg(avatarFileName);
+
+    if (success && !QFile::exists(mimeTypeFileName)) {
+        QTemporaryFile mimeTypeFile(mimeTypeFileName);
+        if (mimeTypeFile.open()) {
+            mimeTypeFile.write(mimeType.toLatin1());
+            mimeTypeFile.setAutoRemove(false);
+            if (!mimeTypeFile.rename(mimeTypeFileName)) {
+                mimeTypeFile.remove();
+                success = false;
+            }
+        } else {
+            success = false;
+        }
+    }
+
+    if (success && !QFile::exists(avatarFileName)) {
+        QTemporaryFile avatarFile(avatarFileName);
+        if (avatarFile.open()) {
+            avatarFile.write(data);
+            avatarFile.setAutoRemove(false);
+            if (!avatarFile.rename(avatarFileName)) {
+                avatarFile.remove();
+                success = false;
+            }
+        } else {
+            success = false;
+        }
+    }
+
+    emit avatarWritten(path, fileName, mimeType, data.size(), success);
+}
+
+void AvatarCacheWorker::touchAvatar(const QString &path, const QString &fileName)
+{
+#ifdef Q_OS_UNIX
+    QByteArray avatarFileName = QFile::encodeName(
+            QString(QLatin1String("%1/%2")).arg(path).arg(fileName));
+    utime(avatarFileName.constData(), 0);
+#else
+    Q_UNUSED(path);
+    Q_UNUSED(fileName);
+#endif
+}
+
+void AvatarCacheWorker::removeAvatars(const QString &path, const QStringList &fileNames)
+{
+    QDir dir(path);
+    foreach (const QString &fileName, fileNames) {
+        dir.remove(fileName);
+        dir.remove(fileName + QLatin1String(".mime"));
+    }
+}
+
+AvatarCache *AvatarCache::mInstance = 0;
+
+AvatarCache *AvatarCache::instance()
+{
+    if (!mInstance) {
+        mInstance = new AvatarCache();
+    }
+    return mInstance;
+}
+
+AvatarCache::AvatarCache()
+    : QObject(),
+      mThread(new QThread(this)),
+      mWorker(new AvatarCacheWorker),
+      mWrittenSize(0),
+      mUseSerial(0),
+      mMaxSize(defaultMaxSize),
+      mMaxAge(defaultMaxAge),
+      mHits(0),
+      mMisses(0)
+{
+    qRegisterMetaType<Tp::AvatarCacheIndex>("Tp::AvatarCacheIndex");
+
+    mWorker->moveToThread(mThread);
+    connect(mWorker,
+            SIGNAL(directoryScanned(QString,Tp::AvatarCacheIndex)),
+            SLOT(onDirectoryScanned(QString,Tp::AvatarCacheIndex)));
+    connect(mWorker,
+            SIGNAL(avatarWritten(QString,QString,QString,qint64,bool)),
+            SLOT(onAvatarWritten(QString,QString,QString,qint64,bool)));
+    mThread->start(QThread::LowPriority);
+
+    // The worker thread must be stopped before the application goes away
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(),
+                SIGNAL(destroyed()),
+                SLOT(onApplicationDestroyed()));
+    }
+}
+
+AvatarCache::~AvatarCache()
+{
+    mThread->quit();
+    mThread->wait();
+    delete mWorker;
+
+    if (mInstance == this) {
+        mInstance = 0;
+    }
+}
+
+AvatarCache::LookupResult AvatarCache::lookup(const QString &path, const QString &token,
+        AvatarData &avatar)
+{
+    if (!mIndexes.contains(path)) {
+        ensureDirectoryLoaded(path);
+        return Loading;
+    }
+
+    QString fileName = escapeAsIdentifier(token);
+    if (mPendingWrites.value(path).contains(fileName)) {
+        return Storing;
+    }
+
+    AvatarCacheIndex &index = mIndexes[path];
+    AvatarCacheIndex::iterator i = index.find(fileName);
+    if (i == index.end()) {
+        ++mMisses;
+        return Miss;
+    }
+
+    ++mHits;
+
+    qint64 now = currentTime();
+    if (now - i->lastUsed > touchInterval) {
+        QMetaObject::invokeMethod(mWorker, "touchAvatar", Qt::QueuedConnection,
+                Q_ARG(QString, path), Q_ARG(QString, fileName));
+    }
+    i->lastUsed = now;
+    i->useSerial = ++mUseSerial;
+
+    avatar = AvatarData(QString(QLatin1String("%1/%2")).arg(path).arg(fileName), i->mimeType);
+    return Hit;
+}
+
+void AvatarCache::store(const QString &path, const QString &token, const QByteArray &data,
+        const QString &mimeType)
+{
+    QString fileName = escapeAsIdentifier(token);
+
+    if (mPendingWrites.value(path).contains(fileName)) {
+        // avatarStored() will be emitted once the ongoing write finishes
+        return;
+    }
+
+    const AvatarCacheIndex index = mIndexes.value(path);
+    AvatarCacheIndex::const_iterator i = index.constFind(fileName);
+    if (i != index.constEnd()) {
+        emit avatarStored(path, token, AvatarData(
+                    QString(QLatin1String("%1/%2")).arg(path).arg(fileName), i->mimeType));
+        return;
+    }
+
+    mPendingWrites[path].insert(fileName, token);
+    QMetaObject::invokeMethod(mWorker, "writeAvatar", Qt::QueuedConnection,
+            Q_ARG(QString, path), Q_ARG(QString, fileName),
+            Q_ARG(QByteArray, data), Q_ARG(QString, mimeType));
+}
+
+void AvatarCache::pin(const QString &fileName)
+{
+    if (!fileName.isEmpty()) {
+        ++instance()->mPinned[fileName];
+    }
+}
+
+void AvatarCache::unpin(const QString &fileName)
+{
+    if (!mInstance || fileName.isEmpty()) {
+        return;
+    }
+
+    QHash<QString, int>::iterator i = mInstance->mPinned.find(fileName);
+    if (i != mInstance->mPinned.end() && --i.value() == 0) {
+        mInstance->mPinned.erase(i);
+    }
+}
+
+void AvatarCache::setMaxSize(qint64 maxSize)
+{
+    mMaxSize = maxSize;
+    evict();
+}
+
+void AvatarCache::setMaxAge(int maxAge)
+{
+    mMaxAge = maxAge;
+}
+
+void AvatarCache::onDirectoryScanned(const QString &path, const AvatarCacheIndex &index)
+{
+    mLoadingDirectories.remove(path);
+
+    AvatarCacheIndex &loaded = mIndexes[path];
+    loaded = index;
+
+    QStringList expired;
+    qint64 oldest = currentTime() - mMaxAge;
+    AvatarCacheIndex::iterator i = loaded.begin();
+    while (i != loaded.end()) {
+        if (mMaxAge > 0 && i->lastUsed < oldest) {
+            expired << i.key();
+            i = loaded.erase(i);
+        } else {
+            ++i;
+        }
+    }
+
+    debugCategory(DebugAvatars) << "Avatar cache" << path << "loaded with" << loaded.size() <<
+        "avatar(s)," << expired.size() << "expired";
+
+    if (!expired.isEmpty()) {
+        QMetaObject::invokeMethod(mWorker, "removeAvatars", Qt::QueuedConnection,
+                Q_ARG(QString, path), Q_ARG(QStringList, expired));
+    }
+
+    evict();
+
+    emit directoryLoaded(path);
+}
+
+void AvatarCache::onAvatarWritten(const QString &path, const QString &fileName,
+        const QString &mimeType, qint64 size, bool success)
+{
+    QString token = mPendingWrites[path].take(fileName);
+    if (mPendingWrites[path].isEmpty()) {
+        mPendingWrites.remove(path);
+    }
+
+    if (!success) {
+        warning() << "Unable to write avatar" << fileName << "to the cache in" << path;
+    } else if (mIndexes.contains(path) && !mIndexes[path].contains(fileName)) {
+        // If the directory is still being scanned, the scan will pick the new file up
+        AvatarCacheEntry entry(mimeType, size, currentTime());
+        entry.useSerial = ++mUseSerial;
+        entry.written = true;
+        mIndexes[path].insert(fileName, entry);
+        mWrittenSize += size;
+        evict();
+    }
+
+    emit avatarStored(path, token, AvatarData(
+                QString(QLatin1String("%1/%2")).arg(path).arg(fileName), mimeType));
+}
+
+void AvatarCache::onApplicationDestroyed()
+{
+    delete this;
+}
+
+void AvatarCache::ensureDirectoryLoaded(const QString &path)
+{
+    if (mLoadingDirectories.contains(path)) {
+        return;
+    }
+
+    mLoadingDirectories.insert(path);
+    QMetaObject::invokeMethod(mWorker, "scanDirectory", Qt::QueuedConnection,
+            Q_ARG(QString, path));
+}
+
+void AvatarCache::evict()
+{
+    if (mMaxSize <= 0 || mWrittenSize <= mMaxSize) {
+        return;
+    }
+
+    // The cache directories are shared with the other Telepathy clients, which may be using any
+    // avatar in them, so only the avatars this process wrote count against the limit and are
+    // evicted. Evict the least recently used ones until we are comfortably below the limit, so
+    // that we don't have to do this again for every new avatar. Avatars some contact still
+    // points at are kept, even if that leaves us over the limit.
+    typedef QPair<qint64, quint64> UseTime;
+    QMultiMap<UseTime, QPair<QString, QString> > byLastUse;
+    QHash<QString, AvatarCacheIndex>::const_iterator i;
+    for (i = mIndexes.constBegin(); i != mIndexes.constEnd(); ++i) {
+        AvatarCacheIndex::const_iterator j;
+        for (j = i.value().constBegin(); j != i.value().constEnd(); ++j) {
+            if (!j.value().written ||
+                    mPinned.contains(QString(QLatin1String("%1/%2")).arg(i.key()).arg(j.key()))) {
+                continue;
+            }
+            byLastUse.insert(qMakePair(j.value().lastUsed, j.value().useSerial),
+                    qMakePair(i.key(), j.key()));
+        }
+    }
+
+    qint64 target = mMaxSize - mMaxSize / 10;
+    QHash<QString, QStringList> evicted;
+    QMultiMap<UseTime, QPair<QString, QString> >::const_iterator k = byLastUse.constBegin();
+    while (mWrittenSize > target && k != byLastUse.constEnd()) {
+        const QString &path = k.value().first;
+        const QString &fileName = k.value().second;
+        mWrittenSize -= mIndexes[path].take(fileName).size;
+        evicted[path] << fileName;
+        ++k;
+    }
+
+    for (QHash<QString, QStringList>::const_iterator l = evicted.constBegin();
+            l != evicted.constEnd(); ++l) {
+        debugCategory(DebugAvatars) << "Evicting" << l.value().size() <<
+            "avatar(s) from the cache in" << l.key();
+        QMetaObject::invokeMethod(mWorker, "removeAvatars", Qt::QueuedConnection,
+                Q_ARG(QString, l.key()), Q_ARG(QStringList, l.value()));
+    }
+}
+
+} // Tp
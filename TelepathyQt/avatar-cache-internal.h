@@ -0,0 +1,178 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_avatar_cache_internal_h_HEADER_GUARD_
+#define _TelepathyQt_avatar_cache_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/AvatarData>
+#include <TelepathyQt/Global>
+
+#include <QByteArray>
+#include <QHash>
+#include <QMetaType>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class QThread;
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+struct TP_QT_NO_EXPORT AvatarCacheEntry
+{
+    AvatarCacheEntry()
+        : size(0),
+          lastUsed(0),
+          useSerial(0),
+          written(false)
+    {
+    }
+
+    AvatarCacheEntry(const QString &mimeType, qint64 size, qint64 lastUsed)
+        : mimeType(mimeType),
+          size(size),
+          lastUsed(lastUsed),
+          useSerial(0),
+          written(false)
+    {
+    }
+
+    QString mimeType;
+    qint64 size;
+    // Seconds since the epoch
+    qint64 lastUsed;
+    // Orders the uses made by this process within the same second, 0 if unused so far
+    quint64 useSerial;
+    // Whether this process wrote the avatar, only those are ever evicted
+    bool written;
+};
+
+// Maps the escaped avatar token, which is also the avatar file name, to its entry
+typedef QHash<QString, AvatarCacheEntry> AvatarCacheIndex;
+
+class TP_QT_NO_EXPORT AvatarCacheWorker : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(AvatarCacheWorker)
+
+public:
+    AvatarCacheWorker();
+    ~AvatarCacheWorker();
+
+public Q_SLOTS:
+    void scanDirectory(const QString &path);
+    void writeAvatar(const QString &path, const QString &fileName,
+            const QByteArray &data, const QString &mimeType);
+    void touchAvatar(const QString &path, const QString &fileName);
+    void removeAvatars(const QString &path, const QStringList &fileNames);
+
+Q_SIGNALS:
+    void directoryScanned(const QString &path, const Tp::AvatarCacheIndex &index);
+    void avatarWritten(const QString &path, const QString &fileName,
+            const QString &mimeType, qint64 size, bool success);
+};
+
+class TP_QT_NO_EXPORT AvatarCache : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(AvatarCache)
+
+public:
+    enum LookupResult {
+        Hit,
+        Miss,
+        // The directory index is being loaded, directoryLoaded() will be emitted
+        Loading,
+        // The avatar is being written, avatarStored() will be emitted
+        Storing
+    };
+
+    static AvatarCache *instance();
+
+    ~AvatarCache();
+
+    LookupResult lookup(const QString &path, const QString &token, AvatarData &avatar);
+    void store(const QString &path, const QString &token, const QByteArray &data,
+            const QString &mimeType);
+
+    qint64 maxSize() const { return mMaxSize; }
+    void setMaxSize(qint64 maxSize);
+    int maxAge() const { return mMaxAge; }
+    void setMaxAge(int maxAge);
+
+    quint64 hits() const { return mHits; }
+    quint64 misses() const { return mMisses; }
+
+    // Avatar files handed out to live contacts, which are never evicted. Pinning creates the
+    // instance if needed.
+    static void pin(const QString &fileName);
+    static void unpin(const QString &fileName);
+
+Q_SIGNALS:
+    void directoryLoaded(const QString &path);
+    void avatarStored(const QString &path, const QString &token, const Tp::AvatarData &avatar);
+
+private Q_SLOTS:
+    void onDirectoryScanned(const QString &path, const Tp::AvatarCacheIndex &index);
+    void onAvatarWritten(const QString &path, const QString &fileName,
+            const QString &mimeType, qint64 size, bool success);
+    void onApplicationDestroyed();
+
+private:
+    AvatarCache();
+
+    void ensureDirectoryLoaded(const QString &path);
+    void evict();
+
+    static AvatarCache *mInstance;
+
+    QThread *mThread;
+    AvatarCacheWorker *mWorker;
+
+    QHash<QString, AvatarCacheIndex> mIndexes;
+    QSet<QString> mLoadingDirectories;
+    // Token of each file name being written, per directory
+    QHash<QString, QHash<QString, QString> > mPendingWrites;
+    // Size of the avatars written by this process still in the cache
+    qint64 mWrittenSize;
+    quint64 mUseSerial;
+    QHash<QString, int> mPinned;
+
+    qint64 mMaxSize;
+    int mMaxAge;
+
+    quint64 mHits;
+    quint64 mMisses;
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+Q_DECLARE_METATYPE(Tp::AvatarCacheIndex);
+#endif
+
+#endif
@@ -32,6 +32,7 @@
 #include "TelepathyQt/_gen/future-types.h"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/sendfile-internal.h"
 
 #include <TelepathyQt/BaseConnection>
 #include <TelepathyQt/Constants>
@@ -40,11 +41,15 @@
 #include <TelepathyQt/AbstractProtocolInterface>
 
 #include <QDateTime>
+#include <QHash>
+#include <QSet>
 #include <QString>
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QVariantMap>
 
+#include <algorithm>
+
 namespace Tp
 {
 
@@ -413,18 +418,52 @@ struct TP_QT_NO_EXPORT BaseChannelTextType::Private {
     Private(BaseChannelTextType *parent, BaseChannel* channel)
         : channel(channel),
           pendingMessagesId(0),
+          maxPendingMessages(0),
           adaptee(new BaseChannelTextType::Adaptee(parent)) {
     }
 
+    static QString messageToken(const Tp::MessagePartList &message);
+    void removeFromStore(const Tp::UIntList &IDs);
+
     BaseChannel* channel;
-    /* maps pending-message-id to message part list */
+    /* maps pending-message-id to message part list, the oldest message comes first */
     QMap<uint, Tp::MessagePartList> pendingMessages;
+    /* maps message-token to pending-message-ids, tokens are not guaranteed to be unique */
+    QMultiHash<QString, uint> pendingMessageTokens;
     /* increasing unique id of pending messages */
     uint pendingMessagesId;
+    /* 0 means unbounded */
+    int maxPendingMessages;
     MessageAcknowledgedCallback messageAcknowledgedCB;
     BaseChannelTextType::Adaptee *adaptee;
 };
 
+QString BaseChannelTextType::Private::messageToken(const Tp::MessagePartList &message)
+{
+    if (message.isEmpty()) {
+        return QString();
+    }
+
+    return message.front().value(QLatin1String("message-token")).variant().toString();
+}
+
+void BaseChannelTextType::Private::removeFromStore(const Tp::UIntList &IDs)
+{
+    foreach (uint id, IDs) {
+        QMap<uint, Tp::MessagePartList>::Iterator i = pendingMessages.find(id);
+        if (i == pendingMessages.end()) {
+            continue;
+        }
+
+        const QString token = messageToken(*i);
+        if (!token.isEmpty()) {
+            pendingMessageTokens.remove(token, id);
+        }
+
+        pendingMessages.erase(i);
+    }
+}
+
 /**
  * \class BaseChannelTextType
  * \ingroup servicechannel
@@ -487,6 +526,28 @@ void BaseChannelTextType::addReceivedMessage(const Tp::MessagePartList &msg)
     header[QLatin1String("pending-message-id")] = QDBusVariant(pendingMessageId);
     mPriv->pendingMessages[pendingMessageId] = message;
 
+    const QString token = Private::messageToken(message);
+    if (!token.isEmpty()) {
+        mPriv->pendingMessageTokens.insert(token, pendingMessageId);
+    }
+
+    if (mPriv->maxPendingMessages > 0 && mPriv->pendingMessages.count() > mPriv->maxPendingMessages) {
+        Tp::UIntList evictedIDs;
+        Tp::MessagePartListList evictedMessages;
+
+        QMap<uint, Tp::MessagePartList>::ConstIterator i = mPriv->pendingMessages.constBegin();
+        int excess = mPriv->pendingMessages.count() - mPriv->maxPendingMessages;
+        for (; excess > 0; --excess, ++i) {
+            evictedIDs.append(i.key());
+            evictedMessages.append(i.value());
+        }
+
+        warning() << "BaseChannelTextType: Too many pending messages, dropping the"
+            << evictedIDs.count() << "oldest ones";
+        removePendingMessages(evictedIDs);
+        emit pendingMessagesEvicted(evictedMessages);
+    }
+
     uint timestamp = 0;
     if (header.count(QLatin1String("message-received")))
         timestamp = header[QLatin1String("message-received")].variant().toUInt();
@@ -534,6 +595,46 @@ Tp::MessagePartListList BaseChannelTextType::pendingMessages() const
     return mPriv->pendingMessages.values();
 }
 
+/**
+ * Return the number of messages which have been received but not acknowledged yet.
+ *
+ * \return The number of pending messages.
+ * \sa pendingMessages()
+ */
+int BaseChannelTextType::pendingMessagesCount() const
+{
+    return mPriv->pendingMessages.count();
+}
+
+/**
+ * Return the maximum number of pending messages kept by this interface.
+ *
+ * \return The maximum number of pending messages, or 0 if there is no limit.
+ * \sa setMaxPendingMessages()
+ */
+int BaseChannelTextType::maxPendingMessages() const
+{
+    return mPriv->maxPendingMessages;
+}
+
+/**
+ * Set the maximum number of pending messages kept by this interface.
+ *
+ * When a received message makes the number of pending messages exceed \a max,
+ * the oldest pending messages are removed as if they were acknowledged, without
+ * calling the message acknowledged callback, and pendingMessagesEvicted() is
+ * emitted with them.
+ *
+ * The default is 0, which means there is no limit.
+ *
+ * \param max The maximum number of pending messages, or 0 to remove the limit.
+ * \sa maxPendingMessages(), pendingMessagesEvicted()
+ */
+void BaseChannelTextType::setMaxPendingMessages(int max)
+{
+    mPriv->maxPendingMessages = qMax(max, 0);
+}
+
 /*
  * Will be called with the value of the message-token field after a received message has been acknowledged,
  * if the message-token field existed in the header.
@@ -543,40 +644,68 @@ void BaseChannelTextType::setMessageAcknowledgedCallback(const MessageAcknowledg
     mPriv->messageAcknowledgedCB = cb;
 }
 
+/*
+ * Acknowledge every pending message carrying one of the given message tokens.
+ */
 void BaseChannelTextType::acknowledgePendingMessages(const QStringList &tokens, DBusError *error)
 {
     Tp::UIntList IDs;
+    IDs.reserve(tokens.count());
 
     Q_FOREACH (const QString &token, tokens) {
-        Q_FOREACH (const Tp::MessagePartList &message, mPriv->pendingMessages) {
-            const MessagePart &header = message.front();
-            if (header.value(QLatin1String("message-token")).variant().toString() == token) {
-                uint id = mPriv->pendingMessages.key(message);
-                IDs.append(id);
-            }
+        QList<uint> tokenIDs = mPriv->pendingMessageTokens.values(token);
+        if (tokenIDs.isEmpty()) {
+            error->set(TP_QT_ERROR_INVALID_ARGUMENT, QLatin1String("Token not found"));
+            return;
         }
+        IDs.append(tokenIDs);
     }
 
-    if (tokens.count() != IDs.count()) {
-        error->set(TP_QT_ERROR_INVALID_ARGUMENT, QLatin1String("Token not found"));
-        return;
+    // Oldest first, as the pending-message-ids are increasing
+    std::sort(IDs.begin(), IDs.end());
+    removePendingMessages(IDs);
+}
+
+/**
+ * Remove the pending messages with the given message tokens, without calling the message
+ * acknowledged callback.
+ *
+ * All the pending messages carrying one of \a tokens are removed. Unknown tokens
+ * are ignored.
+ *
+ * \param tokens The message-token values of the messages to remove.
+ */
+void BaseChannelTextType::removePendingMessagesByToken(const QStringList &tokens)
+{
+    Tp::UIntList IDs;
+    IDs.reserve(tokens.count());
+
+    Q_FOREACH (const QString &token, tokens) {
+        IDs.append(mPriv->pendingMessageTokens.values(token));
     }
 
-    removePendingMessages(IDs);
+    if (!IDs.isEmpty()) {
+        std::sort(IDs.begin(), IDs.end());
+        removePendingMessages(IDs);
+    }
 }
 
 void BaseChannelTextType::acknowledgePendingMessages(const Tp::UIntList &IDs, DBusError* error)
 {
+    // Validate the whole batch first, so that nothing is acknowledged on error
     Q_FOREACH (uint id, IDs) {
-        QMap<uint, Tp::MessagePartList>::Iterator i = mPriv->pendingMessages.find(id);
-        if (i == mPriv->pendingMessages.end()) {
+        if (!mPriv->pendingMessages.contains(id)) {
             error->set(TP_QT_ERROR_INVALID_ARGUMENT, QLatin1String("id not found"));
             return;
         }
+    }
 
-        const MessagePart &header = i->front();
-        if (header.count(QLatin1String("message-token")) && mPriv->messageAcknowledgedCB.isValid()) {
-            mPriv->messageAcknowledgedCB(header[QLatin1String("message-token")].variant().toString());
+    if (mPriv->messageAcknowledgedCB.isValid()) {
+        Q_FOREACH (uint id, IDs) {
+            const QString token = Private::messageToken(mPriv->pendingMessages.value(id));
+            if (!token.isEmpty()) {
+                mPriv->messageAcknowledgedCB(token);
+            }
         }
     }
 
@@ -585,9 +714,7 @@ void BaseChannelTextType::acknowledgePendingMessages(const Tp::UIntList &IDs, DB
 
 void BaseChannelTextType::removePendingMessages(const UIntList &IDs)
 {
-    foreach (uint id, IDs) {
-        mPriv->pendingMessages.remove(id);
-    }
+    mPriv->removeFromStore(IDs);
 
     /* Signal on ChannelMessagesInterface */
     BaseChannelMessagesInterfacePtr messagesIface = BaseChannelMessagesInterfacePtr::dynamicCast(
@@ -598,7 +725,15 @@ void BaseChannelTextType::removePendingMessages(const UIntList &IDs)
                                   Q_ARG(Tp::UIntList, IDs));
 }
 
-
+/**
+ * \fn void BaseChannelTextType::pendingMessagesEvicted(const Tp::MessagePartListList &messages)
+ *
+ * Emitted when pending messages are dropped because there are more than
+ * maxPendingMessages() of them.
+ *
+ * \param messages The dropped messages, the oldest first.
+ * \sa setMaxPendingMessages()
+ */
 
 void BaseChannelTextType::sent(uint timestamp, uint type, QString text)
 {
@@ -827,6 +962,11 @@ struct TP_QT_NO_EXPORT BaseChannelFileTransferType::Private {
           weOpenedDevice(false),
           serverSocket(0),
           clientSocket(0),
+          bufferBegin(0),
+          bufferEnd(0),
+          transferring(false),
+          transferScheduled(false),
+          zeroCopyFailed(false),
           adaptee(new BaseChannelFileTransferType::Adaptee(parent))
     {
         contentType = request.value(TP_QT_IFACE_CHANNEL_TYPE_FILE_TRANSFER + QLatin1String(".ContentType")).toString();
@@ -869,12 +1009,29 @@ struct TP_QT_NO_EXPORT BaseChannelFileTransferType::Private {
     QTcpServer *serverSocket; // Server socket is an implementation detail.
     QIODevice *clientSocket; // A socket to communicate with a Telepathy client
     BaseChannelFileTransferType::Direction direction;
+
+    // Data read from the input, but not yet accepted by the output, is kept in
+    // [bufferBegin, bufferEnd). The buffer is allocated once and reused.
+    QByteArray buffer;
+    int bufferBegin;
+    int bufferEnd;
+    bool transferring;
+    bool transferScheduled;
+    bool zeroCopyFailed;
+
     BaseChannelFileTransferType::Adaptee *adaptee;
 
     friend class BaseChannelFileTransferType::Adaptee;
 
 };
 
+// The amount of data read from the input at once
+static const int c_transferBufferSize = 256 * 1024;
+// The input is not read while the output has at least this amount of data queued
+static const qint64 c_transferHighWaterMark = 1024 * 1024;
+// The amount of data moved before yielding to the event loop
+static const qint64 c_transferIterationLimit = 4 * 1024 * 1024;
+
 BaseChannelFileTransferType::Adaptee::Adaptee(BaseChannelFileTransferType *interface)
     : QObject(interface),
       mInterface(interface)
@@ -1201,7 +1358,15 @@ void BaseChannelFileTransferType::onSocketConnection()
 
 void BaseChannelFileTransferType::doTransfer()
 {
-    if (!mPriv->clientSocket || !mPriv->device) {
+    mPriv->transferScheduled = false;
+
+    // The output may emit bytesWritten() synchronously from write()
+    if (mPriv->transferring || !mPriv->clientSocket || !mPriv->device) {
+        return;
+    }
+
+    // A failed transfer stays cancelled even if the devices have more to say
+    if (state() != Tp::FileTransferStateOpen) {
         return;
     }
 
@@ -1223,27 +1388,102 @@ void BaseChannelFileTransferType::doTransfer()
         break;
     }
 
-    static const int c_blockSize = 16 * 1024;
-    char buffer[c_blockSize];
-    char *inputPointer = buffer;
+    if (mPriv->buffer.isEmpty()) {
+        mPriv->buffer.resize(c_transferBufferSize);
+    }
+
+    mPriv->transferring = true;
+
+    qint64 budget = c_transferIterationLimit;
+    bool failed = false;
+    while (budget > 0 && output->isOpen()) {
+        bool outputBlocked = false;
 
-    qint64 length = input->read(buffer, sizeof(buffer));
+        if (mPriv->bufferBegin == mPriv->bufferEnd) {
+            // Back-pressure: wait for bytesWritten() of the output
+            if (output->bytesToWrite() >= c_transferHighWaterMark) {
+                break;
+            }
+
+            // deviceOffset is the number of already skipped bytes
+            if (!mPriv->zeroCopyFailed && mPriv->deviceOffset >= initialOffset()) {
+                qint64 sent = sendFileToSocket(input, output, budget, &mPriv->zeroCopyFailed);
+                if (mPriv->zeroCopyFailed) {
+                    debug() << "BaseChannelFileTransferType: sendfile() failed, falling back to "
+                        "buffered transfer";
+                }
+                if (sent > 0) {
+                    mPriv->deviceOffset += sent;
+                    budget -= sent;
+                    // The data did not go through the socket buffer, so there
+                    // will be no bytesWritten() for it
+                    if (mPriv->direction == BaseChannelFileTransferType::Incoming) {
+                        setTransferredBytes(transferredBytes() + sent);
+                    }
+                    continue;
+                }
+
+                // Queue a block in the socket, its bytesWritten() resumes the transfer
+                outputBlocked = (sent == 0);
+            }
 
-    if (length) {
-        // deviceOffset is the number of already skipped bytes
-        if (mPriv->deviceOffset + length > initialOffset()) {
+            qint64 length = input->read(mPriv->buffer.data(), mPriv->buffer.size());
+            if (length < 0) {
+                warning() << "BaseChannelFileTransferType: Unable to read the data:"
+                    << input->errorString();
+                failed = true;
+                break;
+            }
+            if (length == 0) {
+                break;
+            }
+
+            mPriv->bufferBegin = 0;
+            mPriv->bufferEnd = length;
             if (mPriv->deviceOffset < initialOffset()) {
-                qint64 diff = initialOffset() - mPriv->deviceOffset;
-                length -= diff;
-                inputPointer += diff;
-                mPriv->deviceOffset += diff;
+                mPriv->bufferBegin = qMin<qint64>(initialOffset() - mPriv->deviceOffset, length);
+            }
+            mPriv->deviceOffset += length;
+        }
+
+        qint64 pending = mPriv->bufferEnd - mPriv->bufferBegin;
+        if (pending > 0) {
+            qint64 written = output->write(mPriv->buffer.constData() + mPriv->bufferBegin, pending);
+            if (written < 0) {
+                warning() << "BaseChannelFileTransferType: Unable to write the data:"
+                    << output->errorString();
+                failed = true;
+                break;
+            }
+
+            mPriv->bufferBegin += written;
+            budget -= written;
+
+            if (written < pending) {
+                break;
             }
-            output->write(inputPointer, length);
         }
-        mPriv->deviceOffset += length;
+
+        mPriv->bufferBegin = 0;
+        mPriv->bufferEnd = 0;
+
+        if (outputBlocked) {
+            break;
+        }
+    }
+
+    mPriv->transferring = false;
+
+    if (failed) {
+        // The rest of the file will never arrive, don't leave the client waiting for it
+        mPriv->clientSocket->close();
+        mPriv->serverSocket->close();
+        setState(Tp::FileTransferStateCancelled, Tp::FileTransferStateChangeReasonLocalError);
+        return;
     }
 
-    if (input->bytesAvailable() > 0) {
+    if (budget <= 0 && !mPriv->transferScheduled) {
+        mPriv->transferScheduled = true;
         QMetaObject::invokeMethod(this, "doTransfer", Qt::QueuedConnection);
     }
 }
@@ -1251,6 +1491,10 @@ void BaseChannelFileTransferType::doTransfer()
 void BaseChannelFileTransferType::onBytesWritten(qint64 count)
 {
     setTransferredBytes(transferredBytes() + count);
+
+    if (state() == Tp::FileTransferStateOpen) {
+        doTransfer();
+    }
 }
 
 /**
@@ -1470,6 +1714,9 @@ bool BaseChannelFileTransferType::remoteAcceptFile(QIODevice *output, qulonglong
     mPriv->weOpenedDevice = !deviceIsAlreadynOpened;
     mPriv->initialOffset = offset;
 
+    // Resume the transfer when the device drains the data queued in it
+    connect(mPriv->device, SIGNAL(bytesWritten(qint64)), this, SLOT(doTransfer()));
+
     QMetaObject::invokeMethod(mPriv->adaptee, "initialOffsetDefined", Q_ARG(qulonglong, offset)); //Can simply use emit in Qt5
     setState(Tp::FileTransferStateAccepted, Tp::FileTransferStateChangeReasonNone);
 
@@ -2602,24 +2849,55 @@ void BaseChannelChatStateInterface::chatStateChanged(uint contact, uint state)
 // The BaseChannelGroupInterface code is fully or partially generated by the TelepathyQt-Generator.
 struct TP_QT_NO_EXPORT BaseChannelGroupInterface::Private {
     Private(BaseChannelGroupInterface *parent)
-        : connection(0),
+        : parent(parent),
+          connection(0),
           selfHandle(0),
+          membersChangedScheduled(false),
           adaptee(new BaseChannelGroupInterface::Adaptee(parent))
     {
     }
 
+    enum MembershipState {
+        NotInGroup,
+        PendingMember,
+        Member
+    };
+
+    static QSet<uint> toSet(const Tp::UIntList &handles);
+    static Tp::UIntList toSortedList(const QSet<uint> &handles);
+
     Tp::UIntList getLocalPendingList() const;
+    void setMemberLists(const Tp::UIntList &newMembers, const Tp::LocalPendingInfoList &newLocalPending, const Tp::UIntList &newRemotePending);
+    void removeFromPendingLists(const QSet<uint> &handles);
+    bool isHandleReferenced(uint handle) const;
     bool updateMemberIdentifiers();
+    bool addMemberIdentifiers(const Tp::UIntList &handles);
+    void removeMemberIdentifiers(const Tp::UIntList &handles);
+    MembershipState membershipState(uint handle) const;
+    void beginMembersChange(const Tp::UIntList &handles, const QVariantMap &details);
+    void endMembersChange();
     void emitMembersChangedSignal(const Tp::UIntList &added, const Tp::UIntList &removed, const Tp::UIntList &localPending, const Tp::UIntList &remotePending, QVariantMap details) const;
 
+    BaseChannelGroupInterface *parent;
     BaseConnection *connection;
     Tp::ChannelGroupFlags groupFlags;
     Tp::HandleOwnerMap handleOwners;
     Tp::LocalPendingInfoList localPendingMembers;
     Tp::UIntList members;
     Tp::UIntList remotePendingMembers;
+    // Lookup sets mirroring the lists above
+    QSet<uint> memberSet;
+    QSet<uint> localPendingSet;
+    QSet<uint> remotePendingSet;
+    QSet<uint> ownerSet;
     uint selfHandle;
     Tp::HandleIdentifierMap memberIdentifiers;
+    // Contacts changed by addMembers()/removeMembers() which are not signalled yet, with their
+    // membership before the first of those changes
+    QHash<uint, MembershipState> pendingInitialStates;
+    QVariantMap pendingDetails;
+    Tp::HandleIdentifierMap pendingContactIds;
+    bool membersChangedScheduled;
     AddMembersCallback addMembersCB;
     RemoveMembersCallback removeMembersCB;
     BaseChannelGroupInterface::Adaptee *adaptee;
@@ -2709,6 +2987,31 @@ void BaseChannelGroupInterface::Adaptee::removeMembersWithReason(const Tp::UIntL
     context->setFinished();
 }
 
+QSet<uint> BaseChannelGroupInterface::Private::toSet(const Tp::UIntList &handles)
+{
+    QSet<uint> result;
+    result.reserve(handles.count());
+
+    foreach (uint handle, handles) {
+        result.insert(handle);
+    }
+
+    return result;
+}
+
+UIntList BaseChannelGroupInterface::Private::toSortedList(const QSet<uint> &handles)
+{
+    Tp::UIntList result;
+    result.reserve(handles.count());
+
+    foreach (uint handle, handles) {
+        result << handle;
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
 UIntList BaseChannelGroupInterface::Private::getLocalPendingList() const
 {
     Tp::UIntList localPending;
@@ -2720,33 +3023,189 @@ UIntList BaseChannelGroupInterface::Private::getLocalPendingList() const
     return localPending;
 }
 
+void BaseChannelGroupInterface::Private::setMemberLists(const Tp::UIntList &newMembers, const Tp::LocalPendingInfoList &newLocalPending, const Tp::UIntList &newRemotePending)
+{
+    members = newMembers;
+    memberSet = toSet(newMembers);
+
+    localPendingMembers = newLocalPending;
+    localPendingSet.clear();
+    localPendingSet.reserve(newLocalPending.count());
+    foreach (const Tp::LocalPendingInfo &info, newLocalPending) {
+        localPendingSet.insert(info.toBeAdded);
+    }
+
+    remotePendingMembers = newRemotePending;
+    remotePendingSet = toSet(newRemotePending);
+}
+
+void BaseChannelGroupInterface::Private::removeFromPendingLists(const QSet<uint> &handles)
+{
+    bool inLocalPending = false;
+    bool inRemotePending = false;
+
+    foreach (uint handle, handles) {
+        if (localPendingSet.remove(handle)) {
+            inLocalPending = true;
+        }
+        if (remotePendingSet.remove(handle)) {
+            inRemotePending = true;
+        }
+    }
+
+    if (inLocalPending) {
+        Tp::LocalPendingInfoList remaining;
+        foreach (const Tp::LocalPendingInfo &info, localPendingMembers) {
+            if (!handles.contains(info.toBeAdded)) {
+                remaining << info;
+            }
+        }
+        localPendingMembers = remaining;
+    }
+
+    if (inRemotePending) {
+        Tp::UIntList remaining;
+        foreach (uint handle, remotePendingMembers) {
+            if (!handles.contains(handle)) {
+                remaining << handle;
+            }
+        }
+        remotePendingMembers = remaining;
+    }
+}
+
+bool BaseChannelGroupInterface::Private::isHandleReferenced(uint handle) const
+{
+    if (handle == selfHandle || memberSet.contains(handle) || remotePendingSet.contains(handle)
+            || localPendingSet.contains(handle) || ownerSet.contains(handle)) {
+        return true;
+    }
+
+    foreach (const Tp::LocalPendingInfo &info, localPendingMembers) {
+        if (info.actor == handle) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 bool BaseChannelGroupInterface::Private::updateMemberIdentifiers()
 {
-    Tp::UIntList handles = members + remotePendingMembers + handleOwners.values();
+    // Forget the handles which are not mentioned anymore and only inspect the new ones
+    Tp::HandleIdentifierMap::iterator it = memberIdentifiers.begin();
+    while (it != memberIdentifiers.end()) {
+        if (isHandleReferenced(it.key())) {
+            ++it;
+        } else {
+            it = memberIdentifiers.erase(it);
+        }
+    }
+
+    Tp::UIntList handles = members + remotePendingMembers + ownerSet.values();
     handles << selfHandle;
 
     foreach (const Tp::LocalPendingInfo &info, localPendingMembers) {
         handles << info.toBeAdded;
-        if (info.actor && !handles.contains(info.actor)) {
+        if (info.actor) {
             handles << info.actor;
         }
     }
 
-    Tp::DBusError error;
-    const QStringList identifiers = connection->inspectHandles(Tp::HandleTypeContact, handles, &error);
+    return addMemberIdentifiers(handles);
+}
 
-    if (error.isValid() || (handles.count() != identifiers.count())) {
+bool BaseChannelGroupInterface::Private::addMemberIdentifiers(const Tp::UIntList &handles)
+{
+    Tp::UIntList newHandles;
+    QSet<uint> seen;
+
+    foreach (uint handle, handles) {
+        if (handle && !memberIdentifiers.contains(handle) && !seen.contains(handle)) {
+            seen.insert(handle);
+            newHandles << handle;
+        }
+    }
+
+    if (newHandles.isEmpty()) {
+        return true;
+    }
+
+    if (!connection) {
         return false;
     }
 
-    memberIdentifiers.clear();
+    Tp::DBusError error;
+    const QStringList identifiers = connection->inspectHandles(Tp::HandleTypeContact, newHandles, &error);
+
+    if (error.isValid() || (newHandles.count() != identifiers.count())) {
+        return false;
+    }
 
     for (int i = 0; i < identifiers.count(); ++i) {
-        memberIdentifiers[handles.at(i)] = identifiers.at(i);
+        memberIdentifiers.insert(newHandles.at(i), identifiers.at(i));
     }
     return true;
 }
 
+void BaseChannelGroupInterface::Private::removeMemberIdentifiers(const Tp::UIntList &handles)
+{
+    foreach (uint handle, handles) {
+        if (!isHandleReferenced(handle)) {
+            memberIdentifiers.remove(handle);
+        }
+    }
+}
+
+BaseChannelGroupInterface::Private::MembershipState BaseChannelGroupInterface::Private::membershipState(uint handle) const
+{
+    if (memberSet.contains(handle)) {
+        return Member;
+    }
+    if (localPendingSet.contains(handle) || remotePendingSet.contains(handle)) {
+        return PendingMember;
+    }
+    return NotInGroup;
+}
+
+/*
+ * Must be called before changing the membership of handles, the changes are then signalled
+ * once endMembersChange() has been called.
+ */
+void BaseChannelGroupInterface::Private::beginMembersChange(const Tp::UIntList &handles, const QVariantMap &details)
+{
+    QVariantMap changeDetails = details;
+    const Tp::HandleIdentifierMap contactIds = qvariant_cast<Tp::HandleIdentifierMap>(
+            changeDetails.take(QLatin1String("contact-ids")));
+
+    // Only the changes with the same actor, reason, message etc are signalled together
+    if (!pendingInitialStates.isEmpty() && changeDetails != pendingDetails) {
+        parent->flushMembersChanged();
+    }
+
+    pendingDetails = changeDetails;
+
+    for (Tp::HandleIdentifierMap::const_iterator it = contactIds.constBegin(); it != contactIds.constEnd(); ++it) {
+        pendingContactIds.insert(it.key(), it.value());
+    }
+
+    // The signalled change is the difference with the membership at the start of the batch
+    foreach (uint handle, handles) {
+        if (!pendingInitialStates.contains(handle)) {
+            pendingInitialStates.insert(handle, membershipState(handle));
+        }
+    }
+}
+
+void BaseChannelGroupInterface::Private::endMembersChange()
+{
+    if (!membersChangedScheduled) {
+        membersChangedScheduled = true;
+        //emit after return
+        QMetaObject::invokeMethod(parent, "flushMembersChanged", Qt::QueuedConnection);
+    }
+}
+
 void BaseChannelGroupInterface::Private::emitMembersChangedSignal(const UIntList &added, const UIntList &removed, const UIntList &localPending, const UIntList &remotePending, QVariantMap details) const
 {
     const uint actor = details.value(QLatin1String("actor"), 0).toUInt();
@@ -2841,6 +3300,10 @@ void BaseChannelGroupInterface::Private::emitMembersChangedSignal(const UIntList
  *
  * Note, that the interface automatically update the MemberIdentifiers property on members changes.
  *
+ * In channels with many members, such as big chat rooms, members joining and leaving should
+ * be reported with addMembers(const Tp::UIntList &, const QVariantMap &) and
+ * removeMembers(const Tp::UIntList &, const QVariantMap &) rather than setMembers().
+ *
  * \sa setGroupFlags(), setSelfHandle(), setMembers(), setAddMembersCallback(),
  * setRemoveMembersCallback(), setHandleOwners(),
  * setLocalPendingMembers(), setRemotePendingMembers()
@@ -2949,41 +3412,33 @@ Tp::UIntList BaseChannelGroupInterface::members() const
  */
 void BaseChannelGroupInterface::setMembers(const UIntList &members, const QVariantMap &details)
 {
-    Tp::UIntList localPendingList = mPriv->getLocalPendingList();
+    flushMembersChanged();
+
+    const QSet<uint> newMemberSet = Private::toSet(members);
 
     Tp::UIntList added;
+    QSet<uint> addedSet;
     foreach (uint handle, members) {
-        if (!mPriv->members.contains(handle)) {
+        if (!mPriv->memberSet.contains(handle) && !addedSet.contains(handle)) {
             added << handle;
-
-            // Remove added member from the local pending list
-            int indexInLocalPending = localPendingList.indexOf(handle);
-
-            if (indexInLocalPending >= 0) {
-                localPendingList.removeAt(indexInLocalPending);
-                mPriv->localPendingMembers.removeAt(indexInLocalPending);
-            }
-
-            // Remove added member from the remote pending list
-            int indexInRemotePending = mPriv->remotePendingMembers.indexOf(handle);
-
-            if (indexInRemotePending >= 0) {
-                mPriv->remotePendingMembers.removeAt(indexInRemotePending);
-            }
+            addedSet.insert(handle);
         }
     }
 
     Tp::UIntList removed;
     foreach (uint handle, mPriv->members) {
-        if (!members.contains(handle)) {
+        if (!newMemberSet.contains(handle)) {
             removed << handle;
         }
     }
 
+    // Added members are removed from the local and remote pending lists
+    mPriv->removeFromPendingLists(addedSet);
     mPriv->members = members;
+    mPriv->memberSet = newMemberSet;
 
     mPriv->updateMemberIdentifiers();
-    mPriv->emitMembersChangedSignal(added, removed, localPendingList, mPriv->remotePendingMembers, details);
+    mPriv->emitMembersChangedSignal(added, removed, mPriv->getLocalPendingList(), mPriv->remotePendingMembers, details);
 }
 
 /**
@@ -3003,29 +3458,191 @@ void BaseChannelGroupInterface::setMembers(const UIntList &members, const QVaria
  */
 void BaseChannelGroupInterface::setMembers(const Tp::UIntList &members, const Tp::LocalPendingInfoList &localPending, const Tp::UIntList &remotePending, const QVariantMap &details)
 {
+    flushMembersChanged();
+
+    const QSet<uint> oldMemberSet = mPriv->memberSet;
+    const Tp::UIntList oldMembers = mPriv->members;
+
+    // Do not use the setters here to avoid signal duplication
+    mPriv->setMemberLists(members, localPending, remotePending);
+
     Tp::UIntList added;
+    QSet<uint> addedSet;
     foreach (uint handle, members) {
-        if (!mPriv->members.contains(handle)) {
+        if (!oldMemberSet.contains(handle) && !addedSet.contains(handle)) {
             added << handle;
+            addedSet.insert(handle);
         }
     }
 
     Tp::UIntList removed;
-    foreach (uint handle, mPriv->members) {
-        if (!members.contains(handle)) {
+    foreach (uint handle, oldMembers) {
+        if (!mPriv->memberSet.contains(handle)) {
             removed << handle;
         }
     }
 
-    // Do not use the setters here to avoid signal duplication
-    mPriv->localPendingMembers = localPending;
-    mPriv->remotePendingMembers = remotePending;
-    mPriv->members = members;
-
     mPriv->updateMemberIdentifiers();
     mPriv->emitMembersChangedSignal(added, removed, mPriv->getLocalPendingList(), remotePending, details);
 }
 
+/**
+ * Add contacts to the list of current members of the channel.
+ *
+ * Unlike setMembers(), only the change has to be given, which is cheaper for channels with
+ * many members. The added contacts are removed from the local and remote pending lists, and
+ * the contacts which are already members are ignored.
+ *
+ * The changes made with this method and removeMembers(const Tp::UIntList &, const QVariantMap &)
+ * during one main loop iteration are signalled together, as long as their \a details are the same.
+ *
+ * \param members The contacts which became members of the channel.
+ * \param details The map with an information about the change.
+ *
+ * \sa removeMembers(const Tp::UIntList &, const QVariantMap &), setMembers(), flushMembersChanged()
+ */
+void BaseChannelGroupInterface::addMembers(const Tp::UIntList &members, const QVariantMap &details)
+{
+    Tp::UIntList added;
+    QSet<uint> addedSet;
+
+    foreach (uint handle, members) {
+        if (!mPriv->memberSet.contains(handle) && !addedSet.contains(handle)) {
+            added << handle;
+            addedSet.insert(handle);
+        }
+    }
+
+    if (added.isEmpty()) {
+        return;
+    }
+
+    mPriv->beginMembersChange(added, details);
+
+    mPriv->memberSet.unite(addedSet);
+    mPriv->members << added;
+    mPriv->removeFromPendingLists(addedSet);
+    mPriv->addMemberIdentifiers(added);
+
+    mPriv->endMembersChange();
+}
+
+/**
+ * Remove contacts from the channel.
+ *
+ * The contacts are removed from the list of current members as well as from the local
+ * and remote pending lists. The contacts which are on none of the lists are ignored.
+ *
+ * The changes made with this method and addMembers(const Tp::UIntList &, const QVariantMap &)
+ * during one main loop iteration are signalled together, as long as their \a details are the same.
+ *
+ * \param members The contacts which left the channel.
+ * \param details The map with an information about the change.
+ *
+ * \sa addMembers(const Tp::UIntList &, const QVariantMap &), setMembers(), flushMembersChanged()
+ */
+void BaseChannelGroupInterface::removeMembers(const Tp::UIntList &members, const QVariantMap &details)
+{
+    Tp::UIntList removed;
+    QSet<uint> removedSet;
+    bool wereMembers = false;
+
+    foreach (uint handle, members) {
+        if (removedSet.contains(handle)) {
+            continue;
+        }
+
+        if (mPriv->memberSet.contains(handle)) {
+            wereMembers = true;
+        } else if (!mPriv->localPendingSet.contains(handle) && !mPriv->remotePendingSet.contains(handle)) {
+            continue;
+        }
+
+        removed << handle;
+        removedSet.insert(handle);
+    }
+
+    if (removed.isEmpty()) {
+        return;
+    }
+
+    mPriv->beginMembersChange(removed, details);
+
+    if (wereMembers) {
+        mPriv->memberSet.subtract(removedSet);
+        Tp::UIntList remaining;
+        remaining.reserve(mPriv->memberSet.count());
+        foreach (uint handle, mPriv->members) {
+            if (!removedSet.contains(handle)) {
+                remaining << handle;
+            }
+        }
+        mPriv->members = remaining;
+    }
+
+    mPriv->removeFromPendingLists(removedSet);
+    mPriv->removeMemberIdentifiers(removed);
+
+    mPriv->endMembersChange();
+}
+
+/**
+ * Emit the MembersChanged signals for the changes made with
+ * addMembers(const Tp::UIntList &, const QVariantMap &) and
+ * removeMembers(const Tp::UIntList &, const QVariantMap &) which are not signalled yet.
+ *
+ * The pending changes are signalled automatically once the control returns to the main loop,
+ * and before any change made with the other setters. This method can be used to signal them
+ * right away instead.
+ */
+void BaseChannelGroupInterface::flushMembersChanged()
+{
+    mPriv->membersChangedScheduled = false;
+
+    if (mPriv->pendingInitialStates.isEmpty()) {
+        return;
+    }
+
+    // Contacts which left and joined again, or joined and left, within the batch are not signalled
+    QSet<uint> addedSet;
+    QSet<uint> removedSet;
+    QHash<uint, Private::MembershipState>::ConstIterator i = mPriv->pendingInitialStates.constBegin();
+    for (; i != mPriv->pendingInitialStates.constEnd(); ++i) {
+        const Private::MembershipState state = mPriv->membershipState(i.key());
+        if (state == Private::Member && i.value() != Private::Member) {
+            addedSet.insert(i.key());
+        } else if (state == Private::NotInGroup && i.value() != Private::NotInGroup) {
+            removedSet.insert(i.key());
+        }
+    }
+
+    const Tp::UIntList added = Private::toSortedList(addedSet);
+    const Tp::UIntList removed = Private::toSortedList(removedSet);
+
+    Tp::HandleIdentifierMap contactIds;
+    foreach (uint handle, added) {
+        Tp::HandleIdentifierMap::const_iterator it = mPriv->pendingContactIds.constFind(handle);
+        if (it != mPriv->pendingContactIds.constEnd()) {
+            contactIds.insert(handle, it.value());
+        } else {
+            contactIds.insert(handle, mPriv->memberIdentifiers.value(handle));
+        }
+    }
+
+    QVariantMap details = mPriv->pendingDetails;
+    details.insert(QLatin1String("contact-ids"), QVariant::fromValue(contactIds));
+
+    mPriv->pendingInitialStates.clear();
+    mPriv->pendingDetails.clear();
+    mPriv->pendingContactIds.clear();
+
+    if (added.isEmpty() && removed.isEmpty()) {
+        return;
+    }
+
+    mPriv->emitMembersChangedSignal(added, removed, /* localPending */ Tp::UIntList(), /* remotePending */ Tp::UIntList(), details);
+}
+
 /**
  * Return a map from channel-specific handles to their owners.
  *
@@ -3070,6 +3687,7 @@ void BaseChannelGroupInterface::setHandleOwners(const Tp::HandleOwnerMap &handle
     }
 
     mPriv->handleOwners = handleOwners;
+    mPriv->ownerSet = Private::toSet(handleOwners.values());
     mPriv->updateMemberIdentifiers();
 
     Tp::HandleIdentifierMap identifiers;
@@ -3107,7 +3725,10 @@ Tp::LocalPendingInfoList BaseChannelGroupInterface::localPendingMembers() const
  */
 void BaseChannelGroupInterface::setLocalPendingMembers(const Tp::LocalPendingInfoList &localPendingMembers)
 {
+    flushMembersChanged();
+
     mPriv->localPendingMembers = localPendingMembers;
+    mPriv->localPendingSet = Private::toSet(mPriv->getLocalPendingList());
     mPriv->updateMemberIdentifiers();
 
     uint actor = 0;
@@ -3180,7 +3801,10 @@ Tp::UIntList BaseChannelGroupInterface::remotePendingMembers() const
  */
 void BaseChannelGroupInterface::setRemotePendingMembers(const Tp::UIntList &remotePendingMembers)
 {
+    flushMembersChanged();
+
     mPriv->remotePendingMembers = remotePendingMembers;
+    mPriv->remotePendingSet = Private::toSet(remotePendingMembers);
 
     mPriv->updateMemberIdentifiers();
     mPriv->emitMembersChangedSignal(/* addedMembers */ Tp::UIntList(), /* removedMembers */ Tp::UIntList(), mPriv->getLocalPendingList(), mPriv->remotePendingMembers, /* details */ QVariantMap());
@@ -139,10 +139,18 @@ public:
     void setMessageAcknowledgedCallback(const MessageAcknowledgedCallback &cb);
 
     Tp::MessagePartListList pendingMessages() const;
+    int pendingMessagesCount() const;
+
+    int maxPendingMessages() const;
+    void setMaxPendingMessages(int max);
 
     /* Convenience function */
     void addReceivedMessage(const Tp::MessagePartList &message);
     void acknowledgePendingMessages(const QStringList &tokens, DBusError *error);
+    void removePendingMessagesByToken(const QStringList &tokens);
+
+Q_SIGNALS:
+    void pendingMessagesEvicted(const Tp::MessagePartListList &messages);
 
 private Q_SLOTS:
     void sent(uint timestamp, uint type, QString text);
@@ -636,6 +644,9 @@ public:
     Tp::UIntList members() const;
     void setMembers(const Tp::UIntList &members, const QVariantMap &details);
     void setMembers(const Tp::UIntList &members, const Tp::LocalPendingInfoList &localPending, const Tp::UIntList &remotePending, const QVariantMap &details);
+    void addMembers(const Tp::UIntList &members, const QVariantMap &details);
+    void removeMembers(const Tp::UIntList &members, const QVariantMap &details);
+    Q_INVOKABLE void flushMembersChanged();
 
     Tp::HandleOwnerMap handleOwners() const;
     void setHandleOwners(const Tp::HandleOwnerMap &handleOwners);
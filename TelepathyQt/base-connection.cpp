@@ -32,6 +32,8 @@
 #include <TelepathyQt/DBusObject>
 #include <TelepathyQt/Utils>
 #include <TelepathyQt/AbstractProtocolInterface>
+#include <QMultiHash>
+#include <QPair>
 #include <QString>
 #include <QVariantMap>
 
@@ -46,18 +48,39 @@ struct TP_QT_NO_EXPORT BaseConnection::Private {
           cmName(cmName),
           protocolName(protocolName),
           parameters(parameters),
+          channelIndexEnabled(true),
+          newChannelsFlushScheduled(false),
+          maxNewChannelsBatchSize(100),
           selfHandle(0),
           status(Tp::ConnectionStatusDisconnected),
           adaptee(new BaseConnection::Adaptee(dbusConnection, connection))
     {
     }
 
+    // (ChannelType, TargetHandleType) of a channel
+    typedef QPair<QString, uint> ChannelClass;
+
+    void indexChannel(const BaseChannelPtr &channel);
+    void unindexChannel(const BaseChannelPtr &channel);
+    bool indexedChannels(const QString &channelType, const QVariantMap &request,
+            QList<BaseChannelPtr> *candidates) const;
+    BaseChannelPtr matchingChannel(const QList<BaseChannelPtr> &candidates,
+            const QString &channelType, const QVariantMap &request, DBusError *error) const;
+
     BaseConnection *connection;
     QString cmName;
     QString protocolName;
     QVariantMap parameters;
     QHash<QString, AbstractConnectionInterfacePtr> interfaces;
     QSet<BaseChannelPtr> channels;
+    // The target of a channel is immutable, so the channels are indexed by it once added
+    QMultiHash<QPair<ChannelClass, uint>, BaseChannelPtr> channelsByTargetHandle;
+    QMultiHash<QPair<ChannelClass, QString>, BaseChannelPtr> channelsByTargetID;
+    bool channelIndexEnabled;
+    // Channels added since the last NewChannels emission, with their suppressHandler flag
+    QList<QPair<BaseChannelPtr, bool> > newChannels;
+    bool newChannelsFlushScheduled;
+    int maxNewChannelsBatchSize;
     uint selfHandle;
     QString selfID;
     uint status;
@@ -68,6 +91,99 @@ struct TP_QT_NO_EXPORT BaseConnection::Private {
     BaseConnection::Adaptee *adaptee;
 };
 
+static const QString &targetHandleTypeKey()
+{
+    static const QString key = TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType");
+    return key;
+}
+
+static const QString &targetHandleKey()
+{
+    static const QString key = TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle");
+    return key;
+}
+
+static const QString &targetIDKey()
+{
+    static const QString key = TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID");
+    return key;
+}
+
+void BaseConnection::Private::indexChannel(const BaseChannelPtr &channel)
+{
+    const ChannelClass channelClass(channel->channelType(), channel->targetHandleType());
+
+    if (channel->targetHandle() != 0) {
+        channelsByTargetHandle.insert(qMakePair(channelClass, channel->targetHandle()), channel);
+    }
+    if (!channel->targetID().isEmpty()) {
+        channelsByTargetID.insert(qMakePair(channelClass, channel->targetID()), channel);
+    }
+}
+
+void BaseConnection::Private::unindexChannel(const BaseChannelPtr &channel)
+{
+    const ChannelClass channelClass(channel->channelType(), channel->targetHandleType());
+
+    channelsByTargetHandle.remove(qMakePair(channelClass, channel->targetHandle()), channel);
+    channelsByTargetID.remove(qMakePair(channelClass, channel->targetID()), channel);
+}
+
+/*
+ * Return in candidates the channels which may satisfy the request, according to its target.
+ *
+ * Returns false if the request has no target, so that the index can not be used.
+ */
+bool BaseConnection::Private::indexedChannels(const QString &channelType,
+        const QVariantMap &request, QList<BaseChannelPtr> *candidates) const
+{
+    QVariantMap::ConstIterator i = request.constFind(targetHandleTypeKey());
+    if (i == request.constEnd()) {
+        return false;
+    }
+
+    const ChannelClass channelClass(channelType, i.value().toUInt());
+
+    i = request.constFind(targetHandleKey());
+    if (i != request.constEnd()) {
+        *candidates = channelsByTargetHandle.values(qMakePair(channelClass, i.value().toUInt()));
+        return true;
+    }
+
+    i = request.constFind(targetIDKey());
+    if (i != request.constEnd()) {
+        *candidates = channelsByTargetID.values(qMakePair(channelClass, i.value().toString()));
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Return the first of the candidates of the given type which matchChannel() accepts, if any.
+ */
+BaseChannelPtr BaseConnection::Private::matchingChannel(const QList<BaseChannelPtr> &candidates,
+        const QString &channelType, const QVariantMap &request, DBusError *error) const
+{
+    foreach(const BaseChannelPtr &channel, candidates) {
+        if (channel->channelType() != channelType) {
+            continue;
+        }
+
+        bool match = connection->matchChannel(channel, request, error);
+
+        if (error->isValid()) {
+            return BaseChannelPtr();
+        }
+
+        if (match) {
+            return channel;
+        }
+    }
+
+    return BaseChannelPtr();
+}
+
 BaseConnection::Adaptee::Adaptee(const QDBusConnection &dbusConnection,
                                  BaseConnection *connection)
     : QObject(connection),
@@ -504,6 +620,9 @@ Tp::ChannelDetailsList BaseConnection::channelsDetails()
  * suitable channel, then new channel with given request details will be created.
  * This method uses the matchChannel() method to check whether there exists a channel which confirms with the \a request.
  *
+ * If the \a request specifies TargetHandleType and either TargetHandle or TargetID, only the
+ * channels with that target are checked, see setChannelIndexEnabled().
+ *
  * If \a error is passed, any error that may occur will be stored there.
  *
  * \param request A dictionary containing the desirable properties.
@@ -522,21 +641,21 @@ Tp::BaseChannelPtr BaseConnection::ensureChannel(const QVariantMap &request, boo
 
     const QString channelType = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType")).toString();
 
-    foreach(const BaseChannelPtr &channel, mPriv->channels) {
-        if (channel->channelType() != channelType) {
-            continue;
-        }
-
-        bool match = matchChannel(channel, request, error);
+    QList<BaseChannelPtr> candidates;
+    BaseChannelPtr channel;
+    if (mPriv->channelIndexEnabled && mPriv->indexedChannels(channelType, request, &candidates)) {
+        channel = mPriv->matchingChannel(candidates, channelType, request, error);
+    } else {
+        channel = mPriv->matchingChannel(mPriv->channels.toList(), channelType, request, error);
+    }
 
-        if (error->isValid()) {
-            return BaseChannelPtr();
-        }
+    if (error->isValid()) {
+        return BaseChannelPtr();
+    }
 
-        if (match) {
-            yours = false;
-            return channel;
-        }
+    if (channel) {
+        yours = false;
+        return channel;
     }
 
     yours = true;
@@ -551,31 +670,96 @@ void BaseConnection::addChannel(BaseChannelPtr channel, bool suppressHandler)
     }
 
     mPriv->channels.insert(channel);
+    mPriv->indexChannel(channel);
 
-    BaseConnectionRequestsInterfacePtr reqIface =
-        BaseConnectionRequestsInterfacePtr::dynamicCast(interface(TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS));
+    // The channels added before are announced right away when the batch is full, the new one
+    // is always announced after return
+    if (mPriv->newChannels.count() >= mPriv->maxNewChannelsBatchSize) {
+        flushNewChannels();
+    }
 
-    if (!reqIface.isNull()) {
+    mPriv->newChannels.append(qMakePair(channel, suppressHandler));
+
+    if (!mPriv->newChannelsFlushScheduled) {
+        mPriv->newChannelsFlushScheduled = true;
         //emit after return
-        QMetaObject::invokeMethod(reqIface.data(), "newChannels",
-                                  Qt::QueuedConnection,
-                                  Q_ARG(Tp::ChannelDetailsList, ChannelDetailsList() << channel->details()));
+        QMetaObject::invokeMethod(this, "flushNewChannels", Qt::QueuedConnection);
     }
 
-    //emit after return
-    QMetaObject::invokeMethod(mPriv->adaptee, "newChannel",
-                              Qt::QueuedConnection,
-                              Q_ARG(QDBusObjectPath, QDBusObjectPath(channel->objectPath())),
-                              Q_ARG(QString, channel->channelType()),
-                              Q_ARG(uint, channel->targetHandleType()),
-                              Q_ARG(uint, channel->targetHandle()),
-                              Q_ARG(bool, suppressHandler));
-
     QObject::connect(channel.data(),
                      SIGNAL(closed()),
                      SLOT(removeChannel()));
 }
 
+/**
+ * Emit the NewChannels signal for the channels added with addChannel() which have not been
+ * announced yet.
+ *
+ * The channels added during one main loop iteration are announced together with a single
+ * NewChannels signal, once the control returns to the main loop. This method can be used to
+ * announce them right away instead.
+ *
+ * \sa addChannel(), setNewChannelsBatchSize()
+ */
+void BaseConnection::flushNewChannels()
+{
+    mPriv->newChannelsFlushScheduled = false;
+
+    if (mPriv->newChannels.isEmpty()) {
+        return;
+    }
+
+    QList<QPair<BaseChannelPtr, bool> > newChannels = mPriv->newChannels;
+    mPriv->newChannels.clear();
+
+    BaseConnectionRequestsInterfacePtr reqIface =
+        BaseConnectionRequestsInterfacePtr::dynamicCast(interface(TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS));
+
+    if (!reqIface.isNull()) {
+        ChannelDetailsList details;
+        details.reserve(newChannels.count());
+        for (int i = 0; i < newChannels.count(); ++i) {
+            details << newChannels.at(i).first->details();
+        }
+        reqIface->newChannels(details);
+    }
+
+    for (int i = 0; i < newChannels.count(); ++i) {
+        const BaseChannelPtr &channel = newChannels.at(i).first;
+        QMetaObject::invokeMethod(mPriv->adaptee, "newChannel",
+                                  Q_ARG(QDBusObjectPath, QDBusObjectPath(channel->objectPath())),
+                                  Q_ARG(QString, channel->channelType()),
+                                  Q_ARG(uint, channel->targetHandleType()),
+                                  Q_ARG(uint, channel->targetHandle()),
+                                  Q_ARG(bool, newChannels.at(i).second));
+    }
+}
+
+/**
+ * Return the maximum number of channels announced by a single NewChannels signal.
+ *
+ * \return The maximum number of channels per NewChannels signal.
+ * \sa setNewChannelsBatchSize()
+ */
+int BaseConnection::newChannelsBatchSize() const
+{
+    return mPriv->maxNewChannelsBatchSize;
+}
+
+/**
+ * Set the maximum number of channels announced by a single NewChannels signal.
+ *
+ * When that many channels are waiting to be announced, they are announced before
+ * the next channel is added. The default is 100.
+ *
+ * \param size The maximum number of channels per NewChannels signal, at least 1.
+ * \sa newChannelsBatchSize(), flushNewChannels()
+ */
+void BaseConnection::setNewChannelsBatchSize(int size)
+{
+    mPriv->maxNewChannelsBatchSize = qMax(size, 1);
+}
+
 void BaseConnection::removeChannel()
 {
     BaseChannelPtr channel = BaseChannelPtr(
@@ -583,6 +767,9 @@ void BaseConnection::removeChannel()
     Q_ASSERT(channel);
     Q_ASSERT(mPriv->channels.contains(channel));
 
+    // NewChannels must be emitted before ChannelClosed for the same channel
+    flushNewChannels();
+
     BaseConnectionRequestsInterfacePtr reqIface =
         BaseConnectionRequestsInterfacePtr::dynamicCast(interface(TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS));
 
@@ -591,6 +778,38 @@ void BaseConnection::removeChannel()
     }
 
     mPriv->channels.remove(channel);
+    mPriv->unindexChannel(channel);
+}
+
+/**
+ * Return whether ensureChannel() looks up the existing channels by their target.
+ *
+ * \return \c true if the channel index is used, \c false otherwise.
+ * \sa setChannelIndexEnabled()
+ */
+bool BaseConnection::isChannelIndexEnabled() const
+{
+    return mPriv->channelIndexEnabled;
+}
+
+/**
+ * Set whether ensureChannel() looks up the existing channels by their target.
+ *
+ * When enabled, which is the default, a request specifying TargetHandleType and either
+ * TargetHandle or TargetID is only checked with matchChannel() against the channels of
+ * the requested type having that target. Neither finding an existing channel nor creating a
+ * new one then needs to check all the channels of this connection.
+ *
+ * Subclasses reimplementing matchChannel() to accept channels with a different target than
+ * the requested one must disable the index, so that all the channels are checked, in no
+ * particular order, as before.
+ *
+ * \param enabled Whether to use the channel index.
+ * \sa isChannelIndexEnabled(), ensureChannel(), matchChannel()
+ */
+void BaseConnection::setChannelIndexEnabled(bool enabled)
+{
+    mPriv->channelIndexEnabled = enabled;
 }
 
 /**
@@ -754,16 +973,19 @@ bool BaseConnection::matchChannel(const BaseChannelPtr &channel, const QVariantM
 {
     Q_UNUSED(error);
 
-    if (request.contains(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType"))) {
-        uint targetHandleType = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType")).toUInt();
+    QVariantMap::ConstIterator i = request.constFind(targetHandleTypeKey());
+    if (i != request.constEnd()) {
+        uint targetHandleType = i.value().toUInt();
         if (channel->targetHandleType() != targetHandleType) {
             return false;
         }
-        if (request.contains(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle"))) {
-            uint targetHandle = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")).toUInt();
+        QVariantMap::ConstIterator handle = request.constFind(targetHandleKey());
+        QVariantMap::ConstIterator id = request.constFind(targetIDKey());
+        if (handle != request.constEnd()) {
+            uint targetHandle = handle.value().toUInt();
             return channel->targetHandle() == targetHandle;
-        } else  if (request.contains(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID"))) {
-            const QString targetID = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID")).toString();
+        } else if (id != request.constEnd()) {
+            const QString targetID = id.value().toString();
             return channel->targetID() == targetID;
         } else {
             // Request is not valid
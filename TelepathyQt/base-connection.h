@@ -102,6 +102,10 @@ public:
     BaseChannelPtr ensureChannel(const QVariantMap &request, bool &yours, bool suppressHandler, DBusError *error);
 
     void addChannel(BaseChannelPtr channel, bool suppressHandler = false);
+    Q_INVOKABLE void flushNewChannels();
+
+    int newChannelsBatchSize() const;
+    void setNewChannelsBatchSize(int size);
 
     QList<AbstractConnectionInterfacePtr> interfaces() const;
     AbstractConnectionInterfacePtr interface(const QString  &interfaceName) const;
@@ -126,6 +130,9 @@ protected:
 
     virtual bool matchChannel(const Tp::BaseChannelPtr &channel, const QVariantMap &request, Tp::DBusError *error);
 
+    bool isChannelIndexEnabled() const;
+    void setChannelIndexEnabled(bool enabled);
+
 private:
     class Adaptee;
     friend class Adaptee;
@@ -22,36 +22,97 @@
 #include <TelepathyQt/BaseDebug>
 #include "TelepathyQt/base-debug-internal.h"
 
+#include "TelepathyQt/debug-internal.h"
+
 #include <TelepathyQt/DBusObject>
 
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+
 #include "TelepathyQt/_gen/base-debug.moc.hpp"
 #include "TelepathyQt/_gen/base-debug-internal.moc.hpp"
 
 namespace Tp
 {
 
+// Upper bound of the messages waiting to be signalled, so that a stalled event loop can't make
+// them grow without limit
+static const int maxPendingMessages = 10000;
+
 struct TP_QT_NO_EXPORT BaseDebug::Private
 {
     Private(BaseDebug *parent, const QDBusConnection &dbusConnection)
         : parent(parent),
           enabled(false),
           getMessagesLimit(0),
-          lastMessageIndex(-1),
+          firstMessageIndex(0),
+          messagesCount(0),
+          droppedMessages(0),
+          signalBatchInterval(0),
+          flushScheduled(false),
+          flushTimer(new QTimer(parent)),
           adaptee(new BaseDebug::Adaptee(dbusConnection, parent))
     {
+        flushTimer->setSingleShot(true);
+        parent->connect(flushTimer, SIGNAL(timeout()), SLOT(flushNewDebugMessages()));
     }
 
+    void appendMessage(const DebugMessage &message);
+    DebugMessageList storedMessages() const;
+
     BaseDebug *parent;
     bool enabled;
     int getMessagesLimit;
-    int lastMessageIndex;
 
-    DebugMessageList messages;
+    // Guards the stored and pending messages, newDebugMessage() may be called from any thread
+    mutable QMutex mutex;
+    // Ring buffer of getMessagesLimit entries, or a plain growing array if there's no limit
+    QVector<DebugMessage> messages;
+    int firstMessageIndex;
+    int messagesCount;
+
+    // Messages waiting to be signalled, the oldest ones are dropped past maxPendingMessages
+    DebugMessageList pendingMessages;
+    int droppedMessages;
+    int signalBatchInterval;
+    bool flushScheduled;
+    QTimer *flushTimer;
 
     GetMessagesCallback getMessageCB;
     BaseDebug::Adaptee *adaptee;
 };
 
+void BaseDebug::Private::appendMessage(const DebugMessage &message)
+{
+    if (getMessagesLimit < 0) {
+        messages.append(message);
+        ++messagesCount;
+    } else if (messagesCount < getMessagesLimit) {
+        messages[(firstMessageIndex + messagesCount) % getMessagesLimit] = message;
+        ++messagesCount;
+    } else {
+        messages[firstMessageIndex] = message;
+        firstMessageIndex = (firstMessageIndex + 1) % getMessagesLimit;
+    }
+}
+
+DebugMessageList BaseDebug::Private::storedMessages() const
+{
+    DebugMessageList result;
+    if (messagesCount == 0) {
+        return result;
+    }
+
+    result.reserve(messagesCount);
+    for (int i = 0; i < messagesCount; ++i) {
+        result << messages.at((firstMessageIndex + i) % messages.size());
+    }
+    return result;
+}
+
 BaseDebug::Adaptee::Adaptee(const QDBusConnection &dbusConnection, BaseDebug *interface)
     : QObject(interface),
       mInterface(interface)
@@ -66,7 +127,7 @@ bool BaseDebug::Adaptee::isEnabled()
 
 void BaseDebug::Adaptee::setEnabled(bool enabled)
 {
-    mInterface->mPriv->enabled = enabled;
+    mInterface->setEnabled(enabled);
 }
 
 void BaseDebug::Adaptee::getMessages(const Service::DebugAdaptor::GetMessagesContextPtr &context)
@@ -89,11 +150,13 @@ BaseDebug::BaseDebug(const QDBusConnection &dbusConnection) :
 
 bool BaseDebug::isEnabled() const
 {
+    QMutexLocker locker(&mPriv->mutex);
     return mPriv->enabled;
 }
 
 int BaseDebug::getMessagesLimit() const
 {
+    QMutexLocker locker(&mPriv->mutex);
     return mPriv->getMessagesLimit;
 }
 
@@ -105,13 +168,12 @@ void BaseDebug::setGetMessagesCallback(const BaseDebug::GetMessagesCallback &cb)
 DebugMessageList BaseDebug::getMessages(Tp::DBusError *error) const
 {
     if (!mPriv->getMessageCB.isValid()) {
+        QMutexLocker locker(&mPriv->mutex);
         if (mPriv->getMessagesLimit) {
-            if (mPriv->lastMessageIndex < 0) {
-                return mPriv->messages;
-            } else {
-                return mPriv->messages.mid(mPriv->lastMessageIndex + 1) + mPriv->messages.mid(0, mPriv->lastMessageIndex + 1);
-            }
+            return mPriv->storedMessages();
         }
+        locker.unlock();
+
         error->set(TP_QT_ERROR_NOT_IMPLEMENTED, QLatin1String("Not implemented"));
         return DebugMessageList();
     }
@@ -121,33 +183,47 @@ DebugMessageList BaseDebug::getMessages(Tp::DBusError *error) const
 
 void BaseDebug::setEnabled(bool enabled)
 {
+    QMutexLocker locker(&mPriv->mutex);
     mPriv->enabled = enabled;
 }
 
 void BaseDebug::setGetMessagesLimit(int limit)
 {
-    mPriv->getMessagesLimit = limit;
-    DebugMessageList messages;
+    QMutexLocker locker(&mPriv->mutex);
 
-    if (mPriv->lastMessageIndex < 0) {
-        messages = mPriv->messages;
-    } else {
-        messages = mPriv->messages.mid(mPriv->lastMessageIndex + 1) + mPriv->messages.mid(0, mPriv->lastMessageIndex + 1);
+    DebugMessageList messages = mPriv->storedMessages();
+    if (limit >= 0 && messages.count() > limit) {
+        messages = messages.mid(messages.count() - limit, limit);
     }
 
-    mPriv->lastMessageIndex = -1;
-
-    if (mPriv->messages.count() <= limit) {
-        mPriv->messages = messages;
+    mPriv->getMessagesLimit = limit;
+    mPriv->firstMessageIndex = 0;
+    mPriv->messagesCount = 0;
+    mPriv->messages.clear();
+    if (limit > 0) {
+        // Preallocated, so that storing a message never allocates the ring itself
+        mPriv->messages.resize(limit);
     } else {
-        mPriv->messages = messages.mid(messages.count() - limit, limit);
+        mPriv->messages.reserve(messages.count());
+    }
+
+    foreach (const DebugMessage &message, messages) {
+        mPriv->appendMessage(message);
     }
 }
 
 void BaseDebug::clear()
 {
-    mPriv->messages.clear();
-    mPriv->lastMessageIndex = -1;
+    QMutexLocker locker(&mPriv->mutex);
+
+    mPriv->firstMessageIndex = 0;
+    mPriv->messagesCount = 0;
+    if (mPriv->getMessagesLimit < 0) {
+        mPriv->messages.clear();
+    } else {
+        // Keep the ring allocated, the stale entries are released as they are overwritten
+        mPriv->messages.fill(DebugMessage());
+    }
 }
 
 void BaseDebug::newDebugMessage(const QString &domain, DebugLevel level, const QString &message)
@@ -160,35 +236,123 @@ void BaseDebug::newDebugMessage(const QString &domain, DebugLevel level, const Q
 
 void BaseDebug::newDebugMessage(double time, const QString &domain, DebugLevel level, const QString &message)
 {
+    QMutexLocker locker(&mPriv->mutex);
+
+    bool enabled = mPriv->enabled;
+    if (mPriv->getMessagesLimit == 0 && !enabled) {
+        return;
+    }
+
+    DebugMessage newMessage;
+    newMessage.timestamp = time;
+    newMessage.domain = domain;
+    newMessage.level = level;
+    newMessage.message = message;
+
     if (mPriv->getMessagesLimit != 0) {
-        DebugMessage newMessage;
-        newMessage.timestamp = time;
-        newMessage.domain = domain;
-        newMessage.level = level;
-        newMessage.message = message;
-
-        if (mPriv->messages.count() == mPriv->getMessagesLimit) {
-            ++mPriv->lastMessageIndex;
-
-            if (mPriv->lastMessageIndex >= mPriv->messages.count()) {
-                mPriv->lastMessageIndex = 0;
-            }
-
-            mPriv->messages[mPriv->lastMessageIndex] = newMessage;
-        } else { // This works when the limit is not hitted yet, or when there is no limit at all (negative limit number)
-            mPriv->messages << newMessage;
-        }
+        mPriv->appendMessage(newMessage);
     }
 
-    if (!isEnabled()) {
+    if (!enabled) {
         return;
     }
 
+    // Messages coming from other threads are always queued, the signal has to be emitted from
+    // the thread the object lives in. Once anything is queued, so is everything after it, so
+    // that the signals keep the order of the messages.
+    if (mPriv->signalBatchInterval > 0 || QThread::currentThread() != thread() ||
+            !mPriv->pendingMessages.isEmpty()) {
+        if (mPriv->pendingMessages.size() >= maxPendingMessages) {
+            mPriv->pendingMessages.removeFirst();
+            ++mPriv->droppedMessages;
+        }
+        mPriv->pendingMessages << newMessage;
+        if (!mPriv->flushScheduled) {
+            mPriv->flushScheduled = true;
+            QMetaObject::invokeMethod(mPriv->flushTimer, "start", Qt::QueuedConnection,
+                    Q_ARG(int, mPriv->signalBatchInterval));
+        }
+        return;
+    }
+
+    locker.unlock();
+
     QMetaObject::invokeMethod(mPriv->adaptee, "newDebugMessage",
                               Q_ARG(double, time), Q_ARG(QString, domain),
                               Q_ARG(uint, level), Q_ARG(QString, message)); //Can simply use emit in Qt5
 }
 
+/**
+ * Return the interval, in milliseconds, during which new debug messages are gathered before
+ * being signalled.
+ *
+ * \return The interval in milliseconds, 0 if each message is signalled right away.
+ * \sa setSignalBatchInterval()
+ */
+int BaseDebug::signalBatchInterval() const
+{
+    QMutexLocker locker(&mPriv->mutex);
+    return mPriv->signalBatchInterval;
+}
+
+/**
+ * Set the interval, in milliseconds, during which new debug messages are gathered before
+ * being signalled.
+ *
+ * With an interval, newDebugMessage() only stores the message, and the NewDebugMessage
+ * signals for all the messages of the interval are emitted together when it ends. This
+ * keeps chatty producers cheap while a client is monitoring the debug output. The default is
+ * 0, signalling each message as it arrives.
+ *
+ * Batching only defers the signals: the D-Bus interface has no signal carrying several
+ * messages, so one NewDebugMessage signal is still sent per message.
+ *
+ * At most 10000 messages wait to be signalled. If more arrive before the pending ones are
+ * flushed, for instance because the event loop is blocked, the oldest ones are not signalled.
+ * They are still returned by getMessages() if they fit within getMessagesLimit().
+ *
+ * \param msec The interval in milliseconds.
+ * \sa flushNewDebugMessages()
+ */
+void BaseDebug::setSignalBatchInterval(int msec)
+{
+    QMutexLocker locker(&mPriv->mutex);
+    mPriv->signalBatchInterval = qMax(msec, 0);
+}
+
+/**
+ * Emit the NewDebugMessage signals for the messages which have not been signalled yet.
+ *
+ * \sa setSignalBatchInterval()
+ */
+void BaseDebug::flushNewDebugMessages()
+{
+    QMutexLocker locker(&mPriv->mutex);
+    mPriv->flushScheduled = false;
+    DebugMessageList messages = mPriv->pendingMessages;
+    mPriv->pendingMessages.clear();
+    int droppedMessages = mPriv->droppedMessages;
+    mPriv->droppedMessages = 0;
+    locker.unlock();
+
+    mPriv->flushTimer->stop();
+
+    if (droppedMessages > 0) {
+        warning() << "BaseDebug: dropped" << droppedMessages
+            << "debug messages which were not signalled in time";
+    }
+
+    if (!isEnabled()) {
+        return;
+    }
+
+    foreach (const DebugMessage &message, messages) {
+        QMetaObject::invokeMethod(mPriv->adaptee, "newDebugMessage",
+                                  Q_ARG(double, message.timestamp), Q_ARG(QString, message.domain),
+                                  Q_ARG(uint, message.level), Q_ARG(QString, message.message));
+    }
+}
+
 QVariantMap BaseDebug::immutableProperties() const
 {
     // There is no immutable properties.
@@ -49,11 +49,16 @@ public:
 
     DebugMessageList getMessages(DBusError *error) const;
 
+    int signalBatchInterval() const;
+
 public Q_SLOTS:
     void setEnabled(bool enabled);
     void setGetMessagesLimit(int limit);
     void clear();
 
+    void setSignalBatchInterval(int msec);
+    void flushNewDebugMessages();
+
     void newDebugMessage(const QString &domain, DebugLevel level, const QString &message);
     void newDebugMessage(double time, const QString &domain, DebugLevel level, const QString &message);
 
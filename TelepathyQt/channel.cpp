@@ -91,6 +91,7 @@ struct TP_QT_NO_EXPORT Channel::Private
     void doMembersChangedDetailed(const UIntList &, const UIntList &, const UIntList &,
             const UIntList &, const QVariantMap &);
     void processMembersChanged();
+    void dequeueMembersChanged();
     void updateContacts(const QList<ContactPtr> &contacts =
             QList<ContactPtr>());
     bool fakeGroupInterfaceIfNeeded();
@@ -116,6 +117,8 @@ struct TP_QT_NO_EXPORT Channel::Private
     struct GroupMembersChangedInfo;
     struct ConferenceChannelRemovedInfo;
 
+    void applyMembersChanged(GroupMembersChangedInfo *info, QHash<uint, ContactPtr> &contacts);
+
     // Public object
     Channel *parent;
 
@@ -162,15 +165,13 @@ struct TP_QT_NO_EXPORT Channel::Private
 
     // Queue of received MCD signals to process
     QQueue<GroupMembersChangedInfo *> groupMembersChangedQueue;
-    GroupMembersChangedInfo *currentGroupMembersChangedInfo;
+    // MCD signals taken from the queue, processed together
+    QList<GroupMembersChangedInfo *> currentGroupMembersChangedInfos;
 
-    // Pending from the MCD signal currently processed, but contacts not yet built
+    // Pending from the MCD signals currently processed, but contacts not yet built
     QSet<uint> pendingGroupMembers;
     QSet<uint> pendingGroupLocalPendingMembers;
     QSet<uint> pendingGroupRemotePendingMembers;
-    UIntList groupMembersToRemove;
-    UIntList groupLocalPendingMembersToRemove;
-    UIntList groupRemotePendingMembersToRemove;
 
     // Initial members
     UIntList groupInitialMembers;
@@ -277,7 +278,6 @@ Channel::Private::Private(Channel *parent, const ConnectionPtr &connection,
       usingMembersChangedDetailed(false),
       groupHaveMembers(false),
       buildingContacts(false),
-      currentGroupMembersChangedInfo(0),
       groupAreHandleOwnersAvailable(false),
       pendingRetrieveGroupSelfContact(false),
       groupIsSelfHandleTracked(false),
@@ -331,7 +331,9 @@ Channel::Private::Private(Channel *parent, const ConnectionPtr &connection,
 
 Channel::Private::~Private()
 {
-    delete currentGroupMembersChangedInfo;
+    foreach (GroupMembersChangedInfo *info, currentGroupMembersChangedInfos) {
+        delete info;
+    }
     foreach (GroupMembersChangedInfo *info, groupMembersChangedQueue) {
         delete info;
     }
@@ -832,34 +834,42 @@ void Channel::Private::buildContacts()
     buildingContacts = true;
 
     ContactManagerPtr manager = connection->contactManager();
-    UIntList toBuild = QSet<uint>(pendingGroupMembers +
-            pendingGroupLocalPendingMembers +
-            pendingGroupRemotePendingMembers).toList();
+    QSet<uint> toBuild = pendingGroupMembers +
+        pendingGroupLocalPendingMembers +
+        pendingGroupRemotePendingMembers;
 
-    if (currentGroupMembersChangedInfo &&
-            currentGroupMembersChangedInfo->actor != 0) {
-        toBuild.append(currentGroupMembersChangedInfo->actor);
+    foreach (GroupMembersChangedInfo *info, currentGroupMembersChangedInfos) {
+        if (info->actor != 0) {
+            toBuild.insert(info->actor);
+        }
     }
 
     if (!initiatorContact && initiatorHandle) {
         // No initiator contact, but Yes initiator handle - might do something about it with just
         // that information
-        toBuild.append(initiatorHandle);
+        toBuild.insert(initiatorHandle);
     }
 
     if (!targetContact && targetHandleType == HandleTypeContact && targetHandle != 0) {
-        toBuild.append(targetHandle);
+        toBuild.insert(targetHandle);
     }
 
     // always try to retrieve selfContact and check if it changed on
     // updateContacts or on gotContacts, in case we were not able to retrieve it
     if (groupSelfHandle) {
-        toBuild.append(groupSelfHandle);
+        toBuild.insert(groupSelfHandle);
     }
 
     // group self handle changed to 0 <- strange but it may happen, and contacts
     // were being built at the time, so check now
     if (toBuild.isEmpty()) {
+        if (!currentGroupMembersChangedInfos.isEmpty()) {
+            // Nothing to build for the changes being processed, e.g. only removals
+            buildingContacts = false;
+            updateContacts();
+            return;
+        }
+
         if (!groupSelfHandle && groupSelfContact) {
             groupSelfContact.reset();
             if (parent->isReady(Channel::FeatureCore)) {
@@ -872,7 +882,7 @@ void Channel::Private::buildContacts()
     }
 
     PendingContacts *pendingContacts = manager->contactsForHandles(
-            toBuild);
+            toBuild.toList());
     parent->connect(pendingContacts,
             SIGNAL(finished(Tp::PendingOperation*)),
             SLOT(gotContacts(Tp::PendingOperation*)));
@@ -881,8 +891,13 @@ void Channel::Private::buildContacts()
 void Channel::Private::processMembersChanged()
 {
     Q_ASSERT(!buildingContacts);
+    Q_ASSERT(currentGroupMembersChangedInfos.isEmpty());
+
+    // Take all the MCD signals queued up while the previous ones were being processed, so that a
+    // burst of membership changes is resolved with a single contact lookup
+    dequeueMembersChanged();
 
-    if (groupMembersChangedQueue.isEmpty()) {
+    if (currentGroupMembersChangedInfos.isEmpty()) {
         if (pendingRetrieveGroupSelfContact) {
             pendingRetrieveGroupSelfContact = false;
             // nothing queued but selfContact changed
@@ -927,67 +942,97 @@ void Channel::Private::processMembersChanged()
     // contact is the same as the current contact.
     pendingRetrieveGroupSelfContact = false;
 
-    currentGroupMembersChangedInfo = groupMembersChangedQueue.dequeue();
+    foreach (GroupMembersChangedInfo *info, currentGroupMembersChangedInfos) {
+        foreach (uint handle, info->added) {
+            if (!groupContacts.contains(handle)) {
+                pendingGroupMembers.insert(handle);
+            }
+        }
 
-    foreach (uint handle, currentGroupMembersChangedInfo->added) {
-        if (!groupContacts.contains(handle)) {
-            pendingGroupMembers.insert(handle);
+        foreach (uint handle, info->localPending) {
+            if (!groupLocalPendingContacts.contains(handle)) {
+                pendingGroupLocalPendingMembers.insert(handle);
+            }
         }
 
-        // the member was added to current members, check if it was in the
-        // local/pending lists and if true, schedule for removal from that list
-        if (groupLocalPendingContacts.contains(handle)) {
-            groupLocalPendingMembersToRemove.append(handle);
-        } else if(groupRemotePendingContacts.contains(handle)) {
-            groupRemotePendingMembersToRemove.append(handle);
+        foreach (uint handle, info->remotePending) {
+            if (!groupRemotePendingContacts.contains(handle)) {
+                pendingGroupRemotePendingMembers.insert(handle);
+            }
         }
     }
 
-    foreach (uint handle, currentGroupMembersChangedInfo->localPending) {
-        if (!groupLocalPendingContacts.contains(handle)) {
-            pendingGroupLocalPendingMembers.insert(handle);
+    // Always go through buildContacts - we might have a self/initiator/whatever handle to build
+    buildContacts();
+}
+
+void Channel::Private::dequeueMembersChanged()
+{
+    // Follow each handle through the queued changes. The ones which were in no member list and
+    // are in none after the changes joined and left in the meantime, so they can be dropped
+    // without building their contacts.
+    QHash<uint, bool> inGroup;
+    foreach (GroupMembersChangedInfo *info, groupMembersChangedQueue) {
+        foreach (uint handle, info->added + info->localPending + info->remotePending) {
+            inGroup.insert(handle, true);
+        }
+        foreach (uint handle, info->removed) {
+            inGroup.insert(handle, false);
         }
     }
 
-    foreach (uint handle, currentGroupMembersChangedInfo->remotePending) {
-        if (!groupRemotePendingContacts.contains(handle)) {
-            pendingGroupRemotePendingMembers.insert(handle);
+    QSet<uint> cancelled;
+    for (QHash<uint, bool>::const_iterator i = inGroup.constBegin(); i != inGroup.constEnd(); ++i) {
+        uint handle = i.key();
+        if (!i.value() && handle != groupSelfHandle &&
+                !groupContacts.contains(handle) &&
+                !groupLocalPendingContacts.contains(handle) &&
+                !groupRemotePendingContacts.contains(handle)) {
+            cancelled.insert(handle);
         }
     }
 
-    foreach (uint handle, currentGroupMembersChangedInfo->removed) {
-        groupMembersToRemove.append(handle);
+    if (!cancelled.isEmpty()) {
+        debug() << cancelled.size() << "handles joined and left the group in the same batch";
     }
 
-    // Always go through buildContacts - we might have a self/initiator/whatever handle to build
-    buildContacts();
+    while (!groupMembersChangedQueue.isEmpty()) {
+        GroupMembersChangedInfo *info = groupMembersChangedQueue.dequeue();
+
+        if (!cancelled.isEmpty()) {
+            UIntList *lists[] = { &info->added, &info->removed, &info->localPending,
+                &info->remotePending };
+            for (uint i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i) {
+                UIntList handles;
+                foreach (uint handle, *lists[i]) {
+                    if (!cancelled.contains(handle)) {
+                        handles.append(handle);
+                    }
+                }
+                *lists[i] = handles;
+            }
+
+            if (info->added.isEmpty() && info->removed.isEmpty() &&
+                    info->localPending.isEmpty() && info->remotePending.isEmpty()) {
+                delete info;
+                continue;
+            }
+        }
+
+        currentGroupMembersChangedInfos.append(info);
+    }
 }
 
 void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
 {
-    Contacts groupContactsAdded;
-    Contacts groupLocalPendingContactsAdded;
-    Contacts groupRemotePendingContactsAdded;
-    ContactPtr actorContact;
+    QHash<uint, ContactPtr> builtContacts;
     bool selfContactUpdated = false;
 
     debug() << "Entering Chan::Priv::updateContacts() with" << contacts.size() << "contacts";
 
-    // FIXME: simplify. Some duplication of logic present.
     foreach (ContactPtr contact, contacts) {
         uint handle = contact->handle()[0];
-        if (pendingGroupMembers.contains(handle)) {
-            groupContactsAdded.insert(contact);
-            groupContacts[handle] = contact;
-        } else if (pendingGroupLocalPendingMembers.contains(handle)) {
-            groupLocalPendingContactsAdded.insert(contact);
-            groupLocalPendingContacts[handle] = contact;
-            // FIXME: should set the details and actor here too
-            groupLocalPendingContactsChangeInfo[handle] = GroupMemberChangeDetails();
-        } else if (pendingGroupRemotePendingMembers.contains(handle)) {
-            groupRemotePendingContactsAdded.insert(contact);
-            groupRemotePendingContacts[handle] = contact;
-        }
+        builtContacts.insert(handle, contact);
 
         if (groupSelfHandle == handle && groupSelfContact != contact) {
             groupSelfContact = contact;
@@ -1009,11 +1054,6 @@ void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
                 targetId = targetContact->id();
             }
         }
-
-        if (currentGroupMembersChangedInfo &&
-            currentGroupMembersChangedInfo->actor == contact->handle()[0]) {
-            actorContact = contact;
-        }
     }
 
     if (!groupSelfHandle && groupSelfContact) {
@@ -1025,87 +1065,108 @@ void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
     pendingGroupLocalPendingMembers.clear();
     pendingGroupRemotePendingMembers.clear();
 
-    // FIXME: This shouldn't be needed. Clearer would be to first scan for the actor being present
-    // in the contacts supplied.
-    foreach (ContactPtr contact, contacts) {
-        uint handle = contact->handle()[0];
-        if (groupLocalPendingContactsChangeInfo.contains(handle)) {
-            groupLocalPendingContactsChangeInfo[handle] =
-                GroupMemberChangeDetails(actorContact,
-                        currentGroupMembersChangedInfo ? currentGroupMembersChangedInfo->details : QVariantMap());
-        }
+    // Apply the changes in the order they were signalled, each with its own details
+    foreach (GroupMembersChangedInfo *info, currentGroupMembersChangedInfos) {
+        applyMembersChanged(info, builtContacts);
+        delete info;
+    }
+    currentGroupMembersChangedInfos.clear();
+
+    if (selfContactUpdated && parent->isReady(Channel::FeatureCore)) {
+        emit parent->groupSelfContactChanged();
     }
 
+    processMembersChanged();
+}
+
+void Channel::Private::applyMembersChanged(GroupMembersChangedInfo *info,
+        QHash<uint, ContactPtr> &contacts)
+{
+    Contacts groupContactsAdded;
+    Contacts groupLocalPendingContactsAdded;
+    Contacts groupRemotePendingContactsAdded;
     Contacts groupContactsRemoved;
-    ContactPtr contactToRemove;
-    foreach (uint handle, groupMembersToRemove) {
-        if (groupContacts.contains(handle)) {
-            contactToRemove = groupContacts[handle];
-            groupContacts.remove(handle);
-        } else if (groupLocalPendingContacts.contains(handle)) {
-            contactToRemove = groupLocalPendingContacts[handle];
-            groupLocalPendingContacts.remove(handle);
-        } else if (groupRemotePendingContacts.contains(handle)) {
-            contactToRemove = groupRemotePendingContacts[handle];
-            groupRemotePendingContacts.remove(handle);
-        }
 
-        if (groupLocalPendingContactsChangeInfo.contains(handle)) {
-            groupLocalPendingContactsChangeInfo.remove(handle);
-        }
+    GroupMemberChangeDetails details(contacts.value(info->actor), info->details);
 
-        if (contactToRemove) {
-            groupContactsRemoved.insert(contactToRemove);
+    foreach (uint handle, info->added) {
+        if (!groupContacts.contains(handle)) {
+            ContactPtr contact = contacts.value(handle);
+            if (contact) {
+                groupContactsAdded.insert(contact);
+                groupContacts.insert(handle, contact);
+            }
         }
-    }
-    groupMembersToRemove.clear();
 
-    // FIXME: drop the LPToRemove and RPToRemove sets - they're redundant
-    foreach (uint handle, groupLocalPendingMembersToRemove) {
+        // the member was added to current members, so it is not local/remote pending anymore
         groupLocalPendingContacts.remove(handle);
+        groupLocalPendingContactsChangeInfo.remove(handle);
+        groupRemotePendingContacts.remove(handle);
     }
-    groupLocalPendingMembersToRemove.clear();
 
-    foreach (uint handle, groupRemotePendingMembersToRemove) {
-        groupRemotePendingContacts.remove(handle);
+    foreach (uint handle, info->localPending) {
+        if (!groupLocalPendingContacts.contains(handle)) {
+            ContactPtr contact = contacts.value(handle);
+            if (contact) {
+                groupLocalPendingContactsAdded.insert(contact);
+                groupLocalPendingContacts.insert(handle, contact);
+                groupLocalPendingContactsChangeInfo.insert(handle, details);
+            }
+        }
     }
-    groupRemotePendingMembersToRemove.clear();
-
-    if (!groupContactsAdded.isEmpty() ||
-        !groupLocalPendingContactsAdded.isEmpty() ||
-        !groupRemotePendingContactsAdded.isEmpty() ||
-        !groupContactsRemoved.isEmpty()) {
-        GroupMemberChangeDetails details(
-                actorContact,
-                currentGroupMembersChangedInfo ? currentGroupMembersChangedInfo->details : QVariantMap());
-
-        if (currentGroupMembersChangedInfo
-                && currentGroupMembersChangedInfo->removed.contains(groupSelfHandle)) {
-            // Update groupSelfContactRemoveInfo with the proper actor in case
-            // the actor was not available by the time onMembersChangedDetailed
-            // was called.
-            groupSelfContactRemoveInfo = details;
+
+    foreach (uint handle, info->remotePending) {
+        if (!groupRemotePendingContacts.contains(handle)) {
+            ContactPtr contact = contacts.value(handle);
+            if (contact) {
+                groupRemotePendingContactsAdded.insert(contact);
+                groupRemotePendingContacts.insert(handle, contact);
+            }
         }
+    }
 
-        if (parent->isReady(Channel::FeatureCore)) {
-            // Channel is ready, we can signal membership changes to the outside world without
-            // confusing anyone's fragile logic.
-            emit parent->groupMembersChanged(
-                    groupContactsAdded,
-                    groupLocalPendingContactsAdded,
-                    groupRemotePendingContactsAdded,
-                    groupContactsRemoved,
-                    details);
+    foreach (uint handle, info->removed) {
+        ContactPtr contactToRemove = groupContacts.take(handle);
+        if (!contactToRemove) {
+            contactToRemove = groupLocalPendingContacts.take(handle);
+        }
+        if (!contactToRemove) {
+            contactToRemove = groupRemotePendingContacts.take(handle);
+        }
+
+        groupLocalPendingContactsChangeInfo.remove(handle);
+
+        if (contactToRemove) {
+            groupContactsRemoved.insert(contactToRemove);
+            // A later change in the same batch may add it back, without it having been built
+            contacts.insert(handle, contactToRemove);
         }
     }
-    delete currentGroupMembersChangedInfo;
-    currentGroupMembersChangedInfo = 0;
 
-    if (selfContactUpdated && parent->isReady(Channel::FeatureCore)) {
-        emit parent->groupSelfContactChanged();
+    if (groupContactsAdded.isEmpty() &&
+        groupLocalPendingContactsAdded.isEmpty() &&
+        groupRemotePendingContactsAdded.isEmpty() &&
+        groupContactsRemoved.isEmpty()) {
+        return;
     }
 
-    processMembersChanged();
+    if (info->removed.contains(groupSelfHandle)) {
+        // Update groupSelfContactRemoveInfo with the proper actor in case
+        // the actor was not available by the time onMembersChangedDetailed
+        // was called.
+        groupSelfContactRemoveInfo = details;
+    }
+
+    if (parent->isReady(Channel::FeatureCore)) {
+        // Channel is ready, we can signal membership changes to the outside world without
+        // confusing anyone's fragile logic.
+        emit parent->groupMembersChanged(
+                groupContactsAdded,
+                groupLocalPendingContactsAdded,
+                groupRemotePendingContactsAdded,
+                groupContactsRemoved,
+                details);
+    }
 }
 
 bool Channel::Private::fakeGroupInterfaceIfNeeded()
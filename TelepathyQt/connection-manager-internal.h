@@ -26,10 +26,13 @@
 #include <TelepathyQt/PendingStringList>
 
 #include <QDBusConnection>
+#include <QHash>
 #include <QLatin1String>
+#include <QPair>
 #include <QQueue>
 #include <QSet>
 #include <QString>
+#include <QStringList>
 
 namespace Tp
 {
@@ -50,12 +53,16 @@ struct TP_QT_NO_EXPORT ConnectionManager::Private
     static void introspectMain(Private *self);
     void introspectProtocolsLegacy();
     void introspectParametersLegacy();
+    void applySharedIntrospection();
+    void setCoreIntrospected(bool success, const QString &errorName = QString(),
+            const QString &errorMessage = QString());
 
     static QString makeBusName(const QString &name);
     static QString makeObjectPath(const QString &name);
 
     class PendingNames;
     class ProtocolWrapper;
+    class SharedIntrospection;
 
     // Public object
     ConnectionManager *parent;
@@ -79,6 +86,9 @@ struct TP_QT_NO_EXPORT ConnectionManager::Private
     QQueue<QString> parametersQueue;
     ProtocolInfoList protocols;
     QSet<SharedPtr<ProtocolWrapper> > wrappers;
+    // Shared with the other instances for the same CM, only one of them introspects it
+    SharedPtr<SharedIntrospection> sharedIntrospection;
+    bool ownsSharedIntrospection;
 };
 
 struct TP_QT_NO_EXPORT ConnectionManagerLowlevel::Private
@@ -112,6 +122,60 @@ private:
     QDBusConnection mBus;
 };
 
+class TP_QT_NO_EXPORT ConnectionManager::Private::SharedIntrospection :
+                public QObject, public RefCounted
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(SharedIntrospection)
+
+public:
+    typedef QPair<QString /* D-Bus connection name */, QString /* CM name */> Key;
+
+    enum State {
+        NotStarted,
+        Running,
+        Finished,
+        Failed
+    };
+
+    static SharedPtr<SharedIntrospection> get(const QDBusConnection &bus, const QString &name);
+
+    // Number of introspections started so far, by any instance
+    static int startedCount() { return startCount; }
+
+    ~SharedIntrospection();
+
+    State state() const { return mState; }
+    void start();
+    void abandon();
+    void setFinished(const QStringList &interfaces, const ProtocolInfoList &protocols);
+    void setFailed(const QString &errorName, const QString &errorMessage);
+
+    QStringList interfaces() const { return mInterfaces; }
+    ProtocolInfoList protocols() const { return mProtocols; }
+    QString errorName() const { return mErrorName; }
+    QString errorMessage() const { return mErrorMessage; }
+
+Q_SIGNALS:
+    void stateChanged();
+
+private Q_SLOTS:
+    void onServiceOwnerChanged(const QString &name, const QString &oldOwner, const QString &newOwner);
+
+private:
+    SharedIntrospection(const QDBusConnection &bus, const Key &key);
+
+    static QHash<Key, SharedIntrospection*> instances;
+    static int startCount;
+
+    Key mKey;
+    State mState;
+    QStringList mInterfaces;
+    ProtocolInfoList mProtocols;
+    QString mErrorName;
+    QString mErrorMessage;
+};
+
 class TP_QT_NO_EXPORT ConnectionManager::Private::ProtocolWrapper :
                 public StatelessDBusProxy, public OptionalInterfaceFactory<ProtocolWrapper>
 {
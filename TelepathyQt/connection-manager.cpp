@@ -43,6 +43,7 @@
 #include <TelepathyQt/Utils>
 
 #include <QDBusConnectionInterface>
+#include <QDBusServiceWatcher>
 #include <QQueue>
 #include <QStringList>
 #include <QTimer>
@@ -518,6 +519,92 @@ void ConnectionManager::Private::ProtocolWrapper::extractAddressingProperties(co
     mInfo.setAddressableUriSchemes(uriSchemes);
 }
 
+QHash<ConnectionManager::Private::SharedIntrospection::Key,
+      ConnectionManager::Private::SharedIntrospection*> ConnectionManager::Private::SharedIntrospection::instances;
+int ConnectionManager::Private::SharedIntrospection::startCount = 0;
+
+SharedPtr<ConnectionManager::Private::SharedIntrospection>
+ConnectionManager::Private::SharedIntrospection::get(const QDBusConnection &bus, const QString &name)
+{
+    Key key(bus.name(), name);
+    SharedIntrospection *instance = instances.value(key);
+    if (!instance) {
+        instance = new SharedIntrospection(bus, key);
+        instances.insert(key, instance);
+    }
+    return SharedPtr<SharedIntrospection>(instance);
+}
+
+ConnectionManager::Private::SharedIntrospection::SharedIntrospection(const QDBusConnection &bus,
+        const Key &key)
+    : mKey(key),
+      mState(NotStarted)
+{
+    QDBusServiceWatcher *serviceWatcher = new QDBusServiceWatcher(makeBusName(key.second),
+            bus, QDBusServiceWatcher::WatchForOwnerChange, this);
+    connect(serviceWatcher,
+            SIGNAL(serviceOwnerChanged(QString,QString,QString)),
+            SLOT(onServiceOwnerChanged(QString,QString,QString)));
+}
+
+ConnectionManager::Private::SharedIntrospection::~SharedIntrospection()
+{
+    if (instances.value(mKey) == this) {
+        instances.remove(mKey);
+    }
+}
+
+void ConnectionManager::Private::SharedIntrospection::start()
+{
+    Q_ASSERT(mState != Running && mState != Finished);
+    mState = Running;
+    ++startCount;
+}
+
+void ConnectionManager::Private::SharedIntrospection::abandon()
+{
+    // The instance introspecting the CM went away, let one of the waiting ones take over
+    Q_ASSERT(mState == Running);
+    mState = NotStarted;
+    emit stateChanged();
+}
+
+void ConnectionManager::Private::SharedIntrospection::setFinished(const QStringList &interfaces,
+        const ProtocolInfoList &protocols)
+{
+    Q_ASSERT(mState == Running);
+    mState = Finished;
+    mInterfaces = interfaces;
+    mProtocols = protocols;
+    emit stateChanged();
+}
+
+void ConnectionManager::Private::SharedIntrospection::setFailed(const QString &errorName,
+        const QString &errorMessage)
+{
+    Q_ASSERT(mState == Running);
+    mState = Failed;
+    mErrorName = errorName;
+    mErrorMessage = errorMessage;
+    emit stateChanged();
+}
+
+void ConnectionManager::Private::SharedIntrospection::onServiceOwnerChanged(const QString &name,
+        const QString &oldOwner, const QString &newOwner)
+{
+    Q_UNUSED(newOwner);
+
+    // The CM being activated does not matter, but once the process which was introspected
+    // goes away or is replaced the instances created afterwards must introspect it again.
+    // The instances already using this result keep it.
+    if (oldOwner.isEmpty() || instances.value(mKey) != this) {
+        return;
+    }
+
+    debug() << "Connection manager" << name << "changed owner, dropping its shared introspection";
+    instances.remove(mKey);
+}
+
 ConnectionManager::Private::Private(ConnectionManager *parent, const QString &name,
         const ConnectionFactoryConstPtr &connFactory,
         const ChannelFactoryConstPtr &chanFactory,
@@ -530,7 +617,8 @@ ConnectionManager::Private::Private(ConnectionManager *parent, const QString &na
       readinessHelper(parent->readinessHelper()),
       connFactory(connFactory),
       chanFactory(chanFactory),
-      contactFactory(contactFactory)
+      contactFactory(contactFactory),
+      ownsSharedIntrospection(false)
 {
     debug() << "Creating new ConnectionManager:" << parent->busName();
 
@@ -558,6 +646,10 @@ ConnectionManager::Private::Private(ConnectionManager *parent, const QString &na
 
 ConnectionManager::Private::~Private()
 {
+    if (ownsSharedIntrospection) {
+        sharedIntrospection->abandon();
+    }
+
     delete baseInterface;
 }
 
@@ -592,9 +684,36 @@ bool ConnectionManager::Private::parseConfigFile()
 
 void ConnectionManager::Private::introspectMain(ConnectionManager::Private *self)
 {
-    if (self->parseConfigFile()) {
+    // All the instances for the same CM on the same bus share the result of a single
+    // introspection
+    if (!self->sharedIntrospection) {
+        self->sharedIntrospection = SharedIntrospection::get(self->parent->dbusConnection(),
+                self->name);
+    }
+
+    switch (self->sharedIntrospection->state()) {
+    case SharedIntrospection::Finished:
+        debug() << "Reusing introspection of connection manager" << self->name;
+        self->applySharedIntrospection();
         self->readinessHelper->setIntrospectCompleted(FeatureCore, true);
         return;
+    case SharedIntrospection::Running:
+        debug() << "Waiting for another instance to introspect connection manager" << self->name;
+        self->parent->connect(self->sharedIntrospection.data(),
+                SIGNAL(stateChanged()),
+                SLOT(onSharedIntrospectionStateChanged()));
+        return;
+    default:
+        break;
+    }
+
+    debug() << "Introspecting connection manager" << self->name;
+    self->sharedIntrospection->start();
+    self->ownsSharedIntrospection = true;
+
+    if (self->parseConfigFile()) {
+        self->setCoreIntrospected(true);
+        return;
     }
 
     warning() << "Error parsing config file for connection manager"
@@ -629,6 +748,31 @@ void ConnectionManager::Private::introspectParametersLegacy()
     }
 }
 
+void ConnectionManager::Private::applySharedIntrospection()
+{
+    if (!sharedIntrospection->interfaces().isEmpty()) {
+        parent->setInterfaces(sharedIntrospection->interfaces());
+        readinessHelper->setInterfaces(parent->interfaces());
+    }
+
+    protocols = sharedIntrospection->protocols();
+}
+
+void ConnectionManager::Private::setCoreIntrospected(bool success, const QString &errorName,
+        const QString &errorMessage)
+{
+    if (ownsSharedIntrospection) {
+        ownsSharedIntrospection = false;
+        if (success) {
+            sharedIntrospection->setFinished(parent->interfaces(), protocols);
+        } else {
+            sharedIntrospection->setFailed(errorName, errorMessage);
+        }
+    }
+
+    readinessHelper->setIntrospectCompleted(FeatureCore, success, errorName, errorMessage);
+}
+
 QString ConnectionManager::Private::makeBusName(const QString &name)
 {
     return QString(TP_QT_CONNECTION_MANAGER_BUS_NAME_BASE).append(name);
@@ -709,7 +853,7 @@ const Feature ConnectionManager::FeatureCore = Feature(QLatin1String(ConnectionM
  */
 ConnectionManagerPtr ConnectionManager::create(const QDBusConnection &bus, const QString &name)
 {
-    return ConnectionManagerPtr(new ConnectionManager(QDBusConnection::sessionBus(), name,
+    return ConnectionManagerPtr(new ConnectionManager(bus, name,
                 ConnectionFactory::create(bus), ChannelFactory::create(bus),
                 ContactFactory::create()));
 }
@@ -1005,8 +1149,7 @@ void ConnectionManager::gotMainProperties(Tp::PendingOperation *op)
             "Properties.GetAll(ConnectionManager) failed: " <<
             op->errorName() << ": " << op->errorMessage();
 
-        mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, false,
-                op->errorName(), op->errorMessage());
+        mPriv->setCoreIntrospected(false, op->errorName(), op->errorMessage());
         return;
     }
 
@@ -1019,6 +1162,7 @@ void ConnectionManager::gotMainProperties(Tp::PendingOperation *op)
             QString protocolName = i.key();
             if (!checkValidProtocolName(protocolName)) {
                 warning() << "Protocol has an invalid name" << protocolName << "- ignoring";
+                ++i;
                 continue;
             }
 
@@ -1058,10 +1202,10 @@ void ConnectionManager::gotProtocolsLegacy(QDBusPendingCallWatcher *watcher)
             mPriv->introspectParametersLegacy();
         } else {
             //no protocols - introspection finished
-            mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
+            mPriv->setCoreIntrospected(true);
         }
     } else {
-        mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, false, reply.error());
+        mPriv->setCoreIntrospected(false, reply.error().name(), reply.error().message());
 
         warning().nospace() <<
             "ConnectionManager.ListProtocols failed: " <<
@@ -1110,10 +1254,10 @@ void ConnectionManager::gotParametersLegacy(QDBusPendingCallWatcher *watcher)
 
     if (mPriv->parametersQueue.isEmpty()) {
         if (!mPriv->protocols.isEmpty()) {
-            mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
+            mPriv->setCoreIntrospected(true);
         } else {
             // we could not retrieve the params for any protocol, fail core.
-            mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, false, reply.error());
+            mPriv->setCoreIntrospected(false, reply.error().name(), reply.error().message());
         }
     }
 
@@ -1138,13 +1282,42 @@ void ConnectionManager::onProtocolReady(Tp::PendingOperation *op)
 
     if (mPriv->wrappers.isEmpty()) {
         if (!mPriv->protocols.isEmpty()) {
-            mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
+            mPriv->setCoreIntrospected(true);
         } else {
             // we could not make any Protocol objects ready, fail core.
-            mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, false,
-                    op->errorName(), op->errorMessage());
+            mPriv->setCoreIntrospected(false, op->errorName(), op->errorMessage());
         }
     }
 }
 
+void ConnectionManager::onSharedIntrospectionStateChanged()
+{
+    Private::SharedIntrospection *introspection = mPriv->sharedIntrospection.data();
+
+    switch (introspection->state()) {
+    case Private::SharedIntrospection::Finished:
+        introspection->disconnect(this);
+        mPriv->applySharedIntrospection();
+        mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
+        break;
+    case Private::SharedIntrospection::Failed:
+        introspection->disconnect(this);
+        mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, false,
+                introspection->errorName(), introspection->errorMessage());
+        break;
+    case Private::SharedIntrospection::NotStarted:
+        introspection->disconnect(this);
+        Private::introspectMain(mPriv);
+        break;
+    default:
+        // Another waiting instance took over the introspection
+        break;
+    }
+}
+
+int ConnectionManager::introspectionCount()
+{
+    return Private::SharedIntrospection::startedCount();
+}
+
 } // Tp
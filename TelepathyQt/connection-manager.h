@@ -48,6 +48,7 @@ namespace Tp
 class ConnectionManagerLowlevel;
 class PendingConnection;
 class PendingStringList;
+class TestBackdoors;
 
 class TP_QT_EXPORT ConnectionManager : public StatelessDBusProxy,
                 public OptionalInterfaceFactory<ConnectionManager>
@@ -111,9 +112,13 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void gotProtocolsLegacy(QDBusPendingCallWatcher *watcher);
     TP_QT_NO_EXPORT void gotParametersLegacy(QDBusPendingCallWatcher *watcher);
     TP_QT_NO_EXPORT void onProtocolReady(Tp::PendingOperation *watcher);
+    TP_QT_NO_EXPORT void onSharedIntrospectionStateChanged();
 
 private:
     friend class PendingConnection;
+    friend class TestBackdoors;
+
+    static int introspectionCount();
 
     struct Private;
     friend struct Private;
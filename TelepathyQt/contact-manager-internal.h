@@ -26,13 +26,16 @@
 #include <TelepathyQt/ContactManager>
 #include <TelepathyQt/Global>
 #include <TelepathyQt/PendingOperation>
+#include <TelepathyQt/ReferencedHandles>
 #include <TelepathyQt/Types>
 
+#include <QHash>
 #include <QList>
 #include <QObject>
 #include <QQueue>
 #include <QString>
 #include <QStringList>
+#include <QTimer>
 
 namespace Tp
 {
@@ -383,6 +386,61 @@ private:
     QSet<uint> mToRequest;
 };
 
+class TP_QT_NO_EXPORT ContactManager::PendingAttributesRequest : public PendingOperation
+{
+    Q_OBJECT
+
+public:
+    PendingAttributesRequest(const ConnectionPtr &conn, const UIntList &handles);
+    ~PendingAttributesRequest();
+
+    const UIntList &contactsRequested() const { return mContactsRequested; }
+    ReferencedHandles validHandles() const { return mValidHandles; }
+    ContactAttributesMap attributes() const { return mAttributes; }
+
+    void setResult(const ReferencedHandles &validHandles, const ContactAttributesMap &attributes);
+    void setError(const QString &errorName, const QString &errorMessage);
+
+private:
+    UIntList mContactsRequested;
+    ReferencedHandles mValidHandles;
+    ContactAttributesMap mAttributes;
+};
+
+class TP_QT_NO_EXPORT ContactManager::AttributesBatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    AttributesBatcher(ContactManager *manager);
+    ~AttributesBatcher();
+
+    PendingAttributesRequest *requestAttributes(const UIntList &handles,
+            const QStringList &interfaces);
+
+    int interval() const { return mFlushTimer.interval(); }
+    void setInterval(int msec) { mFlushTimer.setInterval(msec); }
+
+    quint64 requestCount() const { return mRequestCount; }
+    quint64 callCount() const { return mCallCount; }
+
+public Q_SLOTS:
+    void flush();
+
+private Q_SLOTS:
+    void onAttributesFinished(Tp::PendingOperation *op);
+
+private:
+    struct Batch;
+
+    ContactManager *mManager;
+    QTimer mFlushTimer;
+    Batch *mCurrentBatch;
+    QHash<PendingOperation *, Batch *> mBatchesInFlight;
+    quint64 mRequestCount;
+    quint64 mCallCount;
+};
+
 } // Tp
 
 #endif
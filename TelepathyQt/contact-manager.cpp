@@ -25,7 +25,10 @@
 
 #include "TelepathyQt/_gen/contact-manager.moc.hpp"
 
+#include "TelepathyQt/avatar-cache-internal.h"
+
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/feature-internal.h"
 #include "TelepathyQt/future-internal.h"
 
 #include <TelepathyQt/AvatarData>
@@ -52,8 +55,8 @@ struct TP_QT_NO_EXPORT ContactManager::Private
     ~Private();
 
     // avatar specific methods
-    bool buildAvatarFileName(QString token, bool createDir,
-        QString &avatarFileName, QString &mimeTypeFileName);
+    QString avatarCachePath();
+    AvatarCache *avatarCache();
     Features realFeatures(const Features &features);
     QSet<QString> interfacesForFeatures(const Features &features);
 
@@ -69,9 +72,21 @@ struct TP_QT_NO_EXPORT ContactManager::Private
     // avatar
     QSet<ContactPtr> requestAvatarsQueue;
     bool requestAvatarsIdle;
+    bool avatarCacheConnected;
+    // Contacts to look up again once the avatar cache index is loaded
+    QSet<ContactPtr> avatarsAwaitingLoad;
+    // Handles to deliver avatar data to once it's written to the cache, by token
+    QHash<QString, QSet<uint> > avatarsAwaitingStore;
+    quint64 avatarCacheHits;
+    quint64 avatarCacheMisses;
 
     // contact info
     PendingRefreshContactInfo *refreshInfoOp;
+
+    // contact attributes
+    int contactAttributesChunkSize;
+    int maxContactAttributesRequestsInFlight;
+    AttributesBatcher *attributesBatcher;
 };
 
 ContactManager::Private::Private(ContactManager *parent, Connection *connection)
@@ -79,18 +94,24 @@ ContactManager::Private::Private(ContactManager *parent, Connection *connection)
       connection(connection),
       roster(new ContactManager::Roster(parent)),
       requestAvatarsIdle(false),
-      refreshInfoOp(0)
+      avatarCacheConnected(false),
+      avatarCacheHits(0),
+      avatarCacheMisses(0),
+      refreshInfoOp(0),
+      contactAttributesChunkSize(1000),
+      maxContactAttributesRequestsInFlight(4),
+      attributesBatcher(new AttributesBatcher(parent))
 {
 }
 
 ContactManager::Private::~Private()
 {
+    delete attributesBatcher;
     delete refreshInfoOp;
     delete roster;
 }
 
-bool ContactManager::Private::buildAvatarFileName(QString token, bool createDir,
-        QString &avatarFileName, QString &mimeTypeFileName)
+QString ContactManager::Private::avatarCachePath()
 {
     QString cacheDir = QString(QLatin1String(qgetenv("XDG_CACHE_HOME")));
     if (cacheDir.isEmpty()) {
@@ -98,17 +119,25 @@ bool ContactManager::Private::buildAvatarFileName(QString token, bool createDir,
     }
 
     ConnectionPtr conn(parent->connection());
-    QString path = QString(QLatin1String("%1/telepathy/avatars/%2/%3")).
+    return QString(QLatin1String("%1/telepathy/avatars/%2/%3")).
         arg(cacheDir).arg(conn->cmName()).arg(conn->protocolName());
+}
 
-    if (createDir && !QDir().mkpath(path)) {
-        return false;
-    }
+AvatarCache *ContactManager::Private::avatarCache()
+{
+    AvatarCache *cache = AvatarCache::instance();
 
-    avatarFileName = QString(QLatin1String("%1/%2")).arg(path).arg(escapeAsIdentifier(token));
-    mimeTypeFileName = QString(QLatin1String("%1.mime")).arg(avatarFileName);
+    if (!avatarCacheConnected) {
+        parent->connect(cache,
+                SIGNAL(directoryLoaded(QString)),
+                SLOT(onAvatarCacheLoaded(QString)));
+        parent->connect(cache,
+                SIGNAL(avatarStored(QString,QString,Tp::AvatarData)),
+                SLOT(onAvatarStored(QString,QString,Tp::AvatarData)));
+        avatarCacheConnected = true;
+    }
 
-    return true;
+    return cache;
 }
 
 Features ContactManager::Private::realFeatures(const Features &features)
@@ -193,6 +222,165 @@ void ContactManager::PendingRefreshContactInfo::onRefreshInfoFinished(PendingOpe
     }
 }
 
+struct TP_QT_NO_EXPORT ContactManager::AttributesBatcher::Batch
+{
+    UIntList handles;
+    QSet<uint> handlesSet;
+    QSet<QString> interfaces;
+    QList<PendingAttributesRequest *> requests;
+};
+
+ContactManager::PendingAttributesRequest::PendingAttributesRequest(const ConnectionPtr &conn,
+        const UIntList &handles)
+    : PendingOperation(conn),
+      mContactsRequested(handles)
+{
+}
+
+ContactManager::PendingAttributesRequest::~PendingAttributesRequest()
+{
+}
+
+void ContactManager::PendingAttributesRequest::setResult(const ReferencedHandles &validHandles,
+        const ContactAttributesMap &attributes)
+{
+    mValidHandles = validHandles;
+    mAttributes = attributes;
+    setFinished();
+}
+
+void ContactManager::PendingAttributesRequest::setError(const QString &errorName,
+        const QString &errorMessage)
+{
+    setFinishedWithError(errorName, errorMessage);
+}
+
+ContactManager::AttributesBatcher::AttributesBatcher(ContactManager *manager)
+    : mManager(manager),
+      mCurrentBatch(0),
+      mRequestCount(0),
+      mCallCount(0)
+{
+    mFlushTimer.setSingleShot(true);
+    mFlushTimer.setInterval(0);
+    connect(&mFlushTimer, SIGNAL(timeout()), SLOT(flush()));
+}
+
+ContactManager::AttributesBatcher::~AttributesBatcher()
+{
+    // Don't leave the PendingContacts waiting for these batches hanging forever
+    QList<Batch *> batches = mBatchesInFlight.values();
+    if (mCurrentBatch) {
+        batches.push_back(mCurrentBatch);
+    }
+    foreach (Batch *batch, batches) {
+        foreach (PendingAttributesRequest *request, batch->requests) {
+            request->setError(TP_QT_ERROR_CANCELLED,
+                    QLatin1String("ContactManager destroyed before the attributes were retrieved"));
+        }
+    }
+
+    delete mCurrentBatch;
+    qDeleteAll(mBatchesInFlight);
+}
+
+ContactManager::PendingAttributesRequest *ContactManager::AttributesBatcher::requestAttributes(
+        const UIntList &handles, const QStringList &interfaces)
+{
+    PendingAttributesRequest *request = new PendingAttributesRequest(mManager->connection(),
+            handles);
+    ++mRequestCount;
+
+    // Don't let merging grow a batch past the chunk size PendingContacts would use on its own
+    int chunkSize = mManager->contactAttributesChunkSize();
+    if (mCurrentBatch && chunkSize > 0 &&
+        mCurrentBatch->handles.size() + handles.size() > chunkSize) {
+        flush();
+    }
+
+    if (!mCurrentBatch) {
+        mCurrentBatch = new Batch;
+    }
+
+    foreach (uint handle, handles) {
+        if (!mCurrentBatch->handlesSet.contains(handle)) {
+            mCurrentBatch->handlesSet.insert(handle);
+            mCurrentBatch->handles.push_back(handle);
+        }
+    }
+    foreach (const QString &interface, interfaces) {
+        mCurrentBatch->interfaces.insert(interface);
+    }
+    mCurrentBatch->requests.push_back(request);
+
+    if (!mFlushTimer.isActive()) {
+        mFlushTimer.start();
+    }
+
+    return request;
+}
+
+void ContactManager::AttributesBatcher::flush()
+{
+    mFlushTimer.stop();
+
+    if (!mCurrentBatch) {
+        return;
+    }
+
+    Batch *batch = mCurrentBatch;
+    mCurrentBatch = 0;
+    ++mCallCount;
+
+    debug() << "Requesting attributes for" << batch->handles.size() << "contacts on behalf of"
+        << batch->requests.size() << "requests";
+
+    PendingContactAttributes *attributes =
+        mManager->connection()->lowlevel()->contactAttributes(batch->handles,
+                batch->interfaces.toList(), true);
+    mBatchesInFlight.insert(attributes, batch);
+    connect(attributes,
+            SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(onAttributesFinished(Tp::PendingOperation*)));
+}
+
+void ContactManager::AttributesBatcher::onAttributesFinished(PendingOperation *op)
+{
+    Batch *batch = mBatchesInFlight.take(op);
+    Q_ASSERT(batch);
+
+    if (op->isError()) {
+        foreach (PendingAttributesRequest *request, batch->requests) {
+            request->setError(op->errorName(), op->errorMessage());
+        }
+        delete batch;
+        return;
+    }
+
+    PendingContactAttributes *pendingAttributes = qobject_cast<PendingContactAttributes *>(op);
+    ContactAttributesMap attributes = pendingAttributes->attributes();
+    // Keep the handles referenced until every request has its own reference
+    ReferencedHandles validHandles = pendingAttributes->validHandles();
+    ConnectionPtr conn = mManager->connection();
+
+    foreach (PendingAttributesRequest *request, batch->requests) {
+        UIntList requestValidHandles;
+        ContactAttributesMap requestAttributes;
+        foreach (uint handle, request->contactsRequested()) {
+            ContactAttributesMap::const_iterator i = attributes.constFind(handle);
+            if (i != attributes.constEnd()) {
+                requestValidHandles.push_back(handle);
+                requestAttributes.insert(handle, i.value());
+            }
+        }
+
+        request->setResult(ReferencedHandles(conn, HandleTypeContact, requestValidHandles),
+                requestAttributes);
+    }
+
+    delete batch;
+}
+
 /**
  * \class ContactManager
  * \ingroup clientconn
@@ -1022,23 +1210,29 @@ PendingContacts *ContactManager::contactsForHandles(const UIntList &handles,
         }
     }
 
+    // Compare the features as bitsets, this is done for every contact of the roster when it is
+    // first loaded
+    FeatureSet realFeatureSet(realFeatures);
+    FeatureSet missingFeatureSet;
     foreach (uint handle, handles) {
         ContactPtr contact = lookupContactByHandle(handle);
         if (contact) {
-            if ((realFeatures - contact->requestedFeatures()).isEmpty()) {
+            FeatureSet requestedFeatureSet = contact->requestedFeatureSet();
+            if (requestedFeatureSet.contains(realFeatureSet)) {
                 // Contact exists and has all the requested features
                 satisfyingContacts.insert(handle, contact);
             } else {
                 // Contact exists but is missing features
                 otherContacts.insert(handle);
-                missingFeatures.unite(realFeatures - contact->requestedFeatures());
+                missingFeatureSet.unite(realFeatureSet - requestedFeatureSet);
             }
         } else {
             // Contact doesn't exist - we need to get all of the features (same as unite(features))
-            missingFeatures = realFeatures;
+            missingFeatureSet = realFeatureSet;
             otherContacts.insert(handle);
         }
     }
+    missingFeatures = missingFeatureSet.toFeatures();
 
     QSet<QString> interfaces = mPriv->interfacesForFeatures(missingFeatures);
 
@@ -1174,6 +1368,118 @@ PendingContacts *ContactManager::upgradeContacts(const QList<ContactPtr> &contac
     return new PendingContacts(ContactManagerPtr(this), contacts, features);
 }
 
+/**
+ * Return the maximum number of handles for which contact attributes are requested in a single
+ * D-Bus call when building contacts.
+ *
+ * \return The chunk size, or 0 if requests are never split.
+ * \sa setContactAttributesChunkSize(), maxContactAttributesRequestsInFlight()
+ */
+int ContactManager::contactAttributesChunkSize() const
+{
+    return mPriv->contactAttributesChunkSize;
+}
+
+/**
+ * Set the maximum number of handles for which contact attributes are requested in a single D-Bus
+ * call when building contacts.
+ *
+ * Requests for more handles than this, as made by contactsForHandles() and related methods, are
+ * split into several GetContactAttributes calls, so that the connection manager is not blocked
+ * demarshalling a huge message and the first contacts can be delivered through
+ * PendingContacts::contactsRetrieved() before the rest are known.
+ *
+ * The default chunk size is 1000. A value of 0 disables splitting requests.
+ *
+ * \param chunkSize The new chunk size.
+ * \sa setMaxContactAttributesRequestsInFlight()
+ */
+void ContactManager::setContactAttributesChunkSize(int chunkSize)
+{
+    mPriv->contactAttributesChunkSize = qMax(0, chunkSize);
+}
+
+/**
+ * Return the maximum number of GetContactAttributes calls a single PendingContacts keeps in flight
+ * when its request was split in chunks.
+ *
+ * \return The maximum number of requests in flight.
+ * \sa setMaxContactAttributesRequestsInFlight(), contactAttributesChunkSize()
+ */
+int ContactManager::maxContactAttributesRequestsInFlight() const
+{
+    return mPriv->maxContactAttributesRequestsInFlight;
+}
+
+/**
+ * Set the maximum number of GetContactAttributes calls a single PendingContacts keeps in flight
+ * when its request was split in chunks.
+ *
+ * The default is 4. Values lower than 1 are treated as 1.
+ *
+ * \param maxRequests The new maximum number of requests in flight.
+ * \sa setContactAttributesChunkSize()
+ */
+void ContactManager::setMaxContactAttributesRequestsInFlight(int maxRequests)
+{
+    mPriv->maxContactAttributesRequestsInFlight = qMax(1, maxRequests);
+}
+
+/**
+ * Return for how long contact attribute requests are held back to be merged with other requests.
+ *
+ * \return The batching interval in milliseconds.
+ * \sa setContactAttributesBatchingInterval()
+ */
+int ContactManager::contactAttributesBatchingInterval() const
+{
+    return mPriv->attributesBatcher->interval();
+}
+
+/**
+ * Set for how long contact attribute requests are held back to be merged with other requests.
+ *
+ * Requests made through contactsForHandles(), upgradeContacts() and related methods, including
+ * the ones made internally for e.g. text channels and contact list changes, are not sent
+ * immediately. Instead, all the requests made within the batching interval are merged into a
+ * single GetContactAttributes call for the union of their handles and interfaces, and the
+ * result is dispatched back to each PendingContacts.
+ *
+ * The default interval is 0, which merges the requests made within the same main loop
+ * iteration.
+ *
+ * \param msec The new batching interval in milliseconds.
+ * \sa contactAttributesRequestCount(), savedContactAttributesRoundTrips()
+ */
+void ContactManager::setContactAttributesBatchingInterval(int msec)
+{
+    mPriv->attributesBatcher->setInterval(qMax(0, msec));
+}
+
+/**
+ * Return how many contact attribute requests were made by PendingContacts objects on this
+ * ContactManager since it was created.
+ *
+ * \return The number of requests.
+ * \sa savedContactAttributesRoundTrips()
+ */
+quint64 ContactManager::contactAttributesRequestCount() const
+{
+    return mPriv->attributesBatcher->requestCount();
+}
+
+/**
+ * Return how many GetContactAttributes D-Bus round-trips were saved by merging concurrent
+ * requests.
+ *
+ * \return The number of requests which did not need a D-Bus call of their own.
+ * \sa contactAttributesRequestCount(), setContactAttributesBatchingInterval()
+ */
+quint64 ContactManager::savedContactAttributesRoundTrips() const
+{
+    return mPriv->attributesBatcher->requestCount() - mPriv->attributesBatcher->callCount();
+}
+
 ContactPtr ContactManager::lookupContactByHandle(uint handle)
 {
     ContactPtr contact;
@@ -1219,6 +1525,32 @@ void ContactManager::requestContactAvatars(const QList<ContactPtr> &contacts)
     mPriv->requestAvatarsQueue.unite(contacts.toSet());
 }
 
+/**
+ * Return how many avatars requested for contacts of this ContactManager were found in the
+ * local avatar cache since it was created.
+ *
+ * \return The number of avatar cache hits.
+ * \sa avatarCacheMisses(), requestContactAvatars()
+ */
+quint64 ContactManager::avatarCacheHits() const
+{
+    return mPriv->avatarCacheHits;
+}
+
+/**
+ * Return how many avatars requested for contacts of this ContactManager were not found in the
+ * local avatar cache, and had to be requested from the connection manager, since it was created.
+ *
+ * Contacts whose avatar token is not known yet are not counted.
+ *
+ * \return The number of avatar cache misses.
+ * \sa avatarCacheHits(), requestContactAvatars()
+ */
+quint64 ContactManager::avatarCacheMisses() const
+{
+    return mPriv->avatarCacheMisses;
+}
+
 /**
  * Refresh information for the given contact.
  *
@@ -1266,45 +1598,55 @@ void ContactManager::doRequestAvatars()
     mPriv->requestAvatarsQueue.clear();
     mPriv->requestAvatarsIdle = false;
 
+    // The cache does all of its file I/O in a worker thread, so nothing here blocks on the
+    // filesystem; contacts whose avatar can't be answered from the in-memory index yet are
+    // handled again once it is
+    AvatarCache *cache = mPriv->avatarCache();
+    QString path = mPriv->avatarCachePath();
     int found = 0;
+    int waiting = 0;
     UIntList notFound;
     foreach (const ContactPtr &contact, contacts) {
         if (!contact) {
             continue;
         }
 
-        QString avatarFileName;
-        QString mimeTypeFileName;
-        bool success = (contact->isAvatarTokenKnown() &&
-            mPriv->buildAvatarFileName(contact->avatarToken(), false,
-                avatarFileName, mimeTypeFileName));
-
-        /* Check if the avatar is already in the cache */
-        if (success && QFile::exists(avatarFileName)) {
-            QFile mimeTypeFile(mimeTypeFileName);
-            mimeTypeFile.open(QIODevice::ReadOnly);
-            QString mimeType = QString(QLatin1String(mimeTypeFile.readAll()));
-            mimeTypeFile.close();
-
-            found++;
-
-            contact->receiveAvatarData(AvatarData(avatarFileName, mimeType));
-
+        if (!contact->isAvatarTokenKnown()) {
+            notFound << contact->handle()[0];
             continue;
         }
 
-        notFound << contact->handle()[0];
+        AvatarData avatar;
+        switch (cache->lookup(path, contact->avatarToken(), avatar)) {
+        case AvatarCache::Hit:
+            found++;
+            mPriv->avatarCacheHits++;
+            contact->receiveAvatarData(avatar);
+            break;
+        case AvatarCache::Loading:
+            waiting++;
+            mPriv->avatarsAwaitingLoad.insert(contact);
+            break;
+        case AvatarCache::Storing:
+            waiting++;
+            mPriv->avatarsAwaitingStore[contact->avatarToken()].insert(contact->handle()[0]);
+            break;
+        case AvatarCache::Miss:
+            mPriv->avatarCacheMisses++;
+            notFound << contact->handle()[0];
+            break;
+        }
     }
 
     if (found > 0) {
-        debug() << "Avatar(s) found in cache for" << found << "contact(s)";
+        debugCategory(DebugAvatars) << "Avatar(s) found in cache for" << found << "contact(s)";
     }
 
-    if (found == contacts.size()) {
+    if (notFound.isEmpty()) {
         return;
     }
 
-    debug() << "Requesting avatar(s) for" << contacts.size() - found << "contact(s)";
+    debugCategory(DebugAvatars) << "Requesting avatar(s) for" << notFound.size() << "contact(s)";
 
     Client::ConnectionInterfaceAvatarsInterface *avatarsInterface =
         connection()->interface<Client::ConnectionInterfaceAvatarsInterface>();
@@ -1317,7 +1659,7 @@ void ContactManager::doRequestAvatars()
 
 void ContactManager::onAvatarUpdated(uint handle, const QString &token)
 {
-    debug() << "Got AvatarUpdate for contact with handle" << handle;
+    debugCategory(DebugAvatars) << "Got AvatarUpdate for contact with handle" << handle;
 
     ContactPtr contact = lookupContactByHandle(handle);
     if (contact) {
@@ -1328,46 +1670,45 @@ void ContactManager::onAvatarUpdated(uint handle, const QString &token)
 void ContactManager::onAvatarRetrieved(uint handle, const QString &token,
     const QByteArray &data, const QString &mimeType)
 {
-    QString avatarFileName;
-    QString mimeTypeFileName;
+    debugCategory(DebugAvatars) << "Got AvatarRetrieved for contact with handle" << handle;
 
-    debug() << "Got AvatarRetrieved for contact with handle" << handle;
+    ContactPtr contact = lookupContactByHandle(handle);
+    if (contact) {
+        contact->setAvatarToken(token);
+    }
 
-    bool success = mPriv->buildAvatarFileName(token, true, avatarFileName,
-        mimeTypeFileName);
+    // The avatar data is delivered to the contact once it's been written to the cache, in
+    // onAvatarStored()
+    mPriv->avatarsAwaitingStore[token].insert(handle);
+    mPriv->avatarCache()->store(mPriv->avatarCachePath(), token, data, mimeType);
+}
 
-    if (success) {
-        debug() << "Write avatar in cache for handle" << handle;
-        debug() << "Filename:" << avatarFileName;
-        debug() << "MimeType:" << mimeType;
+void ContactManager::onAvatarCacheLoaded(const QString &path)
+{
+    if (path != mPriv->avatarCachePath() || mPriv->avatarsAwaitingLoad.isEmpty()) {
+        return;
+    }
 
-        if (!QFile::exists(mimeTypeFileName)) {
-            QTemporaryFile mimeTypeFile(mimeTypeFileName);
-            if (mimeTypeFile.open()) {
-                mimeTypeFile.write(mimeType.toLatin1());
-                mimeTypeFile.setAutoRemove(false);
-                if (!mimeTypeFile.rename(mimeTypeFileName)) {
-                    mimeTypeFile.remove();
-                }
-            }
-        }
+    QList<ContactPtr> contacts = mPriv->avatarsAwaitingLoad.toList();
+    mPriv->avatarsAwaitingLoad.clear();
+    requestContactAvatars(contacts);
+}
 
-        if (!QFile::exists(avatarFileName)) {
-            QTemporaryFile avatarFile(avatarFileName);
-            if (avatarFile.open()) {
-                avatarFile.write(data);
-                avatarFile.setAutoRemove(false);
-                if (!avatarFile.rename(avatarFileName)) {
-                    avatarFile.remove();
-                }
-            }
-        }
+void ContactManager::onAvatarStored(const QString &path, const QString &token,
+        const AvatarData &avatar)
+{
+    if (path != mPriv->avatarCachePath() || !mPriv->avatarsAwaitingStore.contains(token)) {
+        return;
     }
 
-    ContactPtr contact = lookupContactByHandle(handle);
-    if (contact) {
-        contact->setAvatarToken(token);
-        contact->receiveAvatarData(AvatarData(avatarFileName, mimeType));
+    debugCategory(DebugAvatars) << "Avatar for token" << token << "stored in cache as" <<
+        avatar.fileName;
+
+    foreach (uint handle, mPriv->avatarsAwaitingStore.take(token)) {
+        ContactPtr contact = lookupContactByHandle(handle);
+        if (contact) {
+            contact->receiveAvatarData(avatar);
+        }
     }
 }
 
@@ -1454,6 +1795,39 @@ ContactPtr ContactManager::ensureContact(const ReferencedHandles &handle,
     return contact;
 }
 
+ContactManager::PendingAttributesRequest *ContactManager::requestContactAttributes(
+        const UIntList &handles, const QStringList &interfaces)
+{
+    return mPriv->attributesBatcher->requestAttributes(handles, interfaces);
+}
+
+QHash<uint, ContactPtr> ContactManager::ensureContacts(const ReferencedHandles &handles,
+        const Features &features, const ContactAttributesMap &attributes)
+{
+    // Build all the contacts in a single pass over the handles, keyed by bare handle, so callers
+    // merging the result with their own handle lists don't need to search the referenced handles
+    // for every contact (which is quadratic for big rosters)
+    QHash<uint, ContactPtr> ret;
+    ret.reserve(handles.size());
+
+    ContactFactoryConstPtr factory = connection()->contactFactory();
+    for (int i = 0; i < handles.size(); ++i) {
+        uint bareHandle = handles.at(i);
+        QVariantMap handleAttributes = attributes.value(bareHandle);
+        ContactPtr contact = lookupContactByHandle(bareHandle);
+
+        if (!contact) {
+            contact = factory->construct(this, handles.mid(i, 1), features, handleAttributes);
+            mPriv->contacts.insert(bareHandle, contact);
+        }
+
+        contact->augment(features, handleAttributes);
+        ret.insert(bareHandle, contact);
+    }
+
+    return ret;
+}
+
 ContactPtr ContactManager::ensureContact(uint bareHandle, const QString &id,
         const Features &features)
 {
@@ -34,6 +34,7 @@
 #include <TelepathyQt/ReferencedHandles>
 #include <TelepathyQt/Types>
 
+#include <QHash>
 #include <QList>
 #include <QSet>
 #include <QString>
@@ -126,9 +127,20 @@ public:
             const Features &features);
 
     void requestContactAvatars(const QList<ContactPtr> &contacts);
+    quint64 avatarCacheHits() const;
+    quint64 avatarCacheMisses() const;
 
     PendingOperation *refreshContactInfo(const QList<ContactPtr> &contact);
 
+    int contactAttributesChunkSize() const;
+    void setContactAttributesChunkSize(int chunkSize);
+    int maxContactAttributesRequestsInFlight() const;
+    void setMaxContactAttributesRequestsInFlight(int maxRequests);
+    int contactAttributesBatchingInterval() const;
+    void setContactAttributesBatchingInterval(int msec);
+    quint64 contactAttributesRequestCount() const;
+    quint64 savedContactAttributesRoundTrips() const;
+
 Q_SIGNALS:
     void stateChanged(Tp::ContactListState state);
 
@@ -152,6 +164,8 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void doRequestAvatars();
     TP_QT_NO_EXPORT void onAvatarUpdated(uint, const QString &);
     TP_QT_NO_EXPORT void onAvatarRetrieved(uint, const QString &, const QByteArray &, const QString &);
+    TP_QT_NO_EXPORT void onAvatarCacheLoaded(const QString &);
+    TP_QT_NO_EXPORT void onAvatarStored(const QString &, const QString &, const Tp::AvatarData &);
     TP_QT_NO_EXPORT void onPresencesChanged(const Tp::SimpleContactPresences &);
     TP_QT_NO_EXPORT void onCapabilitiesChanged(const Tp::ContactCapabilitiesMap &);
     TP_QT_NO_EXPORT void onLocationUpdated(uint, const QVariantMap &);
@@ -160,10 +174,14 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void doRefreshInfo();
 
 private:
+    class AttributesBatcher;
+    class PendingAttributesRequest;
     class PendingRefreshContactInfo;
     class Roster;
+    friend class AttributesBatcher;
     friend class Channel;
     friend class Connection;
+    friend class PendingAttributesRequest;
     friend class PendingContacts;
     friend class PendingRefreshContactInfo;
     friend class Roster;
@@ -177,6 +195,12 @@ private:
             const QVariantMap &attributes);
     TP_QT_NO_EXPORT ContactPtr ensureContact(uint bareHandle,
             const QString &id, const Features &features);
+    TP_QT_NO_EXPORT QHash<uint, ContactPtr> ensureContacts(const ReferencedHandles &handles,
+            const Features &features,
+            const ContactAttributesMap &attributes);
+
+    TP_QT_NO_EXPORT PendingAttributesRequest *requestContactAttributes(const UIntList &handles,
+            const QStringList &interfaces);
 
     TP_QT_NO_EXPORT static QString featureToInterface(const Feature &feature);
     TP_QT_NO_EXPORT void ensureTracking(const Feature &feature);
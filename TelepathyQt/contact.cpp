@@ -24,7 +24,9 @@
 
 #include "TelepathyQt/_gen/contact.moc.hpp"
 
+#include "TelepathyQt/avatar-cache-internal.h"
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/feature-internal.h"
 #include "TelepathyQt/future-internal.h"
 
 #include <TelepathyQt/AvatarData>
@@ -68,7 +70,7 @@ struct TP_QT_NO_EXPORT Contact::Private
     ReferencedHandles handle;
     QString id;
 
-    Features requestedFeatures;
+    FeatureSet requestedFeatures;
     Features actualFeatures;
 
     QString alias;
@@ -107,7 +109,8 @@ void Contact::Private::updateAvatarData()
 
     /* If token is empty (""), it means the contact has no avatar. */
     if (avatarToken.isEmpty()) {
-        debug() << "Contact" << parent->id() << "has no avatar";
+        debugCategory(DebugAvatars) << "Contact" << parent->id() << "has no avatar";
+        AvatarCache::unpin(avatarData.fileName);
         avatarData = AvatarData();
         emit parent->avatarDataChanged(avatarData);
         return;
@@ -332,6 +335,7 @@ Contact::Contact(ContactManager *manager, const ReferencedHandles &handle,
 Contact::~Contact()
 {
     debug() << "Contact" << id() << "destroyed";
+    AvatarCache::unpin(mPriv->avatarData.fileName);
     delete mPriv;
 }
 
@@ -371,6 +375,11 @@ QString Contact::id() const
  * \return The requested features as a set of Feature objects.
  */
 Features Contact::requestedFeatures() const
+{
+    return mPriv->requestedFeatures.toFeatures();
+}
+
+FeatureSet Contact::requestedFeatureSet() const
 {
     return mPriv->requestedFeatures;
 }
@@ -1171,6 +1180,9 @@ void Contact::setAvatarToken(const QString &token)
 void Contact::receiveAvatarData(const AvatarData &avatar)
 {
     if (mPriv->avatarData.fileName != avatar.fileName) {
+        // Keep the cache from evicting the file while we point at it
+        AvatarCache::unpin(mPriv->avatarData.fileName);
+        AvatarCache::pin(avatar.fileName);
         mPriv->avatarData = avatar;
         emit avatarDataChanged(mPriv->avatarData);
     }
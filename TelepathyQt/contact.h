@@ -42,6 +42,7 @@ struct AvatarData;
 class ContactCapabilities;
 class LocationInfo;
 class ContactManager;
+class FeatureSet;
 class PendingContactInfo;
 class PendingOperation;
 class PendingStringList;
@@ -213,6 +214,8 @@ protected:
 private:
     static const Feature FeatureRosterGroups;
 
+    TP_QT_NO_EXPORT FeatureSet requestedFeatureSet() const;
+
     TP_QT_NO_EXPORT void receiveAlias(const QString &alias);
     TP_QT_NO_EXPORT void receiveAvatarToken(const QString &avatarToken);
     TP_QT_NO_EXPORT void setAvatarToken(const QString &token);
@@ -30,7 +30,10 @@
 #include <TelepathyQt/DBusObject>
 
 #include <QDBusConnection>
+#include <QElapsedTimer>
+#include <QPointer>
 #include <QString>
+#include <QTimer>
 
 namespace Tp
 {
@@ -203,18 +206,91 @@ bool DBusService::registerObject(const QString &busName, const QString &objectPa
 
 struct AbstractDBusServiceInterface::Private
 {
-    Private(const QString &interfaceName)
-        : interfaceName(interfaceName),
+    Private(AbstractDBusServiceInterface *parent, const QString &interfaceName)
+        : parent(parent),
+          interfaceName(interfaceName),
           dbusObject(0),
-          registered(false)
+          registered(false),
+          mergeChanges(false),
+          flushScheduled(false),
+          throttleTimer(new QTimer(parent)),
+          throttleDeadline(0)
     {
+        throttleTimer->setSingleShot(true);
+        parent->connect(throttleTimer, SIGNAL(timeout()), SLOT(emitThrottledProperties()));
+        clock.start();
     }
 
+    void scheduleThrottledProperties(qint64 deadline);
+    bool emitPropertiesChanged();
+
+    AbstractDBusServiceInterface *parent;
     QString interfaceName;
-    DBusObject *dbusObject;
+    // Owned by the service, which may go away before the interface
+    QPointer<DBusObject> dbusObject;
     bool registered;
+
+    // Changes waiting for the next PropertiesChanged signal
+    QVariantMap changedProperties;
+    bool mergeChanges;
+    bool flushScheduled;
+
+    // Changes to rate limited properties which happened too soon after the previous signal
+    QHash<QString, int> propertyIntervals;
+    QHash<QString, qint64> lastEmitted;
+    QVariantMap throttledProperties;
+    QTimer *throttleTimer;
+    qint64 throttleDeadline;
+    // Monotonic time base of lastEmitted and throttleDeadline, immune to wall clock changes
+    QElapsedTimer clock;
 };
 
+void AbstractDBusServiceInterface::Private::scheduleThrottledProperties(qint64 deadline)
+{
+    if (throttleTimer->isActive() && throttleDeadline <= deadline) {
+        return;
+    }
+
+    throttleDeadline = deadline;
+    throttleTimer->start(qMax<qint64>(deadline - clock.elapsed(), 0));
+}
+
+bool AbstractDBusServiceInterface::Private::emitPropertiesChanged()
+{
+    if (changedProperties.isEmpty()) {
+        return true;
+    }
+
+    QVariantMap properties = changedProperties;
+    changedProperties.clear();
+
+    // The changes may have been queued before the object went away
+    if (!registered || !dbusObject) {
+        debug() << "Dropping property changes of" << interfaceName <<
+            "as it is no longer registered";
+        return false;
+    }
+
+    if (!propertyIntervals.isEmpty()) {
+        qint64 now = clock.elapsed();
+        for (QVariantMap::const_iterator i = properties.constBegin();
+                i != properties.constEnd(); ++i) {
+            if (propertyIntervals.contains(i.key())) {
+                lastEmitted.insert(i.key(), now);
+            }
+        }
+    }
+
+    QDBusMessage signal = QDBusMessage::createSignal(dbusObject->objectPath(),
+                                                     TP_QT_IFACE_PROPERTIES,
+                                                     QLatin1String("PropertiesChanged"));
+    signal << interfaceName;
+    signal << properties;
+    signal << QStringList();
+
+    return dbusObject->dbusConnection().send(signal);
+}
+
 /**
  * \class AbstractDBusServiceInterface
  * \ingroup servicesideimpl
@@ -224,6 +300,12 @@ struct AbstractDBusServiceInterface::Private
  *
  * This class serves as a base for all the classes that are used to implement
  * interfaces that sit on top of D-Bus services.
+ *
+ * Property changes reported with notifyPropertyChanged() are signalled right away by
+ * default. Interfaces whose properties change often can merge the changes of one main loop
+ * iteration into a single PropertiesChanged signal with setPropertyChangeMergingEnabled(),
+ * and limit properties changing at a high rate to one signal per interval with
+ * setPropertyChangedInterval().
  */
 
 /**
@@ -233,7 +315,7 @@ struct AbstractDBusServiceInterface::Private
  * \param interfaceName The name of the interface that this class implements.
  */
 AbstractDBusServiceInterface::AbstractDBusServiceInterface(const QString &interfaceName)
-    : mPriv(new Private(interfaceName))
+    : mPriv(new Private(this, interfaceName))
 {
 }
 
@@ -286,27 +368,185 @@ bool AbstractDBusServiceInterface::isRegistered() const
  * Emit PropertiesChanged signal on object org.freedesktop.DBus.Properties interface
  * with the property \a propertyName.
  *
+ * By default the signal is sent before this method returns. If merging was enabled with
+ * setPropertyChangeMergingEnabled(), it is sent once the control returns to the main loop
+ * instead, together with the other properties of this interface which changed in the
+ * meantime. If an interval was set for \a propertyName with setPropertyChangedInterval(),
+ * the signal is delayed until the interval since the previous signal for this property has
+ * elapsed. A delayed signal only carries the latest value of the property.
+ *
+ * A delayed PropertiesChanged signal is sent after the other signals the object emits in the
+ * meantime, so clients may see them in a different order than the changes happened. Call
+ * flushPropertiesChanged() before emitting a signal which clients expect to follow the
+ * property change.
+ *
  * \param propertyName The name of the changed property.
  * \param propertyValue The actual value of the changed property.
- * \return \c false if the signal can not be emmited or \a true otherwise.
+ * \return \c false if the signal can not be emmited or \a true otherwise. When the signal
+ *         is delayed, \c true only means that the change was queued, not that it was sent.
+ * \sa flushPropertiesChanged()
  */
 bool AbstractDBusServiceInterface::notifyPropertyChanged(const QString &propertyName, const QVariant &propertyValue)
 {
-    if (!isRegistered()) {
+    if (!isRegistered() || !mPriv->dbusObject) {
         return false;
     }
 
-    QDBusMessage signal = QDBusMessage::createSignal(dbusObject()->objectPath(),
-                                                     TP_QT_IFACE_PROPERTIES,
-                                                     QLatin1String("PropertiesChanged"));
-    QVariantMap changedProperties;
-    changedProperties.insert(propertyName, propertyValue);
+    int interval = mPriv->propertyIntervals.value(propertyName);
+    if (interval > 0 && !mPriv->changedProperties.contains(propertyName)) {
+        QHash<QString, qint64>::const_iterator it = mPriv->lastEmitted.constFind(propertyName);
+        if (it != mPriv->lastEmitted.constEnd()) {
+            qint64 deadline = it.value() + interval;
+            if (deadline > mPriv->clock.elapsed()) {
+                mPriv->throttledProperties.insert(propertyName, propertyValue);
+                mPriv->scheduleThrottledProperties(deadline);
+                return true;
+            }
+        }
+    }
 
-    signal << interfaceName();
-    signal << changedProperties;
-    signal << QStringList();
+    mPriv->throttledProperties.remove(propertyName);
+    mPriv->changedProperties.insert(propertyName, propertyValue);
+
+    if (!mPriv->mergeChanges) {
+        return mPriv->emitPropertiesChanged();
+    }
+
+    if (!mPriv->flushScheduled) {
+        mPriv->flushScheduled = true;
+        //emit after return
+        QMetaObject::invokeMethod(this, "emitChangedProperties", Qt::QueuedConnection);
+    }
+
+    return true;
+}
+
+/**
+ * Emit the PropertiesChanged signal for the property changes reported with
+ * notifyPropertyChanged() which have not been signalled yet.
+ *
+ * This includes the changes held back by setPropertyChangedInterval(). It can be used when
+ * a client must see the new values before a subsequent signal or method return.
+ *
+ * \sa notifyPropertyChanged()
+ */
+void AbstractDBusServiceInterface::flushPropertiesChanged()
+{
+    mPriv->throttleTimer->stop();
+
+    for (QVariantMap::const_iterator i = mPriv->throttledProperties.constBegin();
+            i != mPriv->throttledProperties.constEnd(); ++i) {
+        mPriv->changedProperties.insert(i.key(), i.value());
+    }
+    mPriv->throttledProperties.clear();
+
+    mPriv->emitPropertiesChanged();
+}
+
+/**
+ * Return whether the property changes of one main loop iteration are merged into a single
+ * PropertiesChanged signal.
+ *
+ * \return \c true if the changes are merged, \c false if each one is signalled right away.
+ * \sa setPropertyChangeMergingEnabled()
+ */
+bool AbstractDBusServiceInterface::isPropertyChangeMergingEnabled() const
+{
+    return mPriv->mergeChanges;
+}
+
+/**
+ * Set whether the property changes of one main loop iteration are merged into a single
+ * PropertiesChanged signal.
+ *
+ * Merging saves D-Bus traffic when several properties change together or when a property
+ * changes many times in a row, at the cost of delaying the signal as described in
+ * notifyPropertyChanged(). The default is \c false, signalling each change right away.
+ *
+ * Disabling merging sends the changes which are waiting for the main loop first.
+ *
+ * \param enabled Whether to merge the property changes.
+ * \sa notifyPropertyChanged(), setPropertyChangedInterval()
+ */
+void AbstractDBusServiceInterface::setPropertyChangeMergingEnabled(bool enabled)
+{
+    mPriv->mergeChanges = enabled;
+    if (!enabled) {
+        mPriv->emitPropertiesChanged();
+    }
+}
+
+/**
+ * Return the minimum interval, in milliseconds, between two PropertiesChanged signals
+ * carrying the property \a propertyName.
+ *
+ * \param propertyName The name of the property.
+ * \return The interval in milliseconds, 0 if the property is not rate limited.
+ * \sa setPropertyChangedInterval()
+ */
+int AbstractDBusServiceInterface::propertyChangedInterval(const QString &propertyName) const
+{
+    return mPriv->propertyIntervals.value(propertyName);
+}
+
+/**
+ * Set the minimum interval, in milliseconds, between two PropertiesChanged signals
+ * carrying the property \a propertyName.
+ *
+ * This is meant for properties which may change many times per second, such as progress
+ * counters. Changes happening within the interval are merged, and the latest value is
+ * signalled when the interval elapses.
+ *
+ * \param propertyName The name of the property.
+ * \param msec The interval in milliseconds, or 0 to signal each main loop iteration.
+ * \sa flushPropertiesChanged()
+ */
+void AbstractDBusServiceInterface::setPropertyChangedInterval(const QString &propertyName,
+        int msec)
+{
+    if (msec > 0) {
+        mPriv->propertyIntervals.insert(propertyName, msec);
+        return;
+    }
+
+    mPriv->propertyIntervals.remove(propertyName);
+    mPriv->lastEmitted.remove(propertyName);
+    if (mPriv->throttledProperties.contains(propertyName)) {
+        notifyPropertyChanged(propertyName, mPriv->throttledProperties.take(propertyName));
+    }
+}
+
+void AbstractDBusServiceInterface::emitChangedProperties()
+{
+    mPriv->flushScheduled = false;
+    mPriv->emitPropertiesChanged();
+}
+
+void AbstractDBusServiceInterface::emitThrottledProperties()
+{
+    qint64 now = mPriv->clock.elapsed();
+    qint64 nextDeadline = 0;
+
+    QVariantMap::iterator i = mPriv->throttledProperties.begin();
+    while (i != mPriv->throttledProperties.end()) {
+        qint64 deadline = mPriv->lastEmitted.value(i.key()) +
+            mPriv->propertyIntervals.value(i.key());
+        if (deadline <= now) {
+            mPriv->changedProperties.insert(i.key(), i.value());
+            i = mPriv->throttledProperties.erase(i);
+        } else {
+            if (!nextDeadline || deadline < nextDeadline) {
+                nextDeadline = deadline;
+            }
+            ++i;
+        }
+    }
+
+    if (nextDeadline) {
+        mPriv->scheduleThrottledProperties(nextDeadline);
+    }
 
-    return dbusObject()->dbusConnection().send(signal);
+    mPriv->emitPropertiesChanged();
 }
 
 /**
@@ -92,6 +92,17 @@ protected:
 
 public:
     bool notifyPropertyChanged(const QString &propertyName, const QVariant &propertyValue);
+    Q_INVOKABLE void flushPropertiesChanged();
+
+    bool isPropertyChangeMergingEnabled() const;
+    void setPropertyChangeMergingEnabled(bool enabled);
+
+    int propertyChangedInterval(const QString &propertyName) const;
+    void setPropertyChangedInterval(const QString &propertyName, int msec);
+
+private Q_SLOTS:
+    TP_QT_NO_EXPORT void emitChangedProperties();
+    TP_QT_NO_EXPORT void emitThrottledProperties();
 
 private:
     struct Private;
@@ -117,11 +117,33 @@ private:
 TP_QT_EXPORT Debug enabledDebug();
 TP_QT_EXPORT Debug enabledWarning();
 
+// Categories of debug output, debug() being DebugGeneral. If TP_QT_DEBUG is set when
+// enableDebug() is called, only the categories it lists (comma separated, or "all") are output.
+//
+// Use debugCategory() on hot paths: unlike debug(), it doesn't evaluate its output operands
+// at all when the category is disabled.
+enum DebugCategory {
+    DebugGeneral = 0,
+    DebugAvatars,
+    DebugMessages,
+    NumDebugCategories
+};
+
 #ifdef ENABLE_DEBUG
 
+// Whether the output of each category is enabled, updated by enableDebug()
+extern TP_QT_EXPORT bool debugCategoryEnabled[NumDebugCategories];
+
+// A for loop rather than an if, so that the macro doesn't steal the else of an unbraced if
+// around it. It can't be used as debug() itself, as qDebug() expands to a debug() call on Qt 5.
+#define debugCategory(category) \
+    for (bool tpQtDebugEnabled = Tp::debugCategoryEnabled[category]; tpQtDebugEnabled; \
+            tpQtDebugEnabled = false) \
+        Tp::enabledDebug()
+
 inline Debug debug()
 {
-    return enabledDebug();
+    return debugCategoryEnabled[DebugGeneral] ? enabledDebug() : Debug();
 }
 
 inline Debug warning()
@@ -155,6 +177,10 @@ struct NoDebug
     }
 };
 
+#define debugCategory(category) \
+    while (false) \
+        Tp::NoDebug()
+
 inline NoDebug debug()
 {
     return NoDebug();
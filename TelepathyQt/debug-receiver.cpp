@@ -32,23 +32,67 @@
 #include <TelepathyQt/PendingVariantMap>
 #include <TelepathyQt/ReadinessHelper>
 
+#include <QDataStream>
+#include <QFile>
+#include <QTimer>
+
 namespace Tp
 {
 
+namespace
+{
+
+// "TPDB", followed by the format version
+const quint32 spoolMagic = 0x54504442;
+const quint32 spoolVersion = 1;
+
+}
+
 struct TP_QT_NO_EXPORT DebugReceiver::Private
 {
     Private(DebugReceiver *parent);
+    ~Private();
 
     static void introspectCore(Private *self);
 
+    bool acceptsMessage(const QString &domain, uint level) const;
+    void bufferMessage(const DebugMessage &message);
+
+    bool openSpool(const QString &fileName);
+    void closeSpool();
+    void spoolMessages(const DebugMessageList &messages);
+
     DebugReceiver *parent;
     Client::DebugInterface *baseInterface;
+
+    // Messages waiting to be delivered by newDebugMessages()
+    DebugMessageList pendingMessages;
+    int bufferLimit;
+    uint droppedMessagesCount;
+    QTimer *flushTimer;
+
+    QStringList domainFilter;
+    DebugLevel levelFilter;
+
+    QFile *spoolFile;
+    QDataStream spoolStream;
+    // Domains are only written once to the spool, further messages refer to them by index
+    QHash<QString, quint32> spoolDomains;
 };
 
 DebugReceiver::Private::Private(DebugReceiver *parent)
     : parent(parent),
-      baseInterface(new Client::DebugInterface(parent))
+      baseInterface(new Client::DebugInterface(parent)),
+      bufferLimit(1000),
+      droppedMessagesCount(0),
+      flushTimer(new QTimer(parent)),
+      levelFilter(DebugLevelDebug),
+      spoolFile(0)
 {
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(0);
+    parent->connect(flushTimer, SIGNAL(timeout()), SLOT(flushDebugMessages()));
+
     ReadinessHelper::Introspectables introspectables;
 
     ReadinessHelper::Introspectable introspectableCore(
@@ -62,6 +106,10 @@ DebugReceiver::Private::Private(DebugReceiver *parent)
     parent->readinessHelper()->addIntrospectables(introspectables);
 }
 
+DebugReceiver::Private::~Private()
+{
+    closeSpool();
+}
 
 void DebugReceiver::Private::introspectCore(DebugReceiver::Private *self)
 {
@@ -72,6 +120,90 @@ void DebugReceiver::Private::introspectCore(DebugReceiver::Private *self)
             SLOT(onRequestAllPropertiesFinished(Tp::PendingOperation*)));
 }
 
+bool DebugReceiver::Private::acceptsMessage(const QString &domain, uint level) const
+{
+    if (level > (uint) levelFilter) {
+        return false;
+    }
+
+    if (domainFilter.isEmpty()) {
+        return true;
+    }
+
+    foreach (const QString &filter, domainFilter) {
+        if (domain.startsWith(filter) &&
+                (domain.size() == filter.size() || domain.at(filter.size()) == QLatin1Char('/'))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DebugReceiver::Private::bufferMessage(const DebugMessage &message)
+{
+    if (pendingMessages.size() >= bufferLimit) {
+        pendingMessages.removeFirst();
+        ++droppedMessagesCount;
+    }
+    pendingMessages.append(message);
+
+    if (!flushTimer->isActive()) {
+        flushTimer->start();
+    }
+}
+
+bool DebugReceiver::Private::openSpool(const QString &fileName)
+{
+    spoolFile = new QFile(fileName);
+    if (!spoolFile->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        warning() << "Unable to open debug messages spool" << fileName << "-"
+            << spoolFile->errorString();
+        delete spoolFile;
+        spoolFile = 0;
+        return false;
+    }
+
+    spoolStream.setDevice(spoolFile);
+    spoolStream.setVersion(QDataStream::Qt_4_6);
+    spoolStream << spoolMagic << spoolVersion;
+    spoolFile->flush();
+    return true;
+}
+
+void DebugReceiver::Private::closeSpool()
+{
+    if (!spoolFile) {
+        return;
+    }
+
+    spoolStream.setDevice(0);
+    spoolDomains.clear();
+    delete spoolFile;
+    spoolFile = 0;
+}
+
+void DebugReceiver::Private::spoolMessages(const DebugMessageList &messages)
+{
+    if (!spoolFile) {
+        return;
+    }
+
+    foreach (const DebugMessage &message, messages) {
+        QHash<QString, quint32>::const_iterator it = spoolDomains.constFind(message.domain);
+        if (it != spoolDomains.constEnd()) {
+            spoolStream << message.timestamp << it.value();
+        } else {
+            quint32 index = spoolDomains.size();
+            spoolDomains.insert(message.domain, index);
+            spoolStream << message.timestamp << index << message.domain;
+        }
+        spoolStream << (quint8) message.level << message.message.toUtf8();
+    }
+
+    // Keep the spool usable if the process dies before the next batch
+    spoolFile->flush();
+}
+
 /**
  * \class DebugReceiver
  * \ingroup clientsideproxies
@@ -81,6 +213,14 @@ void DebugReceiver::Private::introspectCore(DebugReceiver::Private *self)
  * Debug object.
  *
  * A Debug object provides debugging messages from services.
+ *
+ * Besides the newDebugMessage() signal, monitored messages are delivered in chunks by
+ * newDebugMessages(), which is better suited to following a busy service: messages received
+ * together are delivered together, optionally gathered over an interval (see
+ * setBatchInterval()), and at most bufferLimit() of them are kept waiting for delivery, the
+ * oldest ones being dropped first. Messages can be filtered by domain and level before being
+ * delivered or buffered, and can also be spooled to a compact file for post-mortem analysis
+ * (see setSpoolFileName() and readSpoolFile()).
  */
 
 /**
@@ -108,6 +248,7 @@ DebugReceiver::DebugReceiver(const QDBusConnection &bus, const QString &busName)
 
 DebugReceiver::~DebugReceiver()
 {
+    mPriv->spoolMessages(mPriv->pendingMessages);
     delete mPriv;
 }
 
@@ -158,6 +299,235 @@ PendingOperation *DebugReceiver::setMonitoringEnabled(bool enabled)
     return mPriv->baseInterface->setPropertyEnabled(enabled);
 }
 
+/**
+ * Return the maximum number of monitored messages kept waiting for delivery by
+ * newDebugMessages().
+ *
+ * \return The maximum number of buffered messages.
+ * \sa setBufferLimit(), droppedMessagesCount()
+ */
+int DebugReceiver::bufferLimit() const
+{
+    return mPriv->bufferLimit;
+}
+
+/**
+ * Set the maximum number of monitored messages kept waiting for delivery by
+ * newDebugMessages().
+ *
+ * When the limit is reached, the oldest buffered message is dropped to make room for the new
+ * one. The default limit is 1000 messages.
+ *
+ * \param limit The maximum number of buffered messages, at least 1.
+ * \sa droppedMessagesCount()
+ */
+void DebugReceiver::setBufferLimit(int limit)
+{
+    mPriv->bufferLimit = qMax(limit, 1);
+    while (mPriv->pendingMessages.size() > mPriv->bufferLimit) {
+        mPriv->pendingMessages.removeFirst();
+        ++mPriv->droppedMessagesCount;
+    }
+}
+
+/**
+ * Return the number of monitored messages which have been dropped because the buffer was full.
+ *
+ * \return The number of dropped messages.
+ * \sa setBufferLimit()
+ */
+uint DebugReceiver::droppedMessagesCount() const
+{
+    return mPriv->droppedMessagesCount;
+}
+
+/**
+ * Return the interval, in milliseconds, during which monitored messages are gathered before
+ * being delivered by newDebugMessages().
+ *
+ * \return The interval in milliseconds.
+ * \sa setBatchInterval()
+ */
+int DebugReceiver::batchInterval() const
+{
+    return mPriv->flushTimer->interval();
+}
+
+/**
+ * Set the interval, in milliseconds, during which monitored messages are gathered before
+ * being delivered by newDebugMessages().
+ *
+ * The default is 0, delivering the messages received during an event loop iteration together.
+ *
+ * \param msec The interval in milliseconds.
+ * \sa flushDebugMessages()
+ */
+void DebugReceiver::setBatchInterval(int msec)
+{
+    mPriv->flushTimer->setInterval(qMax(msec, 0));
+}
+
+/**
+ * Return the domains monitored messages are restricted to.
+ *
+ * \return The list of domains, empty if messages are not filtered by domain.
+ * \sa setDomainFilter()
+ */
+QStringList DebugReceiver::domainFilter() const
+{
+    return mPriv->domainFilter;
+}
+
+/**
+ * Restrict the monitored messages to the given domains.
+ *
+ * A message matches a domain if its domain is either the same or a subdomain of it, for
+ * example "gabble/connection" matches "gabble". Messages not matching any of the domains are
+ * neither signalled, buffered nor spooled.
+ *
+ * The Debug interface has no way to filter messages on the service side, so this only saves
+ * work on the receiving side. Messages returned by fetchMessages() are never filtered.
+ *
+ * \param domains The list of domains, or an empty list to accept messages from all domains.
+ * \sa setLevelFilter()
+ */
+void DebugReceiver::setDomainFilter(const QStringList &domains)
+{
+    mPriv->domainFilter = domains;
+}
+
+/**
+ * Return the least severe level of the monitored messages which are accepted.
+ *
+ * \return The level as #DebugLevel.
+ * \sa setLevelFilter()
+ */
+DebugLevel DebugReceiver::levelFilter() const
+{
+    return mPriv->levelFilter;
+}
+
+/**
+ * Ignore the monitored messages which are less severe than \a level.
+ *
+ * The default is #DebugLevelDebug, accepting messages of all levels. As with
+ * setDomainFilter(), filtering happens on the receiving side.
+ *
+ * \param level The least severe level accepted, as #DebugLevel.
+ */
+void DebugReceiver::setLevelFilter(DebugLevel level)
+{
+    mPriv->levelFilter = level;
+}
+
+/**
+ * Return the name of the file monitored messages are spooled to.
+ *
+ * \return The file name, or an empty string if messages are not spooled.
+ * \sa setSpoolFileName()
+ */
+QString DebugReceiver::spoolFileName() const
+{
+    return mPriv->spoolFile ? mPriv->spoolFile->fileName() : QString();
+}
+
+/**
+ * Spool monitored messages to the file named \a fileName.
+ *
+ * The file is truncated, and each chunk of messages is appended to it as it is delivered by
+ * newDebugMessages(). The file uses a compact binary format, which can be read back with
+ * readSpoolFile(), even if the process died while spooling.
+ *
+ * \param fileName The file name, or an empty string to stop spooling.
+ * \return \c true if the file could be opened, \c false otherwise.
+ */
+bool DebugReceiver::setSpoolFileName(const QString &fileName)
+{
+    mPriv->closeSpool();
+    if (fileName.isEmpty()) {
+        return true;
+    }
+    return mPriv->openSpool(fileName);
+}
+
+/**
+ * Read the messages spooled to the file named \a fileName.
+ *
+ * If the last message was only partially written, it is ignored.
+ *
+ * \param fileName The file name, as given to setSpoolFileName().
+ * \return The spooled messages, or an empty list if the file could not be read.
+ */
+DebugMessageList DebugReceiver::readSpoolFile(const QString &fileName)
+{
+    DebugMessageList messages;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        warning() << "Unable to open debug messages spool" << fileName << "-"
+            << file.errorString();
+        return messages;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != spoolMagic || version != spoolVersion) {
+        warning() << fileName << "is not a debug messages spool";
+        return messages;
+    }
+
+    QStringList domains;
+    while (!stream.atEnd()) {
+        DebugMessage message;
+        quint32 index;
+        stream >> message.timestamp >> index;
+        if (index == (quint32) domains.size()) {
+            QString domain;
+            stream >> domain;
+            domains << domain;
+        } else if (index > (quint32) domains.size()) {
+            warning() << "Invalid domain index in debug messages spool" << fileName;
+            break;
+        }
+
+        quint8 level;
+        QByteArray text;
+        stream >> level >> text;
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+
+        message.domain = domains.at(index);
+        message.level = level;
+        message.message = QString::fromUtf8(text.constData(), text.size());
+        messages << message;
+    }
+
+    return messages;
+}
+
+/**
+ * Deliver the buffered monitored messages right away.
+ *
+ * \sa setBatchInterval()
+ */
+void DebugReceiver::flushDebugMessages()
+{
+    mPriv->flushTimer->stop();
+    if (mPriv->pendingMessages.isEmpty()) {
+        return;
+    }
+
+    DebugMessageList messages = mPriv->pendingMessages;
+    mPriv->pendingMessages.clear();
+
+    mPriv->spoolMessages(messages);
+    emit newDebugMessages(messages);
+}
+
 void DebugReceiver::onRequestAllPropertiesFinished(Tp::PendingOperation *op)
 {
     if (op->isError()) {
@@ -175,6 +545,10 @@ void DebugReceiver::onRequestAllPropertiesFinished(Tp::PendingOperation *op)
 void DebugReceiver::onNewDebugMessage(double time, const QString &domain,
         uint level, const QString &message)
 {
+    if (!mPriv->acceptsMessage(domain, level)) {
+        return;
+    }
+
     DebugMessage msg;
     msg.timestamp = time;
     msg.domain = domain;
@@ -182,6 +556,8 @@ void DebugReceiver::onNewDebugMessage(double time, const QString &domain,
     msg.message = message;
 
     emit newDebugMessage(msg);
+
+    mPriv->bufferMessage(msg);
 }
 
 /**
@@ -195,4 +571,15 @@ void DebugReceiver::onNewDebugMessage(double time, const QString &domain,
  * \sa setMonitoringEnabled
  */
 
+/**
+ * \fn void DebugReceiver::newDebugMessages(const Tp::DebugMessageList &messages)
+ *
+ * Emitted with the monitored messages received since the previous emission, once the batch
+ * interval has elapsed. This will be emitted only if monitoring has been previously enabled.
+ *
+ * \param messages The new debug messages, oldest first.
+ *
+ * \sa setBatchInterval(), setBufferLimit()
+ */
+
 } // Tp
@@ -51,8 +51,28 @@ public:
     PendingDebugMessageList *fetchMessages();
     PendingOperation *setMonitoringEnabled(bool enabled);
 
+    int bufferLimit() const;
+    void setBufferLimit(int limit);
+    uint droppedMessagesCount() const;
+
+    int batchInterval() const;
+    void setBatchInterval(int msec);
+
+    QStringList domainFilter() const;
+    void setDomainFilter(const QStringList &domains);
+    DebugLevel levelFilter() const;
+    void setLevelFilter(DebugLevel level);
+
+    QString spoolFileName() const;
+    bool setSpoolFileName(const QString &fileName);
+    static DebugMessageList readSpoolFile(const QString &fileName);
+
+public Q_SLOTS:
+    void flushDebugMessages();
+
 Q_SIGNALS:
     void newDebugMessage(const Tp::DebugMessage & message);
+    void newDebugMessages(const Tp::DebugMessageList &messages);
 
 protected:
     DebugReceiver(const QDBusConnection &bus, const QString &busName);
@@ -37,6 +37,11 @@
  * warning messages. Normal debug output results in the normal operation of the
  * library, warning messages are output only when something goes wrong. Each
  * category can be invidually enabled.
+ *
+ * Normal debug output can be further restricted by setting the TP_QT_DEBUG
+ * environment variable to a comma separated list of the areas of interest, among
+ * <code>general</code>, <code>avatars</code> and <code>messages</code>, or
+ * <code>all</code>. It is read when debug output is enabled with enableDebug().
  */
 
 namespace Tp
@@ -96,16 +101,41 @@ namespace Tp
 
 #ifdef ENABLE_DEBUG
 
+bool debugCategoryEnabled[NumDebugCategories];
+
 namespace
 {
 bool debugEnabled = false;
 bool warningsEnabled = true;
 DebugCallback debugCallback = NULL;
+
+// Indexed by DebugCategory
+const char * const debugCategoryNames[NumDebugCategories] = {
+    "general",
+    "avatars",
+    "messages"
+};
+
+void updateDebugCategories()
+{
+    QList<QByteArray> selected = qgetenv("TP_QT_DEBUG").split(',');
+    for (int i = 0; i < selected.size(); ++i) {
+        selected[i] = selected[i].trimmed();
+    }
+    selected.removeAll(QByteArray());
+
+    bool all = selected.isEmpty() || selected.contains("all");
+    for (int i = 0; i < NumDebugCategories; ++i) {
+        debugCategoryEnabled[i] = debugEnabled &&
+            (all || selected.contains(debugCategoryNames[i]));
+    }
+}
 }
 
 void enableDebug(bool enable)
 {
     debugEnabled = enable;
+    updateDebugCategories();
 }
 
 void enableWarnings(bool enable)
@@ -0,0 +1,87 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_feature_internal_h_HEADER_GUARD_
+#define _TelepathyQt_feature_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Feature>
+
+#include <QVector>
+
+namespace Tp
+{
+
+// A set of features stored as a bitset indexed by the interned feature ids, for the set
+// arithmetic done over and over on contacts and readiness helpers.
+//
+// Exported so the tests can use it even if they link dynamically
+// The header is not installed though, so this should be considered private API
+class TP_QT_EXPORT FeatureSet
+{
+public:
+    FeatureSet() { }
+    FeatureSet(const Feature &feature) { insert(feature); }
+    FeatureSet(const Features &features);
+
+    bool isEmpty() const;
+    int count() const;
+    void clear() { mWords.clear(); }
+
+    bool contains(const Feature &feature) const;
+    bool contains(const FeatureSet &other) const;
+    bool intersects(const FeatureSet &other) const;
+
+    FeatureSet &insert(const Feature &feature);
+    FeatureSet &remove(const Feature &feature);
+
+    FeatureSet &unite(const FeatureSet &other);
+    FeatureSet &subtract(const FeatureSet &other);
+    FeatureSet &intersect(const FeatureSet &other);
+
+    Features toFeatures() const;
+
+    FeatureSet &operator<<(const Feature &feature) { return insert(feature); }
+    FeatureSet &operator|=(const FeatureSet &other) { return unite(other); }
+    FeatureSet &operator+=(const FeatureSet &other) { return unite(other); }
+    FeatureSet &operator-=(const FeatureSet &other) { return subtract(other); }
+    FeatureSet &operator&=(const FeatureSet &other) { return intersect(other); }
+
+    FeatureSet operator|(const FeatureSet &other) const { return FeatureSet(*this).unite(other); }
+    FeatureSet operator+(const FeatureSet &other) const { return FeatureSet(*this).unite(other); }
+    FeatureSet operator-(const FeatureSet &other) const
+    {
+        return FeatureSet(*this).subtract(other);
+    }
+    FeatureSet operator&(const FeatureSet &other) const
+    {
+        return FeatureSet(*this).intersect(other);
+    }
+
+    bool operator==(const FeatureSet &other) const;
+    bool operator!=(const FeatureSet &other) const { return !(*this == other); }
+
+private:
+    QVector<quint32> mWords;
+};
+
+} // Tp
+
+#endif
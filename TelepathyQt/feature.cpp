@@ -21,15 +21,73 @@
  */
 
 #include <TelepathyQt/Feature>
+#include "TelepathyQt/feature-internal.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 
 namespace Tp
 {
 
+namespace
+{
+
+// Gives each (class name, id) pair a small index, so that FeatureSet can be a plain bitset
+class FeatureRegistry
+{
+public:
+    uint intern(const QString &className, uint id)
+    {
+        QMutexLocker locker(&mLock);
+        QPair<QString, uint> key(className, id);
+        QHash<QPair<QString, uint>, uint>::const_iterator i = mIndexes.constFind(key);
+        if (i != mIndexes.constEnd()) {
+            return *i;
+        }
+
+        uint index = mFeatures.size();
+        mIndexes.insert(key, index);
+        mFeatures.append(Feature());
+        return index;
+    }
+
+    void remember(const Feature &feature, uint index)
+    {
+        QMutexLocker locker(&mLock);
+        if (!mFeatures[index].isValid()) {
+            mFeatures[index] = feature;
+        }
+    }
+
+    Feature feature(uint index)
+    {
+        QMutexLocker locker(&mLock);
+        return mFeatures.value(index);
+    }
+
+private:
+    QMutex mLock;
+    QHash<QPair<QString, uint>, uint> mIndexes;
+    QVector<Feature> mFeatures;
+};
+
+// Features are mostly constructed during static initialization, so the registry has to be
+// created on first use
+FeatureRegistry *featureRegistry()
+{
+    static FeatureRegistry registry;
+    return &registry;
+}
+
+}
+
 struct TP_QT_NO_EXPORT Feature::Private : public QSharedData
 {
-    Private(bool critical) : critical(critical) {}
+    Private(bool critical, uint index) : critical(critical), index(index) {}
 
     bool critical;
+    uint index;
 };
 
 /**
@@ -48,8 +106,9 @@ Feature::Feature()
 
 Feature::Feature(const QString &className, uint id, bool critical)
     : QPair<QString, uint>(className, id),
-      mPriv(new Private(critical))
+      mPriv(new Private(critical, featureRegistry()->intern(className, id)))
 {
+    featureRegistry()->remember(*this, mPriv->index);
 }
 
 Feature::Feature(const Feature &other)
@@ -64,7 +123,7 @@ Feature::~Feature()
 
 Feature &Feature::operator=(const Feature &other)
 {
-    *this = other;
+    QPair<QString, uint>::operator=(other);
     this->mPriv = other.mPriv;
     return *this;
 }
@@ -86,4 +145,146 @@ bool Feature::isCritical() const
  * \brief The Features class represents a list of Feature.
  */
 
+FeatureSet::FeatureSet(const Features &features)
+{
+    foreach (const Feature &feature, features) {
+        insert(feature);
+    }
+}
+
+bool FeatureSet::isEmpty() const
+{
+    foreach (quint32 word, mWords) {
+        if (word) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int FeatureSet::count() const
+{
+    int ret = 0;
+    foreach (quint32 word, mWords) {
+        for (; word; word &= word - 1) {
+            ++ret;
+        }
+    }
+    return ret;
+}
+
+bool FeatureSet::contains(const Feature &feature) const
+{
+    if (!feature.isValid()) {
+        return false;
+    }
+
+    uint index = feature.mPriv->index;
+    int word = index / 32;
+    return word < mWords.size() && (mWords[word] & (1u << (index % 32)));
+}
+
+bool FeatureSet::contains(const FeatureSet &other) const
+{
+    for (int i = 0; i < other.mWords.size(); ++i) {
+        quint32 word = i < mWords.size() ? mWords[i] : 0;
+        if (other.mWords[i] & ~word) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FeatureSet::intersects(const FeatureSet &other) const
+{
+    int size = qMin(mWords.size(), other.mWords.size());
+    for (int i = 0; i < size; ++i) {
+        if (mWords[i] & other.mWords[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+FeatureSet &FeatureSet::insert(const Feature &feature)
+{
+    if (!feature.isValid()) {
+        return *this;
+    }
+
+    uint index = feature.mPriv->index;
+    int word = index / 32;
+    if (word >= mWords.size()) {
+        mWords.resize(word + 1);
+    }
+    mWords[word] |= 1u << (index % 32);
+    return *this;
+}
+
+FeatureSet &FeatureSet::remove(const Feature &feature)
+{
+    if (contains(feature)) {
+        uint index = feature.mPriv->index;
+        mWords[index / 32] &= ~(1u << (index % 32));
+    }
+    return *this;
+}
+
+FeatureSet &FeatureSet::unite(const FeatureSet &other)
+{
+    if (mWords.size() < other.mWords.size()) {
+        mWords.resize(other.mWords.size());
+    }
+    for (int i = 0; i < other.mWords.size(); ++i) {
+        mWords[i] |= other.mWords[i];
+    }
+    return *this;
+}
+
+FeatureSet &FeatureSet::subtract(const FeatureSet &other)
+{
+    int size = qMin(mWords.size(), other.mWords.size());
+    for (int i = 0; i < size; ++i) {
+        mWords[i] &= ~other.mWords[i];
+    }
+    return *this;
+}
+
+FeatureSet &FeatureSet::intersect(const FeatureSet &other)
+{
+    for (int i = 0; i < mWords.size(); ++i) {
+        mWords[i] &= i < other.mWords.size() ? other.mWords[i] : 0;
+    }
+    return *this;
+}
+
+Features FeatureSet::toFeatures() const
+{
+    Features ret;
+    for (int i = 0; i < mWords.size(); ++i) {
+        for (quint32 word = mWords[i]; word; word &= word - 1) {
+            uint bit = 0;
+            while (!(word & (1u << bit))) {
+                ++bit;
+            }
+            ret.insert(featureRegistry()->feature(i * 32 + bit));
+        }
+    }
+    return ret;
+}
+
+bool FeatureSet::operator==(const FeatureSet &other) const
+{
+    // Trailing empty words do not matter
+    int size = qMax(mWords.size(), other.mWords.size());
+    for (int i = 0; i < size; ++i) {
+        quint32 word = i < mWords.size() ? mWords[i] : 0;
+        quint32 otherWord = i < other.mWords.size() ? other.mWords[i] : 0;
+        if (word != otherWord) {
+            return false;
+        }
+    }
+    return true;
+}
+
 } // Tp
@@ -29,6 +29,8 @@
 #include <TelepathyQt/Connection>
 #include <TelepathyQt/Types>
 
+#include <QElapsedTimer>
+
 namespace Tp
 {
 
@@ -66,6 +68,13 @@ struct TP_QT_NO_EXPORT FileTransferChannel::Private
     qulonglong transferredBytes;
     SupportedSocketMap availableSocketTypes;
 
+    qint64 transferWindowSize;
+
+    // Transfer rate instrumentation, the timer is started once the state becomes Open
+    QElapsedTimer transferTime;
+    qint64 transferDuration;
+    qulonglong transferStartBytes;
+
     bool connected;
     bool finished;
 };
@@ -83,9 +92,14 @@ FileTransferChannel::Private::Private(FileTransferChannel *parent)
       initialOffset(0),
       size(0),
       transferredBytes(0),
+      transferWindowSize(256 * 1024),
+      transferDuration(-1),
+      transferStartBytes(0),
       connected(false),
       finished(false)
 {
+    transferTime.invalidate();
+
     parent->connect(fileTransferInterface,
             SIGNAL(InitialOffsetDefined(qulonglong)),
             SLOT(onInitialOffsetDefined(qulonglong)));
@@ -467,6 +481,70 @@ qulonglong FileTransferChannel::transferredBytes() const
     return mPriv->transferredBytes;
 }
 
+/**
+ * Return the average transfer rate of this channel, in bytes per second.
+ *
+ * The rate is measured from the moment the state() becomes #FileTransferStateOpen
+ * until it becomes #FileTransferStateCompleted or #FileTransferStateCancelled,
+ * based on the transferredBytes() reported by the connection manager.
+ *
+ * This method requires FileTransferChannel::FeatureCore to be ready.
+ *
+ * \return The number of bytes per second, or 0 if the transfer has not started yet.
+ * \sa transferredBytes()
+ */
+double FileTransferChannel::transferRate() const
+{
+    if (!isReady(FeatureCore)) {
+        warning() << "FileTransferChannel::FeatureCore must be ready before "
+            "calling transferRate";
+    }
+
+    if (!mPriv->transferTime.isValid()) {
+        return 0;
+    }
+
+    qint64 duration = mPriv->transferDuration >= 0 ?
+        mPriv->transferDuration : mPriv->transferTime.elapsed();
+    if (duration <= 0 || mPriv->transferredBytes < mPriv->transferStartBytes) {
+        return 0;
+    }
+
+    return (mPriv->transferredBytes - mPriv->transferStartBytes) * 1000.0 / duration;
+}
+
+/**
+ * Return the maximum amount of data, in bytes, this channel keeps in memory while
+ * transferring the file.
+ *
+ * The file data is read from the input device only while less than this amount of data
+ * is waiting to be written to the output device, in both directions.
+ *
+ * The default is 256 KiB.
+ *
+ * \return The window size in bytes.
+ * \sa setTransferWindowSize()
+ */
+qint64 FileTransferChannel::transferWindowSize() const
+{
+    return mPriv->transferWindowSize;
+}
+
+/**
+ * Set the maximum amount of data, in bytes, this channel keeps in memory while
+ * transferring the file.
+ *
+ * Larger windows reduce the number of read and write calls on fast devices, while
+ * smaller ones limit the memory used when the output device is slow.
+ *
+ * \param size The window size in bytes, at least 4 KiB.
+ * \sa transferWindowSize()
+ */
+void FileTransferChannel::setTransferWindowSize(qint64 size)
+{
+    mPriv->transferWindowSize = qMax(size, qint64(4 * 1024));
+}
+
 /**
  * Return a mapping from address types (members of #SocketAddressType) to arrays
  * of access-control type (members of #SocketAccessControl) that the CM
@@ -599,6 +677,15 @@ void FileTransferChannel::changeState()
 
     mPriv->state = mPriv->pendingState;
     mPriv->stateReason = mPriv->pendingStateReason;
+
+    if (mPriv->state == FileTransferStateOpen) {
+        mPriv->transferTime.start();
+        mPriv->transferDuration = -1;
+        mPriv->transferStartBytes = mPriv->transferredBytes;
+    } else if (mPriv->transferTime.isValid() && mPriv->transferDuration < 0) {
+        mPriv->transferDuration = mPriv->transferTime.elapsed();
+    }
+
     emit stateChanged((FileTransferState) mPriv->state,
             (FileTransferStateChangeReason) mPriv->stateReason);
 }
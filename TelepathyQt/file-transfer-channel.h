@@ -63,6 +63,10 @@ public:
     qulonglong initialOffset() const;
 
     qulonglong transferredBytes() const;
+    double transferRate() const;
+
+    qint64 transferWindowSize() const;
+    void setTransferWindowSize(qint64 size);
 
     PendingOperation *cancel();
 
@@ -55,6 +55,12 @@ struct TP_QT_NO_EXPORT IncomingFileTransferChannel::Private
     qulonglong requestedOffset;
     qint64 pos;
     bool weOpenedDevice;
+
+    void writeData(const char *data, qint64 length);
+
+    // Reused between reads, never bigger than the transfer window
+    QByteArray buffer;
+    bool transferring;
 };
 
 IncomingFileTransferChannel::Private::Private(IncomingFileTransferChannel *parent)
@@ -64,7 +70,8 @@ IncomingFileTransferChannel::Private::Private(IncomingFileTransferChannel *paren
       socket(0),
       requestedOffset(0),
       pos(0),
-      weOpenedDevice(false)
+      weOpenedDevice(false),
+      transferring(false)
 {
     parent->connect(fileTransferInterface,
             SIGNAL(URIDefined(QString)),
@@ -78,6 +85,21 @@ IncomingFileTransferChannel::Private::~Private()
 {
 }
 
+void IncomingFileTransferChannel::Private::writeData(const char *data, qint64 length)
+{
+    // skip until we reach requestedOffset and start writing from there
+    qint64 skip = 0;
+    if ((qulonglong) pos < requestedOffset) {
+        skip = (qint64) qMin(requestedOffset - pos, (qulonglong) length);
+    }
+
+    if (length > skip) {
+        output->write(data + skip, length - skip); // never fails
+    }
+
+    pos += length;
+}
+
 /**
  * \class IncomingFileTransferChannel
  * \ingroup clientchannel
@@ -315,6 +337,12 @@ void IncomingFileTransferChannel::connectToHost()
             SLOT(onSocketError(QAbstractSocket::SocketError)));
     connect(mPriv->socket, SIGNAL(readyRead()),
             SLOT(doTransfer()));
+    connect(mPriv->output, SIGNAL(bytesWritten(qint64)),
+            SLOT(doTransfer()));
+
+    // Data not read from the socket stays in the kernel, so the sender is slowed
+    // down by the TCP flow control while the output is busy
+    mPriv->socket->setReadBufferSize(transferWindowSize());
 
     debug().nospace() << "Connecting to host " <<
         mPriv->addr.address << ":" << mPriv->addr.port << "...";
@@ -332,6 +360,11 @@ void IncomingFileTransferChannel::onSocketConnected()
 void IncomingFileTransferChannel::onSocketDisconnected()
 {
     debug() << "Disconnected from host";
+
+    // the data held back by the transfer window is still readable
+    QByteArray data = mPriv->socket->readAll();
+    mPriv->writeData(data.constData(), data.size());
+
     setFinished();
 }
 
@@ -342,22 +375,31 @@ void IncomingFileTransferChannel::onSocketError(QAbstractSocket::SocketError err
 
 void IncomingFileTransferChannel::doTransfer()
 {
-    QByteArray data;
-    while (mPriv->socket->bytesAvailable()) {
-        data = mPriv->socket->readAll();
-
-        // skip until we reach requetedOffset and start writing from there
-        if ((qulonglong) mPriv->pos < mPriv->requestedOffset) {
-            if ((qulonglong) data.length() <= (mPriv->requestedOffset - mPriv->pos)) {
-                break;
-            }
-            data = data.mid(mPriv->requestedOffset - mPriv->pos);
+    // the output may emit bytesWritten() synchronously from write()
+    if (mPriv->transferring || !mPriv->socket) {
+        return;
+    }
+
+    const qint64 window = transferWindowSize();
+    if (mPriv->buffer.size() != window) {
+        mPriv->buffer.resize(window);
+    }
+
+    mPriv->transferring = true;
+
+    // only read while the output has room in the transfer window, its
+    // bytesWritten() resumes the transfer
+    qint64 room;
+    while ((room = window - mPriv->output->bytesToWrite()) > 0) {
+        qint64 len = mPriv->socket->read(mPriv->buffer.data(), room);
+        if (len <= 0) {
+            break;
         }
 
-        mPriv->output->write(data); // never fails
+        mPriv->writeData(mPriv->buffer.constData(), len);
     }
 
-    mPriv->pos += data.length();
+    mPriv->transferring = false;
 }
 
 void IncomingFileTransferChannel::setFinished()
@@ -379,8 +421,13 @@ void IncomingFileTransferChannel::setFinished()
         mPriv->socket->close();
     }
 
-    if (mPriv->output && mPriv->weOpenedDevice) {
-        mPriv->output->close();
+    if (mPriv->output) {
+        disconnect(mPriv->output, SIGNAL(bytesWritten(qint64)),
+                   this, SLOT(doTransfer()));
+
+        if (mPriv->weOpenedDevice) {
+            mPriv->output->close();
+        }
     }
 
     FileTransferChannel::setFinished();
@@ -29,14 +29,83 @@
 #include <QtCore/QByteArray>
 #include <QtCore/QFile>
 #include <QtCore/QHash>
+#include <QtCore/QSharedData>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 
+#include <string.h>
+
 namespace Tp
 {
 
+namespace
+{
+
+// Same set of characters as QByteArray::trimmed()
+inline bool isSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+}
+
+inline void trim(const char *data, int &from, int &to)
+{
+    while (from < to && isSpace(data[from])) {
+        ++from;
+    }
+    while (to > from && isSpace(data[to - 1])) {
+        --to;
+    }
+}
+
+inline int indexOf(const char *data, int from, int to, char ch)
+{
+    const void *found = memchr(data + from, ch, to - from);
+    return found ? static_cast<const char *>(found) - data : -1;
+}
+
+bool appendUnescaped(const QByteArray &data, int from, int to, QStringList &result)
+{
+    QString str;
+    if (!KeyFile::unescapeString(data, from, to, str)) {
+        return false;
+    }
+    result << str;
+    return true;
+}
+
+}
+
 struct TP_QT_NO_EXPORT KeyFile::Private
 {
+    // The file contents, read once. Values are only kept as offsets into it, so it is shared by
+    // the copies of a KeyFile. It is not mapped, as the file may be changed or truncated while
+    // the KeyFile is still in use.
+    struct Buffer : public QSharedData
+    {
+        QByteArray data;
+    };
+
+    // Raw value of a key, unescaped when it is accessed
+    struct Value
+    {
+        Value()
+            : from(0),
+              to(0)
+        {
+        }
+
+        Value(int from, int to)
+            : from(from),
+              to(to)
+        {
+        }
+
+        int from;
+        int to;
+    };
+
+    typedef QHash<QString, Value> Group;
+
     Private();
     Private(const QString &fName);
 
@@ -46,6 +115,8 @@ struct TP_QT_NO_EXPORT KeyFile::Private
 
     bool validateKey(const QByteArray &data, int from, int to, QString &result);
 
+    bool findValue(const QString &key, Value &result) const;
+
     QStringList allGroups() const;
     QStringList allKeys() const;
     QStringList keys() const;
@@ -56,7 +127,8 @@ struct TP_QT_NO_EXPORT KeyFile::Private
 
     QString fileName;
     KeyFile::Status status;
-    QHash<QString, QHash<QString, QByteArray> > groups;
+    QExplicitlySharedDataPointer<Buffer> buffer;
+    QHash<QString, Group> groups;
     QString currentGroup;
 };
 
@@ -78,6 +150,7 @@ void KeyFile::Private::setFileName(const QString &fName)
     status = KeyFile::NoError;
     currentGroup = QString();
     groups.clear();
+    buffer.reset();
     read();
 }
 
@@ -87,6 +160,7 @@ void KeyFile::Private::setError(KeyFile::Status st, const QString &reason)
                          .arg(fileName).arg(reason);
     status = st;
     groups.clear();
+    buffer.reset();
 }
 
 bool KeyFile::Private::read()
@@ -104,23 +178,36 @@ bool KeyFile::Private::read()
         return false;
     }
 
-    QByteArray data;
-    QByteArray group;
+    buffer = new Buffer;
+    buffer->data = file.readAll();
+    file.close();
+
+    // Tokenize the whole file in one pass, only keys and group names are copied out of it
+    const QByteArray &bytes = buffer->data;
+    const char *data = bytes.constData();
+    const int size = bytes.size();
     QString currentGroup;
-    QHash<QString, QByteArray> groupMap;
-    QByteArray rawValue;
+    Group groupMap;
     int line = 0;
-    int idx;
-    while (!file.atEnd()) {
-        data = file.readLine().trimmed();
+    int lineStart = 0;
+    while (lineStart < size) {
+        int lineEnd = indexOf(data, lineStart, size, '\n');
+        if (lineEnd == -1) {
+            lineEnd = size;
+        }
+
+        int from = lineStart;
+        int to = lineEnd;
+        lineStart = lineEnd + 1;
         line++;
 
-        if (data.size() == 0) {
+        trim(data, from, to);
+        if (from == to) {
             // skip empty lines
             continue;
         }
 
-        char ch = data.at(0);
+        char ch = data[from];
         if (ch == '#') {
             // skip comments
             continue;
@@ -131,7 +218,7 @@ bool KeyFile::Private::read()
                 groupMap.clear();
             }
 
-            idx = data.indexOf(']');
+            int idx = indexOf(data, from, to, ']');
             if (idx == -1) {
                 // line starts with [ and it's not a group
                 setError(KeyFile::FormatError,
@@ -140,16 +227,19 @@ bool KeyFile::Private::read()
                 return false;
             }
 
-            group = data.mid(1, idx - 1).trimmed();
-            if (groups.contains(QLatin1String(group))) {
+            int groupFrom = from + 1;
+            int groupTo = idx;
+            trim(data, groupFrom, groupTo);
+            QString rawGroup = QString::fromLatin1(data + groupFrom, groupTo - groupFrom);
+            if (groups.contains(rawGroup)) {
                 setError(KeyFile::FormatError,
                          QString(QLatin1String("duplicated group '%1' at line %2"))
-                                 .arg(QLatin1String(group)).arg(line));
+                                 .arg(rawGroup).arg(line));
                 return false;
             }
 
             currentGroup = QLatin1String("");
-            if (!unescapeString(group, 0, group.size(), currentGroup)) {
+            if (!unescapeString(bytes, groupFrom, groupTo, currentGroup)) {
                 setError(KeyFile::FormatError,
                          QString(QLatin1String("invalid group '%1' at line %2"))
                                  .arg(currentGroup).arg(line));
@@ -157,7 +247,7 @@ bool KeyFile::Private::read()
             }
         }
         else {
-            idx = data.indexOf('=');
+            int idx = indexOf(data, from, to, '=');
             if (idx == -1) {
                 setError(KeyFile::FormatError,
                          QString(QLatin1String("format error at line %1 - missing '='"))
@@ -166,14 +256,14 @@ bool KeyFile::Private::read()
             }
 
             // remove trailing spaces
-            char ch;
             int idxKeyEnd = idx;
-            while ((ch = data.at(idxKeyEnd - 1)) == ' ' || ch == '\t') {
+            while (idxKeyEnd > from &&
+                   ((ch = data[idxKeyEnd - 1]) == ' ' || ch == '\t')) {
                 --idxKeyEnd;
             }
 
             QString key;
-            if (!validateKey(data, 0, idxKeyEnd, key)) {
+            if (!validateKey(bytes, from, idxKeyEnd, key)) {
                 setError(KeyFile::FormatError,
                          QString(QLatin1String("invalid key '%1' at line %2"))
                                  .arg(key).arg(line));
@@ -187,9 +277,10 @@ bool KeyFile::Private::read()
                 return false;
             }
 
-            data = data.mid(idx + 1).trimmed();
-            rawValue = data.mid(0, data.size());
-            groupMap[key] = rawValue;
+            int valueFrom = idx + 1;
+            int valueTo = to;
+            trim(data, valueFrom, valueTo);
+            groupMap.insert(key, Value(valueFrom, valueTo));
         }
     }
 
@@ -203,10 +294,10 @@ bool KeyFile::Private::read()
 
 bool KeyFile::Private::validateKey(const QByteArray &data, int from, int to, QString &result)
 {
-    int i = from;
+    const char *key = data.constData();
     bool ret = true;
-    while (i < to) {
-        uint ch = data.at(i++);
+    for (int i = from; i < to; ++i) {
+        char ch = key[i];
         // as an extension to the Desktop Entry spec, we allow " ", "_", "." and "@"
         // as valid key characters - "_" and "." are needed for keys that are
         // D-Bus property names, and GKeyFile and KConfigIniBackend also accept
@@ -218,12 +309,29 @@ bool KeyFile::Private::validateKey(const QByteArray &data, int from, int to, QSt
               (ch == '-') || (ch == '_') ||
               (ch == '.') || (ch == '@'))) {
             ret = false;
+            break;
         }
-        result += ch;
     }
+    result = QString::fromLatin1(key + from, to - from);
     return ret;
 }
 
+bool KeyFile::Private::findValue(const QString &key, Value &result) const
+{
+    QHash<QString, Group>::const_iterator itrGroup = groups.constFind(currentGroup);
+    if (itrGroup == groups.constEnd()) {
+        return false;
+    }
+
+    Group::const_iterator itrValue = itrGroup.value().constFind(key);
+    if (itrValue == itrGroup.value().constEnd()) {
+        return false;
+    }
+
+    result = itrValue.value();
+    return true;
+}
+
 QStringList KeyFile::Private::allGroups() const
 {
     return groups.keys();
@@ -232,7 +340,7 @@ QStringList KeyFile::Private::allGroups() const
 QStringList KeyFile::Private::allKeys() const
 {
     QStringList keys;
-    QHash<QString, QHash<QString, QByteArray> >::const_iterator itrGroups = groups.begin();
+    QHash<QString, Group>::const_iterator itrGroups = groups.begin();
     while (itrGroups != groups.end()) {
         keys << itrGroups.value().keys();
         ++itrGroups;
@@ -242,29 +350,34 @@ QStringList KeyFile::Private::allKeys() const
 
 QStringList KeyFile::Private::keys() const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
-    return groupMap.keys();
+    return groups.value(currentGroup).keys();
 }
 
 bool KeyFile::Private::contains(const QString &key) const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
-    return groupMap.contains(key);
+    Value rawValue;
+    return findValue(key, rawValue);
 }
 
 QString KeyFile::Private::rawValue(const QString &key) const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
-    QByteArray rawValue = groupMap.value(key);
-    return QLatin1String(rawValue);
+    Value rawValue;
+    if (!findValue(key, rawValue)) {
+        return QString();
+    }
+    return QString::fromLatin1(buffer->data.constData() + rawValue.from,
+            rawValue.to - rawValue.from);
 }
 
 QString KeyFile::Private::value(const QString &key) const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
+    Value rawValue;
     QString result;
-    QByteArray rawValue = groupMap.value(key);
-    if (unescapeString(rawValue, 0, rawValue.size(), result)) {
+    if (!findValue(key, rawValue)) {
+        return result;
+    }
+
+    if (unescapeString(buffer->data, rawValue.from, rawValue.to, result)) {
         return result;
     }
     return QString();
@@ -272,10 +385,13 @@ QString KeyFile::Private::value(const QString &key) const
 
 QStringList KeyFile::Private::valueAsStringList(const QString &key) const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
+    Value rawValue;
     QStringList result;
-    QByteArray rawValue = groupMap.value(key);
-    if (unescapeStringList(rawValue, 0, rawValue.size(), result)) {
+    if (!findValue(key, rawValue)) {
+        return result;
+    }
+
+    if (unescapeStringList(buffer->data, rawValue.from, rawValue.to, result)) {
         return result;
     }
     return QStringList();
@@ -322,6 +438,7 @@ KeyFile::KeyFile(const KeyFile &other)
 {
     mPriv->fileName = other.mPriv->fileName;
     mPriv->status = other.mPriv->status;
+    mPriv->buffer = other.mPriv->buffer;
     mPriv->groups = other.mPriv->groups;
     mPriv->currentGroup = other.mPriv->currentGroup;
 }
@@ -338,6 +455,7 @@ KeyFile &KeyFile::operator=(const KeyFile &other)
 {
     mPriv->fileName = other.mPriv->fileName;
     mPriv->status = other.mPriv->status;
+    mPriv->buffer = other.mPriv->buffer;
     mPriv->groups = other.mPriv->groups;
     mPriv->currentGroup = other.mPriv->currentGroup;
     return *this;
@@ -494,6 +612,10 @@ QStringList KeyFile::valueAsStringList(const QString &key) const
 
 bool KeyFile::unescapeString(const QByteArray &data, int from, int to, QString &result)
 {
+    if (to > from) {
+        result.reserve(result.size() + to - from);
+    }
+
     int i = from;
     while (i < to) {
         uint ch = data.at(i++);
@@ -537,41 +659,35 @@ bool KeyFile::unescapeString(const QByteArray &data, int from, int to, QString &
 
 bool KeyFile::unescapeStringList(const QByteArray &data, int from, int to, QStringList &result)
 {
-    QByteArray value;
-    QList<QByteArray> valueList;
+    // Elements are unescaped straight from data, a trailing ';' does not start a new one
+    int elementFrom = from;
     int i = from;
     char ch;
     while (i < to) {
         ch = data.at(i++);
 
         if (ch == '\\') {
-            value += ch;
             if (i < to) {
-                value += data.at(i++);
+                ++i;
                 continue;
             } else {
-                valueList << value;
+                if (!appendUnescaped(data, elementFrom, to, result)) {
+                    return false;
+                }
                 break;
             }
         } else if (ch == ';') {
-            valueList << value;
-            value = "";
-        } else {
-            value += ch;
-            if (i == to) {
-                valueList << value;
+            if (!appendUnescaped(data, elementFrom, i - 1, result)) {
+                return false;
+            }
+            elementFrom = i;
+        } else if (i == to) {
+            if (!appendUnescaped(data, elementFrom, to, result)) {
+                return false;
             }
         }
     }
 
-    foreach (value, valueList) {
-        QString str;
-        if (!unescapeString(value, 0, value.size(), str)) {
-            return false;
-        }
-        result << str;
-    }
-
     return true;
 }
 
@@ -24,6 +24,7 @@
 
 #include "TelepathyQt/debug-internal.h"
 #include "TelepathyQt/key-file.h"
+#include "TelepathyQt/parsed-file-cache.h"
 
 #include <TelepathyQt/Constants>
 #include <TelepathyQt/Utils>
@@ -44,6 +45,8 @@ struct TP_QT_NO_EXPORT ManagerFile::Private
 
     void init();
     bool parse(const QString &fileName);
+    bool loadFromCache(const QString &fileName);
+    void storeToCache(const QString &fileName) const;
     bool isValid() const;
 
     bool hasParameter(const QString &protocol, const QString &paramName) const;
@@ -119,12 +122,19 @@ void ManagerFile::Private::init()
     foreach (const QString configDir, configDirs) {
         QString fileName = configDir + cmName + QLatin1String(".manager");
         if (QFile::exists(fileName)) {
-            debug() << "parsing manager file" << fileName;
             protocolsMap.clear();
+            if (loadFromCache(fileName)) {
+                valid = true;
+                return;
+            }
+
+            // A failed cache load leaves protocolsMap empty
+            debug() << "parsing manager file" << fileName;
             if (!parse(fileName)) {
                 warning() << "error parsing manager file" << fileName;
                 continue;
             }
+            storeToCache(fileName);
             valid = true;
             return;
         }
@@ -324,9 +334,132 @@ bool ManagerFile::Private::parse(const QString &fileName)
     return true;
 }
 
+// Bump when the layout written by storeToCache() changes
+static const quint32 c_managerFileCacheVersion = 1;
+
+bool ManagerFile::Private::loadFromCache(const QString &fileName)
+{
+    ParsedFileCache::Reader reader(QLatin1String("managers"), c_managerFileCacheVersion, fileName);
+    if (!reader.isValid()) {
+        return false;
+    }
+
+    QDataStream &in = reader.stream();
+
+    quint32 protocolsCount;
+    in >> protocolsCount;
+    for (quint32 i = 0; i < protocolsCount && in.status() == QDataStream::Ok; ++i) {
+        QString protocol;
+        ProtocolInfo info;
+        in >> protocol;
+
+        quint32 count;
+        in >> count;
+        for (quint32 j = 0; j < count && in.status() == QDataStream::Ok; ++j) {
+            ParamSpec spec;
+            QVariant defaultValue;
+            in >> spec.name >> spec.flags >> spec.signature >> defaultValue;
+            if (spec.flags & ConnMgrParamFlagHasDefault) {
+                spec.defaultValue = QDBusVariant(defaultValue);
+            }
+            info.params.append(spec);
+        }
+
+        in >> info.vcardField >> info.englishName >> info.iconName;
+
+        in >> count;
+        for (quint32 j = 0; j < count && in.status() == QDataStream::Ok; ++j) {
+            RequestableChannelClass rcc;
+            in >> rcc.fixedProperties >> rcc.allowedProperties;
+            info.rccs.append(rcc);
+        }
+
+        in >> count;
+        for (quint32 j = 0; j < count && in.status() == QDataStream::Ok; ++j) {
+            QString status;
+            SimpleStatusSpec spec;
+            in >> status >> spec.type >> spec.maySetOnSelf >> spec.canHaveMessage;
+            info.statuses.append(PresenceSpec(status, spec));
+        }
+
+        QStringList supportedMimeTypes;
+        uint minHeight, maxHeight, recommendedHeight;
+        uint minWidth, maxWidth, recommendedWidth;
+        uint maxBytes;
+        in >> supportedMimeTypes >> minHeight >> maxHeight >> recommendedHeight >>
+            minWidth >> maxWidth >> recommendedWidth >> maxBytes;
+        info.avatarRequirements = AvatarSpec(supportedMimeTypes,
+                minHeight, maxHeight, recommendedHeight,
+                minWidth, maxWidth, recommendedWidth,
+                maxBytes);
+
+        in >> info.addressableVCardFields >> info.addressableUriSchemes;
+
+        protocolsMap.insert(protocol, info);
+    }
+
+    if (!reader.atEnd()) {
+        warning() << "Corrupted cache entry for manager file" << fileName;
+        protocolsMap.clear();
+        return false;
+    }
+
+    debug() << "Loaded manager file" << fileName << "from cache";
+    reader.setUsed();
+    return true;
+}
+
+void ManagerFile::Private::storeToCache(const QString &fileName) const
+{
+    if (!ParsedFileCache::isEnabled()) {
+        return;
+    }
+
+    ParsedFileCache::Writer writer(QLatin1String("managers"), c_managerFileCacheVersion, fileName);
+    QDataStream &out = writer.stream();
+
+    out << quint32(protocolsMap.size());
+    for (QHash<QString, ProtocolInfo>::const_iterator i = protocolsMap.constBegin();
+            i != protocolsMap.constEnd(); ++i) {
+        const ProtocolInfo &info = i.value();
+        out << i.key();
+
+        out << quint32(info.params.size());
+        foreach (const ParamSpec &spec, info.params) {
+            out << spec.name << spec.flags << spec.signature << spec.defaultValue.variant();
+        }
+
+        out << info.vcardField << info.englishName << info.iconName;
+
+        out << quint32(info.rccs.size());
+        foreach (const RequestableChannelClass &rcc, info.rccs) {
+            out << rcc.fixedProperties << rcc.allowedProperties;
+        }
+
+        out << quint32(info.statuses.size());
+        foreach (const PresenceSpec &spec, info.statuses) {
+            SimpleStatusSpec bareSpec = spec.bareSpec();
+            out << spec.presence().status() << bareSpec.type << bareSpec.maySetOnSelf <<
+                bareSpec.canHaveMessage;
+        }
+
+        const AvatarSpec &avatar = info.avatarRequirements;
+        out << avatar.supportedMimeTypes() << avatar.minimumHeight() << avatar.maximumHeight() <<
+            avatar.recommendedHeight() << avatar.minimumWidth() << avatar.maximumWidth() <<
+            avatar.recommendedWidth() << avatar.maximumBytes();
+
+        out << info.addressableVCardFields << info.addressableUriSchemes;
+    }
+
+    if (!writer.commit()) {
+        debug() << "Unable to cache manager file" << fileName;
+    }
+}
+
 bool ManagerFile::Private::isValid() const
 {
-    return ((keyFile.status() == KeyFile::NoError) && (valid));
+    // A manager file loaded from the cache has no key file
+    return valid;
 }
 
 bool ManagerFile::Private::hasParameter(const QString &protocol,
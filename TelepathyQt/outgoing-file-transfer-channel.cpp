@@ -32,14 +32,14 @@
 #include <TelepathyQt/Types>
 #include <TelepathyQt/types-internal.h>
 
+#include "TelepathyQt/sendfile-internal.h"
+
 #include <QIODevice>
 #include <QTcpSocket>
 
 namespace Tp
 {
 
-static const int FT_BLOCK_SIZE = 16 * 1024;
-
 struct TP_QT_NO_EXPORT OutgoingFileTransferChannel::Private
 {
     Private(OutgoingFileTransferChannel *parent);
@@ -57,6 +57,10 @@ struct TP_QT_NO_EXPORT OutgoingFileTransferChannel::Private
 
     qint64 pos;
     bool weOpenedDevice;
+    bool zeroCopyFailed;
+
+    // Reused between reads, never bigger than the transfer window
+    QByteArray buffer;
 };
 
 OutgoingFileTransferChannel::Private::Private(OutgoingFileTransferChannel *parent)
@@ -65,7 +69,8 @@ OutgoingFileTransferChannel::Private::Private(OutgoingFileTransferChannel *paren
       input(0),
       socket(0),
       pos(0),
-      weOpenedDevice(false)
+      weOpenedDevice(false),
+      zeroCopyFailed(false)
 {
 }
 
@@ -301,49 +306,71 @@ void OutgoingFileTransferChannel::onInputAboutToClose()
 
 void OutgoingFileTransferChannel::doTransfer()
 {
-    // read FT_BLOCK_SIZE each time, as input can be a QFile, we don't want to
-    // block reading the whole file
-    char buffer[FT_BLOCK_SIZE];
-    char *p = buffer;
-
-    memset(buffer, 0, sizeof(buffer));
-    qint64 len = mPriv->input->read(buffer, sizeof(buffer));
-
-    bool scheduleTransfer = false;
-    if (((qulonglong) mPriv->pos < initialOffset()) && (len > 0)) {
-        qint64 skip = (qint64) qMin(initialOffset() - mPriv->pos,
-                (qulonglong) len);
-
-        mPriv->pos += skip;
-        debug() << "skipping" << skip << "bytes";
-        if (skip == len) {
-            // nothing to write, all data read was skipped
-            // schedule a transfer, as readyRead may never be called and
-            // bytesWriiten will not
-            scheduleTransfer = true;
-            goto end;
-        }
-
-        p += skip;
-        len -= skip;
+    if (isFinished()) {
+        return;
     }
 
-    if (len > 0) {
-        mPriv->socket->write(p, len); // never fails
+    const qint64 window = transferWindowSize();
+    if (mPriv->buffer.size() != window) {
+        mPriv->buffer.resize(window);
     }
 
-end:
-    if (len == -1 || (!mPriv->input->isSequential() && mPriv->input->atEnd())) {
-        // error or EOF
-        setFinished();
-        return;
-    }
+    // only read while the socket has room in the transfer window, as input can
+    // be a QFile, we don't want to read the whole file into memory.
+    // bytesWritten() resumes the transfer
+    qint64 room;
+    while ((room = window - mPriv->socket->bytesToWrite()) > 0) {
+        bool socketFull = false;
+
+        if (!mPriv->zeroCopyFailed && (qulonglong) mPriv->pos >= initialOffset()) {
+            qint64 sent = sendFileToSocket(mPriv->input, mPriv->socket, window,
+                    &mPriv->zeroCopyFailed);
+            if (mPriv->zeroCopyFailed) {
+                debug() << "sendfile() failed, falling back to buffered transfer";
+            }
+            if (sent > 0) {
+                mPriv->pos += sent;
+                if (mPriv->input->atEnd()) {
+                    setFinished();
+                    return;
+                }
+                continue;
+            }
+
+            // the data sent directly does not emit bytesWritten(), so write a
+            // block through the socket to be notified when there is room again
+            socketFull = (sent == 0);
+        }
 
-    mPriv->pos += len;
+        qint64 len = mPriv->input->read(mPriv->buffer.data(), room);
+        if (len == -1) {
+            // error
+            setFinished();
+            return;
+        }
+
+        qint64 skip = 0;
+        if ((qulonglong) mPriv->pos < initialOffset()) {
+            skip = (qint64) qMin(initialOffset() - mPriv->pos, (qulonglong) len);
+            debug() << "skipping" << skip << "bytes";
+        }
+
+        if (len > skip) {
+            mPriv->socket->write(mPriv->buffer.constData() + skip, len - skip); // never fails
+        }
 
-    if (scheduleTransfer) {
-        QMetaObject::invokeMethod(this, SLOT(doTransfer()),
-                Qt::QueuedConnection);
+        mPriv->pos += len;
+
+        if (!mPriv->input->isSequential() && mPriv->input->atEnd()) {
+            // EOF
+            setFinished();
+            return;
+        }
+
+        if (len == 0 || socketFull) {
+            // wait for readyRead() or bytesWritten()
+            break;
+        }
     }
 }
 
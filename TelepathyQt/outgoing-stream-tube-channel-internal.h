@@ -28,6 +28,7 @@
 namespace Tp
 {
 
+class PendingContacts;
 class PendingVoid;
 
 class TP_QT_NO_EXPORT PendingOpenTube : public PendingOperation
@@ -76,9 +77,23 @@ private:
         UIntList handles;
     };
 
-    bool m_isProcessing;
+    // The requests queued during one main loop iteration, retrieved with a single lookup
+    struct Batch {
+        Batch() : pendingContacts(0), finished(false) {}
+
+        QList<Entry> entries;
+        PendingContacts *pendingContacts;
+        bool finished;
+        QHash<uint, ContactPtr> contacts;
+    };
+
+    void deliverFinishedBatches();
+
+    bool m_processScheduled;
     ContactManagerPtr m_manager;
     QQueue<Entry> m_queue;
+    // Batches being retrieved, their results are delivered in this order
+    QQueue<Batch> m_batches;
 };
 
 struct TP_QT_NO_EXPORT PendingOpenTube::Private
@@ -96,12 +111,19 @@ struct TP_QT_NO_EXPORT OutgoingStreamTubeChannel::Private
 {
     Private(OutgoingStreamTubeChannel *parent);
 
+    bool checkConnectionMonitoring(const char *method) const;
+    void unindexConnection(uint connectionId);
+
     OutgoingStreamTubeChannel *parent;
 
     QHash<uint, Tp::ContactPtr> contactsForConnections;
     QHash<QPair<QHostAddress, quint16>, uint> connectionsForSourceAddresses;
     QHash<uchar, uint> connectionsForCredentials;
 
+    // Reverse indexes, so that closed connections can be dropped without scanning the above
+    QHash<uint, QPair<QHostAddress, quint16> > sourceAddressesForConnections;
+    QHash<uint, uchar> credentialsForConnections;
+
     QHash<QUuid, QPair<uint, QDBusVariant> > pendingNewConnections;
 
     struct ClosedConnection {
@@ -29,6 +29,7 @@
 #include "TelepathyQt/types-internal.h"
 
 #include <TelepathyQt/Connection>
+#include <TelepathyQt/Contact>
 #include <TelepathyQt/ContactManager>
 #include <TelepathyQt/PendingContacts>
 #include <TelepathyQt/PendingFailure>
@@ -118,7 +119,7 @@ void PendingOpenTube::onTubeStateChanged(TubeChannelState state)
 
 QueuedContactFactory::QueuedContactFactory(Tp::ContactManagerPtr contactManager, QObject* parent)
     : QObject(parent),
-      m_isProcessing(false),
+      m_processScheduled(false),
       m_manager(contactManager)
 {
 }
@@ -129,27 +130,65 @@ QueuedContactFactory::~QueuedContactFactory()
 
 void QueuedContactFactory::processNextRequest()
 {
-    if (m_isProcessing) {
-        // Return, nothing to do
-        return;
-    }
+    m_processScheduled = false;
+
+    if (!m_queue.isEmpty()) {
+        // Retrieve the contacts for everything queued so far at once, without waiting for the
+        // batches already in flight
+        Batch batch;
+        batch.entries = m_queue;
+        m_queue.clear();
+
+        UIntList handles;
+        QSet<uint> seenHandles;
+        foreach (const Entry &entry, batch.entries) {
+            foreach (uint handle, entry.handles) {
+                if (!seenHandles.contains(handle)) {
+                    seenHandles.insert(handle);
+                    handles << handle;
+                }
+            }
+        }
 
-    if (m_queue.isEmpty()) {
-        // Queue completed, notify and return
-        emit queueCompleted();
-        return;
+        if (handles.isEmpty()) {
+            // Only fake requests for ordering, nothing to retrieve
+            batch.finished = true;
+        } else {
+            // TODO: pass id hints to ContactManager if we ever gain support to retrieve contact
+            //       ids from NewRemoteConnection.
+            batch.pendingContacts = m_manager->contactsForHandles(handles);
+            connect(batch.pendingContacts, SIGNAL(finished(Tp::PendingOperation*)),
+                    this, SLOT(onPendingContactsFinished(Tp::PendingOperation*)));
+        }
+
+        m_batches.enqueue(batch);
     }
 
-    m_isProcessing = true;
+    deliverFinishedBatches();
+}
 
-    Entry entry = m_queue.dequeue();
+void QueuedContactFactory::deliverFinishedBatches()
+{
+    while (!m_batches.isEmpty() && m_batches.head().finished) {
+        Batch batch = m_batches.dequeue();
+
+        foreach (const Entry &entry, batch.entries) {
+            QList<ContactPtr> contacts;
+            foreach (uint handle, entry.handles) {
+                ContactPtr contact = batch.contacts.value(handle);
+                if (contact) {
+                    contacts << contact;
+                }
+            }
 
-    // TODO: pass id hints to ContactManager if we ever gain support to retrieve contact ids
-    //       from NewRemoteConnection.
-    PendingContacts *pc = m_manager->contactsForHandles(entry.handles);
-    pc->setProperty("__TpQt__QueuedContactFactoryUuid", entry.uuid.toString());
-    connect(pc, SIGNAL(finished(Tp::PendingOperation*)),
-            this, SLOT(onPendingContactsFinished(Tp::PendingOperation*)));
+            emit contactsRetrieved(entry.uuid, contacts);
+        }
+    }
+
+    if (m_batches.isEmpty() && m_queue.isEmpty()) {
+        // Queue completed, notify
+        emit queueCompleted();
+    }
 }
 
 QUuid QueuedContactFactory::appendNewRequest(const Tp::UIntList &handles)
@@ -160,8 +199,12 @@ QUuid QueuedContactFactory::appendNewRequest(const Tp::UIntList &handles)
     entry.handles = handles;
     m_queue.enqueue(entry);
 
-    // Enqueue a process request in the event loop
-    QTimer::singleShot(0, this, SLOT(processNextRequest()));
+    // Enqueue a process request in the event loop, the requests appended until then are
+    // processed together
+    if (!m_processScheduled) {
+        m_processScheduled = true;
+        QTimer::singleShot(0, this, SLOT(processNextRequest()));
+    }
 
     // Return the UUID
     return entry.uuid;
@@ -171,15 +214,26 @@ void QueuedContactFactory::onPendingContactsFinished(PendingOperation *op)
 {
     PendingContacts *pc = qobject_cast<PendingContacts*>(op);
 
-    QUuid uuid = QUuid(pc->property("__TpQt__QueuedContactFactoryUuid").toString());
-
-    emit contactsRetrieved(uuid, pc->contacts());
+    for (QQueue<Batch>::iterator i = m_batches.begin(); i != m_batches.end(); ++i) {
+        if (i->pendingContacts != pc) {
+            continue;
+        }
 
-    // No longer processing
-    m_isProcessing = false;
+        i->finished = true;
+        i->pendingContacts = 0;
+        if (!pc->isError()) {
+            foreach (const ContactPtr &contact, pc->contacts()) {
+                i->contacts.insert(contact->handle()[0], contact);
+            }
+        } else {
+            warning().nospace() << "Retrieving contacts for queued requests failed with " <<
+                pc->errorName() << ": " << pc->errorMessage();
+        }
+        break;
+    }
 
-    // Go for next one
-    processNextRequest();
+    // Deliver this batch and the ones which finished while waiting for it
+    deliverFinishedBatches();
 }
 
 OutgoingStreamTubeChannel::Private::Private(OutgoingStreamTubeChannel *parent)
@@ -188,6 +242,60 @@ OutgoingStreamTubeChannel::Private::Private(OutgoingStreamTubeChannel *parent)
 {
 }
 
+bool OutgoingStreamTubeChannel::Private::checkConnectionMonitoring(const char *method) const
+{
+    if (parent->isValid() || !parent->isDroppingConnections() ||
+            !parent->requestedFeatures().contains(StreamTubeChannel::FeatureConnectionMonitoring)) {
+        if (!parent->isReady(StreamTubeChannel::FeatureConnectionMonitoring)) {
+            warning() << "StreamTubeChannel::FeatureConnectionMonitoring must be ready before "
+                "calling OutgoingStreamTubeChannel::" << method;
+            return false;
+        }
+
+        if (parent->state() != TubeChannelStateOpen) {
+            warning() << "OutgoingStreamTubeChannel::" << method << "makes sense "
+                "just when the tube is open";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void OutgoingStreamTubeChannel::Private::unindexConnection(uint connectionId)
+{
+    contactsForConnections.remove(connectionId);
+
+    QHash<uint, QPair<QHostAddress, quint16> >::iterator srcAddrIter =
+        sourceAddressesForConnections.find(connectionId);
+    if (srcAddrIter != sourceAddressesForConnections.end()) {
+        // Only the connections sharing the same source address need to be looked at
+        QHash<QPair<QHostAddress, quint16>, uint>::iterator i =
+            connectionsForSourceAddresses.find(srcAddrIter.value());
+        while (i != connectionsForSourceAddresses.end() && i.key() == srcAddrIter.value()) {
+            if (i.value() == connectionId) {
+                i = connectionsForSourceAddresses.erase(i);
+            } else {
+                ++i;
+            }
+        }
+        sourceAddressesForConnections.erase(srcAddrIter);
+    }
+
+    QHash<uint, uchar>::iterator credIter = credentialsForConnections.find(connectionId);
+    if (credIter != credentialsForConnections.end()) {
+        QHash<uchar, uint>::iterator i = connectionsForCredentials.find(credIter.value());
+        while (i != connectionsForCredentials.end() && i.key() == credIter.value()) {
+            if (i.value() == connectionId) {
+                i = connectionsForCredentials.erase(i);
+            } else {
+                ++i;
+            }
+        }
+        credentialsForConnections.erase(credIter);
+    }
+}
+
 /**
  * \class OutgoingStreamTubeChannel
  * \ingroup clientchannel
@@ -637,6 +745,37 @@ QHash<QPair<QHostAddress, quint16>, uint> OutgoingStreamTubeChannel::connections
     return mPriv->connectionsForSourceAddresses;
 }
 
+/**
+ * Return the source address of the connection with the given id.
+ *
+ * Unlike connectionsForSourceAddresses(), this doesn't copy the whole map, which makes it the
+ * preferred way to handle a single connection, for example in a slot connected to
+ * StreamTubeChannel::newConnection() or StreamTubeChannel::connectionClosed().
+ *
+ * The same restrictions as for connectionsForSourceAddresses() apply.
+ *
+ * \param connectionId The connection id.
+ * \return The source address as a (QHostAddress, port in native byte order) pair, or a pair with
+ *     a null address if it is not known.
+ * \sa contactForConnection()
+ */
+QPair<QHostAddress, quint16> OutgoingStreamTubeChannel::sourceAddressForConnection(
+        uint connectionId) const
+{
+    if (addressType() != SocketAddressTypeIPv4 && addressType() != SocketAddressTypeIPv6) {
+        warning() << "OutgoingStreamTubeChannel::sourceAddressForConnection() makes sense "
+                "just when offering a TCP socket";
+        return qMakePair(QHostAddress(), quint16(0));
+    }
+
+    if (!mPriv->checkConnectionMonitoring("sourceAddressForConnection()")) {
+        return qMakePair(QHostAddress(), quint16(0));
+    }
+
+    return mPriv->sourceAddressesForConnections.value(connectionId,
+            qMakePair(QHostAddress(), quint16(0)));
+}
+
 /**
  * Return a map from a credential byte to the corresponding connections ids.
  *
@@ -717,6 +856,26 @@ QHash<uint, ContactPtr> OutgoingStreamTubeChannel::contactsForConnections() cons
     return mPriv->contactsForConnections;
 }
 
+/**
+ * Return the contact associated with the connection with the given id.
+ *
+ * Unlike contactsForConnections(), this doesn't copy the whole map.
+ *
+ * The same restrictions as for contactsForConnections() apply.
+ *
+ * \param connectionId The connection id.
+ * \return A pointer to the Contact object, or a null ContactPtr if it is not known.
+ * \sa sourceAddressForConnection()
+ */
+ContactPtr OutgoingStreamTubeChannel::contactForConnection(uint connectionId) const
+{
+    if (!mPriv->checkConnectionMonitoring("contactForConnection()")) {
+        return ContactPtr();
+    }
+
+    return mPriv->contactsForConnections.value(connectionId);
+}
+
 void OutgoingStreamTubeChannel::onNewRemoteConnection(
         uint contactId,
         const QDBusVariant &parameter,
@@ -748,26 +907,7 @@ void OutgoingStreamTubeChannel::onContactsRetrieved(
             removeConnection(conn.id, conn.error, conn.message);
 
             // Remove stuff from our hashes
-            mPriv->contactsForConnections.remove(conn.id);
-
-            QHash<QPair<QHostAddress, quint16>, uint>::iterator srcAddrIter =
-                mPriv->connectionsForSourceAddresses.begin();
-            while (srcAddrIter != mPriv->connectionsForSourceAddresses.end()) {
-                if (srcAddrIter.value() == conn.id) {
-                    srcAddrIter = mPriv->connectionsForSourceAddresses.erase(srcAddrIter);
-                } else {
-                    ++srcAddrIter;
-                }
-            }
-
-            QHash<uchar, uint>::iterator credIter = mPriv->connectionsForCredentials.begin();
-            while (credIter != mPriv->connectionsForCredentials.end()) {
-                if (credIter.value() == conn.id) {
-                    credIter = mPriv->connectionsForCredentials.erase(credIter);
-                } else {
-                    ++credIter;
-                }
-            }
+            mPriv->unindexConnection(conn.id);
         } else {
             warning() << "No pending connections found in OSTC" << objectPath() << "for contacts"
                 << contacts;
@@ -805,12 +945,14 @@ void OutgoingStreamTubeChannel::onContactsRetrieved(
         if (accessControl() == SocketAccessControlCredentials) {
             uchar credentialByte = qdbus_cast<uchar>(connectionProperties.second.variant());
             mPriv->connectionsForCredentials.insertMulti(credentialByte, connectionProperties.first);
+            mPriv->credentialsForConnections.insert(connectionProperties.first, credentialByte);
         }
     }
 
     if (address.first != QHostAddress::Null) {
         // We can map it to a source address as well
         mPriv->connectionsForSourceAddresses.insertMulti(address, connectionProperties.first);
+        mPriv->sourceAddressesForConnections.insert(connectionProperties.first, address);
     }
 
     // Time for us to emit the signal
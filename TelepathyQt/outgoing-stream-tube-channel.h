@@ -60,8 +60,10 @@ public:
             const QVariantMap &parameters = QVariantMap(), bool requireCredentials = false);
 
     QHash<uint, Tp::ContactPtr> contactsForConnections() const;
+    Tp::ContactPtr contactForConnection(uint connectionId) const;
 
     QHash<QPair<QHostAddress,quint16>, uint> connectionsForSourceAddresses() const;
+    QPair<QHostAddress, quint16> sourceAddressForConnection(uint connectionId) const;
     QHash<uchar, uint> connectionsForCredentials() const;
 
 protected:
@@ -0,0 +1,219 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/parsed-file-cache.h"
+
+#include "TelepathyQt/debug-internal.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+
+#include <QAtomicInt>
+
+namespace Tp
+{
+
+namespace
+{
+
+// "TPQC"
+const quint32 c_magic = 0x54505143;
+// Bump when the header layout changes, the callers version their own payload
+const quint32 c_formatVersion = 1;
+
+QAtomicInt s_hits;
+QAtomicInt s_misses;
+
+}
+
+ParsedFileCache::Reader::Reader(const QString &category, quint32 version,
+        const QString &fileName)
+    : mFile(ParsedFileCache::cacheFileName(category, fileName)),
+      mData(0),
+      mValid(false),
+      mUsed(false)
+{
+    if (!ParsedFileCache::isEnabled() || !mFile.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    // Map the entry rather than reading it, the payload is deserialized in place
+    mData = mFile.map(0, mFile.size());
+    if (mData) {
+        mBuffer = QByteArray::fromRawData(reinterpret_cast<const char *>(mData), mFile.size());
+    } else {
+        mBuffer = mFile.readAll();
+    }
+
+    mDevice.setBuffer(&mBuffer);
+    mDevice.open(QIODevice::ReadOnly);
+    mStream.setDevice(&mDevice);
+    mStream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic = 0;
+    quint32 formatVersion = 0;
+    quint32 entryVersion = 0;
+    QString sourceFileName;
+    qint64 mtime = -1;
+    qint64 size = -1;
+    mStream >> magic >> formatVersion >> entryVersion >> sourceFileName >> mtime >> size;
+
+    qint64 currentMtime;
+    qint64 currentSize;
+    mValid = mStream.status() == QDataStream::Ok &&
+        magic == c_magic &&
+        formatVersion == c_formatVersion &&
+        entryVersion == version &&
+        sourceFileName == QFileInfo(fileName).absoluteFilePath() &&
+        ParsedFileCache::fileStamp(fileName, currentMtime, currentSize) &&
+        mtime == currentMtime &&
+        size == currentSize;
+
+    if (!mValid) {
+        debug() << "Ignoring stale or invalid cache entry" << mFile.fileName() <<
+            "for" << fileName;
+    }
+}
+
+ParsedFileCache::Reader::~Reader()
+{
+    if (ParsedFileCache::isEnabled()) {
+        if (mUsed) {
+            s_hits.ref();
+        } else {
+            s_misses.ref();
+        }
+    }
+
+    mStream.setDevice(0);
+    mDevice.close();
+    mBuffer.clear();
+
+    if (mData) {
+        mFile.unmap(mData);
+    }
+}
+
+bool ParsedFileCache::Reader::atEnd() const
+{
+    return mStream.status() == QDataStream::Ok && mStream.atEnd();
+}
+
+ParsedFileCache::Writer::Writer(const QString &category, quint32 version,
+        const QString &fileName)
+    : mCacheFileName(ParsedFileCache::cacheFileName(category, fileName)),
+      mStream(&mBuffer, QIODevice::WriteOnly)
+{
+    mStream.setVersion(QDataStream::Qt_4_6);
+
+    qint64 mtime = -1;
+    qint64 size = -1;
+    ParsedFileCache::fileStamp(fileName, mtime, size);
+
+    mStream << c_magic << c_formatVersion << version <<
+        QFileInfo(fileName).absoluteFilePath() << mtime << size;
+}
+
+bool ParsedFileCache::Writer::commit()
+{
+    if (!ParsedFileCache::isEnabled() || mStream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    QFileInfo fi(mCacheFileName);
+    if (!QDir().mkpath(fi.absolutePath())) {
+        warning() << "Unable to create cache directory" << fi.absolutePath();
+        return false;
+    }
+
+    // Write a temporary file and rename it, so concurrent readers never see a partial entry
+    QFile file(QString(QLatin1String("%1.%2.tmp")).arg(mCacheFileName)
+            .arg(QCoreApplication::applicationPid()));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        warning() << "Unable to write cache entry" << file.fileName();
+        return false;
+    }
+
+    if (file.write(mBuffer) != mBuffer.size()) {
+        warning() << "Unable to write cache entry" << file.fileName();
+        file.remove();
+        return false;
+    }
+    file.close();
+
+    QFile::remove(mCacheFileName);
+    if (!file.rename(mCacheFileName)) {
+        file.remove();
+        return false;
+    }
+
+    return true;
+}
+
+bool ParsedFileCache::isEnabled()
+{
+    return qgetenv("TP_QT_DISABLE_PARSED_FILE_CACHE").isEmpty();
+}
+
+QString ParsedFileCache::cacheFileName(const QString &category, const QString &fileName)
+{
+    QString cacheDir = QString(QLatin1String(qgetenv("XDG_CACHE_HOME")));
+    if (cacheDir.isEmpty()) {
+        cacheDir = QString(QLatin1String("%1/.cache")).arg(QLatin1String(qgetenv("HOME")));
+    }
+
+    QByteArray hash = QCryptographicHash::hash(QFileInfo(fileName).absoluteFilePath().toUtf8(),
+            QCryptographicHash::Md5).toHex();
+    return QString(QLatin1String("%1/telepathy/qt/%2/%3")).
+        arg(cacheDir).arg(category).arg(QLatin1String(hash));
+}
+
+int ParsedFileCache::hitCount()
+{
+    return s_hits.fetchAndAddRelaxed(0);
+}
+
+int ParsedFileCache::missCount()
+{
+    return s_misses.fetchAndAddRelaxed(0);
+}
+
+bool ParsedFileCache::fileStamp(const QString &fileName, qint64 &mtime, qint64 &size)
+{
+    QFileInfo fi(fileName);
+    if (!fi.exists()) {
+        return false;
+    }
+
+    QDateTime lastModified = fi.lastModified();
+#if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
+    mtime = lastModified.toMSecsSinceEpoch();
+#else
+    mtime = qint64(lastModified.toTime_t()) * 1000 + lastModified.time().msec();
+#endif
+    size = fi.size();
+    return true;
+}
+
+} // Tp
@@ -0,0 +1,106 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_parsed_file_cache_h_HEADER_GUARD_
+#define _TelepathyQt_parsed_file_cache_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+#include <QString>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+namespace Tp
+{
+
+// Binary cache of the data parsed from a configuration file (.manager, .profile), stored
+// under $XDG_CACHE_HOME and only used as long as the file keeps the same size and mtime.
+//
+// Exported so the tests can check whether the cache is hit even if they link dynamically
+// The header is not installed though, so this should be considered private API
+class TP_QT_EXPORT ParsedFileCache
+{
+public:
+    // Maps the cache entry for fileName, stream() is only usable if isValid()
+    class TP_QT_EXPORT Reader
+    {
+    public:
+        Reader(const QString &category, quint32 version, const QString &fileName);
+        ~Reader();
+
+        bool isValid() const { return mValid; }
+        QDataStream &stream() { return mStream; }
+
+        // Whether the whole entry was read without errors
+        bool atEnd() const;
+
+        // Called once the entry has been loaded, a reader destroyed without it counts as a miss
+        void setUsed() { mUsed = true; }
+
+    private:
+        Q_DISABLE_COPY(Reader)
+
+        QFile mFile;
+        uchar *mData;
+        QByteArray mBuffer;
+        QBuffer mDevice;
+        QDataStream mStream;
+        bool mValid;
+        bool mUsed;
+    };
+
+    class TP_QT_EXPORT Writer
+    {
+    public:
+        Writer(const QString &category, quint32 version, const QString &fileName);
+
+        QDataStream &stream() { return mStream; }
+
+        bool commit();
+
+    private:
+        Q_DISABLE_COPY(Writer)
+
+        QString mCacheFileName;
+        QByteArray mBuffer;
+        QDataStream mStream;
+    };
+
+    static bool isEnabled();
+    static QString cacheFileName(const QString &category, const QString &fileName);
+
+    // Number of entries loaded from the cache, and of lookups which fell back to parsing
+    static int hitCount();
+    static int missCount();
+
+private:
+    static bool fileStamp(const QString &fileName, qint64 &mtime, qint64 &size);
+};
+
+} // Tp
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+#endif
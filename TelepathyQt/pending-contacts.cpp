@@ -26,6 +26,7 @@
 #include "TelepathyQt/_gen/pending-contacts.moc.hpp"
 #include "TelepathyQt/_gen/pending-contacts-internal.moc.hpp"
 
+#include "TelepathyQt/contact-manager-internal.h"
 #include "TelepathyQt/debug-internal.h"
 
 #include <TelepathyQt/Connection>
@@ -54,7 +55,9 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
           satisfyingContacts(satisfyingContacts),
           requestType(PendingContacts::ForHandles),
           handles(handles),
-          nested(0)
+          nested(0),
+          fetchOffset(0),
+          attributesRequestsInFlight(0)
     {
     }
 
@@ -66,7 +69,9 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
           missingFeatures(features),
           requestType(type),
           addresses(list),
-          nested(0)
+          nested(0),
+          fetchOffset(0),
+          attributesRequestsInFlight(0)
     {
         if (type != PendingContacts::ForIdentifiers &&
             type != PendingContacts::ForUris) {
@@ -83,7 +88,9 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
           requestType(PendingContacts::ForVCardAddresses),
           addresses(vcardAddresses),
           vcardField(vcardField),
-          nested(0)
+          nested(0),
+          fetchOffset(0),
+          attributesRequestsInFlight(0)
     {
     }
 
@@ -95,11 +102,14 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
           features(features),
           requestType(PendingContacts::Upgrade),
           contactsToUpgrade(contactsToUpgrade),
-          nested(0)
+          nested(0),
+          fetchOffset(0),
+          attributesRequestsInFlight(0)
     {
     }
 
     void setFinished();
+    void requestNextAttributes();
 
     bool checkRequestTypeAndState(const char *methodName, const char *debug, RequestType type);
 
@@ -120,6 +130,12 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
     QList<ContactPtr> contactsToUpgrade;
     PendingContacts *nested;
 
+    // Attributes requests, possibly split in chunks
+    QStringList interfaces;
+    UIntList handlesToFetch;
+    int fetchOffset;
+    int attributesRequestsInFlight;
+
     // Results
     QList<ContactPtr> contacts;
     UIntList invalidHandles;
@@ -135,17 +151,38 @@ void PendingContacts::Private::setFinished()
 {
     ConnectionLowlevelPtr connLowlevel = manager->connection()->lowlevel();
     UIntList handles = invalidHandles;
+    invalidHandles.clear();
     foreach (uint handle, handles) {
         if (connLowlevel->hasContactId(handle)) {
             satisfyingContacts.insert(handle, manager->ensureContact(handle,
                         connLowlevel->contactId(handle), missingFeatures));
-            invalidHandles.removeOne(handle);
+        } else {
+            invalidHandles.push_back(handle);
         }
     }
 
     parent->setFinished();
 }
 
+void PendingContacts::Private::requestNextAttributes()
+{
+    int chunkSize = manager->contactAttributesChunkSize();
+    int maxInFlight = manager->maxContactAttributesRequestsInFlight();
+
+    while (fetchOffset < handlesToFetch.size() && attributesRequestsInFlight < maxInFlight) {
+        UIntList chunk = handlesToFetch.mid(fetchOffset, chunkSize > 0 ? chunkSize : -1);
+        fetchOffset += chunk.size();
+        ++attributesRequestsInFlight;
+
+        // Requests are merged with the ones other PendingContacts make in the same main loop
+        // iteration by the ContactManager
+        PendingOperation *attributes = manager->requestContactAttributes(chunk, interfaces);
+        parent->connect(attributes,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(onAttributesFinished(Tp::PendingOperation*)));
+    }
+}
+
 bool PendingContacts::Private::checkRequestTypeAndState(const char *methodName,
         const char *debug,
         RequestType type)
@@ -196,13 +233,18 @@ PendingContacts::PendingContacts(const ContactManagerPtr &manager,
     if (!otherContacts.isEmpty()) {
         ConnectionPtr conn = manager->connection();
         if (conn->interfaces().contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACTS)) {
-            PendingContactAttributes *attributes =
-                conn->lowlevel()->contactAttributes(otherContacts.toList(),
-                        interfaces, true);
+            // Fetch in the order the handles were requested, so contacts delivered
+            // progressively through contactsRetrieved() follow that order
+            QSet<uint> toFetch = otherContacts;
+            foreach (uint handle, handles) {
+                if (toFetch.remove(handle)) {
+                    mPriv->handlesToFetch.push_back(handle);
+                }
+            }
+            mPriv->handlesToFetch.append(toFetch.toList());
 
-            connect(attributes,
-                    SIGNAL(finished(Tp::PendingOperation*)),
-                    SLOT(onAttributesFinished(Tp::PendingOperation*)));
+            mPriv->interfaces = interfaces;
+            mPriv->requestNextAttributes();
         } else {
             // fallback to just create the contacts
             PendingHandles *handles = conn->lowlevel()->referenceHandles(HandleTypeContact,
@@ -300,6 +342,9 @@ PendingContacts::PendingContacts(const ContactManagerPtr &manager,
     }
 
     mPriv->nested = manager->contactsForHandles(handles, features);
+    connect(mPriv->nested,
+            SIGNAL(contactsRetrieved(QList<Tp::ContactPtr>)),
+            SIGNAL(contactsRetrieved(QList<Tp::ContactPtr>)));
     connect(mPriv->nested,
             SIGNAL(finished(Tp::PendingOperation*)),
             SLOT(onNestedFinished(Tp::PendingOperation*)));
@@ -479,10 +524,32 @@ QStringList PendingContacts::invalidUris() const
     return mPriv->invalidAddresses;
 }
 
+/**
+ * \fn void PendingContacts::contactsRetrieved(const QList<Tp::ContactPtr> &contacts)
+ *
+ * Emitted when some of the requested contacts have been built, before the whole
+ * operation has finished.
+ *
+ * Requests for many handles are split in chunks (see
+ * ContactManager::setContactAttributesChunkSize()) and this signal is emitted as each chunk
+ * arrives, which allows e.g. roster views to start showing contacts early. Contacts which were
+ * already available when the request was made are not included. The complete list is still
+ * available from contacts() once the operation has finished.
+ *
+ * \param contacts The contacts which have just been built.
+ */
+
 void PendingContacts::onAttributesFinished(PendingOperation *operation)
 {
-    PendingContactAttributes *pendingAttributes =
-        qobject_cast<PendingContactAttributes *>(operation);
+    ContactManager::PendingAttributesRequest *pendingAttributes =
+        qobject_cast<ContactManager::PendingAttributesRequest *>(operation);
+
+    if (isFinished()) {
+        // Another chunk of this request already failed
+        return;
+    }
+
+    --mPriv->attributesRequestsInFlight;
 
     if (pendingAttributes->isError()) {
         debug() << "PendingAttrs error" << pendingAttributes->errorName()
@@ -494,17 +561,30 @@ void PendingContacts::onAttributesFinished(PendingOperation *operation)
     ReferencedHandles validHandles = pendingAttributes->validHandles();
     ContactAttributesMap attributes = pendingAttributes->attributes();
 
+    QHash<uint, ContactPtr> validContacts = manager()->ensureContacts(validHandles,
+            mPriv->missingFeatures, attributes);
+
+    QList<ContactPtr> retrieved;
+    foreach (uint handle, validHandles) {
+        ContactPtr contact = validContacts.value(handle);
+        mPriv->satisfyingContacts.insert(handle, contact);
+        retrieved.push_back(contact);
+    }
+
+    if (!retrieved.isEmpty()) {
+        emit contactsRetrieved(retrieved);
+    }
+
+    if (mPriv->fetchOffset < mPriv->handlesToFetch.size() ||
+        mPriv->attributesRequestsInFlight > 0) {
+        mPriv->requestNextAttributes();
+        return;
+    }
+
+    // Every handle which is still not satisfied was not returned by any of the chunks
     foreach (uint handle, mPriv->handles) {
         if (!mPriv->satisfyingContacts.contains(handle)) {
-            int indexInValid = validHandles.indexOf(handle);
-            if (indexInValid >= 0) {
-                ReferencedHandles referencedHandle = validHandles.mid(indexInValid, 1);
-                QVariantMap handleAttributes = attributes[handle];
-                mPriv->satisfyingContacts.insert(handle, manager()->ensureContact(referencedHandle,
-                            mPriv->missingFeatures, handleAttributes));
-            } else {
-                mPriv->invalidHandles.push_back(handle);
-            }
+            mPriv->invalidHandles.push_back(handle);
         }
     }
 
@@ -526,6 +606,9 @@ void PendingContacts::onRequestHandlesFinished(PendingOperation *operation)
     }
 
     mPriv->nested = manager()->contactsForHandles(pendingHandles->handles(), features());
+    connect(mPriv->nested,
+            SIGNAL(contactsRetrieved(QList<Tp::ContactPtr>)),
+            SIGNAL(contactsRetrieved(QList<Tp::ContactPtr>)));
     connect(mPriv->nested,
             SIGNAL(finished(Tp::PendingOperation*)),
             SLOT(onNestedFinished(Tp::PendingOperation*)));
@@ -549,14 +632,12 @@ void PendingContacts::onAddressingGetContactsFinished(PendingOperation *operatio
     UIntList handles = attributes.keys();
     ReferencedHandles referencedHandles(conn, HandleTypeContact, handles);
 
+    QHash<uint, ContactPtr> validContacts = mPriv->manager->ensureContacts(referencedHandles,
+            mPriv->missingFeatures, attributes);
+
     foreach (uint handle, handles) {
-        int indexInValid = referencedHandles.indexOf(handle);
-        Q_ASSERT(indexInValid >= 0);
-        ReferencedHandles referencedHandle = referencedHandles.mid(indexInValid, 1);
-        QVariantMap handleAttributes = attributes[handle];
-        ContactPtr contact = mPriv->manager->ensureContact(referencedHandle,
-                    mPriv->missingFeatures, handleAttributes);
-        mPriv->contacts.push_back(contact);
+        Q_ASSERT(validContacts.contains(handle));
+        mPriv->contacts.push_back(validContacts.value(handle));
     }
 
     setFinished();
@@ -576,18 +657,18 @@ void PendingContacts::onReferenceHandlesFinished(PendingOperation *operation)
     ReferencedHandles validHandles = pendingHandles->handles();
     UIntList invalidHandles = pendingHandles->invalidHandles();
     ConnectionPtr conn = mPriv->manager->connection();
-    mPriv->handlesToInspect = ReferencedHandles(conn, HandleTypeContact, UIntList());
+    QSet<uint> validHandlesSet = validHandles.toSet();
+    UIntList handlesToInspect;
     foreach (uint handle, mPriv->handles) {
         if (!mPriv->satisfyingContacts.contains(handle)) {
-            int indexInValid = validHandles.indexOf(handle);
-            if (indexInValid >= 0) {
-                ReferencedHandles referencedHandle = validHandles.mid(indexInValid, 1);
-                mPriv->handlesToInspect.append(referencedHandle);
+            if (validHandlesSet.contains(handle)) {
+                handlesToInspect.push_back(handle);
             } else {
                 mPriv->invalidHandles.push_back(handle);
             }
         }
     }
+    mPriv->handlesToInspect = ReferencedHandles(conn, HandleTypeContact, handlesToInspect);
 
     QDBusPendingCallWatcher *watcher =
         new QDBusPendingCallWatcher(
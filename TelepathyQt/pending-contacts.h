@@ -79,6 +79,9 @@ public:
     QStringList validUris() const;
     QStringList invalidUris() const;
 
+Q_SIGNALS:
+    void contactsRetrieved(const QList<Tp::ContactPtr> &contacts);
+
 private Q_SLOTS:
     TP_QT_NO_EXPORT void onAttributesFinished(Tp::PendingOperation *);
     TP_QT_NO_EXPORT void onRequestHandlesFinished(Tp::PendingOperation *);
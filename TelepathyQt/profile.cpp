@@ -24,6 +24,7 @@
 
 #include "TelepathyQt/debug-internal.h"
 #include "TelepathyQt/manager-file.h"
+#include "TelepathyQt/parsed-file-cache.h"
 
 #include <TelepathyQt/ProtocolInfo>
 #include <TelepathyQt/ProtocolParameter>
@@ -49,6 +50,8 @@ struct TP_QT_NO_EXPORT Profile::Private
 
     void lookupProfile();
     bool parse(QFile *file);
+    bool loadFromCache(const QString &fileName);
+    void storeToCache(const QString &fileName) const;
     void invalidate();
 
     struct Data
@@ -439,6 +442,10 @@ void Profile::Private::setFileName(const QString &fileName)
 
     debug() << "Loading profile file" << fileName;
 
+    if (loadFromCache(fileName)) {
+        return;
+    }
+
     QFile file(fileName);
     if (!file.exists()) {
         warning() << QString(QLatin1String("Error parsing profile file %1: file does not exist"))
@@ -455,6 +462,7 @@ void Profile::Private::setFileName(const QString &fileName)
 
     if (parse(&file)) {
         debug() << "Profile file" << fileName << "loaded successfully";
+        storeToCache(fileName);
     }
 }
 
@@ -472,12 +480,19 @@ void Profile::Private::lookupProfile()
             continue;
         }
 
+        if (loadFromCache(fileName)) {
+            debug() << "Profile for service" << serviceName << "found:" << fileName;
+            found = true;
+            break;
+        }
+
         if (!file.open(QFile::ReadOnly)) {
             continue;
         }
 
         if (parse(&file)) {
             debug() << "Profile for service" << serviceName << "found:" << fileName;
+            storeToCache(fileName);
             found = true;
             break;
         }
@@ -513,6 +528,108 @@ bool Profile::Private::parse(QFile *file)
     return true;
 }
 
+// Bump when the layout written by storeToCache() changes
+static const quint32 c_profileCacheVersion = 1;
+
+bool Profile::Private::loadFromCache(const QString &fileName)
+{
+    ParsedFileCache::Reader reader(QLatin1String("profiles"), c_profileCacheVersion, fileName);
+    if (!reader.isValid()) {
+        return false;
+    }
+
+    invalidate();
+
+    QDataStream &in = reader.stream();
+    QString cachedServiceName;
+    in >> cachedServiceName >> data.type >> data.provider >> data.name >> data.iconName >>
+        data.cmName >> data.protocolName;
+
+    quint32 count;
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString name;
+        QString signature;
+        QVariant value;
+        QString label;
+        bool mandatory;
+        in >> name >> signature >> value >> label >> mandatory;
+        data.parameters.append(Profile::Parameter(name, QDBusSignature(signature), value,
+                    label, mandatory));
+    }
+
+    in >> data.allowOtherPresences;
+
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString id;
+        QString label;
+        QString iconName;
+        bool canHaveStatusMessage;
+        bool disabled;
+        in >> id >> label >> iconName >> canHaveStatusMessage >> disabled;
+        data.presences.append(Profile::Presence(id, label, iconName,
+                    canHaveStatusMessage ? QString(QLatin1String("true")) : QString(), disabled));
+    }
+
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        RequestableChannelClass rcc;
+        in >> rcc.fixedProperties >> rcc.allowedProperties;
+        data.unsupportedChannelClassSpecs.append(RequestableChannelClassSpec(rcc));
+    }
+
+    // The parser refuses non-IM profiles unless they are explicitly asked for
+    if (!reader.atEnd() || cachedServiceName != serviceName ||
+            (data.type != QLatin1String("IM") && !allowNonIMType)) {
+        invalidate();
+        return false;
+    }
+
+    debug() << "Profile file" << fileName << "loaded from cache";
+    reader.setUsed();
+    fake = false;
+    valid = true;
+    return true;
+}
+
+void Profile::Private::storeToCache(const QString &fileName) const
+{
+    if (!ParsedFileCache::isEnabled()) {
+        return;
+    }
+
+    ParsedFileCache::Writer writer(QLatin1String("profiles"), c_profileCacheVersion, fileName);
+    QDataStream &out = writer.stream();
+
+    out << serviceName << data.type << data.provider << data.name << data.iconName <<
+        data.cmName << data.protocolName;
+
+    out << quint32(data.parameters.size());
+    foreach (const Profile::Parameter &param, data.parameters) {
+        out << param.name() << param.dbusSignature().signature() << param.value() <<
+            param.label() << param.isMandatory();
+    }
+
+    out << data.allowOtherPresences;
+
+    out << quint32(data.presences.size());
+    foreach (const Profile::Presence &presence, data.presences) {
+        out << presence.id() << presence.label() << presence.iconName() <<
+            presence.canHaveStatusMessage() << presence.isDisabled();
+    }
+
+    out << quint32(data.unsupportedChannelClassSpecs.size());
+    foreach (const RequestableChannelClassSpec &spec, data.unsupportedChannelClassSpecs) {
+        RequestableChannelClass rcc = spec.bareClass();
+        out << rcc.fixedProperties << rcc.allowedProperties;
+    }
+
+    if (!writer.commit()) {
+        debug() << "Unable to cache profile file" << fileName;
+    }
+}
+
 void Profile::Private::invalidate()
 {
     valid = false;
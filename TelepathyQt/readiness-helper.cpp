@@ -25,6 +25,7 @@
 #include "TelepathyQt/_gen/readiness-helper.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/feature-internal.h"
 
 #include <TelepathyQt/Constants>
 #include <TelepathyQt/DBusProxy>
@@ -49,6 +50,7 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Introspectable::Private : public QShared
             bool critical)
         : makesSenseForStatuses(makesSenseForStatuses),
         dependsOnFeatures(dependsOnFeatures),
+        dependsOnFeatureSet(dependsOnFeatures),
         dependsOnInterfaces(dependsOnInterfaces),
         introspectFunc(introspectFunc),
         introspectFuncData(introspectFuncData),
@@ -56,6 +58,7 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Introspectable::Private : public QShared
 
     QSet<uint> makesSenseForStatuses;
     Features dependsOnFeatures;
+    FeatureSet dependsOnFeatureSet;
     QStringList dependsOnInterfaces;
     IntrospectFunc introspectFunc;
     void *introspectFuncData;
@@ -108,7 +111,7 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Private
             const QString &errorName = QString(),
             const QString &errorMessage = QString());
     void iterateIntrospection();
-    Features depsFor(const Feature &feature); // Recursive dependencies for a feature
+    FeatureSet depsFor(const Feature &feature); // Recursive dependencies for a feature
 
     void abortOperations(const QString &errorName, const QString &errorMessage);
 
@@ -119,12 +122,13 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Private
     QStringList interfaces;
     Introspectables introspectables;
     QSet<uint> supportedStatuses;
-    Features supportedFeatures;
-    Features satisfiedFeatures;
-    Features requestedFeatures;
-    Features missingFeatures;
-    Features pendingFeatures;
-    Features inFlightFeatures;
+    // Bitsets, as these are combined on every introspection step
+    FeatureSet supportedFeatures;
+    FeatureSet satisfiedFeatures;
+    FeatureSet requestedFeatures;
+    FeatureSet missingFeatures;
+    FeatureSet pendingFeatures;
+    FeatureSet inFlightFeatures;
     QHash<Feature, QPair<QString, QString> > missingFeaturesErrors;
     QList<PendingReady *> pendingOperations;
 
@@ -282,8 +286,8 @@ void ReadinessHelper::Private::iterateIntrospection()
 
     // Flag the currently pending reverse dependencies of any previously discovered missing features
     // as missing
-    foreach (const Feature &feature, pendingFeatures) {
-        if (!depsFor(feature).intersect(missingFeatures).isEmpty()) {
+    foreach (const Feature &feature, pendingFeatures.toFeatures()) {
+        if (depsFor(feature).intersects(missingFeatures)) {
             missingFeatures.insert(feature);
             missingFeaturesErrors.insert(feature,
                     QPair<QString, QString>(TP_QT_ERROR_NOT_AVAILABLE,
@@ -291,7 +295,7 @@ void ReadinessHelper::Private::iterateIntrospection()
         }
     }
 
-    const Features completedFeatures = satisfiedFeatures + missingFeatures;
+    const FeatureSet completedFeatures = satisfiedFeatures + missingFeatures;
 
     // check if any pending operations for becomeReady should finish now
     // based on their requested features having nothing more than what
@@ -299,7 +303,7 @@ void ReadinessHelper::Private::iterateIntrospection()
     QString errorName;
     QString errorMessage;
     foreach (PendingReady *operation, pendingOperations) {
-        if ((operation->requestedFeatures() - completedFeatures).isEmpty()) {
+        if (completedFeatures.contains(FeatureSet(operation->requestedFeatures()))) {
             if (parent->isReady(operation->requestedFeatures(), &errorName, &errorMessage)) {
                 operation->setFinished();
             } else {
@@ -314,7 +318,7 @@ void ReadinessHelper::Private::iterateIntrospection()
         }
     }
 
-    if ((requestedFeatures - completedFeatures).isEmpty()) {
+    if (completedFeatures.contains(requestedFeatures)) {
         // Otherwise, we'd emit statusReady with currentStatus although we are supposed to be
         // introspecting the pendingStatus and only when that is complete, emit statusReady
         Q_ASSERT(!pendingStatusChange);
@@ -330,9 +334,9 @@ void ReadinessHelper::Private::iterateIntrospection()
 
     // find out which features don't have dependencies that are still pending
     Features readyToIntrospect;
-    foreach (const Feature &feature, pendingFeatures) {
+    foreach (const Feature &feature, pendingFeatures.toFeatures()) {
         // missing doesn't have to be considered here anymore
-        if ((introspectables[feature].mPriv->dependsOnFeatures - satisfiedFeatures).isEmpty()) {
+        if (satisfiedFeatures.contains(introspectables[feature].mPriv->dependsOnFeatureSet)) {
             readyToIntrospect.insert(feature);
         }
     }
@@ -376,9 +380,9 @@ void ReadinessHelper::Private::iterateIntrospection()
     }
 }
 
-Features ReadinessHelper::Private::depsFor(const Feature &feature)
+FeatureSet ReadinessHelper::Private::depsFor(const Feature &feature)
 {
-    Features deps;
+    FeatureSet deps;
 
     foreach (Feature dep, introspectables[feature].mPriv->dependsOnFeatures) {
         deps += dep;
@@ -458,7 +462,7 @@ void ReadinessHelper::addIntrospectables(const Introspectables &introspectables)
     }
 
     debug() << "ReadinessHelper: new supportedStatuses =" << mPriv->supportedStatuses;
-    debug() << "ReadinessHelper: new supportedFeatures =" << mPriv->supportedFeatures;
+    debug() << "ReadinessHelper: new supportedFeatures =" << mPriv->supportedFeatures.toFeatures();
 }
 
 uint ReadinessHelper::currentStatus() const
@@ -500,17 +504,17 @@ void ReadinessHelper::setInterfaces(const QStringList &interfaces)
 
 Features ReadinessHelper::requestedFeatures() const
 {
-    return mPriv->requestedFeatures;
+    return mPriv->requestedFeatures.toFeatures();
 }
 
 Features ReadinessHelper::actualFeatures() const
 {
-    return mPriv->satisfiedFeatures;
+    return mPriv->satisfiedFeatures.toFeatures();
 }
 
 Features ReadinessHelper::missingFeatures() const
 {
-    return mPriv->missingFeatures;
+    return mPriv->missingFeatures.toFeatures();
 }
 
 bool ReadinessHelper::isReady(const Feature &feature,
@@ -604,10 +608,10 @@ PendingReady *ReadinessHelper::becomeReady(const Features &requestedFeatures)
         }
     }
 
-    Features supportedFeatures = mPriv->supportedFeatures;
-    if (supportedFeatures.intersect(requestedFeatures) != requestedFeatures) {
+    FeatureSet requestedFeatureSet(requestedFeatures);
+    if (!mPriv->supportedFeatures.contains(requestedFeatureSet)) {
         warning() << "ReadinessHelper::becomeReady called with invalid features: requestedFeatures =" <<
-            requestedFeatures << "- supportedFeatures =" << mPriv->supportedFeatures;
+            requestedFeatures << "- supportedFeatures =" << mPriv->supportedFeatures.toFeatures();
         PendingReady *operation = new PendingReady(SharedPtr<RefCounted>(mPriv->object),
                 requestedFeatures);
         operation->setFinishedWithError(
@@ -632,7 +636,7 @@ PendingReady *ReadinessHelper::becomeReady(const Features &requestedFeatures)
     }
 
     // Insert the dependencies of the requested features too
-    Features requestedWithDeps = requestedFeatures;
+    FeatureSet requestedWithDeps = requestedFeatureSet;
     foreach (const Feature &feature, requestedFeatures) {
         requestedWithDeps.unite(mPriv->depsFor(feature));
     }
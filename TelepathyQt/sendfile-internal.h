@@ -0,0 +1,99 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2016 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_sendfile_internal_h_HEADER_GUARD_
+#define _TelepathyQt_sendfile_internal_h_HEADER_GUARD_
+
+#include <QAbstractSocket>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <sys/sendfile.h>
+#endif
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+/*
+ * Send up to maxLength bytes from input to output without copying them to the user space.
+ *
+ * This is only possible if input is a regular file and output is a socket with no data queued,
+ * so that the kernel can move the data directly. The position of input is advanced by the
+ * number of bytes sent.
+ *
+ * Returns the number of bytes sent, 0 if the socket can not take more data right now or -1 if
+ * the data should be copied with read() and write() instead. If failed is given, it is set when
+ * sendfile() itself failed, in which case it will most likely fail again for these devices.
+ *
+ * Note that the data sent this way does not go through the socket buffer, thus
+ * QIODevice::bytesWritten() is not emitted for it.
+ */
+inline qint64 sendFileToSocket(QIODevice *input, QIODevice *output, qint64 maxLength,
+        bool *failed = 0)
+{
+#ifdef Q_OS_LINUX
+    QFile *file = qobject_cast<QFile*>(input);
+    QAbstractSocket *socket = qobject_cast<QAbstractSocket*>(output);
+
+    if (!file || !socket || file->isSequential() || file->handle() < 0 ||
+            socket->socketDescriptor() < 0 || socket->bytesToWrite() > 0) {
+        return -1;
+    }
+
+    qint64 remaining = file->size() - file->pos();
+    if (remaining <= 0) {
+        return -1;
+    }
+
+    off_t offset = file->pos();
+    ssize_t sent = ::sendfile(socket->socketDescriptor(), file->handle(), &offset,
+            qMin(remaining, maxLength));
+
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        if (failed) {
+            *failed = true;
+        }
+        return -1;
+    }
+
+    // QFile keeps its own position and read buffer, sync them with the file offset
+    file->seek(file->pos() + sent);
+    return sent;
+#else
+    Q_UNUSED(input);
+    Q_UNUSED(output);
+    Q_UNUSED(maxLength);
+    Q_UNUSED(failed);
+    return -1;
+#endif
+}
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
@@ -0,0 +1,1021 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <TelepathyQt/StreamTubeRelay>
+
+#include "TelepathyQt/_gen/stream-tube-relay.moc.hpp"
+
+#include "TelepathyQt/debug-internal.h"
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QThread>
+#include <QVector>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef Q_OS_LINUX
+// Bytes are moved between the sockets through a pipe with splice(), without being copied to
+// user space
+#define TP_QT_RELAY_USE_SPLICE
+#endif
+#endif
+
+namespace Tp
+{
+
+namespace
+{
+
+const int defaultBufferSize = 64 * 1024;
+
+struct Endpoint
+{
+    Endpoint() : port(0) {}
+
+    bool isUnix() const { return !socket.isEmpty(); }
+
+    QHostAddress address;
+    quint16 port;
+    QString socket;
+};
+
+#ifdef Q_OS_UNIX
+
+QString errorString(int error)
+{
+    return QString::fromLocal8Bit(strerror(error));
+}
+
+bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 &&
+        fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+socklen_t toSockaddr(const Endpoint &endpoint, sockaddr_storage *storage)
+{
+    memset(storage, 0, sizeof(*storage));
+
+    if (endpoint.isUnix()) {
+        sockaddr_un *addr = reinterpret_cast<sockaddr_un *>(storage);
+        QByteArray path = QFile::encodeName(endpoint.socket);
+        if (path.size() >= (int) sizeof(addr->sun_path)) {
+            return 0;
+        }
+        addr->sun_family = AF_UNIX;
+        memcpy(addr->sun_path, path.constData(), path.size());
+        return sizeof(sockaddr_un);
+    }
+
+    if (endpoint.address.protocol() == QAbstractSocket::IPv4Protocol) {
+        sockaddr_in *addr = reinterpret_cast<sockaddr_in *>(storage);
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(endpoint.port);
+        addr->sin_addr.s_addr = htonl(endpoint.address.toIPv4Address());
+        return sizeof(sockaddr_in);
+    } else if (endpoint.address.protocol() == QAbstractSocket::IPv6Protocol) {
+        sockaddr_in6 *addr = reinterpret_cast<sockaddr_in6 *>(storage);
+        Q_IPV6ADDR ipv6 = endpoint.address.toIPv6Address();
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = htons(endpoint.port);
+        memcpy(&addr->sin6_addr, &ipv6, sizeof(ipv6));
+        return sizeof(sockaddr_in6);
+    }
+
+    return 0;
+}
+
+// One direction of a relayed connection
+struct Direction
+{
+    Direction(int from, int to)
+        : from(from),
+          to(to),
+          capacity(0),
+          buffered(0),
+          eof(false),
+          pipeFull(false),
+          shutdown(false),
+          bytes(0)
+    {
+#ifdef TP_QT_RELAY_USE_SPLICE
+        pipe[0] = pipe[1] = -1;
+#else
+        offset = 0;
+#endif
+    }
+
+    ~Direction()
+    {
+#ifdef TP_QT_RELAY_USE_SPLICE
+        if (pipe[0] >= 0) {
+            ::close(pipe[0]);
+            ::close(pipe[1]);
+        }
+#endif
+    }
+
+    bool init(int bufferSize);
+    bool canRead() const { return !eof && !pipeFull && buffered < capacity; }
+    bool read();
+    bool write();
+
+    int from, to;
+#ifdef TP_QT_RELAY_USE_SPLICE
+    int pipe[2];
+#else
+    QByteArray buffer;
+    int offset;
+#endif
+    int capacity;
+    int buffered;
+    bool eof;
+    // The pipe accounts for pages rather than bytes, so it may fill up before capacity is
+    // reached. Reading stops until a write makes room, instead of polling a readable source
+    // which can't be read from.
+    bool pipeFull;
+    bool shutdown;
+    qint64 bytes;
+};
+
+bool Direction::init(int bufferSize)
+{
+    capacity = bufferSize;
+#ifdef TP_QT_RELAY_USE_SPLICE
+    if (::pipe(pipe) != 0) {
+        pipe[0] = pipe[1] = -1;
+        return false;
+    }
+    if (!setNonBlocking(pipe[0]) || !setNonBlocking(pipe[1])) {
+        return false;
+    }
+#ifdef F_SETPIPE_SZ
+    // Best effort, the capacity is enforced below anyway
+    fcntl(pipe[1], F_SETPIPE_SZ, bufferSize);
+#endif
+#else
+    buffer.resize(bufferSize);
+#endif
+    return true;
+}
+
+// Pull what the source has to offer, without taking more than the free buffer space, so that
+// a slow destination slows down the source through the socket buffers
+bool Direction::read()
+{
+    while (canRead()) {
+#ifdef TP_QT_RELAY_USE_SPLICE
+        ssize_t n = splice(from, 0, pipe[1], 0, capacity - buffered,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+        if (offset + buffered == capacity) {
+            memmove(buffer.data(), buffer.constData() + offset, buffered);
+            offset = 0;
+        }
+        ssize_t n = recv(from, buffer.data() + offset + buffered,
+                capacity - offset - buffered, 0);
+#endif
+        if (n > 0) {
+            buffered += n;
+        } else if (n == 0) {
+            eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+#ifdef TP_QT_RELAY_USE_SPLICE
+            // Either the source is drained or the pipe is full, which can only be the case if
+            // something is buffered. Waiting for the write side to make progress is right either
+            // way, as the source is polled again as soon as it does.
+            pipeFull = buffered > 0;
+#endif
+            return true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Direction::write()
+{
+    while (buffered > 0) {
+#ifdef TP_QT_RELAY_USE_SPLICE
+        ssize_t n = splice(pipe[0], 0, to, 0, buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+        ssize_t n = send(to, buffer.constData() + offset, buffered, MSG_NOSIGNAL);
+#endif
+        if (n > 0) {
+            buffered -= n;
+            bytes += n;
+            pipeFull = false;
+#ifndef TP_QT_RELAY_USE_SPLICE
+            offset = buffered ? offset + n : 0;
+#endif
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    if (eof && !shutdown) {
+        // Forward the half-close once everything has been written
+        ::shutdown(to, SHUT_WR);
+        shutdown = true;
+    }
+    return true;
+}
+
+struct Connection
+{
+    Connection(uint id, int client, int backend)
+        : id(id),
+          client(client),
+          backend(backend),
+          connecting(false),
+          toBackend(client, backend),
+          fromBackend(backend, client)
+    {
+    }
+
+    ~Connection()
+    {
+        ::close(client);
+        if (backend >= 0) {
+            ::close(backend);
+        }
+    }
+
+    bool isFinished() const { return toBackend.shutdown && fromBackend.shutdown; }
+
+    uint id;
+    int client;
+    int backend;
+    bool connecting;
+    Direction toBackend;
+    Direction fromBackend;
+};
+
+#endif // Q_OS_UNIX
+
+}
+
+struct TP_QT_NO_EXPORT StreamTubeRelay::Private
+{
+    Private(StreamTubeRelay *parent)
+        : parent(parent),
+          bufferSize(defaultBufferSize),
+          listenFd(-1),
+          thread(0),
+          stopping(false)
+    {
+        wakeFds[0] = wakeFds[1] = -1;
+    }
+
+    bool startListening(int fd);
+
+    StreamTubeRelay *parent;
+    Endpoint backend;
+    Endpoint listen;
+    int bufferSize;
+
+    int listenFd;
+    int wakeFds[2];
+    IoThread *thread;
+
+    // Shared with the I/O thread
+    mutable QMutex mutex;
+    bool stopping;
+    QHash<uint, QPair<qint64, qint64> > counters;
+
+    // Number of times poll() returned, for the tests
+    QAtomicInt pollWakeUps;
+};
+
+class TP_QT_NO_EXPORT StreamTubeRelay::IoThread : public QThread
+{
+public:
+    IoThread(StreamTubeRelay::Private *priv)
+        : mPriv(priv),
+          mNextConnectionId(1)
+    {
+    }
+
+protected:
+    void run();
+
+#ifdef Q_OS_UNIX
+private:
+    void acceptConnections();
+    bool connectBackend(Connection *conn, QString *errorMessage);
+    void closeConnection(Connection *conn, const QString &errorMessage);
+
+    StreamTubeRelay::Private *mPriv;
+    uint mNextConnectionId;
+    QList<Connection *> mConnections;
+#else
+private:
+    StreamTubeRelay::Private *mPriv;
+    uint mNextConnectionId;
+#endif
+};
+
+#ifdef Q_OS_UNIX
+
+bool StreamTubeRelay::Private::startListening(int fd)
+{
+    if (::listen(fd, SOMAXCONN) != 0 || !setNonBlocking(fd)) {
+        warning() << "StreamTubeRelay: unable to listen -" << errorString(errno);
+        ::close(fd);
+        return false;
+    }
+
+    if (::pipe(wakeFds) != 0 || !setNonBlocking(wakeFds[0]) || !setNonBlocking(wakeFds[1])) {
+        warning() << "StreamTubeRelay: unable to create the wake up pipe -" << errorString(errno);
+        if (wakeFds[0] >= 0) {
+            ::close(wakeFds[0]);
+            ::close(wakeFds[1]);
+            wakeFds[0] = wakeFds[1] = -1;
+        }
+        ::close(fd);
+        return false;
+    }
+
+    listenFd = fd;
+    stopping = false;
+    thread = new IoThread(this);
+    thread->start();
+    return true;
+}
+
+void StreamTubeRelay::IoThread::run()
+{
+    // Writing to a socket closed by the peer must fail with EPIPE instead of killing the process
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, 0);
+
+    QVector<pollfd> fds;
+    forever {
+        fds.resize(2);
+        fds[0].fd = mPriv->wakeFds[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = mPriv->listenFd;
+        fds[1].events = POLLIN;
+
+        foreach (Connection *conn, mConnections) {
+            pollfd clientFd;
+            clientFd.fd = conn->client;
+            clientFd.events = 0;
+            pollfd backendFd;
+            backendFd.fd = conn->backend;
+            backendFd.events = 0;
+
+            if (conn->connecting) {
+                backendFd.events = POLLOUT;
+            } else {
+                // Only poll for what can be handled, a full buffer stops reading from its source
+                if (conn->toBackend.canRead()) {
+                    clientFd.events |= POLLIN;
+                }
+                if (conn->fromBackend.buffered > 0) {
+                    clientFd.events |= POLLOUT;
+                }
+                if (conn->fromBackend.canRead()) {
+                    backendFd.events |= POLLIN;
+                }
+                if (conn->toBackend.buffered > 0) {
+                    backendFd.events |= POLLOUT;
+                }
+            }
+
+            // A socket with nothing to wait for would keep reporting a hang up
+            if (!clientFd.events) {
+                clientFd.fd = -1;
+            }
+            if (!backendFd.events) {
+                backendFd.fd = -1;
+            }
+            fds << clientFd << backendFd;
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            warning() << "StreamTubeRelay: poll failed -" << errorString(errno);
+            break;
+        }
+        mPriv->pollWakeUps.ref();
+
+        if (fds[0].revents) {
+            char buf[16];
+            while (::read(mPriv->wakeFds[0], buf, sizeof(buf)) > 0) {
+            }
+
+            QMutexLocker locker(&mPriv->mutex);
+            if (mPriv->stopping) {
+                break;
+            }
+        }
+
+        // Connections accepted below are polled starting with the next iteration
+        QList<Connection *> connections = mConnections;
+
+        if (fds[1].revents) {
+            acceptConnections();
+        }
+
+        QList<Connection *> changed;
+        for (int i = 0; i < connections.size(); ++i) {
+            Connection *conn = connections.at(i);
+            short clientEvents = fds[2 + 2 * i].revents;
+            short backendEvents = fds[3 + 2 * i].revents;
+            if (!clientEvents && !backendEvents) {
+                continue;
+            }
+
+            if (conn->connecting) {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if (getsockopt(conn->backend, SOL_SOCKET, SO_ERROR, &error, &len) != 0) {
+                    error = errno;
+                }
+                if (error) {
+                    closeConnection(conn, errorString(error));
+                    continue;
+                }
+                conn->connecting = false;
+                continue;
+            }
+
+            qint64 toBackend = conn->toBackend.bytes;
+            qint64 fromBackend = conn->fromBackend.bytes;
+
+            // Whatever was read is written right away, if the destination can take it
+            if (!conn->toBackend.read() || !conn->toBackend.write() ||
+                    !conn->fromBackend.read() || !conn->fromBackend.write()) {
+                closeConnection(conn, errorString(errno));
+                continue;
+            }
+
+            if (conn->isFinished()) {
+                closeConnection(conn, QString());
+                continue;
+            }
+
+            if (conn->toBackend.bytes != toBackend || conn->fromBackend.bytes != fromBackend) {
+                changed << conn;
+            }
+        }
+
+        if (!changed.isEmpty()) {
+            QMutexLocker locker(&mPriv->mutex);
+            foreach (Connection *conn, changed) {
+                mPriv->counters.insert(conn->id,
+                        qMakePair(conn->toBackend.bytes, conn->fromBackend.bytes));
+            }
+        }
+    }
+
+    foreach (Connection *conn, mConnections) {
+        closeConnection(conn, QLatin1String("The relay has been closed"));
+    }
+}
+
+void StreamTubeRelay::IoThread::acceptConnections()
+{
+    forever {
+        int client = accept(mPriv->listenFd, 0, 0);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                warning() << "StreamTubeRelay: accept failed -" << errorString(errno);
+            }
+            return;
+        }
+
+        Connection *conn = new Connection(mNextConnectionId++, client, -1);
+        mConnections << conn;
+        {
+            QMutexLocker locker(&mPriv->mutex);
+            mPriv->counters.insert(conn->id, qMakePair(qint64(0), qint64(0)));
+        }
+        QMetaObject::invokeMethod(mPriv->parent, "newConnection", Qt::QueuedConnection,
+                Q_ARG(uint, conn->id));
+
+        QString errorMessage;
+        if (!connectBackend(conn, &errorMessage)) {
+            closeConnection(conn, errorMessage);
+        }
+    }
+}
+
+bool StreamTubeRelay::IoThread::connectBackend(Connection *conn, QString *errorMessage)
+{
+    int bufferSize;
+    {
+        QMutexLocker locker(&mPriv->mutex);
+        bufferSize = mPriv->bufferSize;
+    }
+
+    if (!setNonBlocking(conn->client) || !conn->toBackend.init(bufferSize) ||
+            !conn->fromBackend.init(bufferSize)) {
+        *errorMessage = errorString(errno);
+        return false;
+    }
+
+    sockaddr_storage addr;
+    socklen_t addrLen = toSockaddr(mPriv->backend, &addr);
+    conn->backend = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (conn->backend < 0 || !setNonBlocking(conn->backend)) {
+        *errorMessage = errorString(errno);
+        return false;
+    }
+    conn->toBackend.to = conn->fromBackend.from = conn->backend;
+
+    if (!mPriv->backend.isUnix()) {
+        int one = 1;
+        setsockopt(conn->backend, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (!mPriv->listen.isUnix()) {
+        int one = 1;
+        setsockopt(conn->client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    if (::connect(conn->backend, reinterpret_cast<sockaddr *>(&addr), addrLen) != 0) {
+        if (errno != EINPROGRESS) {
+            *errorMessage = errorString(errno);
+            return false;
+        }
+        conn->connecting = true;
+    }
+    return true;
+}
+
+void StreamTubeRelay::IoThread::closeConnection(Connection *conn, const QString &errorMessage)
+{
+    {
+        QMutexLocker locker(&mPriv->mutex);
+        mPriv->counters.remove(conn->id);
+    }
+    QMetaObject::invokeMethod(mPriv->parent, "connectionClosed", Qt::QueuedConnection,
+            Q_ARG(uint, conn->id), Q_ARG(qint64, conn->toBackend.bytes),
+            Q_ARG(qint64, conn->fromBackend.bytes), Q_ARG(QString, errorMessage));
+
+    mConnections.removeOne(conn);
+    delete conn;
+}
+
+#else // Q_OS_UNIX
+
+bool StreamTubeRelay::Private::startListening(int fd)
+{
+    Q_UNUSED(fd);
+    return false;
+}
+
+void StreamTubeRelay::IoThread::run()
+{
+}
+
+#endif // Q_OS_UNIX
+
+/**
+ * \class StreamTubeRelay
+ * \ingroup clientsideproxies
+ * \headerfile TelepathyQt/stream-tube-relay.h <TelepathyQt/StreamTubeRelay>
+ *
+ * \brief The StreamTubeRelay class forwards the connections made to a local socket to a
+ * backend socket.
+ *
+ * The relay listens on a TCP or Unix socket of its own, and for each connection it accepts,
+ * connects to the backend and forwards the bytes both ways until both sides have closed their
+ * end. The forwarding happens on a dedicated thread, so the application's main loop never
+ * sees the payload. On Linux, the bytes are moved with splice() and never copied to user
+ * space. A connection only reads as much as its buffer can hold (see setBufferSize()), so a
+ * slow receiver slows the sender down instead of making the relay buffer without bounds.
+ *
+ * This saves applications from writing their own socket pumping code around stream tubes.
+ * On the offering side, a relay pointing to the real service can be exported with
+ * StreamTubeServer::exportTcpSocket(const StreamTubeRelayPtr &, const QVariantMap &). This
+ * makes the per connection byte counters available. On the accepting side, a relay created in
+ * a slot connected to StreamTubeClient::tubeAcceptedAsTcp(), with the tube listen address as
+ * its backend, lets a local program connect to a fixed address of its choice.
+ *
+ * The connection ids used by the relay are its own, numbered from 1 in the order the connections
+ * are accepted. They are unrelated to the connection ids of the tubes, and the relay doesn't map
+ * one to the other.
+ *
+ * The relay is only available on Unix platforms, elsewhere listening always fails.
+ */
+
+/**
+ * Create a new relay forwarding connections to the TCP socket listening on the given
+ * (\a backendAddress, \a backendPort) combination.
+ *
+ * \param backendAddress The address of the backend socket.
+ * \param backendPort The port of the backend socket.
+ * \return A StreamTubeRelayPtr object pointing to the newly created relay.
+ */
+StreamTubeRelayPtr StreamTubeRelay::create(const QHostAddress &backendAddress,
+        quint16 backendPort)
+{
+    return StreamTubeRelayPtr(new StreamTubeRelay(backendAddress, backendPort, QString()));
+}
+
+/**
+ * Create a new relay forwarding connections to the Unix socket \a backendSocket.
+ *
+ * \param backendSocket The path of the backend socket.
+ * \return A StreamTubeRelayPtr object pointing to the newly created relay.
+ */
+StreamTubeRelayPtr StreamTubeRelay::create(const QString &backendSocket)
+{
+    return StreamTubeRelayPtr(new StreamTubeRelay(QHostAddress(), 0, backendSocket));
+}
+
+StreamTubeRelay::StreamTubeRelay(const QHostAddress &backendAddress, quint16 backendPort,
+        const QString &backendSocket)
+    : mPriv(new Private(this))
+{
+    mPriv->backend.address = backendAddress;
+    mPriv->backend.port = backendPort;
+    mPriv->backend.socket = backendSocket;
+}
+
+/**
+ * Class destructor.
+ *
+ * The connections being relayed are closed, without connectionClosed() being emitted.
+ */
+StreamTubeRelay::~StreamTubeRelay()
+{
+    close();
+    delete mPriv;
+}
+
+/**
+ * Return the address of the TCP backend socket, as given to create().
+ *
+ * \return The address, or a null address if the backend is a Unix socket.
+ */
+QHostAddress StreamTubeRelay::backendAddress() const
+{
+    return mPriv->backend.address;
+}
+
+/**
+ * Return the port of the TCP backend socket, as given to create().
+ *
+ * \return The port, or 0 if the backend is a Unix socket.
+ */
+quint16 StreamTubeRelay::backendPort() const
+{
+    return mPriv->backend.port;
+}
+
+/**
+ * Return the path of the Unix backend socket, as given to create().
+ *
+ * \return The path, or an empty string if the backend is a TCP socket.
+ */
+QString StreamTubeRelay::backendSocket() const
+{
+    return mPriv->backend.socket;
+}
+
+/**
+ * Start accepting connections on a TCP socket listening on the given (\a address, \a port)
+ * combination.
+ *
+ * \param address The address to listen on, the loopback address by default.
+ * \param port The port to listen on, or 0 to pick a free one (see listenPort()).
+ * \return \c true if the relay is listening, \c false otherwise.
+ */
+bool StreamTubeRelay::listenTcp(const QHostAddress &address, quint16 port)
+{
+    if (isListening()) {
+        warning() << "StreamTubeRelay::listenTcp() called while already listening";
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    Endpoint endpoint;
+    endpoint.address = address;
+    endpoint.port = port;
+
+    sockaddr_storage addr;
+    socklen_t addrLen = toSockaddr(endpoint, &addr);
+    if (!addrLen) {
+        warning() << "StreamTubeRelay::listenTcp() called with an invalid address" << address;
+        return false;
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        warning() << "StreamTubeRelay: unable to create socket -" << errorString(errno);
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), addrLen) != 0) {
+        warning() << "StreamTubeRelay: unable to bind to" << address << port << "-" <<
+            errorString(errno);
+        ::close(fd);
+        return false;
+    }
+
+    // Find out which port was picked
+    addrLen = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &addrLen);
+    if (addr.ss_family == AF_INET) {
+        endpoint.port = ntohs(reinterpret_cast<sockaddr_in *>(&addr)->sin_port);
+    } else {
+        endpoint.port = ntohs(reinterpret_cast<sockaddr_in6 *>(&addr)->sin6_port);
+    }
+
+    mPriv->listen = endpoint;
+    if (!mPriv->startListening(fd)) {
+        mPriv->listen = Endpoint();
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(address);
+    Q_UNUSED(port);
+    warning() << "StreamTubeRelay is not supported on this platform";
+    return false;
+#endif
+}
+
+/**
+ * Start accepting connections on a Unix socket at the path \a socketAddress.
+ *
+ * The socket file is created by this method, and removed by close().
+ *
+ * \param socketAddress The path of the socket.
+ * \return \c true if the relay is listening, \c false otherwise.
+ */
+bool StreamTubeRelay::listenUnix(const QString &socketAddress)
+{
+    if (isListening()) {
+        warning() << "StreamTubeRelay::listenUnix() called while already listening";
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    Endpoint endpoint;
+    endpoint.socket = socketAddress;
+
+    sockaddr_storage addr;
+    socklen_t addrLen = toSockaddr(endpoint, &addr);
+    if (!addrLen) {
+        warning() << "StreamTubeRelay::listenUnix() called with an invalid path" << socketAddress;
+        return false;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        warning() << "StreamTubeRelay: unable to create socket -" << errorString(errno);
+        return false;
+    }
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), addrLen) != 0) {
+        warning() << "StreamTubeRelay: unable to bind to" << socketAddress << "-" <<
+            errorString(errno);
+        ::close(fd);
+        return false;
+    }
+
+    mPriv->listen = endpoint;
+    if (!mPriv->startListening(fd)) {
+        QFile::remove(socketAddress);
+        mPriv->listen = Endpoint();
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(socketAddress);
+    warning() << "StreamTubeRelay is not supported on this platform";
+    return false;
+#endif
+}
+
+/**
+ * Return whether the relay is accepting connections.
+ *
+ * \return \c true if listening, \c false otherwise.
+ * \sa listenTcp(), listenUnix()
+ */
+bool StreamTubeRelay::isListening() const
+{
+    return mPriv->thread != 0;
+}
+
+/**
+ * Stop accepting connections, and close the connections being relayed.
+ *
+ * connectionClosed() is emitted for each of them once the control returns to the main loop.
+ */
+void StreamTubeRelay::close()
+{
+    if (!mPriv->thread) {
+        return;
+    }
+
+#ifdef Q_OS_UNIX
+    {
+        QMutexLocker locker(&mPriv->mutex);
+        mPriv->stopping = true;
+    }
+    char wake = 0;
+    while (::write(mPriv->wakeFds[1], &wake, 1) < 0 && errno == EINTR) {
+    }
+    mPriv->thread->wait();
+
+    ::close(mPriv->listenFd);
+    ::close(mPriv->wakeFds[0]);
+    ::close(mPriv->wakeFds[1]);
+    if (mPriv->listen.isUnix()) {
+        QFile::remove(mPriv->listen.socket);
+    }
+#endif
+
+    delete mPriv->thread;
+    mPriv->thread = 0;
+    mPriv->listenFd = -1;
+    mPriv->wakeFds[0] = mPriv->wakeFds[1] = -1;
+    mPriv->listen = Endpoint();
+
+    QMutexLocker locker(&mPriv->mutex);
+    mPriv->counters.clear();
+}
+
+/**
+ * Return the address of the TCP socket the relay is listening on.
+ *
+ * \return The address, or a null address if not listening on a TCP socket.
+ */
+QHostAddress StreamTubeRelay::listenAddress() const
+{
+    return mPriv->listen.address;
+}
+
+/**
+ * Return the port of the TCP socket the relay is listening on.
+ *
+ * \return The port, or 0 if not listening on a TCP socket.
+ */
+quint16 StreamTubeRelay::listenPort() const
+{
+    return mPriv->listen.port;
+}
+
+/**
+ * Return the path of the Unix socket the relay is listening on.
+ *
+ * \return The path, or an empty string if not listening on a Unix socket.
+ */
+QString StreamTubeRelay::listenSocket() const
+{
+    return mPriv->listen.socket;
+}
+
+/**
+ * Return the number of bytes each direction of a connection can hold while waiting for the
+ * receiving side.
+ *
+ * \return The buffer size in bytes.
+ * \sa setBufferSize()
+ */
+int StreamTubeRelay::bufferSize() const
+{
+    QMutexLocker locker(&mPriv->mutex);
+    return mPriv->bufferSize;
+}
+
+/**
+ * Set the number of bytes each direction of a connection can hold while waiting for the
+ * receiving side.
+ *
+ * Once the buffer is full, the relay stops reading from the sending side until the receiving
+ * side catches up. The new size applies to the connections accepted afterwards. The default is
+ * 64 KiB.
+ *
+ * \param bytes The buffer size in bytes, at least 4096.
+ */
+void StreamTubeRelay::setBufferSize(int bytes)
+{
+    QMutexLocker locker(&mPriv->mutex);
+    mPriv->bufferSize = qMax(bytes, 4096);
+}
+
+/**
+ * Return the ids of the connections being relayed.
+ *
+ * \return The list of connection ids.
+ * \sa newConnection()
+ */
+QList<uint> StreamTubeRelay::connections() const
+{
+    QMutexLocker locker(&mPriv->mutex);
+    return mPriv->counters.keys();
+}
+
+/**
+ * Return the number of bytes forwarded so far to the backend on the connection with the given
+ * id.
+ *
+ * \param connectionId The connection id.
+ * \return The number of bytes, or 0 if the connection is not known.
+ * \sa bytesFromBackend()
+ */
+qint64 StreamTubeRelay::bytesToBackend(uint connectionId) const
+{
+    QMutexLocker locker(&mPriv->mutex);
+    return mPriv->counters.value(connectionId).first;
+}
+
+/**
+ * Return the number of bytes forwarded so far from the backend on the connection with the given
+ * id.
+ *
+ * \param connectionId The connection id.
+ * \return The number of bytes, or 0 if the connection is not known.
+ * \sa bytesToBackend()
+ */
+qint64 StreamTubeRelay::bytesFromBackend(uint connectionId) const
+{
+    QMutexLocker locker(&mPriv->mutex);
+    return mPriv->counters.value(connectionId).second;
+}
+
+int StreamTubeRelay::pollWakeUps() const
+{
+    return mPriv->pollWakeUps.fetchAndAddRelaxed(0);
+}
+
+/**
+ * \fn void StreamTubeRelay::newConnection(uint connectionId)
+ *
+ * Emitted when the relay has accepted a connection.
+ *
+ * \param connectionId The id of the connection, specific to this relay and unrelated to the
+ *                     tube connection ids.
+ */
+
+/**
+ * \fn void StreamTubeRelay::connectionClosed(uint connectionId, qint64 bytesToBackend,
+ * qint64 bytesFromBackend, const QString &errorMessage)
+ *
+ * Emitted when a connection has been closed, either because both sides closed their end, or
+ * because of an error.
+ *
+ * \param connectionId The id of the connection.
+ * \param bytesToBackend The number of bytes forwarded to the backend.
+ * \param bytesFromBackend The number of bytes forwarded from the backend.
+ * \param errorMessage A description of the error, or an empty string.
+ */
+
+} // Tp
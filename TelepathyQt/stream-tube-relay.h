@@ -0,0 +1,96 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_stream_tube_relay_h_HEADER_GUARD_
+#define _TelepathyQt_stream_tube_relay_h_HEADER_GUARD_
+
+#ifndef IN_TP_QT_HEADER
+#error IN_TP_QT_HEADER
+#endif
+
+#include <TelepathyQt/Global>
+#include <TelepathyQt/RefCounted>
+#include <TelepathyQt/Types>
+
+#include <QHostAddress>
+#include <QObject>
+
+namespace Tp
+{
+
+class TestBackdoors;
+
+class TP_QT_EXPORT StreamTubeRelay : public QObject, public RefCounted
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(StreamTubeRelay)
+
+public:
+    static StreamTubeRelayPtr create(const QHostAddress &backendAddress, quint16 backendPort);
+    static StreamTubeRelayPtr create(const QString &backendSocket);
+
+    virtual ~StreamTubeRelay();
+
+    QHostAddress backendAddress() const;
+    quint16 backendPort() const;
+    QString backendSocket() const;
+
+    bool listenTcp(const QHostAddress &address = QHostAddress(QHostAddress::LocalHost),
+            quint16 port = 0);
+    bool listenUnix(const QString &socketAddress);
+    bool isListening() const;
+    void close();
+
+    QHostAddress listenAddress() const;
+    quint16 listenPort() const;
+    QString listenSocket() const;
+
+    int bufferSize() const;
+    void setBufferSize(int bytes);
+
+    QList<uint> connections() const;
+    qint64 bytesToBackend(uint connectionId) const;
+    qint64 bytesFromBackend(uint connectionId) const;
+
+Q_SIGNALS:
+    void newConnection(uint connectionId);
+    void connectionClosed(uint connectionId, qint64 bytesToBackend, qint64 bytesFromBackend,
+            const QString &errorMessage);
+
+private:
+    friend class TestBackdoors;
+
+    StreamTubeRelay(const QHostAddress &backendAddress, quint16 backendPort,
+            const QString &backendSocket);
+
+    int pollWakeUps() const;
+
+    class IoThread;
+    friend class IoThread;
+
+    struct Private;
+    friend struct Private;
+    Private *mPriv;
+};
+
+} // Tp
+
+#endif
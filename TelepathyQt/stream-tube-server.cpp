@@ -37,6 +37,7 @@
 #include <TelepathyQt/ClientRegistrar>
 #include <TelepathyQt/OutgoingStreamTubeChannel>
 #include <TelepathyQt/StreamTubeChannel>
+#include <TelepathyQt/StreamTubeRelay>
 
 namespace Tp
 {
@@ -336,6 +337,7 @@ struct StreamTubeServer::Private
     quint16 exportedPort;
     ParametersGenerator *generator;
     QScopedPointer<FixedParametersGenerator> fixedGenerator;
+    StreamTubeRelayPtr relay;
 
     QHash<StreamTubeChannelPtr, TubeWrapper *> tubes;
 
@@ -729,6 +731,7 @@ void StreamTubeServer::exportTcpSocket(
 
     mPriv->exportedAddr = address;
     mPriv->exportedPort = port;
+    mPriv->relay.reset();
 
     mPriv->generator = 0;
     if (!parameters.isEmpty()) {
@@ -777,6 +780,37 @@ void StreamTubeServer::exportTcpSocket(
     }
 }
 
+/**
+ * Set the StreamTubeServer to offer the listening TCP socket of the given \a relay as the local
+ * endpoint of tubes handled in the future.
+ *
+ * The incoming tube connections are then forwarded to the backend of the relay on its own I/O
+ * thread, and the byte counters of each connection are available from the relay. The server keeps
+ * a reference to the relay until the next call to exportTcpSocket(). Note that the relay numbers
+ * the connections it accepts on its own: its connection ids are unrelated to the connection ids
+ * of the tubes, and the source address and port reported by newTcpConnection() are those of the
+ * connection to the relay.
+ *
+ * A fixed set of protocol bootstrapping \a parameters can optionally be set to be sent along with all
+ * tube offers until the next call to exportTcpSocket(). See the ParametersGenerator documentation
+ * for an in-depth description of the parameter transfer mechanism.
+ *
+ * \param relay The relay, which must be listening on a TCP socket.
+ * \param parameters The bootstrapping parameters in a string-value map.
+ */
+void StreamTubeServer::exportTcpSocket(
+        const StreamTubeRelayPtr &relay,
+        const QVariantMap &parameters)
+{
+    if (!relay || relay->listenPort() == 0) {
+        warning() << "Attempted to export a relay not listening on a TCP socket, ignoring";
+        return;
+    }
+
+    exportTcpSocket(relay->listenAddress(), relay->listenPort(), parameters);
+    mPriv->relay = relay;
+}
+
 /**
  * Set the server to offer the socket listening at the given \a address - \a port combination as the
  * local endpoint of tubes handled in the future, sending the parameters from the given \a generator
@@ -802,6 +836,7 @@ void StreamTubeServer::exportTcpSocket(
 
     mPriv->exportedAddr = address;
     mPriv->exportedPort = port;
+    mPriv->relay.reset();
     mPriv->generator = generator;
 
     mPriv->ensureRegistered();
@@ -1028,14 +1063,9 @@ void StreamTubeServer::onNewConnection(
 
     if (wrapper->mTube->addressType() == SocketAddressTypeIPv4
             || wrapper->mTube->addressType() == SocketAddressTypeIPv6) {
-        QHash<QPair<QHostAddress,quint16>, uint> srcAddrConns =
-            wrapper->mTube->connectionsForSourceAddresses();
-        QHash<uint, Tp::ContactPtr> connContacts =
-            wrapper->mTube->contactsForConnections();
-
-        QPair<QHostAddress, quint16> srcAddr = srcAddrConns.key(conn);
+        QPair<QHostAddress, quint16> srcAddr = wrapper->mTube->sourceAddressForConnection(conn);
         emit newTcpConnection(srcAddr.first, srcAddr.second, wrapper->mAcc,
-                connContacts.value(conn), wrapper->mTube);
+                wrapper->mTube->contactForConnection(conn), wrapper->mTube);
     } else {
         // No UNIX socket should ever have been offered yet
         Q_ASSERT(false);
@@ -1052,14 +1082,9 @@ void StreamTubeServer::onConnectionClosed(
 
     if (wrapper->mTube->addressType() == SocketAddressTypeIPv4
             || wrapper->mTube->addressType() == SocketAddressTypeIPv6) {
-        QHash<QPair<QHostAddress,quint16>, uint> srcAddrConns =
-            wrapper->mTube->connectionsForSourceAddresses();
-        QHash<uint, Tp::ContactPtr> connContacts =
-            wrapper->mTube->contactsForConnections();
-
-        QPair<QHostAddress, quint16> srcAddr = srcAddrConns.key(conn);
+        QPair<QHostAddress, quint16> srcAddr = wrapper->mTube->sourceAddressForConnection(conn);
         emit tcpConnectionClosed(srcAddr.first, srcAddr.second, wrapper->mAcc,
-                connContacts.value(conn), error, message, wrapper->mTube);
+                wrapper->mTube->contactForConnection(conn), error, message, wrapper->mTube);
     } else {
         // No UNIX socket should ever have been offered yet
         Q_ASSERT(false);
@@ -171,6 +171,9 @@ public:
     void exportTcpSocket(
             const QTcpServer *server,
             const QVariantMap &parameters = QVariantMap());
+    void exportTcpSocket(
+            const StreamTubeRelayPtr &relay,
+            const QVariantMap &parameters = QVariantMap());
 
     void exportTcpSocket(
             const QHostAddress &address,
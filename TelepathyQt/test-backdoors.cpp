@@ -22,7 +22,11 @@
 
 #include <TelepathyQt/test-backdoors.h>
 
+#include <TelepathyQt/ConnectionManager>
 #include <TelepathyQt/DBusProxy>
+#include <TelepathyQt/StreamTubeRelay>
+
+#include "TelepathyQt/parsed-file-cache.h"
 
 namespace Tp
 {
@@ -47,4 +51,29 @@ ContactCapabilities TestBackdoors::createContactCapabilities(
     return ContactCapabilities(rccSpecs, specificToContact);
 }
 
+int TestBackdoors::parsedFileCacheHits()
+{
+    return ParsedFileCache::hitCount();
+}
+
+int TestBackdoors::parsedFileCacheMisses()
+{
+    return ParsedFileCache::missCount();
+}
+
+QString TestBackdoors::parsedFileCacheFileName(const QString &category, const QString &fileName)
+{
+    return ParsedFileCache::cacheFileName(category, fileName);
+}
+
+int TestBackdoors::streamTubeRelayPollWakeUps(const StreamTubeRelayPtr &relay)
+{
+    return relay->pollWakeUps();
+}
+
+int TestBackdoors::connectionManagerIntrospections()
+{
+    return ConnectionManager::introspectionCount();
+}
+
 } // Tp
@@ -30,6 +30,7 @@
 #include <TelepathyQt/Global>
 #include <TelepathyQt/ConnectionCapabilities>
 #include <TelepathyQt/ContactCapabilities>
+#include <TelepathyQt/Types>
 
 #include <QString>
 
@@ -50,6 +51,14 @@ struct TP_QT_EXPORT TestBackdoors
             const RequestableChannelClassSpecList &rccSpecs);
     static ContactCapabilities createContactCapabilities(
             const RequestableChannelClassSpecList &rccSpecs, bool specificToContact);
+
+    static int parsedFileCacheHits();
+    static int parsedFileCacheMisses();
+    static QString parsedFileCacheFileName(const QString &category, const QString &fileName);
+
+    static int streamTubeRelayPollWakeUps(const StreamTubeRelayPtr &relay);
+
+    static int connectionManagerIntrospections();
 };
 
 } // Tp
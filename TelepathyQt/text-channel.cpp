@@ -37,6 +37,9 @@
 #include <TelepathyQt/ReferencedHandles>
 
 #include <QDateTime>
+#include <QMultiHash>
+
+#include <algorithm>
 
 namespace Tp
 {
@@ -57,6 +60,11 @@ struct TP_QT_NO_EXPORT TextChannel::Private
     void processMessageQueue();
     void processChatStateQueue();
 
+    void appendMessage(const ReceivedMessage &message);
+    bool removeMessage(const ReceivedMessage &message);
+    QList<ReceivedMessage> takeMessages(uint pendingId);
+    int messageIndex(quint64 key) const;
+
     void contactLost(uint handle);
     void contactFound(ContactPtr contact);
 
@@ -95,7 +103,13 @@ struct TP_QT_NO_EXPORT TextChannel::Private
         ReceivedMessage message;
         uint removed;
     };
-    QList<ReceivedMessage> messages;
+    // The message queue, with the key of each message alongside. Keys are given in the order
+    // in which the messages were received, so they are sorted.
+    QList<ReceivedMessage> messageQueue;
+    QList<quint64> messageQueueKeys;
+    quint64 nextMessageKey;
+    // Maps pendingId() to the keys of the messages with that id
+    QMultiHash<uint, quint64> messageKeys;
     QList<MessageEvent *> incompleteMessages;
     QHash<QDBusPendingCallWatcher *, UIntList> acknowledgeBatches;
 
@@ -125,7 +139,8 @@ TextChannel::Private::Private(TextChannel *parent)
       gotProperties(false),
       messagePartSupport(0),
       deliveryReportingSupport(0),
-      initialMessagesReceived(false)
+      initialMessagesReceived(false),
+      nextMessageKey(0)
 {
     ReadinessHelper::Introspectables introspectables;
 
@@ -346,7 +361,7 @@ void TextChannel::Private::processMessageQueue()
     // to incoming messages
     while (!incompleteMessages.isEmpty()) {
         const MessageEvent *e = incompleteMessages.first();
-        debug() << "MessageEvent:" << reinterpret_cast<const void *>(e);
+        debugCategory(DebugMessages) << "MessageEvent:" << reinterpret_cast<const void *>(e);
 
         if (e->isMessage) {
             if (e->message.senderHandle() != 0 &&
@@ -358,25 +373,18 @@ void TextChannel::Private::processMessageQueue()
             }
 
             // if we reach here, the message is ready
-            debug() << "Message is usable, copying to main queue";
-            messages << e->message;
+            debugCategory(DebugMessages) << "Message is usable, copying to main queue";
+            appendMessage(e->message);
             emit parent->messageReceived(e->message);
         } else {
             // forget about the message(s) with ID e->removed (there should be
             // at most one under normal circumstances)
-            int i = 0;
-            while (i < messages.size()) {
-                if (messages.at(i).pendingId() == e->removed) {
-                    ReceivedMessage removedMessage = messages.at(i);
-                    messages.removeAt(i);
-                    emit parent->pendingMessageRemoved(removedMessage);
-                } else {
-                    i++;
-                }
+            foreach (const ReceivedMessage &removedMessage, takeMessages(e->removed)) {
+                emit parent->pendingMessageRemoved(removedMessage);
             }
         }
 
-        debug() << "Dropping first event";
+        debugCategory(DebugMessages) << "Dropping first event";
         delete incompleteMessages.takeFirst();
     }
 
@@ -418,11 +426,73 @@ void TextChannel::Private::processMessageQueue()
     awaitingContacts |= contactsRequired.keys().toSet();
 }
 
+void TextChannel::Private::appendMessage(const ReceivedMessage &message)
+{
+    quint64 key = nextMessageKey++;
+    messageQueue << message;
+    messageQueueKeys << key;
+    messageKeys.insert(message.pendingId(), key);
+}
+
+bool TextChannel::Private::removeMessage(const ReceivedMessage &message)
+{
+    QMultiHash<uint, quint64>::Iterator i = messageKeys.find(message.pendingId());
+    while (i != messageKeys.end() && i.key() == message.pendingId()) {
+        int index = messageIndex(i.value());
+        if (index != -1 && messageQueue.at(index) == message) {
+            messageQueue.removeAt(index);
+            messageQueueKeys.removeAt(index);
+            messageKeys.erase(i);
+            return true;
+        }
+        ++i;
+    }
+
+    return false;
+}
+
+QList<ReceivedMessage> TextChannel::Private::takeMessages(uint pendingId)
+{
+    QList<quint64> keys = messageKeys.values(pendingId);
+    if (keys.isEmpty()) {
+        return QList<ReceivedMessage>();
+    }
+
+    messageKeys.remove(pendingId);
+    // keep the order of the queue
+    std::sort(keys.begin(), keys.end());
+
+    QList<ReceivedMessage> taken;
+    foreach (quint64 key, keys) {
+        int index = messageIndex(key);
+        if (index != -1) {
+            taken << messageQueue.takeAt(index);
+            messageQueueKeys.removeAt(index);
+        }
+    }
+
+    return taken;
+}
+
+/*
+ * Return the position of the message with the given key in messageQueue, or -1 if it is not
+ * there anymore.
+ */
+int TextChannel::Private::messageIndex(quint64 key) const
+{
+    QList<quint64>::const_iterator i = std::lower_bound(messageQueueKeys.constBegin(),
+            messageQueueKeys.constEnd(), key);
+    if (i == messageQueueKeys.constEnd() || *i != key) {
+        return -1;
+    }
+    return i - messageQueueKeys.constBegin();
+}
+
 void TextChannel::Private::processChatStateQueue()
 {
     while (!chatStateQueue.isEmpty()) {
         const ChatStateEvent *e = chatStateQueue.first();
-        debug() << "ChatStateEvent:" << reinterpret_cast<const void *>(e);
+        debugCategory(DebugMessages) << "ChatStateEvent:" << reinterpret_cast<const void *>(e);
 
         if (e->contact.isNull()) {
             // the chat state Contact object wasn't retrieved yet, but needs
@@ -436,7 +506,7 @@ void TextChannel::Private::processChatStateQueue()
         // if we reach here, the Contact object is ready
         emit parent->chatStateChanged(e->contact, (ChannelChatState) e->state);
 
-        debug() << "Dropping first event";
+        debugCategory(DebugMessages) << "Dropping first event";
         delete chatStateQueue.takeFirst();
     }
 
@@ -825,7 +895,7 @@ DeliveryReportingSupportFlags TextChannel::deliveryReportingSupport() const
  */
 QList<ReceivedMessage> TextChannel::messageQueue() const
 {
-    return mPriv->messages;
+    return mPriv->messageQueue;
 }
 
 /**
@@ -861,7 +931,7 @@ void TextChannel::onAcknowledgePendingMessagesReply(
     if (reply.isError()) {
         // One of the IDs was bad, and we can't know which one. Recover by
         // doing as much as possible, and hope for the best...
-        debug() << "Recovering from AcknowledgePendingMessages failure for: "
+        debugCategory(DebugMessages) << "Recovering from AcknowledgePendingMessages failure for: "
             << ids;
         foreach (uint id, ids) {
             mPriv->textInterface->AcknowledgePendingMessages(UIntList() << id);
@@ -936,7 +1006,7 @@ void TextChannel::forget(const QList<ReceivedMessage> &messages)
     foreach (const ReceivedMessage &m, messages) {
         if (!m.isFromChannel(TextChannelPtr(this))) {
             warning() << "message did not come from this channel, ignoring";
-        } else if (mPriv->messages.removeOne(m)) {
+        } else if (mPriv->removeMessage(m)) {
             emit pendingMessageRemoved(m);
         }
     }
@@ -96,6 +96,7 @@ class StreamedMediaChannel;
 class StreamedMediaStream;
 class StreamTubeChannel;
 class StreamTubeClient;
+class StreamTubeRelay;
 class StreamTubeServer;
 class TextChannel;
 class TubeChannel;
@@ -164,6 +165,7 @@ typedef TP_QT_DEPRECATED SharedPtr<StreamedMediaChannel> StreamedMediaChannelPtr
 typedef TP_QT_DEPRECATED SharedPtr<StreamedMediaStream> StreamedMediaStreamPtr;
 typedef SharedPtr<StreamTubeChannel> StreamTubeChannelPtr;
 typedef SharedPtr<StreamTubeClient> StreamTubeClientPtr;
+typedef SharedPtr<StreamTubeRelay> StreamTubeRelayPtr;
 typedef SharedPtr<StreamTubeServer> StreamTubeServerPtr;
 typedef SharedPtr<TextChannel> TextChannelPtr;
 typedef SharedPtr<TubeChannel> TubeChannelPtr;
@@ -0,0 +1,343 @@
+#include <QtTest/QtTest>
+
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+
+#include <TelepathyQt/Debug>
+#include "TelepathyQt/avatar-cache-internal.h"
+
+#include <sys/types.h>
+#include <time.h>
+#include <utime.h>
+
+using namespace Tp;
+
+class TestAvatarCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestAvatarCache(QObject *parent = 0);
+
+protected Q_SLOTS:
+    void onDirectoryLoaded(const QString &path);
+    void onAvatarStored(const QString &path, const QString &token, const Tp::AvatarData &avatar);
+
+private Q_SLOTS:
+    void init();
+
+    void testLookup();
+    void testEviction();
+    void testEvictionKeepsPinned();
+    void testEvictionKeepsOthers();
+    void testPinBeforeInstance();
+    void testExpiry();
+
+    void cleanup();
+
+private:
+    AvatarCache *cache();
+    void writeFile(const QString &fileName, const QByteArray &data);
+    bool waitForRemoval(const QString &fileName);
+
+    QEventLoop *mLoop;
+    QString mPath;
+    QString mStoredToken;
+    AvatarData mStoredAvatar;
+};
+
+TestAvatarCache::TestAvatarCache(QObject *parent)
+    : QObject(parent),
+      mLoop(new QEventLoop(this))
+{
+    Tp::enableDebug(true);
+    Tp::enableWarnings(true);
+}
+
+void TestAvatarCache::onDirectoryLoaded(const QString &path)
+{
+    if (path == mPath) {
+        mLoop->exit(0);
+    }
+}
+
+void TestAvatarCache::onAvatarStored(const QString &path, const QString &token,
+        const AvatarData &avatar)
+{
+    if (path == mPath) {
+        mStoredToken = token;
+        mStoredAvatar = avatar;
+        mLoop->exit(0);
+    }
+}
+
+AvatarCache *TestAvatarCache::cache()
+{
+    AvatarCache *cache = AvatarCache::instance();
+    connect(cache, SIGNAL(directoryLoaded(QString)),
+            SLOT(onDirectoryLoaded(QString)), Qt::UniqueConnection);
+    connect(cache, SIGNAL(avatarStored(QString,QString,Tp::AvatarData)),
+            SLOT(onAvatarStored(QString,QString,Tp::AvatarData)), Qt::UniqueConnection);
+    return cache;
+}
+
+void TestAvatarCache::writeFile(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(data), qint64(data.size()));
+}
+
+bool TestAvatarCache::waitForRemoval(const QString &fileName)
+{
+    // Files are removed by the cache worker thread
+    for (int i = 0; i < 500 && QFile::exists(fileName); ++i) {
+        QTest::qWait(10);
+    }
+    return !QFile::exists(fileName);
+}
+
+void TestAvatarCache::init()
+{
+    mPath = QString(QLatin1String("%1/avatar-cache-test-%2-%3"))
+        .arg(QDir::tempPath())
+        .arg(QCoreApplication::applicationPid())
+        .arg(QLatin1String(QTest::currentTestFunction()));
+    QVERIFY(QDir().mkpath(mPath));
+
+    mStoredToken.clear();
+    mStoredAvatar = AvatarData();
+}
+
+void TestAvatarCache::testLookup()
+{
+    AvatarCache *avatarCache = cache();
+    AvatarData avatar;
+
+    // The directory index is loaded on first use
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("alice"), avatar), AvatarCache::Loading);
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(avatarCache->hits(), quint64(0));
+    QCOMPARE(avatarCache->misses(), quint64(0));
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("alice"), avatar), AvatarCache::Miss);
+    QCOMPARE(avatarCache->misses(), quint64(1));
+
+    avatarCache->store(mPath, QLatin1String("alice"), QByteArray("alice's avatar"),
+            QLatin1String("image/png"));
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("alice"), avatar), AvatarCache::Storing);
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mStoredToken, QString(QLatin1String("alice")));
+    QCOMPARE(mStoredAvatar.mimeType, QString(QLatin1String("image/png")));
+
+    QFile file(mStoredAvatar.fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), QByteArray("alice's avatar"));
+    QVERIFY(QFile::exists(mStoredAvatar.fileName + QLatin1String(".mime")));
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("alice"), avatar), AvatarCache::Hit);
+    QCOMPARE(avatar.fileName, mStoredAvatar.fileName);
+    QCOMPARE(avatar.mimeType, mStoredAvatar.mimeType);
+    QCOMPARE(avatarCache->hits(), quint64(1));
+    QCOMPARE(avatarCache->misses(), quint64(1));
+}
+
+void TestAvatarCache::testEviction()
+{
+    AvatarCache *avatarCache = cache();
+    avatarCache->setMaxSize(250);
+    AvatarData avatar;
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Loading);
+    QCOMPARE(mLoop->exec(), 0);
+
+    avatarCache->store(mPath, QLatin1String("a"), QByteArray(100, 'a'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QString aFileName = mStoredAvatar.fileName;
+    avatarCache->store(mPath, QLatin1String("b"), QByteArray(100, 'b'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QString bFileName = mStoredAvatar.fileName;
+
+    // Using a makes b the least recently used avatar
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Hit);
+
+    // Going over the limit evicts b, which is enough to get below it
+    avatarCache->store(mPath, QLatin1String("c"), QByteArray(100, 'c'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("b"), avatar), AvatarCache::Miss);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Hit);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("c"), avatar), AvatarCache::Hit);
+    QVERIFY(waitForRemoval(bFileName));
+    QVERIFY(QFile::exists(aFileName));
+    QVERIFY(QFile::exists(mStoredAvatar.fileName));
+
+    // Lowering the limit evicts right away
+    avatarCache->setMaxSize(150);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Miss);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("c"), avatar), AvatarCache::Hit);
+    QVERIFY(waitForRemoval(aFileName));
+}
+
+void TestAvatarCache::testEvictionKeepsPinned()
+{
+    AvatarCache *avatarCache = cache();
+    avatarCache->setMaxSize(250);
+    AvatarData avatar;
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Loading);
+    QCOMPARE(mLoop->exec(), 0);
+
+    avatarCache->store(mPath, QLatin1String("a"), QByteArray(100, 'a'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QString aFileName = mStoredAvatar.fileName;
+    avatarCache->store(mPath, QLatin1String("b"), QByteArray(100, 'b'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QString bFileName = mStoredAvatar.fileName;
+
+    // A contact points at b, so a goes instead even though it was used more recently
+    AvatarCache::pin(bFileName);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Hit);
+
+    avatarCache->store(mPath, QLatin1String("c"), QByteArray(100, 'c'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Miss);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("b"), avatar), AvatarCache::Hit);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("c"), avatar), AvatarCache::Hit);
+    QVERIFY(waitForRemoval(aFileName));
+    QVERIFY(QFile::exists(bFileName));
+
+    // Nothing is evictable when everything left is pinned
+    AvatarCache::pin(mStoredAvatar.fileName);
+    avatarCache->setMaxSize(50);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("b"), avatar), AvatarCache::Hit);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("c"), avatar), AvatarCache::Hit);
+
+    // Once unpinned, b is the least recently used avatar again
+    AvatarCache::unpin(bFileName);
+    avatarCache->setMaxSize(150);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("b"), avatar), AvatarCache::Miss);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("c"), avatar), AvatarCache::Hit);
+    QVERIFY(waitForRemoval(bFileName));
+
+    AvatarCache::unpin(mStoredAvatar.fileName);
+}
+
+void TestAvatarCache::testEvictionKeepsOthers()
+{
+    // An avatar some other client wrote to the shared cache directory
+    QString otherFileName = mPath + QLatin1String("/other");
+    writeFile(otherFileName, QByteArray(1000, 'o'));
+    writeFile(otherFileName + QLatin1String(".mime"), QByteArray("image/png"));
+
+    AvatarCache *avatarCache = cache();
+    avatarCache->setMaxSize(250);
+    AvatarData avatar;
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("other"), avatar), AvatarCache::Loading);
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("other"), avatar), AvatarCache::Hit);
+
+    // It doesn't count against the limit of this process
+    avatarCache->store(mPath, QLatin1String("a"), QByteArray(100, 'a'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QString aFileName = mStoredAvatar.fileName;
+    avatarCache->store(mPath, QLatin1String("b"), QByteArray(100, 'b'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Hit);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("b"), avatar), AvatarCache::Hit);
+
+    // Nor is it evicted, even though it is the least recently used avatar
+    avatarCache->store(mPath, QLatin1String("c"), QByteArray(100, 'c'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("other"), avatar), AvatarCache::Hit);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Miss);
+    QVERIFY(waitForRemoval(aFileName));
+    QVERIFY(QFile::exists(otherFileName));
+
+    avatarCache->setMaxSize(1);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("other"), avatar), AvatarCache::Hit);
+    QVERIFY(QFile::exists(otherFileName));
+}
+
+void TestAvatarCache::testPinBeforeInstance()
+{
+    // Contacts may pin their avatar before anything else uses the cache
+    QString aFileName = mPath + QLatin1String("/a");
+    AvatarCache::pin(aFileName);
+
+    AvatarCache *avatarCache = cache();
+    avatarCache->setMaxSize(250);
+    AvatarData avatar;
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Loading);
+    QCOMPARE(mLoop->exec(), 0);
+
+    avatarCache->store(mPath, QLatin1String("a"), QByteArray(100, 'a'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mStoredAvatar.fileName, aFileName);
+    avatarCache->store(mPath, QLatin1String("b"), QByteArray(100, 'b'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+    QString bFileName = mStoredAvatar.fileName;
+    avatarCache->store(mPath, QLatin1String("c"), QByteArray(100, 'c'), QLatin1String("image/png"));
+    QCOMPARE(mLoop->exec(), 0);
+
+    // a is the least recently used avatar, but pinned
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("a"), avatar), AvatarCache::Hit);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("b"), avatar), AvatarCache::Miss);
+    QVERIFY(waitForRemoval(bFileName));
+    QVERIFY(QFile::exists(aFileName));
+
+    AvatarCache::unpin(aFileName);
+}
+
+void TestAvatarCache::testExpiry()
+{
+    const int day = 24 * 60 * 60;
+
+    QString oldFileName = mPath + QLatin1String("/old");
+    QString newFileName = mPath + QLatin1String("/new");
+    writeFile(oldFileName, QByteArray("old avatar"));
+    writeFile(oldFileName + QLatin1String(".mime"), QByteArray("image/png"));
+    writeFile(newFileName, QByteArray("new avatar"));
+    writeFile(newFileName + QLatin1String(".mime"), QByteArray("image/png"));
+
+    // The last use time of an avatar is its modification time
+    struct utimbuf times;
+    times.actime = times.modtime = time(0) - 2 * day;
+    QCOMPARE(utime(QFile::encodeName(oldFileName).constData(), &times), 0);
+
+    AvatarCache *avatarCache = cache();
+    avatarCache->setMaxAge(day);
+    QCOMPARE(avatarCache->maxAge(), day);
+    AvatarData avatar;
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("new"), avatar), AvatarCache::Loading);
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("old"), avatar), AvatarCache::Miss);
+    QCOMPARE(avatarCache->lookup(mPath, QLatin1String("new"), avatar), AvatarCache::Hit);
+    QCOMPARE(avatar.fileName, newFileName);
+    QCOMPARE(avatar.mimeType, QString(QLatin1String("image/png")));
+
+    QVERIFY(waitForRemoval(oldFileName));
+    QVERIFY(!QFile::exists(oldFileName + QLatin1String(".mime")));
+    QVERIFY(QFile::exists(newFileName));
+}
+
+void TestAvatarCache::cleanup()
+{
+    // Start each test with a fresh cache and counters
+    delete AvatarCache::instance();
+
+    QDir dir(mPath);
+    foreach (const QString &fileName, dir.entryList(QDir::Files | QDir::NoDotAndDotDot)) {
+        dir.remove(fileName);
+    }
+    QDir().rmdir(mPath);
+}
+
+QTEST_MAIN(TestAvatarCache)
+#include "_gen/avatar-cache.cpp.moc.hpp"
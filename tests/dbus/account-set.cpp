@@ -28,12 +28,14 @@ class TestAccountSet : public Test
 public:
     TestAccountSet(QObject *parent = 0)
         : Test(parent),
-          mConn(0)
+          mConn(0),
+          mSetChanges(0)
     { }
 
 protected Q_SLOTS:
     void onAccountAdded(const Tp::AccountPtr &);
     void onAccountRemoved(const Tp::AccountPtr &);
+    void onSetChanged();
     void onCreateAccountFinished(Tp::PendingOperation *op);
 
 private Q_SLOTS:
@@ -42,6 +44,9 @@ private Q_SLOTS:
 
     void testBasics();
     void testFilters();
+    void testPropertyChanges();
+    void testPropertyChanges_data();
+    void testPropertyChangeMovesAccounts();
 
     void cleanup();
     void cleanupTestCase();
@@ -50,6 +55,10 @@ private:
     void createAccount(const char *cmName, const char *protocolName,
             const char *displayName, const QVariantMap &parameters);
     void removeAccount(const AccountPtr &acc);
+    void setAccountEnabled(const AccountPtr &acc, bool enabled);
+    QList<AccountSetPtr> liveAccountSets();
+    void connectSetChanges(const QList<AccountSetPtr> &sets);
+    void disconnectSetChanges(const QList<AccountSetPtr> &sets);
     QStringList pathsForAccounts(const QList<Tp::AccountPtr> &list);
     QStringList pathsForAccounts(const Tp::AccountSetPtr &set);
 
@@ -58,6 +67,7 @@ private:
     AccountPtr mAccountCreated;
     AccountPtr mAccountAdded;
     AccountPtr mAccountRemoved;
+    int mSetChanges;
 };
 
 void TestAccountSet::onAccountAdded(const Tp::AccountPtr &acc)
@@ -76,6 +86,11 @@ void TestAccountSet::onAccountRemoved(const Tp::AccountPtr &acc)
     qDebug() << "ACCOUNT REMOVED:" << acc->objectPath();
 }
 
+void TestAccountSet::onSetChanged()
+{
+    mSetChanges++;
+}
+
 void TestAccountSet::onCreateAccountFinished(PendingOperation *op)
 {
     TEST_VERIFY_OP(op);
@@ -113,9 +128,11 @@ void TestAccountSet::createAccount(const char *cmName, const char *protocolName,
     mAccountCreated.reset();
     mAccountAdded.reset();
 
-    QVERIFY(connect(accounts.data(),
-                SIGNAL(accountAdded(Tp::AccountPtr)),
-                SLOT(onAccountAdded(Tp::AccountPtr))));
+    // The set may already be in use, and connected, from an earlier call
+    connect(accounts.data(),
+            SIGNAL(accountAdded(Tp::AccountPtr)),
+            SLOT(onAccountAdded(Tp::AccountPtr)),
+            Qt::UniqueConnection);
 
     PendingAccount *pacc = mAM->createAccount(QLatin1String(cmName),
             QLatin1String(protocolName), QLatin1String(displayName), parameters);
@@ -135,9 +152,10 @@ void TestAccountSet::removeAccount(const AccountPtr &acc)
     QVERIFY(accounts->accounts().contains(acc));
 
     int oldAccountsCount = accounts->accounts().size();
-    QVERIFY(connect(accounts.data(),
-                SIGNAL(accountRemoved(Tp::AccountPtr)),
-                SLOT(onAccountRemoved(Tp::AccountPtr))));
+    connect(accounts.data(),
+            SIGNAL(accountRemoved(Tp::AccountPtr)),
+            SLOT(onAccountRemoved(Tp::AccountPtr)),
+            Qt::UniqueConnection);
 
     QVERIFY(connect(acc->remove(),
                 SIGNAL(finished(Tp::PendingOperation *)),
@@ -154,6 +172,59 @@ void TestAccountSet::removeAccount(const AccountPtr &acc)
     QCOMPARE(acc->invalidationReason(), TP_QT_ERROR_OBJECT_REMOVED);
 }
 
+void TestAccountSet::setAccountEnabled(const AccountPtr &acc, bool enabled)
+{
+    QVERIFY(connect(acc->setEnabled(enabled),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QTRY_VERIFY_WITH_TIMEOUT(acc->isEnabled() == enabled, 5000);
+    processDBusQueue(mConn->client().data());
+}
+
+QList<AccountSetPtr> TestAccountSet::liveAccountSets()
+{
+    QList<AccountSetPtr> sets;
+    sets << mAM->validAccounts() << mAM->invalidAccounts() <<
+        mAM->enabledAccounts() << mAM->disabledAccounts() <<
+        mAM->onlineAccounts() << mAM->offlineAccounts() <<
+        mAM->textChatAccounts() << mAM->fileTransferAccounts() <<
+        mAM->accountsByProtocol(QLatin1String("bar")) <<
+        mAM->accountsByProtocol(QLatin1String("normal"));
+    // The predefined views are shared, so use custom filters for the other half
+    const char *properties[] = { "valid", "enabled", "online", "hasBeenOnline", "connectsAutomatically" };
+    for (int i = 0; i < 10; ++i) {
+        QVariantMap filter;
+        filter.insert(QLatin1String(properties[i / 2]), (i % 2) == 0);
+        sets << mAM->filterAccounts(filter);
+    }
+    return sets;
+}
+
+void TestAccountSet::connectSetChanges(const QList<AccountSetPtr> &sets)
+{
+    // The predefined views are shared, so they may still be connected from an earlier test
+    mSetChanges = 0;
+    foreach (const AccountSetPtr &set, sets) {
+        connect(set.data(),
+                SIGNAL(accountAdded(Tp::AccountPtr)),
+                SLOT(onSetChanged()),
+                Qt::UniqueConnection);
+        connect(set.data(),
+                SIGNAL(accountRemoved(Tp::AccountPtr)),
+                SLOT(onSetChanged()),
+                Qt::UniqueConnection);
+    }
+}
+
+void TestAccountSet::disconnectSetChanges(const QList<AccountSetPtr> &sets)
+{
+    foreach (const AccountSetPtr &set, sets) {
+        set->disconnect(this, SLOT(onSetChanged()));
+    }
+}
+
 QStringList TestAccountSet::pathsForAccounts(const QList<Tp::AccountPtr> &list)
 {
     QStringList ret;
@@ -395,6 +466,125 @@ void TestAccountSet::testFilters()
         QVERIFY(mAM->accountsByProtocol(QLatin1String("normal"))->accounts().contains(spuriousAcc));
         QCOMPARE(mAM->accountsByProtocol(QLatin1String("noname"))->accounts().size(), 0);
     }
+
+    {
+        // the predefined views are shared while they are in use
+        AccountSetPtr onlineAccounts = mAM->onlineAccounts();
+        QCOMPARE(mAM->onlineAccounts(), onlineAccounts);
+        QCOMPARE(onlineAccounts->accountManager(), mAM);
+        AccountSetPtr barAccounts = mAM->accountsByProtocol(QLatin1String("bar"));
+        QCOMPARE(mAM->accountsByProtocol(QLatin1String("bar")), barAccounts);
+        QVERIFY(mAM->accountsByProtocol(QLatin1String("normal")) != barAccounts);
+        QCOMPARE(barAccounts->accountManager(), mAM);
+        QVERIFY(mAM->filterAccounts(QVariantMap()) != mAM->filterAccounts(QVariantMap()));
+    }
+}
+
+void TestAccountSet::testPropertyChanges()
+{
+    QFETCH(QString, propertyName);
+
+    const int numAccounts = 500;
+    while (mAM->allAccounts().size() < numAccounts) {
+        QByteArray name = "benchmark" + QByteArray::number(mAM->allAccounts().size());
+        QVariantMap parameters;
+        parameters[QLatin1String("account")] = QLatin1String(name.constData());
+        createAccount("foo", "bar", name.constData(), parameters);
+    }
+
+    // 20 live sets, as a few components of a desktop session would have
+    QList<AccountSetPtr> sets = liveAccountSets();
+    QCOMPARE(sets.size(), 20);
+    QVERIFY(sets.first()->accounts().size() >= numAccounts);
+    connectSetChanges(sets);
+
+    QList<AccountPtr> accounts = mAM->allAccounts();
+    QBENCHMARK {
+        foreach (const AccountPtr &account, accounts) {
+            QVERIFY(QMetaObject::invokeMethod(account.data(), "propertyChanged",
+                        Qt::DirectConnection, Q_ARG(QString, propertyName)));
+        }
+    }
+
+    // Nothing actually changed, so the sets must not have either
+    QCOMPARE(mSetChanges, 0);
+    QVERIFY(sets.first()->accounts().size() >= numAccounts);
+    QCOMPARE(sets[8]->accounts().size(), mAM->accountsByProtocol(QLatin1String("bar"))->accounts().size());
+
+    disconnectSetChanges(sets);
+}
+
+void TestAccountSet::testPropertyChanges_data()
+{
+    QTest::addColumn<QString>("propertyName");
+
+    // Not used by any of the filters
+    QTest::newRow("nickname") << QString(QLatin1String("nickname"));
+    // Used by the enabled/disabled account filters
+    QTest::newRow("enabled") << QString(QLatin1String("enabled"));
+}
+
+void TestAccountSet::testPropertyChangeMovesAccounts()
+{
+    QVariantMap parameters;
+    parameters[QLatin1String("account")] = QLatin1String("mover");
+    createAccount("foo", "bar", "mover", parameters);
+    AccountPtr acc = mAccountCreated;
+    QVERIFY(acc->isEnabled());
+
+    QList<AccountSetPtr> sets = liveAccountSets();
+
+    // Composed filters are compiled too, and must track the properties of their children
+    QList<AccountFilterConstPtr> filterChain;
+    AccountPropertyFilterPtr enabledFilter = AccountPropertyFilter::create();
+    enabledFilter->addProperty(QLatin1String("enabled"), true);
+    AccountPropertyFilterPtr cmNameFilter = AccountPropertyFilter::create();
+    cmNameFilter->addProperty(QLatin1String("cmName"), QLatin1String("foo"));
+    AccountPropertyFilterPtr protocolFilter = AccountPropertyFilter::create();
+    protocolFilter->addProperty(QLatin1String("protocolName"), QLatin1String("noname"));
+    filterChain << cmNameFilter << enabledFilter;
+    AccountSetPtr enabledFooAccounts = AccountSetPtr(new AccountSet(mAM,
+                AndFilter<Account>::create(filterChain)));
+    filterChain.clear();
+    filterChain << protocolFilter << NotFilter<Account>::create(enabledFilter);
+    AccountSetPtr notEnabledAccounts = AccountSetPtr(new AccountSet(mAM,
+                OrFilter<Account>::create(filterChain)));
+    QVERIFY(enabledFooAccounts->accounts().contains(acc));
+    QCOMPARE(pathsForAccounts(notEnabledAccounts).toSet(), pathsForAccounts(sets[3]).toSet());
+
+    connectSetChanges(sets);
+
+    // An actual change moves the account between the enabled and disabled sets, and nothing else
+    int numEnabled = sets[2]->accounts().size();
+    int numDisabled = sets[3]->accounts().size();
+    setAccountEnabled(acc, false);
+
+    QCOMPARE(sets[2]->accounts().size(), numEnabled - 1);
+    QVERIFY(!sets[2]->accounts().contains(acc));
+    QCOMPARE(sets[3]->accounts().size(), numDisabled + 1);
+    QVERIFY(sets[3]->accounts().contains(acc));
+    QVERIFY(!sets[12]->accounts().contains(acc));
+    QVERIFY(sets[13]->accounts().contains(acc));
+    // enabled/disabled, and the enabled == true/false custom filters
+    QCOMPARE(mSetChanges, 4);
+
+    QVERIFY(!enabledFooAccounts->accounts().contains(acc));
+    QVERIFY(notEnabledAccounts->accounts().contains(acc));
+    QCOMPARE(pathsForAccounts(notEnabledAccounts).toSet(), pathsForAccounts(sets[3]).toSet());
+
+    setAccountEnabled(acc, true);
+
+    QCOMPARE(sets[2]->accounts().size(), numEnabled);
+    QVERIFY(sets[2]->accounts().contains(acc));
+    QCOMPARE(sets[3]->accounts().size(), numDisabled);
+    QVERIFY(!sets[3]->accounts().contains(acc));
+    QCOMPARE(mSetChanges, 8);
+
+    QVERIFY(enabledFooAccounts->accounts().contains(acc));
+    QVERIFY(!notEnabledAccounts->accounts().contains(acc));
+    QCOMPARE(pathsForAccounts(notEnabledAccounts).toSet(), pathsForAccounts(sets[3]).toSet());
+
+    disconnectSetChanges(sets);
 }
 
 void TestAccountSet::cleanup()
@@ -0,0 +1,403 @@
+#include <tests/lib/test.h>
+
+#define TP_QT_ENABLE_LOWLEVEL_API
+
+#include <TelepathyQt/BaseChannel>
+#include <TelepathyQt/BaseConnection>
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/DBusError>
+
+using namespace Tp;
+
+class TestConnection : public BaseConnection
+{
+public:
+    TestConnection(const QDBusConnection &dbusConnection, const QString &cmName,
+            const QString &protocolName, const QVariantMap &parameters)
+        : BaseConnection(dbusConnection, cmName, protocolName, parameters),
+          matchCount(0),
+          aliasHandle(0),
+          aliasedHandle(0)
+    { }
+
+    bool matchChannel(const BaseChannelPtr &channel, const QVariantMap &request, DBusError *error)
+    {
+        ++matchCount;
+
+        // aliasHandle is another handle for the contact aliasedHandle
+        if (aliasHandle != 0 && channel->targetHandle() == aliasedHandle &&
+                request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")).toUInt() == aliasHandle) {
+            return true;
+        }
+
+        return BaseConnection::matchChannel(channel, request, error);
+    }
+
+    using BaseConnection::isChannelIndexEnabled;
+    using BaseConnection::setChannelIndexEnabled;
+
+    int matchCount;
+    uint aliasHandle;
+    uint aliasedHandle;
+};
+
+typedef SharedPtr<TestConnection> TestConnectionPtr;
+
+static QStringList inspectHandlesCb(uint handleType, const Tp::UIntList &handles, Tp::DBusError *error)
+{
+    Q_UNUSED(handleType);
+    Q_UNUSED(error);
+
+    QStringList identifiers;
+    foreach (uint handle, handles) {
+        identifiers << QString(QLatin1String("contact%1")).arg(handle);
+    }
+    return identifiers;
+}
+
+class TestBaseConnection : public Test
+{
+    Q_OBJECT
+
+public:
+    TestBaseConnection(QObject *parent = 0)
+        : Test(parent),
+          mNewChannelsCount(0)
+    { }
+
+protected Q_SLOTS:
+    void onNewChannels(const Tp::ChannelDetailsList &channels);
+    void onChannelClosed(const QDBusObjectPath &channel);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testChannelIndex();
+    void testChannelIndexOtherTarget();
+    void testChannelIndexDisabled();
+    void testNewChannelsBatching();
+    void testNewChannelsBatchSize();
+    void testFlushNewChannels();
+    void testNewChannelsBeforeClosed();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    BaseChannelPtr createChannelCb(const QVariantMap &request, DBusError *error);
+    BaseChannelPtr ensureTextChannel(uint handle, bool *yours);
+    BaseChannelPtr ensureTextChannel(const QString &id, bool *yours);
+
+    TestConnectionPtr mConn;
+    QString mBusName;
+    QString mObjectPath;
+    QList<QStringList> mNewChannels;
+    int mNewChannelsCount;
+    QStringList mEvents;
+};
+
+void TestBaseConnection::onNewChannels(const Tp::ChannelDetailsList &channels)
+{
+    QStringList paths;
+    foreach (const ChannelDetails &details, channels) {
+        paths << details.channel.path();
+        mEvents << QLatin1String("new ") + details.channel.path();
+    }
+    mNewChannels << paths;
+    mNewChannelsCount += paths.count();
+}
+
+void TestBaseConnection::onChannelClosed(const QDBusObjectPath &channel)
+{
+    mEvents << QLatin1String("closed ") + channel.path();
+}
+
+BaseChannelPtr TestBaseConnection::createChannelCb(const QVariantMap &request, DBusError *error)
+{
+    Q_UNUSED(error);
+
+    uint handle = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")).toUInt();
+    if (handle == 0) {
+        QString id = request.value(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID")).toString();
+        handle = id.mid(QString(QLatin1String("contact")).length()).toUInt();
+    }
+
+    return BaseChannel::create(mConn.data(), TP_QT_IFACE_CHANNEL_TYPE_TEXT, Tp::HandleTypeContact, handle);
+}
+
+BaseChannelPtr TestBaseConnection::ensureTextChannel(uint handle, bool *yours)
+{
+    QVariantMap request;
+    request[TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType")] = TP_QT_IFACE_CHANNEL_TYPE_TEXT;
+    request[TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType")] = (uint) Tp::HandleTypeContact;
+    request[TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle")] = handle;
+
+    DBusError error;
+    BaseChannelPtr channel = mConn->ensureChannel(request, *yours, false, &error);
+    if (error.isValid()) {
+        qWarning() << error.name() << error.message();
+    }
+    return channel;
+}
+
+BaseChannelPtr TestBaseConnection::ensureTextChannel(const QString &id, bool *yours)
+{
+    QVariantMap request;
+    request[TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType")] = TP_QT_IFACE_CHANNEL_TYPE_TEXT;
+    request[TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType")] = (uint) Tp::HandleTypeContact;
+    request[TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID")] = id;
+
+    DBusError error;
+    BaseChannelPtr channel = mConn->ensureChannel(request, *yours, false, &error);
+    if (error.isValid()) {
+        qWarning() << error.name() << error.message();
+    }
+    return channel;
+}
+
+void TestBaseConnection::initTestCase()
+{
+    initTestCaseImpl();
+}
+
+void TestBaseConnection::init()
+{
+    initImpl();
+
+    mConn = BaseConnection::create<TestConnection>(QLatin1String("testcm"),
+            QLatin1String("example"), QVariantMap());
+    mConn->setCreateChannelCallback(Tp::memFun(this, &TestBaseConnection::createChannelCb));
+    mConn->setInspectHandlesCallback(Tp::ptrFun(&inspectHandlesCb));
+
+    BaseConnectionRequestsInterfacePtr requests = BaseConnectionRequestsInterface::create(mConn.data());
+    QVERIFY(mConn->plugInterface(AbstractConnectionInterfacePtr::dynamicCast(requests)));
+
+    DBusError error;
+    QVERIFY(mConn->registerObject(&error));
+
+    mBusName = mConn->busName();
+    mObjectPath = mConn->objectPath();
+    mNewChannels.clear();
+    mNewChannelsCount = 0;
+    mEvents.clear();
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QVERIFY(bus.connect(mBusName, mObjectPath, TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS,
+                QLatin1String("NewChannels"), this, SLOT(onNewChannels(Tp::ChannelDetailsList))));
+    QVERIFY(bus.connect(mBusName, mObjectPath, TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS,
+                QLatin1String("ChannelClosed"), this, SLOT(onChannelClosed(QDBusObjectPath))));
+}
+
+void TestBaseConnection::testChannelIndex()
+{
+    QVERIFY(mConn->isChannelIndexEnabled());
+
+    QList<BaseChannelPtr> channels;
+    for (uint handle = 1; handle <= 50; ++handle) {
+        bool yours = false;
+        BaseChannelPtr channel = ensureTextChannel(handle, &yours);
+        QVERIFY(!channel.isNull());
+        QVERIFY(yours);
+        QCOMPARE(channel->targetHandle(), handle);
+        channels << channel;
+    }
+
+    // An existing channel is found by its target without checking the other ones
+    mConn->matchCount = 0;
+    bool yours = true;
+    QCOMPARE(ensureTextChannel(25, &yours), channels.at(24));
+    QVERIFY(!yours);
+    QCOMPARE(mConn->matchCount, 1);
+
+    mConn->matchCount = 0;
+    yours = true;
+    QCOMPARE(ensureTextChannel(QLatin1String("contact30"), &yours), channels.at(29));
+    QVERIFY(!yours);
+    QCOMPARE(mConn->matchCount, 1);
+
+    // A new target is created without checking the other channels
+    mConn->matchCount = 0;
+    yours = false;
+    BaseChannelPtr channel = ensureTextChannel(51, &yours);
+    QVERIFY(!channel.isNull());
+    QVERIFY(yours);
+    QCOMPARE(mConn->matchCount, 0);
+
+    // Closed channels leave the index
+    channels.at(9)->close();
+    mConn->matchCount = 0;
+    yours = false;
+    channel = ensureTextChannel(10, &yours);
+    QVERIFY(yours);
+    QVERIFY(channel != channels.at(9));
+    QCOMPARE(mConn->matchCount, 0);
+}
+
+void TestBaseConnection::testChannelIndexOtherTarget()
+{
+    bool yours = false;
+    BaseChannelPtr channel = ensureTextChannel(1, &yours);
+    QVERIFY(!channel.isNull());
+    QVERIFY(yours);
+    ensureTextChannel(2, &yours);
+    QVERIFY(yours);
+
+    // The reimplemented matchChannel() accepts a channel with another target, which is only
+    // checked with the index disabled
+    mConn->aliasHandle = 100;
+    mConn->aliasedHandle = 1;
+
+    mConn->setChannelIndexEnabled(false);
+    yours = true;
+    QCOMPARE(ensureTextChannel(100, &yours), channel);
+    QVERIFY(!yours);
+
+    mConn->setChannelIndexEnabled(true);
+    mConn->matchCount = 0;
+    yours = false;
+    BaseChannelPtr other = ensureTextChannel(100, &yours);
+    QVERIFY(!other.isNull());
+    QVERIFY(other != channel);
+    QVERIFY(yours);
+    QCOMPARE(mConn->matchCount, 0);
+}
+
+void TestBaseConnection::testChannelIndexDisabled()
+{
+    mConn->setChannelIndexEnabled(false);
+    QVERIFY(!mConn->isChannelIndexEnabled());
+
+    QList<BaseChannelPtr> channels;
+    for (uint handle = 1; handle <= 10; ++handle) {
+        bool yours = false;
+        BaseChannelPtr channel = ensureTextChannel(handle, &yours);
+        QVERIFY(!channel.isNull());
+        QVERIFY(yours);
+        channels << channel;
+    }
+
+    bool yours = true;
+    QCOMPARE(ensureTextChannel(5, &yours), channels.at(4));
+    QVERIFY(!yours);
+
+    yours = true;
+    QCOMPARE(ensureTextChannel(QLatin1String("contact7"), &yours), channels.at(6));
+    QVERIFY(!yours);
+
+    mConn->aliasHandle = 100;
+    mConn->aliasedHandle = 3;
+    yours = true;
+    QCOMPARE(ensureTextChannel(100, &yours), channels.at(2));
+    QVERIFY(!yours);
+
+    // Every channel is checked when none matches
+    mConn->matchCount = 0;
+    yours = false;
+    QVERIFY(!ensureTextChannel(11, &yours).isNull());
+    QVERIFY(yours);
+    QCOMPARE(mConn->matchCount, 10);
+}
+
+void TestBaseConnection::testNewChannelsBatching()
+{
+    QCOMPARE(mConn->newChannelsBatchSize(), 100);
+
+    // The channels added in one main loop iteration are announced together
+    QStringList paths;
+    for (uint handle = 1; handle <= 5; ++handle) {
+        bool yours = false;
+        BaseChannelPtr channel = ensureTextChannel(handle, &yours);
+        QVERIFY(!channel.isNull());
+        paths << channel->objectPath();
+    }
+    QCOMPARE(mNewChannels.count(), 0);
+
+    QTRY_COMPARE_WITH_TIMEOUT(mNewChannelsCount, 5, 5000);
+    QCOMPARE(mNewChannels.count(), 1);
+    QCOMPARE(mNewChannels.at(0), paths);
+}
+
+void TestBaseConnection::testNewChannelsBatchSize()
+{
+    mConn->setNewChannelsBatchSize(0);
+    QCOMPARE(mConn->newChannelsBatchSize(), 1);
+    mConn->setNewChannelsBatchSize(2);
+    QCOMPARE(mConn->newChannelsBatchSize(), 2);
+
+    // A full batch is announced before the next channel is added
+    QStringList paths;
+    for (uint handle = 1; handle <= 5; ++handle) {
+        bool yours = false;
+        BaseChannelPtr channel = ensureTextChannel(handle, &yours);
+        QVERIFY(!channel.isNull());
+        paths << channel->objectPath();
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(mNewChannelsCount, 5, 5000);
+    QCOMPARE(mNewChannels.count(), 3);
+    QCOMPARE(mNewChannels.at(0), paths.mid(0, 2));
+    QCOMPARE(mNewChannels.at(1), paths.mid(2, 2));
+    QCOMPARE(mNewChannels.at(2), paths.mid(4));
+}
+
+void TestBaseConnection::testFlushNewChannels()
+{
+    QStringList paths;
+    bool yours = false;
+    paths << ensureTextChannel(1, &yours)->objectPath();
+    paths << ensureTextChannel(2, &yours)->objectPath();
+
+    mConn->flushNewChannels();
+    // Nothing is left to announce
+    mConn->flushNewChannels();
+
+    paths << ensureTextChannel(3, &yours)->objectPath();
+
+    QTRY_COMPARE_WITH_TIMEOUT(mNewChannelsCount, 3, 5000);
+    QCOMPARE(mNewChannels.count(), 2);
+    QCOMPARE(mNewChannels.at(0), paths.mid(0, 2));
+    QCOMPARE(mNewChannels.at(1), paths.mid(2));
+}
+
+void TestBaseConnection::testNewChannelsBeforeClosed()
+{
+    bool yours = false;
+    BaseChannelPtr first = ensureTextChannel(1, &yours);
+    BaseChannelPtr second = ensureTextChannel(2, &yours);
+    QVERIFY(!first.isNull());
+    QVERIFY(!second.isNull());
+    const QString firstPath = first->objectPath();
+    const QString secondPath = second->objectPath();
+
+    // Closed before its batch was announced
+    first->close();
+
+    QTRY_COMPARE_WITH_TIMEOUT(mEvents.count(), 3, 5000);
+    QCOMPARE(mEvents, QStringList()
+            << QLatin1String("new ") + firstPath
+            << QLatin1String("new ") + secondPath
+            << QLatin1String("closed ") + firstPath);
+    QCOMPARE(mNewChannels.count(), 1);
+}
+
+void TestBaseConnection::cleanup()
+{
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    bus.disconnect(mBusName, mObjectPath, TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS,
+            QLatin1String("NewChannels"), this, SLOT(onNewChannels(Tp::ChannelDetailsList)));
+    bus.disconnect(mBusName, mObjectPath, TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS,
+            QLatin1String("ChannelClosed"), this, SLOT(onChannelClosed(QDBusObjectPath)));
+
+    mConn.reset();
+
+    cleanupImpl();
+}
+
+void TestBaseConnection::cleanupTestCase()
+{
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestBaseConnection)
+#include "_gen/base-connection.cpp.moc.hpp"
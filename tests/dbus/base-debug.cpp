@@ -0,0 +1,299 @@
+#include <tests/lib/test.h>
+
+#include <TelepathyQt/BaseDebug>
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/DBusError>
+
+#include <QThread>
+#include <QTimer>
+
+using namespace Tp;
+
+class DebugProducer : public QThread
+{
+public:
+    DebugProducer(BaseDebug *debug, int count)
+        : mDebug(debug),
+          mCount(count)
+    { }
+
+protected:
+    void run()
+    {
+        for (int i = 0; i < mCount; ++i) {
+            mDebug->newDebugMessage(i, QLatin1String("thread"), DebugLevelDebug,
+                    QLatin1String("message"));
+        }
+    }
+
+private:
+    BaseDebug *mDebug;
+    int mCount;
+};
+
+class TestBaseDebug : public Test
+{
+    Q_OBJECT
+
+public:
+    TestBaseDebug(QObject *parent = 0)
+        : Test(parent),
+          mDebug(0),
+          mSignalledCount(0)
+    { }
+
+protected Q_SLOTS:
+    void onNewDebugMessage(double time, const QString &domain, uint level,
+            const QString &message);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testMessagesLimit();
+    void testBatchedSignals();
+    void testOtherThreads();
+    void testPendingLimit();
+    void testProducer();
+    void testProducer_data();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    void addMessages(int from, int to);
+    bool waitForSignals(int count);
+    QList<double> timestamps() const;
+
+    BaseDebug *mDebug;
+    int mSignalledCount;
+    QList<double> mSignalled;
+};
+
+void TestBaseDebug::onNewDebugMessage(double time, const QString &domain, uint level,
+        const QString &message)
+{
+    Q_UNUSED(domain);
+    Q_UNUSED(level);
+    Q_UNUSED(message);
+
+    ++mSignalledCount;
+    mSignalled << time;
+    mLoop->exit(0);
+}
+
+void TestBaseDebug::addMessages(int from, int to)
+{
+    for (int i = from; i < to; ++i) {
+        mDebug->newDebugMessage(i, QLatin1String("test"), DebugLevelDebug,
+                QString(QLatin1String("message %1")).arg(i));
+    }
+}
+
+bool TestBaseDebug::waitForSignals(int count)
+{
+    // The deadline timer also wakes the loop up when nothing else happens
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    deadline.start(10000);
+    while (mSignalledCount < count && deadline.isActive()) {
+        mLoop->processEvents(QEventLoop::WaitForMoreEvents);
+    }
+
+    if (mSignalledCount < count) {
+        qWarning() << "Timed out waiting for signals, got" << mSignalledCount << "of" << count;
+        return false;
+    }
+    return true;
+}
+
+QList<double> TestBaseDebug::timestamps() const
+{
+    DBusError error;
+    QList<double> result;
+    foreach (const DebugMessage &message, mDebug->getMessages(&error)) {
+        result << message.timestamp;
+    }
+    return result;
+}
+
+void TestBaseDebug::initTestCase()
+{
+    initTestCaseImpl();
+
+    mDebug = new BaseDebug();
+    DBusError error;
+    QVERIFY(mDebug->registerObject(QLatin1String("org.freedesktop.Telepathy.Tests.BaseDebug"),
+                &error));
+
+    QVERIFY(QDBusConnection::sessionBus().connect(QString(), TP_QT_DEBUG_OBJECT_PATH,
+                TP_QT_IFACE_DEBUG, QLatin1String("NewDebugMessage"),
+                this, SLOT(onNewDebugMessage(double,QString,uint,QString))));
+}
+
+void TestBaseDebug::init()
+{
+    initImpl();
+
+    mDebug->setEnabled(false);
+    mDebug->setSignalBatchInterval(0);
+    mDebug->setGetMessagesLimit(0);
+    mDebug->clear();
+    mSignalledCount = 0;
+    mSignalled.clear();
+}
+
+void TestBaseDebug::testMessagesLimit()
+{
+    DBusError error;
+    mDebug->getMessages(&error);
+    QCOMPARE(error.name(), TP_QT_ERROR_NOT_IMPLEMENTED);
+
+    mDebug->setGetMessagesLimit(3);
+    addMessages(0, 2);
+    QCOMPARE(timestamps(), QList<double>() << 0 << 1);
+
+    // the oldest messages are dropped once the limit is reached
+    addMessages(2, 7);
+    QCOMPARE(timestamps(), QList<double>() << 4 << 5 << 6);
+
+    mDebug->setGetMessagesLimit(2);
+    QCOMPARE(timestamps(), QList<double>() << 5 << 6);
+    addMessages(7, 8);
+    QCOMPARE(timestamps(), QList<double>() << 6 << 7);
+
+    mDebug->setGetMessagesLimit(-1);
+    addMessages(8, 10);
+    QCOMPARE(timestamps(), QList<double>() << 6 << 7 << 8 << 9);
+
+    mDebug->clear();
+    QCOMPARE(timestamps(), QList<double>());
+
+    mDebug->setGetMessagesLimit(3);
+    addMessages(0, 5);
+    mDebug->clear();
+    addMessages(5, 6);
+    QCOMPARE(timestamps(), QList<double>() << 5);
+}
+
+void TestBaseDebug::testBatchedSignals()
+{
+    mDebug->setEnabled(true);
+    mDebug->setSignalBatchInterval(50);
+    QCOMPARE(mDebug->signalBatchInterval(), 50);
+
+    addMessages(0, 10);
+    QCOMPARE(mSignalledCount, 0);
+
+    QVERIFY(waitForSignals(10));
+    QCOMPARE(mSignalled, QList<double>() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9);
+
+    // flushing signals the pending messages right away
+    addMessages(10, 12);
+    mDebug->flushNewDebugMessages();
+    QVERIFY(waitForSignals(12));
+
+    // new messages don't overtake the pending ones when batching is turned off
+    addMessages(12, 14);
+    mDebug->setSignalBatchInterval(0);
+    addMessages(14, 15);
+    QVERIFY(waitForSignals(15));
+    QCOMPARE(mSignalled.mid(12), QList<double>() << 12 << 13 << 14);
+
+    // messages stored while monitoring is disabled are never signalled
+    mDebug->setSignalBatchInterval(50);
+    mDebug->setEnabled(false);
+    addMessages(15, 18);
+    mDebug->flushNewDebugMessages();
+    QTimer timer;
+    timer.setSingleShot(true);
+    timer.start(200);
+    while (timer.isActive()) {
+        mLoop->processEvents();
+    }
+    QCOMPARE(mSignalledCount, 15);
+}
+
+void TestBaseDebug::testOtherThreads()
+{
+    mDebug->setEnabled(true);
+    mDebug->setGetMessagesLimit(-1);
+
+    DebugProducer producer(mDebug, 1000);
+    producer.start();
+    QVERIFY(producer.wait());
+
+    QCOMPARE(timestamps().size(), 1000);
+
+    // messages from other threads are signalled from the thread of the object
+    QVERIFY(waitForSignals(1000));
+    QCOMPARE(mSignalled.first(), 0.0);
+    QCOMPARE(mSignalled.last(), 999.0);
+}
+
+void TestBaseDebug::testPendingLimit()
+{
+    mDebug->setEnabled(true);
+    mDebug->setGetMessagesLimit(-1);
+    mDebug->setSignalBatchInterval(60000);
+
+    // past 10000 pending messages, the oldest ones are not signalled but still stored
+    addMessages(0, 10005);
+    QCOMPARE(timestamps().size(), 10005);
+    mDebug->flushNewDebugMessages();
+    QVERIFY(waitForSignals(10000));
+    QCOMPARE(mSignalled.first(), 5.0);
+    QCOMPARE(mSignalled.last(), 10004.0);
+
+    // the limit applies to the pending messages only, not to the ones already signalled
+    addMessages(10005, 10010);
+    mDebug->flushNewDebugMessages();
+    QVERIFY(waitForSignals(10005));
+    QCOMPARE(mSignalled.last(), 10009.0);
+}
+
+void TestBaseDebug::testProducer()
+{
+    QFETCH(int, batchInterval);
+
+    const int count = 10000;
+
+    mDebug->setEnabled(true);
+    mDebug->setGetMessagesLimit(1000);
+    mDebug->setSignalBatchInterval(batchInterval);
+
+    // The flush is timed too, in batched mode that's where the signals are sent
+    QBENCHMARK_ONCE {
+        addMessages(0, count);
+        mDebug->flushNewDebugMessages();
+    }
+
+    QCOMPARE(timestamps().size(), 1000);
+    QCOMPARE(timestamps().last(), double(count - 1));
+
+    QVERIFY(waitForSignals(count));
+}
+
+void TestBaseDebug::testProducer_data()
+{
+    QTest::addColumn<int>("batchInterval");
+
+    QTest::newRow("unbatched") << 0;
+    QTest::newRow("batched") << 100;
+}
+
+void TestBaseDebug::cleanup()
+{
+    cleanupImpl();
+}
+
+void TestBaseDebug::cleanupTestCase()
+{
+    delete mDebug;
+    mDebug = 0;
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestBaseDebug)
+#include "_gen/base-debug.cpp.moc.hpp"
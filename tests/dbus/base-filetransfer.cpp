@@ -100,6 +100,43 @@ QByteArray generateFileContent(int size)
     return result;
 }
 
+// Provides the first bytes of its data, then fails like a broken disk or connection
+class FailingDevice : public QIODevice
+{
+public:
+    FailingDevice(const QByteArray &data)
+        : mData(data),
+          mPosition(0)
+    { }
+
+    bool isSequential() const { return true; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize)
+    {
+        if (mPosition >= mData.size()) {
+            setErrorString(QLatin1String("Simulated read error"));
+            return -1;
+        }
+
+        qint64 length = qMin<qint64>(maxSize, mData.size() - mPosition);
+        memcpy(data, mData.constData() + mPosition, length);
+        mPosition += length;
+        return length;
+    }
+
+    qint64 writeData(const char *data, qint64 maxSize)
+    {
+        Q_UNUSED(data);
+        Q_UNUSED(maxSize);
+        return -1;
+    }
+
+private:
+    QByteArray mData;
+    int mPosition;
+};
+
 enum CancelCondition {
     NoCancel,
     CancelBeforeAccept,
@@ -375,8 +412,13 @@ private Q_SLOTS:
     void testContactCapability();
     void testSendFile();
     void testSendFile_data();
+    void testSendFileFromFile();
+    void testSendFileFromFile_data();
     void testReceiveFile();
     void testReceiveFile_data();
+    void testReceiveFileThroughput();
+    void testReceiveFileThroughput_data();
+    void testReceiveFileReadError();
 
     void cleanup();
     void cleanupTestCase();
@@ -707,6 +749,82 @@ void TestBaseFileTranfserChannel::testSendFile_data()
     QTest::newRow("Cancel in the middle of the data") << 2048 << 0 << int(CancelBeforeComplete)<< true;
 }
 
+void TestBaseFileTranfserChannel::testSendFileFromFile()
+{
+    QFETCH(int, fileSize);
+    QFETCH(int, initialOffset);
+    QFETCH(int, windowSize);
+
+    QCOMPARE(mCliConnection->status(), Tp::ConnectionStatusConnected);
+    QVERIFY(!mCliContact.isNull());
+
+    const QByteArray fileContent = generateFileContent(fileSize);
+    QCOMPARE(fileContent.size(), fileSize);
+
+    // A regular file lets the client send the data straight to the socket with sendfile()
+    QTemporaryFile cliInputFile;
+    cliInputFile.setFileTemplate(QLatin1String("file-transfer-test-XXXXXX.bin"));
+    QVERIFY2(cliInputFile.open(), "Unable to create a file for the test");
+    QCOMPARE(cliInputFile.write(fileContent), qint64(fileSize));
+    QVERIFY(cliInputFile.flush());
+    QVERIFY(cliInputFile.seek(0));
+
+    Tp::FileTransferChannelCreationProperties fileTransferProperties(cliInputFile.fileName(), c_fileContentType, fileContent.size());
+    Tp::PendingChannel *pendingChannel = mCliConnection->lowlevel()->createChannel(fileTransferProperties.createRequest(mCliContact->handle().first()));
+    connect(pendingChannel, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    Tp::OutgoingFileTransferChannelPtr cliTransferChannel = Tp::OutgoingFileTransferChannelPtr::qObjectCast(pendingChannel->channel());
+    QVERIFY(cliTransferChannel);
+
+    Tp::PendingReady *pendingChannelReady = cliTransferChannel->becomeReady(Tp::OutgoingFileTransferChannel::FeatureCore);
+    connect(pendingChannelReady, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(cliTransferChannel->transferWindowSize(), qint64(256 * 1024));
+    cliTransferChannel->setTransferWindowSize(1);
+    QCOMPARE(cliTransferChannel->transferWindowSize(), qint64(4 * 1024));
+    cliTransferChannel->setTransferWindowSize(windowSize);
+    QCOMPARE(cliTransferChannel->transferWindowSize(), qint64(windowSize));
+    QCOMPARE(cliTransferChannel->transferRate(), 0.0);
+
+    Tp::BaseChannelFileTransferTypePtr svcTransferChannel = Tp::BaseChannelFileTransferTypePtr::dynamicCast(g_channel->interface(TP_QT_IFACE_CHANNEL_TYPE_FILE_TRANSFER));
+    QVERIFY(!svcTransferChannel.isNull());
+
+    Tp::IODevice svcInputDevice;
+    svcInputDevice.open(QIODevice::ReadWrite);
+    connect(&svcInputDevice, SIGNAL(bytesWritten(qint64)), this, SLOT(onSendFileSvcInputBytesWritten(qint64)));
+    svcTransferChannel->remoteAcceptFile(&svcInputDevice, initialOffset);
+
+    QTRY_COMPARE_WITH_TIMEOUT(uint(cliTransferChannel->state()), uint(Tp::FileTransferStateAccepted), c_defaultTimeout);
+
+    Tp::PendingOperation *provideFileOperation = cliTransferChannel->provideFile(&cliInputFile);
+    connect(provideFileOperation, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QTRY_COMPARE_WITH_TIMEOUT(uint(svcTransferChannel->state()), uint(Tp::FileTransferStateCompleted), 10000);
+    QTRY_COMPARE_WITH_TIMEOUT(uint(cliTransferChannel->state()), uint(Tp::FileTransferStateCompleted), c_defaultTimeout);
+    QCOMPARE(svcTransferChannel->transferredBytes(), qulonglong(fileSize));
+
+    QByteArray svcData = svcInputDevice.readAll();
+    QCOMPARE(svcData.size(), fileSize - initialOffset);
+    QVERIFY(svcData == fileContent.mid(initialOffset));
+}
+
+void TestBaseFileTranfserChannel::testSendFileFromFile_data()
+{
+    QTest::addColumn<int>("fileSize");
+    QTest::addColumn<int>("initialOffset");
+    QTest::addColumn<int>("windowSize");
+
+    QTest::newRow("Default window")               << 1024 * 1024 << 0    << 256 * 1024;
+    QTest::newRow("Small window")                 << 1024 * 1024 << 0    << 4 * 1024;
+    QTest::newRow("Small window with an offset")  << 1024 * 1024 << 1000 << 4 * 1024;
+}
+
 void TestBaseFileTranfserChannel::testReceiveFile()
 {
     QFETCH(int, fileSize);
@@ -902,6 +1020,121 @@ void TestBaseFileTranfserChannel::testReceiveFile_data()
     QTest::newRow("Cancel in the middle of the data") << 2048 << 0 << int(CancelBeforeComplete)<< true << false;
 }
 
+void TestBaseFileTranfserChannel::testReceiveFileThroughput()
+{
+    QFETCH(qint64, fileSize);
+
+    QCOMPARE(mCliConnection->status(), Tp::ConnectionStatusConnected);
+    QVERIFY(!mCliContact.isNull());
+
+    QTemporaryFile svcInputFile;
+    svcInputFile.setFileTemplate(QLatin1String("file-transfer-test-XXXXXX.bin"));
+    QVERIFY2(svcInputFile.open(), "Unable to create a file for the test");
+
+    const QByteArray block = generateFileContent(1024 * 1024);
+    for (qint64 written = 0; written < fileSize; written += block.size()) {
+        QCOMPARE(svcInputFile.write(block), qint64(block.size()));
+    }
+    QVERIFY(svcInputFile.flush());
+    QVERIFY(svcInputFile.seek(0));
+
+    QTemporaryFile cliOutputFile;
+    cliOutputFile.setFileTemplate(QLatin1String("file-transfer-test-XXXXXX.bin"));
+    QVERIFY2(cliOutputFile.open(), "Unable to create a file for the test");
+
+    Tp::FileTransferChannelCreationProperties fileTransferProperties(QLatin1String("file-transfer-test-throughput.bin"), c_fileContentType, fileSize);
+    Tp::BaseChannelPtr svcTransferBaseChannel = g_connection->receiveFile(fileTransferProperties, mCliContact->handle().first());
+    QVERIFY(!svcTransferBaseChannel.isNull());
+
+    Tp::IncomingFileTransferChannelPtr cliTransferChannel = Tp::IncomingFileTransferChannel::create(mCliConnection, svcTransferBaseChannel->objectPath(), svcTransferBaseChannel->immutableProperties());
+
+    Tp::PendingReady *pendingChannelReady = cliTransferChannel->becomeReady(Tp::IncomingFileTransferChannel::FeatureCore);
+    connect(pendingChannelReady, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    Tp::BaseChannelFileTransferTypePtr svcTransferChannel = Tp::BaseChannelFileTransferTypePtr::dynamicCast(svcTransferBaseChannel->interface(TP_QT_IFACE_CHANNEL_TYPE_FILE_TRANSFER));
+    QSignalSpy spySvcState(svcTransferChannel.data(), SIGNAL(stateChanged(uint,uint)));
+
+    Tp::PendingOperation *acceptFileOperation = cliTransferChannel->acceptFile(0, &cliOutputFile);
+    connect(acceptFileOperation, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QTRY_COMPARE_WITH_TIMEOUT(uint(svcTransferChannel->state()), uint(Tp::FileTransferStateAccepted), c_defaultTimeout);
+
+    QBENCHMARK_ONCE {
+        QVERIFY(svcTransferChannel->remoteProvideFile(&svcInputFile));
+        QTRY_COMPARE_WITH_TIMEOUT(uint(cliTransferChannel->state()), uint(Tp::FileTransferStateCompleted), 600000);
+    }
+
+    QCOMPARE(uint(svcTransferChannel->state()), uint(Tp::FileTransferStateCompleted));
+    QCOMPARE(svcTransferChannel->transferredBytes(), qulonglong(fileSize));
+    QTRY_COMPARE_WITH_TIMEOUT(cliTransferChannel->transferredBytes(), qulonglong(fileSize), c_defaultTimeout);
+    QVERIFY(cliTransferChannel->transferRate() > 0);
+
+    QVERIFY(cliOutputFile.flush());
+    QCOMPARE(cliOutputFile.size(), fileSize);
+    QVERIFY(cliOutputFile.seek(fileSize - block.size()));
+    QCOMPARE(cliOutputFile.read(block.size()), block);
+}
+
+void TestBaseFileTranfserChannel::testReceiveFileThroughput_data()
+{
+    QTest::addColumn<qint64>("fileSize");
+
+    QTest::newRow("16 MiB") << qint64(16) * 1024 * 1024;
+
+    // Set TPQT_TEST_LARGE_TRANSFERS to measure a full-size local transfer
+    if (!qgetenv("TPQT_TEST_LARGE_TRANSFERS").isEmpty()) {
+        QTest::newRow("1 GiB") << qint64(1024) * 1024 * 1024;
+    }
+}
+
+void TestBaseFileTranfserChannel::testReceiveFileReadError()
+{
+    QCOMPARE(mCliConnection->status(), Tp::ConnectionStatusConnected);
+    QVERIFY(!mCliContact.isNull());
+
+    const int fileSize = 64 * 1024;
+    const QByteArray fileContent = generateFileContent(fileSize);
+
+    // The device fails halfway through the file
+    FailingDevice svcInputDevice(fileContent.left(fileSize / 2));
+    QVERIFY(svcInputDevice.open(QIODevice::ReadOnly));
+
+    QBuffer cliOutputDevice;
+    QVERIFY(cliOutputDevice.open(QIODevice::ReadWrite));
+
+    Tp::FileTransferChannelCreationProperties fileTransferProperties(QLatin1String("file-transfer-test-read-error.txt"), c_fileContentType, fileSize);
+    Tp::BaseChannelPtr svcTransferBaseChannel = g_connection->receiveFile(fileTransferProperties, mCliContact->handle().first());
+    QVERIFY(!svcTransferBaseChannel.isNull());
+
+    Tp::IncomingFileTransferChannelPtr cliTransferChannel = Tp::IncomingFileTransferChannel::create(mCliConnection, svcTransferBaseChannel->objectPath(), svcTransferBaseChannel->immutableProperties());
+
+    Tp::PendingReady *pendingChannelReady = cliTransferChannel->becomeReady(Tp::IncomingFileTransferChannel::FeatureCore);
+    connect(pendingChannelReady, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    Tp::BaseChannelFileTransferTypePtr svcTransferChannel = Tp::BaseChannelFileTransferTypePtr::dynamicCast(svcTransferBaseChannel->interface(TP_QT_IFACE_CHANNEL_TYPE_FILE_TRANSFER));
+    QVERIFY(!svcTransferChannel.isNull());
+
+    Tp::PendingOperation *acceptFileOperation = cliTransferChannel->acceptFile(0, &cliOutputDevice);
+    connect(acceptFileOperation, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QTRY_COMPARE_WITH_TIMEOUT(uint(svcTransferChannel->state()), uint(Tp::FileTransferStateAccepted), c_defaultTimeout);
+    QVERIFY(svcTransferChannel->remoteProvideFile(&svcInputDevice));
+
+    // The failure cancels the transfer instead of leaving it open or completing it
+    QTRY_COMPARE_WITH_TIMEOUT(uint(svcTransferChannel->state()), uint(Tp::FileTransferStateCancelled), 10000);
+    QTRY_COMPARE_WITH_TIMEOUT(uint(cliTransferChannel->state()), uint(Tp::FileTransferStateCancelled), c_defaultTimeout);
+    QCOMPARE(uint(cliTransferChannel->stateReason()), uint(Tp::FileTransferStateChangeReasonLocalError));
+    QVERIFY(svcTransferChannel->transferredBytes() <= qulonglong(fileSize / 2));
+}
+
 void TestBaseFileTranfserChannel::cleanup()
 {
     cleanupImpl();
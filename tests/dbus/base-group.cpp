@@ -0,0 +1,210 @@
+#include <tests/lib/test.h>
+
+#define TP_QT_ENABLE_LOWLEVEL_API
+
+#include <TelepathyQt/BaseChannel>
+#include <TelepathyQt/BaseConnection>
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/DBusError>
+
+using namespace Tp;
+
+static int inspectedHandlesCount = 0;
+
+static QStringList inspectHandlesCb(uint handleType, const Tp::UIntList &handles, Tp::DBusError *error)
+{
+    Q_UNUSED(handleType);
+    Q_UNUSED(error);
+
+    inspectedHandlesCount += handles.count();
+
+    QStringList identifiers;
+    foreach (uint handle, handles) {
+        identifiers << QString(QLatin1String("contact%1@example.com")).arg(handle);
+    }
+    return identifiers;
+}
+
+// The MembersChanged D-Bus signal is emitted by the adaptee of the interface
+static QObject *groupAdaptee(const BaseChannelGroupInterfacePtr &group)
+{
+    foreach (QObject *child, group->children()) {
+        if (child->metaObject()->indexOfSignal("membersChanged(QString,Tp::UIntList,Tp::UIntList,"
+                    "Tp::UIntList,Tp::UIntList,uint,uint)") >= 0) {
+            return child;
+        }
+    }
+    return 0;
+}
+
+class TestBaseGroup : public Test
+{
+    Q_OBJECT
+
+public:
+    TestBaseGroup(QObject *parent = 0)
+        : Test(parent)
+    { }
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testDeltas();
+    void testNetDeltas();
+    void testJoinStorm();
+    void testJoinStorm_data();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    BaseConnectionPtr mConn;
+    BaseChannelPtr mChan;
+    BaseChannelGroupInterfacePtr mGroup;
+};
+
+void TestBaseGroup::initTestCase()
+{
+    initTestCaseImpl();
+
+    mConn = BaseConnection::create(QLatin1String("testcm"), QLatin1String("example"), QVariantMap());
+    mConn->setInspectHandlesCallback(Tp::ptrFun(&inspectHandlesCb));
+}
+
+void TestBaseGroup::init()
+{
+    initImpl();
+
+    inspectedHandlesCount = 0;
+
+    mChan = BaseChannel::create(mConn.data(), TP_QT_IFACE_CHANNEL_TYPE_TEXT, Tp::HandleTypeRoom, 1);
+    mGroup = BaseChannelGroupInterface::create();
+    QVERIFY(mChan->plugInterface(AbstractChannelInterfacePtr::dynamicCast(mGroup)));
+}
+
+void TestBaseGroup::testDeltas()
+{
+    mGroup->setMembers(Tp::UIntList() << 2 << 3, Tp::LocalPendingInfoList(),
+            Tp::UIntList() << 4 << 5, QVariantMap());
+    QCOMPARE(inspectedHandlesCount, 4);
+
+    // 4 leaves the remote pending list, 3 is already a member
+    mGroup->addMembers(Tp::UIntList() << 3 << 4 << 6, QVariantMap());
+    QCOMPARE(mGroup->members(), Tp::UIntList() << 2 << 3 << 4 << 6);
+    QCOMPARE(mGroup->remotePendingMembers(), Tp::UIntList() << 5);
+    QCOMPARE(inspectedHandlesCount, 5);
+
+    // 7 is on none of the lists
+    mGroup->removeMembers(Tp::UIntList() << 2 << 5 << 7, QVariantMap());
+    QCOMPARE(mGroup->members(), Tp::UIntList() << 3 << 4 << 6);
+    QCOMPARE(mGroup->remotePendingMembers(), Tp::UIntList());
+
+    Tp::HandleIdentifierMap identifiers = mGroup->memberIdentifiers();
+    QCOMPARE(identifiers.keys(), Tp::UIntList() << 3 << 4 << 6);
+    QCOMPARE(identifiers.value(6), QLatin1String("contact6@example.com"));
+
+    // Replacing the members only inspects the new handles
+    mGroup->setMembers(Tp::UIntList() << 3 << 8, QVariantMap());
+    QCOMPARE(inspectedHandlesCount, 6);
+    QCOMPARE(mGroup->memberIdentifiers().keys(), Tp::UIntList() << 3 << 8);
+
+    mGroup->flushMembersChanged();
+}
+
+void TestBaseGroup::testNetDeltas()
+{
+    QObject *adaptee = groupAdaptee(mGroup);
+    QVERIFY(adaptee != 0);
+
+    mGroup->setMembers(Tp::UIntList() << 2 << 3, Tp::LocalPendingInfoList(),
+            Tp::UIntList() << 6 << 7, QVariantMap());
+
+    QSignalSpy spyMembersChanged(adaptee,
+            SIGNAL(membersChanged(QString,Tp::UIntList,Tp::UIntList,Tp::UIntList,Tp::UIntList,uint,uint)));
+
+    // 2 leaves and joins again, 4 joins and leaves again
+    mGroup->removeMembers(Tp::UIntList() << 2, QVariantMap());
+    mGroup->addMembers(Tp::UIntList() << 2 << 4, QVariantMap());
+    mGroup->removeMembers(Tp::UIntList() << 4, QVariantMap());
+    mGroup->flushMembersChanged();
+    QCOMPARE(spyMembersChanged.count(), 0);
+
+    // 3 leaves, 5 joins, 6 stops being remote pending and 7 joins from the remote pending list
+    mGroup->addMembers(Tp::UIntList() << 5 << 3, QVariantMap());
+    mGroup->removeMembers(Tp::UIntList() << 3 << 6, QVariantMap());
+    mGroup->removeMembers(Tp::UIntList() << 5, QVariantMap());
+    mGroup->addMembers(Tp::UIntList() << 5 << 7, QVariantMap());
+    mGroup->flushMembersChanged();
+    QCOMPARE(spyMembersChanged.count(), 1);
+    QCOMPARE(qvariant_cast<Tp::UIntList>(spyMembersChanged.at(0).at(1)), Tp::UIntList() << 5 << 7);
+    QCOMPARE(qvariant_cast<Tp::UIntList>(spyMembersChanged.at(0).at(2)), Tp::UIntList() << 3 << 6);
+    QCOMPARE(mGroup->members(), Tp::UIntList() << 2 << 5 << 7);
+    QCOMPARE(mGroup->remotePendingMembers(), Tp::UIntList());
+
+    // Changes with different details are not merged
+    spyMembersChanged.clear();
+    QVariantMap kicked;
+    kicked.insert(QLatin1String("change-reason"), (uint) Tp::ChannelGroupChangeReasonKicked);
+    mGroup->addMembers(Tp::UIntList() << 8, QVariantMap());
+    mGroup->removeMembers(Tp::UIntList() << 8 << 2, kicked);
+    mGroup->flushMembersChanged();
+    QCOMPARE(spyMembersChanged.count(), 2);
+    QCOMPARE(qvariant_cast<Tp::UIntList>(spyMembersChanged.at(0).at(1)), Tp::UIntList() << 8);
+    QCOMPARE(qvariant_cast<Tp::UIntList>(spyMembersChanged.at(0).at(2)), Tp::UIntList());
+    QCOMPARE(qvariant_cast<Tp::UIntList>(spyMembersChanged.at(1).at(1)), Tp::UIntList());
+    QCOMPARE(qvariant_cast<Tp::UIntList>(spyMembersChanged.at(1).at(2)), Tp::UIntList() << 2 << 8);
+    QCOMPARE(spyMembersChanged.at(1).at(6).toUInt(), (uint) Tp::ChannelGroupChangeReasonKicked);
+    QCOMPARE(mGroup->members(), Tp::UIntList() << 5 << 7);
+}
+
+void TestBaseGroup::testJoinStorm()
+{
+    QFETCH(int, occupants);
+
+    Tp::UIntList members;
+    for (int i = 0; i < occupants; ++i) {
+        members << 100 + i;
+    }
+    mGroup->setMembers(members, QVariantMap());
+    QCOMPARE(inspectedHandlesCount, occupants);
+
+    // Every occupant leaves and joins again, one at a time
+    QBENCHMARK_ONCE {
+        foreach (uint handle, members) {
+            mGroup->removeMembers(Tp::UIntList() << handle, QVariantMap());
+            mGroup->addMembers(Tp::UIntList() << handle, QVariantMap());
+        }
+        mGroup->flushMembersChanged();
+    }
+
+    QCOMPARE(mGroup->members().count(), occupants);
+    QCOMPARE(mGroup->memberIdentifiers().count(), occupants);
+    QCOMPARE(inspectedHandlesCount, 2 * occupants);
+}
+
+void TestBaseGroup::testJoinStorm_data()
+{
+    QTest::addColumn<int>("occupants");
+
+    QTest::newRow("300 occupants") << 300;
+    QTest::newRow("3000 occupants") << 3000;
+}
+
+void TestBaseGroup::cleanup()
+{
+    mGroup.reset();
+    mChan.reset();
+
+    cleanupImpl();
+}
+
+void TestBaseGroup::cleanupTestCase()
+{
+    mConn.reset();
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestBaseGroup)
+#include "_gen/base-group.cpp.moc.hpp"
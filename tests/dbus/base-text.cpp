@@ -0,0 +1,183 @@
+#include <tests/lib/test.h>
+
+#define TP_QT_ENABLE_LOWLEVEL_API
+
+#include <TelepathyQt/BaseChannel>
+#include <TelepathyQt/BaseConnection>
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/DBusError>
+
+using namespace Tp;
+
+static MessagePartList createMessage(const QString &token, const QString &text)
+{
+    MessagePart header;
+    if (!token.isEmpty()) {
+        header[QLatin1String("message-token")] = QDBusVariant(token);
+    }
+    header[QLatin1String("message-sender")] = QDBusVariant(2u);
+
+    MessagePart body;
+    body[QLatin1String("content-type")] = QDBusVariant(QLatin1String("text/plain"));
+    body[QLatin1String("content")] = QDBusVariant(text);
+
+    return MessagePartList() << header << body;
+}
+
+static QStringList messageTokens(const MessagePartListList &messages)
+{
+    QStringList tokens;
+    foreach (const MessagePartList &message, messages) {
+        tokens << message.front().value(QLatin1String("message-token")).variant().toString();
+    }
+    return tokens;
+}
+
+class TestBaseText : public Test
+{
+    Q_OBJECT
+
+public:
+    TestBaseText(QObject *parent = 0)
+        : Test(parent)
+    { }
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testRemoveByToken();
+    void testAcknowledgeByToken();
+    void testMaxPendingMessages();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    BaseConnectionPtr mConn;
+    BaseChannelPtr mChan;
+    BaseChannelTextTypePtr mText;
+};
+
+void TestBaseText::initTestCase()
+{
+    initTestCaseImpl();
+
+    mConn = BaseConnection::create(QLatin1String("testcm"), QLatin1String("example"), QVariantMap());
+}
+
+void TestBaseText::init()
+{
+    initImpl();
+
+    mChan = BaseChannel::create(mConn.data(), TP_QT_IFACE_CHANNEL_TYPE_TEXT, Tp::HandleTypeContact, 2);
+    mText = BaseChannelTextType::create(mChan.data());
+    QVERIFY(mChan->plugInterface(AbstractChannelInterfacePtr::dynamicCast(mText)));
+}
+
+void TestBaseText::testRemoveByToken()
+{
+    // Tokens are not guaranteed to be unique, and some messages have none
+    mText->addReceivedMessage(createMessage(QLatin1String("a"), QLatin1String("first")));
+    mText->addReceivedMessage(createMessage(QLatin1String("b"), QLatin1String("second")));
+    mText->addReceivedMessage(createMessage(QLatin1String("a"), QLatin1String("third")));
+    mText->addReceivedMessage(createMessage(QString(), QLatin1String("fourth")));
+    mText->addReceivedMessage(createMessage(QLatin1String("c"), QLatin1String("fifth")));
+    QCOMPARE(mText->pendingMessagesCount(), 5);
+
+    // Every message carrying the token goes, unknown tokens are ignored
+    mText->removePendingMessagesByToken(QStringList() << QLatin1String("a") << QLatin1String("unknown"));
+    QCOMPARE(mText->pendingMessagesCount(), 3);
+    QCOMPARE(messageTokens(mText->pendingMessages()),
+            QStringList() << QLatin1String("b") << QString() << QLatin1String("c"));
+
+    mText->removePendingMessagesByToken(QStringList() << QLatin1String("a"));
+    QCOMPARE(mText->pendingMessagesCount(), 3);
+
+    mText->removePendingMessagesByToken(QStringList() << QLatin1String("c") << QLatin1String("b"));
+    QCOMPARE(mText->pendingMessagesCount(), 1);
+    QCOMPARE(messageTokens(mText->pendingMessages()), QStringList() << QString());
+}
+
+void TestBaseText::testAcknowledgeByToken()
+{
+    mText->addReceivedMessage(createMessage(QLatin1String("a"), QLatin1String("first")));
+    mText->addReceivedMessage(createMessage(QLatin1String("b"), QLatin1String("second")));
+    mText->addReceivedMessage(createMessage(QLatin1String("a"), QLatin1String("third")));
+
+    // A single unknown token fails the whole batch
+    DBusError error;
+    mText->acknowledgePendingMessages(QStringList() << QLatin1String("b") << QLatin1String("unknown"), &error);
+    QVERIFY(error.isValid());
+    QCOMPARE(error.name(), TP_QT_ERROR_INVALID_ARGUMENT);
+    QCOMPARE(mText->pendingMessagesCount(), 3);
+
+    DBusError otherError;
+    mText->acknowledgePendingMessages(QStringList() << QLatin1String("a"), &otherError);
+    QVERIFY(!otherError.isValid());
+    QCOMPARE(messageTokens(mText->pendingMessages()), QStringList() << QLatin1String("b"));
+
+    // The index does not keep acknowledged messages around
+    mText->acknowledgePendingMessages(QStringList() << QLatin1String("a"), &otherError);
+    QVERIFY(otherError.isValid());
+    QCOMPARE(mText->pendingMessagesCount(), 1);
+}
+
+void TestBaseText::testMaxPendingMessages()
+{
+    QCOMPARE(mText->maxPendingMessages(), 0);
+    mText->setMaxPendingMessages(-1);
+    QCOMPARE(mText->maxPendingMessages(), 0);
+
+    mText->setMaxPendingMessages(3);
+    QCOMPARE(mText->maxPendingMessages(), 3);
+
+    QSignalSpy spyEvicted(mText.data(), SIGNAL(pendingMessagesEvicted(Tp::MessagePartListList)));
+
+    for (int i = 0; i < 5; ++i) {
+        mText->addReceivedMessage(createMessage(QString(QLatin1String("m%1")).arg(i),
+                    QLatin1String("hello")));
+    }
+
+    // The oldest messages are dropped, one at a time as the new ones arrive
+    QCOMPARE(mText->pendingMessagesCount(), 3);
+    QCOMPARE(messageTokens(mText->pendingMessages()),
+            QStringList() << QLatin1String("m2") << QLatin1String("m3") << QLatin1String("m4"));
+    QCOMPARE(spyEvicted.count(), 2);
+    QCOMPARE(messageTokens(qvariant_cast<MessagePartListList>(spyEvicted.at(0).at(0))),
+            QStringList() << QLatin1String("m0"));
+    QCOMPARE(messageTokens(qvariant_cast<MessagePartListList>(spyEvicted.at(1).at(0))),
+            QStringList() << QLatin1String("m1"));
+
+    // Evicted messages are gone from the token index too
+    DBusError error;
+    mText->acknowledgePendingMessages(QStringList() << QLatin1String("m0"), &error);
+    QVERIFY(error.isValid());
+
+    // Lowering the limit only applies to the next received message
+    mText->setMaxPendingMessages(1);
+    QCOMPARE(mText->pendingMessagesCount(), 3);
+    mText->addReceivedMessage(createMessage(QLatin1String("m5"), QLatin1String("hello")));
+    QCOMPARE(mText->pendingMessagesCount(), 1);
+    QCOMPARE(spyEvicted.count(), 3);
+    QCOMPARE(messageTokens(qvariant_cast<MessagePartListList>(spyEvicted.at(2).at(0))),
+            QStringList() << QLatin1String("m2") << QLatin1String("m3") << QLatin1String("m4"));
+}
+
+void TestBaseText::cleanup()
+{
+    mText.reset();
+    mChan.reset();
+
+    cleanupImpl();
+}
+
+void TestBaseText::cleanupTestCase()
+{
+    mConn.reset();
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestBaseText)
+#include "_gen/base-text.cpp.moc.hpp"
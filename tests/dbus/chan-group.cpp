@@ -18,6 +18,29 @@
 
 using namespace Tp;
 
+namespace
+{
+
+// One groupMembersChanged() signal received during testMembersChurn
+struct ChurnEvent
+{
+    QSet<uint> added;
+    QSet<uint> removed;
+    uint actor;
+    QString message;
+};
+
+QSet<uint> handlesOf(const Contacts &contacts)
+{
+    QSet<uint> handles;
+    foreach (const ContactPtr &contact, contacts) {
+        handles << contact->handle()[0];
+    }
+    return handles;
+}
+
+}
+
 class TestChanGroup : public Test
 {
     Q_OBJECT
@@ -40,6 +63,12 @@ protected Q_SLOTS:
             const Tp::Channel::GroupMemberChangeDetails &details);
     void onGroupFlagsChanged(Tp::ChannelGroupFlags flags,
             Tp::ChannelGroupFlags added, Tp::ChannelGroupFlags removed);
+    void onChurnMembersChanged(
+            const Tp::Contacts &groupMembersAdded,
+            const Tp::Contacts &groupLocalPendingMembersAdded,
+            const Tp::Contacts &groupRemotePendingMembersAdded,
+            const Tp::Contacts &groupMembersRemoved,
+            const Tp::Channel::GroupMemberChangeDetails &details);
 
 private Q_SLOTS:
     void initTestCase();
@@ -51,6 +80,7 @@ private Q_SLOTS:
     void testLeave();
     void testLeaveWithFallback();
     void testGroupFlagsChange();
+    void testMembersChurn();
 
     void cleanup();
     void cleanupTestCase();
@@ -59,6 +89,8 @@ private:
     void debugContacts();
 
     void commonTest(gboolean properties);
+    bool waitForMembers(const QSet<uint> &present, const QSet<uint> &absent);
+    bool changeMembers(uint handle, bool add, uint actor, const char *message);
 
     TestConnHelper *mConn;
     TpTestsTextChannelGroup *mChanService;
@@ -75,6 +107,7 @@ private:
     ChannelGroupFlags mGroupFlags;
     ChannelGroupFlags mGroupFlagsAdded;
     ChannelGroupFlags mGroupFlagsRemoved;
+    QList<ChurnEvent> mChurnEvents;
 };
 
 void TestChanGroup::onGroupMembersChanged(
@@ -104,6 +137,52 @@ void TestChanGroup::onGroupFlagsChanged(Tp::ChannelGroupFlags flags,
     mGroupFlagsRemoved = removed;
 }
 
+void TestChanGroup::onChurnMembersChanged(
+        const Contacts &groupMembersAdded,
+        const Contacts &groupLocalPendingMembersAdded,
+        const Contacts &groupRemotePendingMembersAdded,
+        const Contacts &groupMembersRemoved,
+        const Channel::GroupMemberChangeDetails &details)
+{
+    ChurnEvent event;
+    event.added = handlesOf(groupMembersAdded + groupLocalPendingMembersAdded +
+            groupRemotePendingMembersAdded);
+    event.removed = handlesOf(groupMembersRemoved);
+    event.actor = details.actor() ? details.actor()->handle()[0] : 0;
+    event.message = details.message();
+    mChurnEvents << event;
+    mLoop->exit(0);
+}
+
+bool TestChanGroup::waitForMembers(const QSet<uint> &present, const QSet<uint> &absent)
+{
+    // The deadline timer also wakes the loop up when nothing else happens
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    deadline.start(10000);
+    forever {
+        QSet<uint> members = handlesOf(mChan->groupContacts());
+        if (members.contains(present) && members.intersect(absent).isEmpty()) {
+            return true;
+        }
+        if (!deadline.isActive()) {
+            qWarning() << "Timed out waiting for the group members";
+            return false;
+        }
+        mLoop->processEvents(QEventLoop::WaitForMoreEvents);
+    }
+}
+
+bool TestChanGroup::changeMembers(uint handle, bool add, uint actor, const char *message)
+{
+    TpIntSet *set = tp_intset_new_containing(handle);
+    bool changed = tp_group_mixin_change_members(G_OBJECT(mChanService), message,
+            add ? set : NULL, add ? NULL : set, NULL, NULL, actor,
+            TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+    tp_intset_destroy(set);
+    return changed;
+}
+
 void TestChanGroup::debugContacts()
 {
     qDebug() << "contacts on group:";
@@ -161,6 +240,7 @@ void TestChanGroup::init()
     mGroupFlags = (ChannelGroupFlags) 0;
     mGroupFlagsAdded = (ChannelGroupFlags) 0;
     mGroupFlagsRemoved = (ChannelGroupFlags) 0;
+    mChurnEvents.clear();
 }
 
 void TestChanGroup::testCreateChannel()
@@ -484,6 +564,128 @@ void TestChanGroup::testGroupFlagsChange()
     QCOMPARE(mGroupFlagsRemoved, (ChannelGroupFlags) 0);
 }
 
+void TestChanGroup::testMembersChurn()
+{
+    mChanObjectPath = QString(QLatin1String("%1/ChannelForTpQtChurnTest"))
+        .arg(mConn->objectPath());
+    QByteArray chanPathLatin1(mChanObjectPath.toLatin1());
+
+    mChanService = TP_TESTS_TEXT_CHANNEL_GROUP(g_object_new(
+                TP_TESTS_TYPE_TEXT_CHANNEL_GROUP,
+                "connection", mConn->service(),
+                "object-path", chanPathLatin1.data(),
+                "detailed", TRUE,
+                "properties", TRUE,
+                NULL));
+    QVERIFY(mChanService != 0);
+
+    mChan = Channel::create(mConn->client(), mChanObjectPath, QVariantMap());
+    QVERIFY(mChan);
+    QVERIFY(connect(mChan->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->isReady(), true);
+
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(groupMembersChanged(
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Channel::GroupMemberChangeDetails &)),
+                    SLOT(onChurnMembersChanged(
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Channel::GroupMemberChangeDetails &))));
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()),
+            TP_HANDLE_TYPE_CONTACT);
+    uint actors[] = {
+        tp_handle_ensure(contactRepo, "churn-actor1@example.com", 0, 0),
+        tp_handle_ensure(contactRepo, "churn-actor2@example.com", 0, 0)
+    };
+
+    // A member from before the burst, who leaves and comes back in the middle of it
+    uint rejoiner = tp_handle_ensure(contactRepo, "churn-rejoiner@example.com", 0, 0);
+    QVERIFY(changeMembers(rejoiner, true, 0, ""));
+    QVERIFY(waitForMembers(QSet<uint>() << rejoiner, QSet<uint>()));
+    mChurnEvents.clear();
+
+    // Every other contact joins and leaves right away, like in a busy chat room
+    const int count = 200;
+    QSet<uint> stayed;
+    QSet<uint> left;
+    QHash<uint, QPair<uint, QString> > joins;
+    QBENCHMARK_ONCE {
+        for (int i = 0; i < count; ++i) {
+            QByteArray id = QString(QLatin1String("churn%1@example.com")).arg(i).toLatin1();
+            uint handle = tp_handle_ensure(contactRepo, id.constData(), 0, 0);
+            uint actor = actors[(i / 2) % 2];
+            QByteArray message = QString(QLatin1String("join %1")).arg(i).toLatin1();
+            QVERIFY(changeMembers(handle, true, actor, message.constData()));
+            if (i % 2) {
+                QVERIFY(changeMembers(handle, false, actor, "leave"));
+                left << handle;
+            } else {
+                stayed << handle;
+                joins.insert(handle, qMakePair(actor, QString::fromLatin1(message.constData())));
+            }
+
+            if (i == count / 4) {
+                QVERIFY(changeMembers(rejoiner, false, actors[0], "rejoiner leaves"));
+            } else if (i == count / 2) {
+                QVERIFY(changeMembers(rejoiner, true, actors[1], "rejoiner is back"));
+            }
+        }
+
+        QVERIFY(waitForMembers(stayed + (QSet<uint>() << rejoiner), left));
+    }
+
+    // The changes queued while contacts were being built are processed together, and the
+    // contacts which joined and left in the meantime are never signalled
+    QCOMPARE(mChurnEvents.size(), stayed.size() + 2);
+    int rejoinerLeft = -1;
+    int rejoinerBack = -1;
+    for (int i = 0; i < mChurnEvents.size(); ++i) {
+        const ChurnEvent &event = mChurnEvents.at(i);
+        QVERIFY(QSet<uint>(event.added).intersect(left).isEmpty());
+        QVERIFY(QSet<uint>(event.removed).intersect(left).isEmpty());
+
+        if (event.removed.contains(rejoiner)) {
+            QVERIFY(event.added.isEmpty());
+            QCOMPARE(event.actor, actors[0]);
+            QCOMPARE(event.message, QLatin1String("rejoiner leaves"));
+            rejoinerLeft = i;
+            continue;
+        }
+        if (event.added.contains(rejoiner)) {
+            QCOMPARE(event.added.size(), 1);
+            QCOMPARE(event.actor, actors[1]);
+            QCOMPARE(event.message, QLatin1String("rejoiner is back"));
+            rejoinerBack = i;
+            continue;
+        }
+
+        // Each event keeps its own actor and message
+        QCOMPARE(event.added.size(), 1);
+        QVERIFY(event.removed.isEmpty());
+        uint handle = *event.added.constBegin();
+        QVERIFY(joins.contains(handle));
+        QCOMPARE(event.actor, joins.value(handle).first);
+        QCOMPARE(event.message, joins.value(handle).second);
+        joins.remove(handle);
+    }
+    QVERIFY(joins.isEmpty());
+
+    // The rejoiner was removed and added back in the same batch, without being built again
+    QVERIFY(rejoinerLeft >= 0);
+    QVERIFY(rejoinerBack > rejoinerLeft);
+}
+
 void TestChanGroup::cleanup()
 {
     if (mChanService) {
@@ -9,6 +9,7 @@
 #include <TelepathyQt/PendingString>
 #include <TelepathyQt/PendingStringList>
 #include <TelepathyQt/PresenceSpec>
+#include "TelepathyQt/test-backdoors.h"
 
 #include <telepathy-glib/debug.h>
 
@@ -35,12 +36,14 @@ class TestCmBasics : public Test
 
 public:
     TestCmBasics(QObject *parent = 0)
-        : Test(parent), mCMService(0)
+        : Test(parent), mCMService(0),
+          mReadyCount(0), mExpectedReadyCount(0)
     { }
 
 protected Q_SLOTS:
     void expectListNamesFinished(Tp::PendingOperation *);
     void expectPendingStringFinished(Tp::PendingOperation *);
+    void expectReadyFinished(Tp::PendingOperation *);
 
 private Q_SLOTS:
     void initTestCase();
@@ -48,6 +51,7 @@ private Q_SLOTS:
 
     void testBasics();
     void testLegacy();
+    void testSharedIntrospection();
     void testListNames();
 
     void cleanup();
@@ -62,6 +66,8 @@ private:
 
     QStringList mCMNames;
     QString mPendingStringResult;
+    int mReadyCount;
+    int mExpectedReadyCount;
 };
 
 void TestCmBasics::expectListNamesFinished(PendingOperation *op)
@@ -82,6 +88,15 @@ void TestCmBasics::expectPendingStringFinished(PendingOperation *op)
     mLoop->exit(0);
 }
 
+void TestCmBasics::expectReadyFinished(PendingOperation *op)
+{
+    TEST_VERIFY_OP(op);
+
+    if (++mReadyCount == mExpectedReadyCount) {
+        mLoop->exit(0);
+    }
+}
+
 void TestCmBasics::initTestCase()
 {
     initTestCaseImpl();
@@ -309,6 +324,46 @@ void TestCmBasics::testLegacy()
     QCOMPARE(mCMLegacy->supportedProtocols(), QStringList() << QLatin1String("simple"));
 }
 
+void TestCmBasics::testSharedIntrospection()
+{
+    // Make sure the instances of the previous tests, and so their shared introspection, are gone
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+
+    int introspections = TestBackdoors::connectionManagerIntrospections();
+
+    // Instances for the same CM introspect it only once, whoever asks first
+    mCM = ConnectionManager::create(QLatin1String("example_echo_2"));
+    ConnectionManagerPtr otherCM = ConnectionManager::create(QLatin1String("example_echo_2"));
+
+    mReadyCount = 0;
+    mExpectedReadyCount = 2;
+    QVERIFY(connect(mCM->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation *)),
+                    SLOT(expectReadyFinished(Tp::PendingOperation *))));
+    QVERIFY(connect(otherCM->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation *)),
+                    SLOT(expectReadyFinished(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mReadyCount, 2);
+    QCOMPARE(mCM->isReady(), true);
+    QCOMPARE(otherCM->isReady(), true);
+    QCOMPARE(TestBackdoors::connectionManagerIntrospections(), introspections + 1);
+
+    QCOMPARE(otherCM->supportedProtocols(), mCM->supportedProtocols());
+    QCOMPARE(otherCM->protocol(QLatin1String("example")).parameters().size(), 1);
+
+    // An instance created afterwards uses the result right away
+    ConnectionManagerPtr lateCM = ConnectionManager::create(QLatin1String("example_echo_2"));
+    QVERIFY(connect(lateCM->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation *)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(lateCM->supportedProtocols(), QStringList() << QLatin1String("example"));
+    QCOMPARE(lateCM->protocol(QLatin1String("example")).cmName(),
+             QLatin1String("example_echo_2"));
+    QCOMPARE(TestBackdoors::connectionManagerIntrospections(), introspections + 1);
+}
+
 // TODO add a test for the case of getting the information from a .manager file, and if possible,
 // also for using the fallbacks for the CM::Protocols property not being present.
 
@@ -200,17 +200,25 @@ void TestContactsAvatar::testAvatar()
             SIGNAL(AvatarRetrieved(uint, const QString &, const QByteArray &, const QString &)),
             SLOT(onAvatarRetrieved(uint, const QString &, const QByteArray &, const QString &)));
 
+    ContactManagerPtr manager = mConn->client()->contactManager();
+    quint64 hits = manager->avatarCacheHits();
+    quint64 misses = manager->avatarCacheMisses();
+
     /* First time we create a contact, avatar should not be in cache, so
      * AvatarRetrieved should be called */
     mGotAvatarRetrieved = false;
     createContactWithFakeAvatar("foo");
     QVERIFY(mGotAvatarRetrieved);
+    QCOMPARE(manager->avatarCacheHits(), hits);
+    QCOMPARE(manager->avatarCacheMisses(), misses + 1);
 
     /* Second time we create a contact, avatar should be in cache now, so
      * AvatarRetrieved should NOT be called */
     mGotAvatarRetrieved = false;
     createContactWithFakeAvatar("bar");
     QVERIFY(!mGotAvatarRetrieved);
+    QCOMPARE(manager->avatarCacheHits(), hits + 1);
+    QCOMPARE(manager->avatarCacheMisses(), misses + 1);
 
     QVERIFY(SmartDir(tmpDir).removeDirectory());
 }
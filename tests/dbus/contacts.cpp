@@ -35,7 +35,7 @@ class TestContacts : public Test
 
 public:
     TestContacts(QObject *parent = 0)
-        : Test(parent), mConnService(0)
+        : Test(parent), mConnService(0), mRetrievedBeforeFinished(0)
     {
     }
 
@@ -43,6 +43,7 @@ protected Q_SLOTS:
     void expectConnReady(Tp::ConnectionStatus, Tp::ConnectionStatusReason);
     void expectConnInvalidated();
     void expectPendingContactsFinished(Tp::PendingOperation *);
+    void expectContactsRetrieved(const QList<Tp::ContactPtr> &);
 
 private Q_SLOTS:
     void initTestCase();
@@ -51,6 +52,12 @@ private Q_SLOTS:
     void testSupport();
     void testSelfContact();
     void testForHandles();
+    void testForHandlesScaling_data();
+    void testForHandlesScaling();
+    void testForHandlesLargeRoster_data();
+    void testForHandlesLargeRoster();
+    void testForHandlesCoalescing();
+    void testForHandlesChunking();
     void testForIdentifiers();
     void testFeatures();
     void testFeaturesNotRequested();
@@ -66,6 +73,8 @@ private:
     ConnectionPtr mConn;
     QList<ContactPtr> mContacts;
     Tp::UIntList mInvalidHandles;
+    QList<QList<ContactPtr> > mRetrieved;
+    int mRetrievedBeforeFinished;
 };
 
 void TestContacts::expectConnReady(Tp::ConnectionStatus newStatus,
@@ -107,9 +116,15 @@ void TestContacts::expectPendingContactsFinished(PendingOperation *op)
         mInvalidHandles = pending->invalidHandles();
     }
 
+    mRetrievedBeforeFinished = mRetrieved.size();
     mLoop->exit(0);
 }
 
+void TestContacts::expectContactsRetrieved(const QList<Tp::ContactPtr> &contacts)
+{
+    mRetrieved.append(contacts);
+}
+
 void TestContacts::initTestCase()
 {
     initTestCaseImpl();
@@ -172,6 +187,9 @@ void TestContacts::initTestCase()
 void TestContacts::init()
 {
     initImpl();
+
+    mRetrieved.clear();
+    mRetrievedBeforeFinished = 0;
 }
 
 void TestContacts::testSupport()
@@ -335,6 +353,227 @@ void TestContacts::testForHandles()
     processDBusQueue(mConn.data());
 }
 
+void TestContacts::testForHandlesScaling_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+    QTest::newRow("50000") << 50000;
+}
+
+void TestContacts::testForHandlesScaling()
+{
+    QFETCH(int, count);
+
+    Tp::UIntList handles;
+    TpHandleRepoIface *serviceRepo =
+        tp_base_connection_get_handles(TP_BASE_CONNECTION(mConnService), TP_HANDLE_TYPE_CONTACT);
+
+    for (int i = 0; i < count; ++i) {
+        QByteArray id = QString(QLatin1String("contact%1")).arg(i).toLatin1();
+        handles << tp_handle_ensure(serviceRepo, id.constData(), NULL, NULL);
+    }
+
+    // Building the contacts should scale linearly with the number of handles
+    QBENCHMARK_ONCE {
+        PendingContacts *pending = mConn->contactManager()->contactsForHandles(handles);
+        QVERIFY(connect(pending,
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    QCOMPARE(mContacts.size(), count);
+    QVERIFY(mInvalidHandles.isEmpty());
+    QCOMPARE(mContacts.first()->handle()[0], handles.first());
+    QCOMPARE(mContacts.last()->handle()[0], handles.last());
+
+    mContacts.clear();
+    mLoop->processEvents();
+    processDBusQueue(mConn.data());
+}
+
+void TestContacts::testForHandlesLargeRoster_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+}
+
+void TestContacts::testForHandlesLargeRoster()
+{
+    QFETCH(int, count);
+
+    Tp::UIntList handles;
+    TpHandleRepoIface *serviceRepo =
+        tp_base_connection_get_handles(TP_BASE_CONNECTION(mConnService), TP_HANDLE_TYPE_CONTACT);
+
+    for (int i = 0; i < count; ++i) {
+        QByteArray id = QString(QLatin1String("roster%1")).arg(i).toLatin1();
+        handles << tp_handle_ensure(serviceRepo, id.constData(), NULL, NULL);
+    }
+
+    Features features = Features()
+        << Contact::FeatureAlias
+        << Contact::FeatureAvatarToken;
+    ContactManagerPtr manager = mConn->contactManager();
+
+    PendingContacts *pending = manager->contactsForHandles(handles, features);
+    QVERIFY(connect(pending,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mContacts.size(), count);
+    QList<ContactPtr> roster = mContacts;
+
+    // Asking again for the whole roster only compares the features each contact already has
+    quint64 requestCount = manager->contactAttributesRequestCount();
+    QBENCHMARK_ONCE {
+        pending = manager->contactsForHandles(handles, features);
+        QVERIFY(connect(pending,
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    QCOMPARE(manager->contactAttributesRequestCount(), requestCount);
+    QCOMPARE(mContacts, roster);
+
+    // Only the missing feature is requested when upgrading the roster
+    Features upgradedFeatures = features;
+    upgradedFeatures << Contact::FeatureSimplePresence;
+    QBENCHMARK_ONCE {
+        pending = manager->contactsForHandles(handles, upgradedFeatures);
+        QVERIFY(connect(pending,
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    QVERIFY(manager->contactAttributesRequestCount() > requestCount);
+    QCOMPARE(mContacts, roster);
+    foreach (const ContactPtr &contact, mContacts) {
+        QVERIFY(contact->requestedFeatures().contains(Contact::FeatureAlias));
+        QVERIFY(contact->requestedFeatures().contains(Contact::FeatureSimplePresence));
+    }
+
+    roster.clear();
+    mContacts.clear();
+    mLoop->processEvents();
+    processDBusQueue(mConn.data());
+}
+
+void TestContacts::testForHandlesCoalescing()
+{
+    TpHandleRepoIface *serviceRepo =
+        tp_base_connection_get_handles(TP_BASE_CONNECTION(mConnService), TP_HANDLE_TYPE_CONTACT);
+
+    Tp::UIntList handles;
+    handles << tp_handle_ensure(serviceRepo, "alice", NULL, NULL);
+    handles << tp_handle_ensure(serviceRepo, "bob", NULL, NULL);
+    handles << tp_handle_ensure(serviceRepo, "chris", NULL, NULL);
+
+    ContactManagerPtr manager = mConn->contactManager();
+    quint64 requestCount = manager->contactAttributesRequestCount();
+    quint64 savedRoundTrips = manager->savedContactAttributesRoundTrips();
+
+    // Two overlapping requests made in the same main loop iteration should share a single
+    // GetContactAttributes call
+    PendingContacts *first = manager->contactsForHandles(handles.mid(0, 2));
+    PendingContacts *second = manager->contactsForHandles(handles.mid(1, 2));
+
+    QVERIFY(connect(first,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mContacts.size(), 2);
+    QList<ContactPtr> firstContacts = mContacts;
+
+    // Both requests were answered by the same reply, so the second one is already finished
+    // when the first one announces it
+    QVERIFY(second->isFinished());
+    QVERIFY(second->isValid());
+    mContacts = second->contacts();
+    QCOMPARE(mContacts.size(), 2);
+
+    QCOMPARE(firstContacts[1], mContacts[0]);
+    QCOMPARE(mContacts[1]->id(), QString(QLatin1String("chris")));
+
+    QCOMPARE(manager->contactAttributesRequestCount(), requestCount + 2);
+    QCOMPARE(manager->savedContactAttributesRoundTrips(), savedRoundTrips + 1);
+
+    firstContacts.clear();
+    mContacts.clear();
+    mLoop->processEvents();
+    processDBusQueue(mConn.data());
+}
+
+void TestContacts::testForHandlesChunking()
+{
+    TpHandleRepoIface *serviceRepo =
+        tp_base_connection_get_handles(TP_BASE_CONNECTION(mConnService), TP_HANDLE_TYPE_CONTACT);
+
+    Tp::UIntList handles;
+    for (int i = 0; i < 10; ++i) {
+        QByteArray id = QString(QLatin1String("chunked%1")).arg(i).toLatin1();
+        handles << tp_handle_ensure(serviceRepo, id.constData(), NULL, NULL);
+    }
+
+    ContactManagerPtr manager = mConn->contactManager();
+    manager->setContactAttributesChunkSize(3);
+    manager->setMaxContactAttributesRequestsInFlight(2);
+    QCOMPARE(manager->contactAttributesChunkSize(), 3);
+    QCOMPARE(manager->maxContactAttributesRequestsInFlight(), 2);
+
+    quint64 requestCount = manager->contactAttributesRequestCount();
+    quint64 savedRoundTrips = manager->savedContactAttributesRoundTrips();
+
+    // Only as many chunks as allowed in flight are requested up front
+    PendingContacts *pending = manager->contactsForHandles(handles);
+    QCOMPARE(manager->contactAttributesRequestCount(), requestCount + 2);
+
+    QVERIFY(connect(pending,
+                SIGNAL(contactsRetrieved(QList<Tp::ContactPtr>)),
+                SLOT(expectContactsRetrieved(QList<Tp::ContactPtr>))));
+    QVERIFY(connect(pending,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    // 10 handles in chunks of 3 make 4 requests, none of which could be merged with another one
+    QCOMPARE(manager->contactAttributesRequestCount(), requestCount + 4);
+    QCOMPARE(manager->savedContactAttributesRoundTrips(), savedRoundTrips);
+
+    // Every chunk was announced before the operation finished, in the order requested
+    QCOMPARE(mRetrieved.size(), 4);
+    QCOMPARE(mRetrievedBeforeFinished, 4);
+    QList<ContactPtr> retrieved;
+    for (int i = 0; i < mRetrieved.size(); ++i) {
+        QCOMPARE(mRetrieved[i].size(), i < 3 ? 3 : 1);
+        retrieved.append(mRetrieved[i]);
+    }
+    QCOMPARE(retrieved, mContacts);
+
+    QCOMPARE(mContacts.size(), handles.size());
+    QVERIFY(mInvalidHandles.isEmpty());
+    for (int i = 0; i < handles.size(); ++i) {
+        QCOMPARE(mContacts[i]->handle()[0], handles[i]);
+        QCOMPARE(mContacts[i]->id(), QString(QLatin1String("chunked%1")).arg(i));
+    }
+
+    manager->setContactAttributesChunkSize(1000);
+    manager->setMaxContactAttributesRequestsInFlight(4);
+
+    retrieved.clear();
+    mRetrieved.clear();
+    mContacts.clear();
+    mLoop->processEvents();
+    processDBusQueue(mConn.data());
+}
+
 void TestContacts::testForIdentifiers()
 {
     QStringList validIDs = QStringList() << QLatin1String("Alice")
@@ -0,0 +1,276 @@
+#include <tests/lib/test.h>
+
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/DBusObject>
+#include <TelepathyQt/DBusService>
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+using namespace Tp;
+
+class TestObject : public DBusObject
+{
+public:
+    TestObject(const QString &path)
+        : DBusObject(QDBusConnection::sessionBus())
+    {
+        setObjectPath(path);
+    }
+};
+
+class TestInterface : public AbstractDBusServiceInterface
+{
+public:
+    TestInterface()
+        : AbstractDBusServiceInterface(QLatin1String("org.freedesktop.Telepathy.Tests.Properties"))
+    { }
+
+    QVariantMap immutableProperties() const
+    {
+        return QVariantMap();
+    }
+
+    bool registerInterface(DBusObject *dbusObject)
+    {
+        return AbstractDBusServiceInterface::registerInterface(dbusObject);
+    }
+
+protected:
+    void createAdaptor()
+    { }
+};
+
+class TestDBusService : public Test
+{
+    Q_OBJECT
+
+public:
+    TestDBusService(QObject *parent = 0)
+        : Test(parent),
+          mObject(0),
+          mInterface(0)
+    { }
+
+protected Q_SLOTS:
+    void onPropertiesChanged(const QString &interfaceName, const QVariantMap &changed,
+            const QStringList &invalidated);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testUnmerged();
+    void testCoalescing();
+    void testFlush();
+    void testInterval();
+    void testObjectGone();
+    void testProgress();
+    void testProgress_data();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    TestObject *mObject;
+    TestInterface *mInterface;
+    QList<QVariantMap> mChanges;
+};
+
+void TestDBusService::onPropertiesChanged(const QString &interfaceName,
+        const QVariantMap &changed, const QStringList &invalidated)
+{
+    QCOMPARE(interfaceName, mInterface->interfaceName());
+    QVERIFY(invalidated.isEmpty());
+
+    mChanges << changed;
+    mLoop->exit(0);
+}
+
+void TestDBusService::initTestCase()
+{
+    initTestCaseImpl();
+
+    mObject = new TestObject(QLatin1String("/org/freedesktop/Telepathy/Tests/Properties"));
+    QVERIFY(QDBusConnection::sessionBus().connect(QString(), mObject->objectPath(),
+                TP_QT_IFACE_PROPERTIES, QLatin1String("PropertiesChanged"),
+                this, SLOT(onPropertiesChanged(QString,QVariantMap,QStringList))));
+}
+
+void TestDBusService::init()
+{
+    initImpl();
+
+    mInterface = new TestInterface();
+    QVERIFY(!mInterface->notifyPropertyChanged(QLatin1String("Title"), QString()));
+    QVERIFY(mInterface->registerInterface(mObject));
+    QVERIFY(!mInterface->isPropertyChangeMergingEnabled());
+    mInterface->setPropertyChangeMergingEnabled(true);
+    mChanges.clear();
+}
+
+void TestDBusService::testUnmerged()
+{
+    mInterface->setPropertyChangeMergingEnabled(false);
+    QVERIFY(!mInterface->isPropertyChangeMergingEnabled());
+
+    // each change is sent right away, in order
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Title"), QLatin1String("a")));
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Limit"), 10u));
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Title"), QLatin1String("b")));
+    QTRY_COMPARE_WITH_TIMEOUT(mChanges.size(), 3, 5000);
+    QCOMPARE(mChanges.at(0).keys(), QStringList() << QLatin1String("Title"));
+    QCOMPARE(mChanges.at(0).value(QLatin1String("Title")).toString(), QLatin1String("a"));
+    QCOMPARE(mChanges.at(1).keys(), QStringList() << QLatin1String("Limit"));
+    QCOMPARE(mChanges.at(2).value(QLatin1String("Title")).toString(), QLatin1String("b"));
+
+    // disabling merging sends the queued changes before the next ones
+    mInterface->setPropertyChangeMergingEnabled(true);
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Title"), QLatin1String("c")));
+    mInterface->setPropertyChangeMergingEnabled(false);
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Limit"), 20u));
+    QTRY_COMPARE_WITH_TIMEOUT(mChanges.size(), 5, 5000);
+    QCOMPARE(mChanges.at(3).value(QLatin1String("Title")).toString(), QLatin1String("c"));
+    QCOMPARE(mChanges.at(4).value(QLatin1String("Limit")).toUInt(), 20u);
+}
+
+void TestDBusService::testCoalescing()
+{
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Title"), QLatin1String("a")));
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Limit"), 10u));
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Title"), QLatin1String("b")));
+
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChanges.size(), 1);
+    QCOMPARE(mChanges.first().size(), 2);
+    QCOMPARE(mChanges.first().value(QLatin1String("Title")).toString(), QLatin1String("b"));
+    QCOMPARE(mChanges.first().value(QLatin1String("Limit")).toUInt(), 10u);
+
+    QVERIFY(mInterface->notifyPropertyChanged(QLatin1String("Limit"), 20u));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChanges.size(), 2);
+    QCOMPARE(mChanges.last().size(), 1);
+    QCOMPARE(mChanges.last().value(QLatin1String("Limit")).toUInt(), 20u);
+}
+
+void TestDBusService::testFlush()
+{
+    mInterface->setPropertyChangedInterval(QLatin1String("Progress"), 60000);
+
+    mInterface->notifyPropertyChanged(QLatin1String("Progress"), 1u);
+    mInterface->flushPropertiesChanged();
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChanges.size(), 1);
+
+    // held back by the interval, until flushed
+    mInterface->notifyPropertyChanged(QLatin1String("Progress"), 2u);
+    mInterface->notifyPropertyChanged(QLatin1String("Title"), QLatin1String("a"));
+    mInterface->flushPropertiesChanged();
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChanges.size(), 2);
+    QCOMPARE(mChanges.last().size(), 2);
+    QCOMPARE(mChanges.last().value(QLatin1String("Progress")).toUInt(), 2u);
+}
+
+void TestDBusService::testInterval()
+{
+    mInterface->setPropertyChangedInterval(QLatin1String("Progress"), 200);
+    QCOMPARE(mInterface->propertyChangedInterval(QLatin1String("Progress")), 200);
+    QCOMPARE(mInterface->propertyChangedInterval(QLatin1String("Title")), 0);
+
+    mInterface->notifyPropertyChanged(QLatin1String("Progress"), 1u);
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChanges.size(), 1);
+    QElapsedTimer sinceFirst;
+    sinceFirst.start();
+
+    mInterface->notifyPropertyChanged(QLatin1String("Progress"), 2u);
+    mInterface->notifyPropertyChanged(QLatin1String("Title"), QLatin1String("a"));
+    mInterface->notifyPropertyChanged(QLatin1String("Progress"), 3u);
+
+    // the other properties are not held back
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChanges.size(), 2);
+    QCOMPARE(mChanges.last().keys(), QStringList() << QLatin1String("Title"));
+
+    QCOMPARE(mLoop->exec(), 0);
+    QVERIFY(sinceFirst.elapsed() >= 150);
+    QCOMPARE(mChanges.size(), 3);
+    QCOMPARE(mChanges.last().keys(), QStringList() << QLatin1String("Progress"));
+    QCOMPARE(mChanges.last().value(QLatin1String("Progress")).toUInt(), 3u);
+}
+
+void TestDBusService::testObjectGone()
+{
+    TestObject *object = new TestObject(mObject->objectPath());
+    TestInterface interface;
+    QVERIFY(interface.registerInterface(object));
+    interface.setPropertyChangeMergingEnabled(true);
+    QVERIFY(interface.notifyPropertyChanged(QLatin1String("Title"), QLatin1String("a")));
+    delete object;
+
+    // the queued change is dropped instead of being sent through the deleted object
+    QTimer timer;
+    timer.setSingleShot(true);
+    timer.start(200);
+    while (timer.isActive()) {
+        mLoop->processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    QVERIFY(mChanges.isEmpty());
+
+    QVERIFY(!interface.notifyPropertyChanged(QLatin1String("Title"), QLatin1String("b")));
+    interface.flushPropertiesChanged();
+    QVERIFY(mChanges.isEmpty());
+}
+
+void TestDBusService::testProgress()
+{
+    QFETCH(int, interval);
+
+    const uint count = 10000;
+
+    mInterface->setPropertyChangedInterval(QLatin1String("Progress"), interval);
+
+    QBENCHMARK_ONCE {
+        for (uint i = 1; i <= count; ++i) {
+            mInterface->notifyPropertyChanged(QLatin1String("Progress"), i);
+            if (i % 100 == 0) {
+                mLoop->processEvents();
+            }
+        }
+        mInterface->flushPropertiesChanged();
+        while (mChanges.isEmpty() ||
+                mChanges.last().value(QLatin1String("Progress")).toUInt() != count) {
+            QCOMPARE(mLoop->exec(), 0);
+        }
+    }
+
+    QVERIFY(mChanges.size() <= int(count / 100) + 1);
+}
+
+void TestDBusService::testProgress_data()
+{
+    QTest::addColumn<int>("interval");
+
+    QTest::newRow("per iteration") << 0;
+    QTest::newRow("rate limited") << 50;
+}
+
+void TestDBusService::cleanup()
+{
+    delete mInterface;
+    mInterface = 0;
+
+    cleanupImpl();
+}
+
+void TestDBusService::cleanupTestCase()
+{
+    delete mObject;
+    mObject = 0;
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestDBusService)
+#include "_gen/dbus-service.cpp.moc.hpp"
@@ -0,0 +1,303 @@
+#include <tests/lib/test.h>
+
+#include <TelepathyQt/BaseDebug>
+#include <TelepathyQt/DBusError>
+#include <TelepathyQt/DebugReceiver>
+#include <TelepathyQt/PendingReady>
+
+#include <QTemporaryFile>
+#include <QTimer>
+
+using namespace Tp;
+
+class TestDebugReceiver : public Test
+{
+    Q_OBJECT
+
+public:
+    TestDebugReceiver(QObject *parent = 0)
+        : Test(parent),
+          mDebug(0),
+          mReceivedCount(0),
+          mDeliveredCount(0)
+    { }
+
+protected Q_SLOTS:
+    void onNewDebugMessage(const Tp::DebugMessage &message);
+    void onNewDebugMessages(const Tp::DebugMessageList &messages);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testBatches();
+    void testBufferLimit();
+    void testFilters();
+    void testSpool();
+    void testStream();
+    void testStream_data();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    void addMessages(int from, int to, const QString &domain = QLatin1String("test"),
+            DebugLevel level = DebugLevelDebug);
+    bool waitForMessages(int count);
+    bool waitForDelivery(int count);
+    DebugMessageList deliveredMessages() const;
+
+    BaseDebug *mDebug;
+    DebugReceiverPtr mReceiver;
+    int mReceivedCount;
+    int mDeliveredCount;
+    QList<DebugMessageList> mBatches;
+};
+
+void TestDebugReceiver::onNewDebugMessage(const Tp::DebugMessage &message)
+{
+    Q_UNUSED(message);
+
+    ++mReceivedCount;
+}
+
+void TestDebugReceiver::onNewDebugMessages(const Tp::DebugMessageList &messages)
+{
+    mBatches << messages;
+    mDeliveredCount += messages.size();
+    mLoop->exit(0);
+}
+
+void TestDebugReceiver::addMessages(int from, int to, const QString &domain, DebugLevel level)
+{
+    for (int i = from; i < to; ++i) {
+        mDebug->newDebugMessage(i, domain, level, QString(QLatin1String("message %1")).arg(i));
+    }
+}
+
+bool TestDebugReceiver::waitForMessages(int count)
+{
+    // The deadline timer also wakes the loop up when nothing else happens
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    deadline.start(10000);
+    while (mReceivedCount < count && deadline.isActive()) {
+        mLoop->processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    mReceiver->flushDebugMessages();
+
+    if (mReceivedCount < count) {
+        qWarning() << "Timed out waiting for messages, got" << mReceivedCount << "of" << count;
+        return false;
+    }
+    return true;
+}
+
+bool TestDebugReceiver::waitForDelivery(int count)
+{
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    deadline.start(10000);
+    while (mDeliveredCount < count && deadline.isActive()) {
+        mLoop->processEvents(QEventLoop::WaitForMoreEvents);
+    }
+
+    if (mDeliveredCount < count) {
+        qWarning() << "Timed out waiting for batches, got" << mDeliveredCount << "of" << count <<
+            "messages";
+        return false;
+    }
+    return true;
+}
+
+DebugMessageList TestDebugReceiver::deliveredMessages() const
+{
+    DebugMessageList messages;
+    foreach (const DebugMessageList &batch, mBatches) {
+        messages << batch;
+    }
+    return messages;
+}
+
+void TestDebugReceiver::initTestCase()
+{
+    initTestCaseImpl();
+
+    mDebug = new BaseDebug();
+    DBusError error;
+    QVERIFY(mDebug->registerObject(
+                QLatin1String("org.freedesktop.Telepathy.Tests.DebugReceiver"), &error));
+    mDebug->setEnabled(false);
+}
+
+void TestDebugReceiver::init()
+{
+    initImpl();
+
+    mReceiver = DebugReceiver::create(QLatin1String("org.freedesktop.Telepathy.Tests.DebugReceiver"));
+    QVERIFY(connect(mReceiver->becomeReady(),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QVERIFY(mReceiver->isReady());
+
+    QVERIFY(connect(mReceiver->setMonitoringEnabled(true),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QVERIFY(mDebug->isEnabled());
+
+    QVERIFY(connect(mReceiver.data(), SIGNAL(newDebugMessage(Tp::DebugMessage)),
+                SLOT(onNewDebugMessage(Tp::DebugMessage))));
+    QVERIFY(connect(mReceiver.data(), SIGNAL(newDebugMessages(Tp::DebugMessageList)),
+                SLOT(onNewDebugMessages(Tp::DebugMessageList))));
+
+    mReceivedCount = 0;
+    mDeliveredCount = 0;
+    mBatches.clear();
+}
+
+void TestDebugReceiver::testBatches()
+{
+    QCOMPARE(mReceiver->batchInterval(), 0);
+
+    addMessages(0, 10);
+    QVERIFY(waitForMessages(10));
+
+    // everything received so far is delivered, in order, however the bus split it up
+    DebugMessageList messages = deliveredMessages();
+    QCOMPARE(messages.size(), 10);
+    QCOMPARE(messages.first().timestamp, 0.0);
+    QCOMPARE(messages.last().timestamp, 9.0);
+    QCOMPARE(messages.last().message, QLatin1String("message 9"));
+
+    // with an interval, the messages are delivered when it ends, without any flush
+    mReceiver->setBatchInterval(50);
+    QCOMPARE(mReceiver->batchInterval(), 50);
+    addMessages(10, 15);
+    QVERIFY(waitForDelivery(15));
+    QCOMPARE(mReceivedCount, 15);
+    messages = deliveredMessages();
+    QCOMPARE(messages.size(), 15);
+    QCOMPARE(messages.at(10).timestamp, 10.0);
+    QCOMPARE(messages.last().timestamp, 14.0);
+}
+
+void TestDebugReceiver::testBufferLimit()
+{
+    QCOMPARE(mReceiver->bufferLimit(), 1000);
+    mReceiver->setBufferLimit(4);
+    QCOMPARE(mReceiver->bufferLimit(), 4);
+    // only deliver when flushed, so that everything ends up in a single batch
+    mReceiver->setBatchInterval(60 * 1000);
+
+    addMessages(0, 10);
+    QVERIFY(waitForMessages(10));
+
+    // the oldest messages are dropped
+    QCOMPARE(mBatches.size(), 1);
+    QCOMPARE(mBatches.first().size(), 4);
+    QCOMPARE(mBatches.first().first().timestamp, 6.0);
+    QCOMPARE(mReceiver->droppedMessagesCount(), 6u);
+}
+
+void TestDebugReceiver::testFilters()
+{
+    mReceiver->setDomainFilter(QStringList() << QLatin1String("gabble"));
+    mReceiver->setLevelFilter(DebugLevelInfo);
+    QCOMPARE(mReceiver->domainFilter(), QStringList() << QLatin1String("gabble"));
+    QCOMPARE(mReceiver->levelFilter(), DebugLevelInfo);
+    mReceiver->setBatchInterval(60 * 1000);
+
+    addMessages(0, 1, QLatin1String("gabble"), DebugLevelWarning);
+    addMessages(1, 2, QLatin1String("gabble/connection"), DebugLevelInfo);
+    addMessages(2, 3, QLatin1String("gabble"), DebugLevelDebug);
+    addMessages(3, 4, QLatin1String("gabblexyz"), DebugLevelWarning);
+    addMessages(4, 5, QLatin1String("salut"), DebugLevelError);
+    QVERIFY(waitForMessages(2));
+
+    QCOMPARE(mBatches.size(), 1);
+    QCOMPARE(mBatches.first().size(), 2);
+    QCOMPARE(mBatches.first().at(0).timestamp, 0.0);
+    QCOMPARE(mBatches.first().at(1).timestamp, 1.0);
+    QCOMPARE(mBatches.first().at(1).domain, QLatin1String("gabble/connection"));
+}
+
+void TestDebugReceiver::testSpool()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QString fileName = file.fileName();
+
+    QVERIFY(mReceiver->setSpoolFileName(fileName));
+    QCOMPARE(mReceiver->spoolFileName(), fileName);
+    mReceiver->setBatchInterval(60 * 1000);
+
+    addMessages(0, 3, QLatin1String("gabble"), DebugLevelWarning);
+    addMessages(3, 5, QLatin1String("salut"), DebugLevelInfo);
+    addMessages(5, 6, QLatin1String("gabble"), DebugLevelDebug);
+    QVERIFY(waitForMessages(6));
+
+    DebugMessageList messages = DebugReceiver::readSpoolFile(fileName);
+    QCOMPARE(messages.size(), 6);
+    QCOMPARE(messages, mBatches.first());
+    QCOMPARE(messages.at(4).domain, QLatin1String("salut"));
+    QCOMPARE(messages.at(5).domain, QLatin1String("gabble"));
+    QCOMPARE(messages.at(5).level, (uint) DebugLevelDebug);
+
+    // a truncated trailing message is ignored
+    QFile spool(fileName);
+    QVERIFY(spool.open(QIODevice::ReadWrite));
+    QVERIFY(spool.resize(spool.size() - 3));
+    spool.close();
+    QCOMPARE(DebugReceiver::readSpoolFile(fileName), messages.mid(0, 5));
+
+    QVERIFY(mReceiver->setSpoolFileName(QString()));
+    QCOMPARE(mReceiver->spoolFileName(), QString());
+}
+
+void TestDebugReceiver::testStream()
+{
+    QFETCH(int, batchInterval);
+
+    const int count = 20000;
+
+    mReceiver->setBatchInterval(batchInterval);
+    mReceiver->setBufferLimit(count);
+
+    QBENCHMARK_ONCE {
+        addMessages(0, count);
+        QVERIFY(waitForDelivery(count));
+    }
+
+    QCOMPARE(mReceivedCount, count);
+    QCOMPARE(mReceiver->droppedMessagesCount(), 0u);
+    QVERIFY(mBatches.size() < count);
+}
+
+void TestDebugReceiver::testStream_data()
+{
+    QTest::addColumn<int>("batchInterval");
+
+    QTest::newRow("per iteration") << 0;
+    QTest::newRow("batched") << 100;
+}
+
+void TestDebugReceiver::cleanup()
+{
+    mReceiver.reset();
+    mDebug->setEnabled(false);
+
+    cleanupImpl();
+}
+
+void TestDebugReceiver::cleanupTestCase()
+{
+    delete mDebug;
+    mDebug = 0;
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestDebugReceiver)
+#include "_gen/debug-receiver.cpp.moc.hpp"
@@ -142,6 +142,8 @@ protected Q_SLOTS:
     void onNewLocalConnection(uint connectionId);
     void onNewRemoteConnection(uint connectionId);
     void onNewSocketConnection();
+    void onBurstConnection(uint connectionId);
+    void onBurstConnectionClosed(uint connectionId);
     void onConnectionClosed(uint connectionId, const QString &errorName,
             const QString &errorMesssage);
     void onOfferFinished(Tp::PendingOperation *op);
@@ -157,6 +159,8 @@ private Q_SLOTS:
     void testAcceptFail();
     void testOfferSuccess();
     void testOutgoingConnectionMonitoring();
+    void testOutgoingConnectionBurst();
+    void testOutgoingConnectionBurst_data();
 
     void cleanup();
     void cleanupTestCase();
@@ -187,6 +191,9 @@ private:
     uint mExpectedPort;
     uint mExpectedHandle;
     QString mExpectedId;
+
+    QList<uint> mBurstConnectionIds;
+    int mExpectedBurstConnections;
 };
 
 void TestStreamTubeChan::onNewLocalConnection(uint connectionId)
@@ -216,6 +223,27 @@ void TestStreamTubeChan::onNewSocketConnection()
     mLoop->exit(0);
 }
 
+void TestStreamTubeChan::onBurstConnection(uint connectionId)
+{
+    QVERIFY(!mGotConnectionClosed);
+
+    mBurstConnectionIds << connectionId;
+    if (mBurstConnectionIds.size() == mExpectedBurstConnections) {
+        mLoop->exit(0);
+    }
+}
+
+void TestStreamTubeChan::onBurstConnectionClosed(uint connectionId)
+{
+    // Closing the last connection is announced after all the connections
+    QCOMPARE(mBurstConnectionIds.size(), mExpectedBurstConnections);
+    QCOMPARE(connectionId, mBurstConnectionIds.last());
+    QVERIFY(!mChan->connections().contains(connectionId));
+
+    mGotConnectionClosed = true;
+    mLoop->exit(0);
+}
+
 void TestStreamTubeChan::onConnectionClosed(uint connectionId,
         const QString &errorName, const QString &errorMesssage)
 {
@@ -339,6 +367,9 @@ void TestStreamTubeChan::init()
     mExpectedPort = -1;
     mExpectedHandle = -1;
     mExpectedId = QString();
+
+    mBurstConnectionIds.clear();
+    mExpectedBurstConnections = 0;
 }
 
 void TestStreamTubeChan::testCheckRemoteConnectionsCommon()
@@ -352,6 +383,7 @@ void TestStreamTubeChan::testCheckRemoteConnectionsCommon()
             mExpectedHandle);
     QCOMPARE(chan->contactsForConnections().value(mRemoteConnectionId)->id(),
             mExpectedId);
+    QCOMPARE(chan->contactForConnection(mRemoteConnectionId)->handle()[0], mExpectedHandle);
 
     if (contexts[mCurrentContext].accessControl == TP_SOCKET_ACCESS_CONTROL_PORT) {
         // qDebug() << "+++ conn for source addresses" << chan->connectionsForSourceAddresses();
@@ -360,6 +392,7 @@ void TestStreamTubeChan::testCheckRemoteConnectionsCommon()
         QPair<QHostAddress, quint16> srcAddr(mExpectedAddress, mExpectedPort);
         QCOMPARE(chan->connectionsForSourceAddresses().contains(srcAddr), true);
         QCOMPARE(chan->connectionsForSourceAddresses().value(srcAddr), mRemoteConnectionId);
+        QCOMPARE(chan->sourceAddressForConnection(mRemoteConnectionId), srcAddr);
     } else if (contexts[mCurrentContext].accessControl == TP_SOCKET_ACCESS_CONTROL_CREDENTIALS) {
         // qDebug() << "+++ conn for credentials" << chan->connectionsForCredentials();
         QCOMPARE(chan->connectionsForCredentials().isEmpty(), false);
@@ -865,6 +898,107 @@ void TestStreamTubeChan::testOutgoingConnectionMonitoring()
     QCOMPARE(mChan->connections().size(), 0);
 }
 
+void TestStreamTubeChan::testOutgoingConnectionBurst()
+{
+    QFETCH(int, connections);
+
+    mCurrentContext = 3; // should point to the room, IPv4, AC port one
+    createTubeChannel(true, TP_SOCKET_ADDRESS_TYPE_IPV4, TP_SOCKET_ACCESS_CONTROL_PORT, false);
+    QVERIFY(connect(mChan->becomeReady(OutgoingStreamTubeChannel::FeatureCore |
+                    StreamTubeChannel::FeatureConnectionMonitoring),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QVERIFY(connect(mChan.data(),
+                SIGNAL(newConnection(uint)),
+                SLOT(onBurstConnection(uint))));
+    QVERIFY(connect(mChan.data(),
+                SIGNAL(connectionClosed(uint,QString,QString)),
+                SLOT(onBurstConnectionClosed(uint))));
+
+    OutgoingStreamTubeChannelPtr chan = OutgoingStreamTubeChannelPtr::qObjectCast(mChan);
+    QVERIFY(connect(chan->offerTcpSocket(QHostAddress(QHostAddress::LocalHost), 9), // DISCARD
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(onOfferFinished(Tp::PendingOperation *))));
+
+    while (mChan->state() != TubeChannelStateRemotePending) {
+        mLoop->processEvents();
+    }
+
+    GValue *connParam = tp_g_value_slice_new_take_boxed(
+            TP_STRUCT_TYPE_SOCKET_ADDRESS_IPV4,
+            dbus_g_type_specialized_construct(TP_STRUCT_TYPE_SOCKET_ADDRESS_IPV4));
+    dbus_g_type_struct_set(connParam,
+            0, "127.0.0.1",
+            1, static_cast<quint16>(12345),
+            G_MAXUINT);
+
+    // Every connection comes from a contact we haven't seen yet, so each one needs its contact
+    // to be retrieved before being announced
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    QList<TpHandle> handles;
+    for (int i = 0; i < connections; ++i) {
+        QByteArray id = QString(QLatin1String("burst%1-%2")).arg(connections).arg(i).toLatin1();
+        handles << tp_handle_ensure(contactRepo, id.constData(), NULL, NULL);
+    }
+
+    mExpectedBurstConnections = connections;
+    QBENCHMARK_ONCE {
+        foreach (TpHandle handle, handles) {
+            tp_tests_stream_tube_channel_peer_connected_no_stream(mChanService,
+                    connParam, handle);
+        }
+        // The last connection is dropped right away, which must still be announced last
+        tp_tests_stream_tube_channel_last_connection_disconnected(mChanService,
+                TP_ERROR_STR_DISCONNECTED);
+
+        while (mBurstConnectionIds.size() < connections) {
+            QCOMPARE(mLoop->exec(), 0);
+        }
+    }
+    tp_g_value_slice_free(connParam);
+
+    // The connections are announced in the order they were made
+    for (int i = 1; i < mBurstConnectionIds.size(); ++i) {
+        QCOMPARE(mBurstConnectionIds.at(i), mBurstConnectionIds.at(i - 1) + 1);
+    }
+
+    while (!mGotConnectionClosed) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+    QCOMPARE(mChan->connections().size(), connections - 1);
+
+    // Each connection is matched with its own contact
+    QHash<uint, ContactPtr> contacts = chan->contactsForConnections();
+    QCOMPARE(contacts.size(), connections - 1);
+    for (int i = 0; i < connections - 1; ++i) {
+        QCOMPARE(contacts.value(mBurstConnectionIds.at(i))->handle()[0], handles.at(i));
+        QCOMPARE(chan->contactForConnection(mBurstConnectionIds.at(i)),
+                contacts.value(mBurstConnectionIds.at(i)));
+    }
+
+    // All the connections share the same source address, only the closed one is dropped
+    QPair<QHostAddress, quint16> srcAddr(QHostAddress(QLatin1String("127.0.0.1")), 12345);
+    QCOMPARE(chan->connectionsForSourceAddresses().values(srcAddr).size(), connections - 1);
+    QVERIFY(!chan->connectionsForSourceAddresses().values(srcAddr).contains(
+                mBurstConnectionIds.last()));
+    QCOMPARE(chan->sourceAddressForConnection(mBurstConnectionIds.first()),
+            connections > 1 ? srcAddr : qMakePair(QHostAddress(), quint16(0)));
+    QCOMPARE(chan->sourceAddressForConnection(mBurstConnectionIds.last()),
+            qMakePair(QHostAddress(), quint16(0)));
+    QVERIFY(chan->contactForConnection(mBurstConnectionIds.last()).isNull());
+}
+
+void TestStreamTubeChan::testOutgoingConnectionBurst_data()
+{
+    QTest::addColumn<int>("connections");
+
+    QTest::newRow("single") << 1;
+    QTest::newRow("burst") << 200;
+}
+
 void TestStreamTubeChan::cleanup()
 {
     cleanupImpl();
@@ -10,13 +10,17 @@
 #include <tests/lib/glib/echo2/chan.h>
 
 #include <TelepathyQt/Connection>
+#include <TelepathyQt/Debug>
 #include <TelepathyQt/Message>
 #include <TelepathyQt/PendingReady>
 #include <TelepathyQt/ReceivedMessage>
 #include <TelepathyQt/TextChannel>
 
+#include <telepathy-glib/cm-message.h>
 #include <telepathy-glib/debug.h>
 
+#include <QTimer>
+
 using namespace Tp;
 
 struct SentMessageDetails
@@ -40,7 +44,8 @@ public:
           mConn(0), mContactRepo(0),
           mTextChanService(0), mMessagesChanService(0),
           mGotChatStateChanged(false),
-          mChatStateChangedState((ChannelChatState) -1)
+          mChatStateChangedState((ChannelChatState) -1),
+          mExpectedQueueSize(0)
     { }
 
 protected Q_SLOTS:
@@ -50,6 +55,9 @@ protected Q_SLOTS:
             Tp::MessageSendingFlags, const QString &);
     void onChatStateChanged(const Tp::ContactPtr &contact,
             Tp::ChannelChatState state);
+    void onMessageQueueGrown();
+    void onMessageQueueTimeout();
+    void onMessageQueueShrunk();
 
 private Q_SLOTS:
     void initTestCase();
@@ -57,6 +65,10 @@ private Q_SLOTS:
 
     void testMessages();
     void testLegacyText();
+    void testMessageQueueScaling_data();
+    void testMessageQueueScaling();
+    void testMessageReceiving_data();
+    void testMessageReceiving();
 
     void cleanup();
     void cleanupTestCase();
@@ -64,6 +76,7 @@ private Q_SLOTS:
 private:
     void commonTest(bool withMessages);
     void sendText(const char *text);
+    bool waitForMessageQueue(int size);
 
     TestConnHelper *mConn;
     TpHandleRepoIface *mContactRepo;
@@ -79,6 +92,8 @@ private:
     bool mGotChatStateChanged;
     ContactPtr mChatStateChangedContact;
     ChannelChatState mChatStateChangedState;
+    int mExpectedQueueSize;
+    QList<int> mQueueSizes;
 };
 
 void TestTextChan::onMessageReceived(const ReceivedMessage &message)
@@ -88,6 +103,48 @@ void TestTextChan::onMessageReceived(const ReceivedMessage &message)
     mLoop->exit(0);
 }
 
+void TestTextChan::onMessageQueueGrown()
+{
+    if (mChan->messageQueue().size() == mExpectedQueueSize) {
+        mLoop->exit(0);
+    }
+}
+
+void TestTextChan::onMessageQueueTimeout()
+{
+    qWarning() << "Timed out waiting for the message queue, got"
+        << mChan->messageQueue().size() << "of" << mExpectedQueueSize << "messages";
+    mLoop->exit(1);
+}
+
+void TestTextChan::onMessageQueueShrunk()
+{
+    // Clients usually look at the queue again whenever a message is removed from it
+    mQueueSizes << mChan->messageQueue().size();
+}
+
+bool TestTextChan::waitForMessageQueue(int size)
+{
+    if (mChan->messageQueue().size() == size) {
+        return true;
+    }
+
+    mExpectedQueueSize = size;
+
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    connect(&deadline, SIGNAL(timeout()), SLOT(onMessageQueueTimeout()));
+    connect(mChan.data(), SIGNAL(messageReceived(Tp::ReceivedMessage)),
+            SLOT(onMessageQueueGrown()));
+    deadline.start(60 * 1000);
+
+    bool ok = (mLoop->exec() == 0);
+
+    disconnect(mChan.data(), SIGNAL(messageReceived(Tp::ReceivedMessage)),
+            this, SLOT(onMessageQueueGrown()));
+    return ok;
+}
+
 void TestTextChan::onMessageRemoved(const ReceivedMessage &message)
 {
     qDebug() << "message removed";
@@ -534,6 +591,109 @@ void TestTextChan::testLegacyText()
     commonTest(false);
 }
 
+void TestTextChan::testMessageQueueScaling_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("1000 messages") << 1000;
+    QTest::newRow("10000 messages") << 10000;
+}
+
+void TestTextChan::testMessageQueueScaling()
+{
+    QFETCH(int, count);
+
+    mChan = TextChannel::create(mConn->client(), mMessagesChanPath, QVariantMap());
+    QVERIFY(connect(mChan->becomeReady(TextChannel::FeatureMessageQueue),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    // start from an empty queue, previous tests may have left messages behind
+    mChan->acknowledge(mChan->messageQueue());
+    processDBusQueue(mChan.data());
+    QCOMPARE(mChan->messageQueue().size(), 0);
+
+    TpBaseConnection *baseConn = TP_BASE_CONNECTION(mConn->service());
+    for (int i = 0; i < count; ++i) {
+        TpMessage *msg = tp_cm_message_new_text(baseConn, mContact->handle()[0],
+                TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, "Hello");
+        tp_message_mixin_take_received(G_OBJECT(mMessagesChanService), msg);
+    }
+
+    QVERIFY(waitForMessageQueue(count));
+
+    QVERIFY(connect(mChan.data(),
+                SIGNAL(pendingMessageRemoved(const Tp::ReceivedMessage &)),
+                SLOT(onMessageRemoved(const Tp::ReceivedMessage &))));
+    QVERIFY(connect(mChan.data(),
+                SIGNAL(pendingMessageRemoved(const Tp::ReceivedMessage &)),
+                SLOT(onMessageQueueShrunk())));
+    mQueueSizes.clear();
+
+    QList<ReceivedMessage> queue = mChan->messageQueue();
+    QBENCHMARK_ONCE {
+        mChan->forget(queue.mid(0, count / 2));
+        mChan->acknowledge(queue.mid(count / 2));
+    }
+
+    QCOMPARE(mChan->messageQueue().size(), 0);
+    QCOMPARE(removed.size(), count);
+    QCOMPARE(mQueueSizes.size(), count);
+    for (int i = 0; i < count; ++i) {
+        QCOMPARE(mQueueSizes.at(i), count - 1 - i);
+    }
+
+    // the PendingMessagesRemoved signals for the acknowledged messages must not
+    // remove anything else
+    processDBusQueue(mChan.data());
+    QCOMPARE(removed.size(), count);
+}
+
+void TestTextChan::testMessageReceiving_data()
+{
+    QTest::addColumn<bool>("debugEnabled");
+
+    QTest::newRow("debug disabled") << false;
+    QTest::newRow("debug enabled") << true;
+}
+
+void TestTextChan::testMessageReceiving()
+{
+    QFETCH(bool, debugEnabled);
+
+    const int count = 1000;
+
+    mChan = TextChannel::create(mConn->client(), mMessagesChanPath, QVariantMap());
+    QVERIFY(connect(mChan->becomeReady(TextChannel::FeatureMessageQueue),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    mChan->acknowledge(mChan->messageQueue());
+    processDBusQueue(mChan.data());
+    QCOMPARE(mChan->messageQueue().size(), 0);
+
+    Tp::enableDebug(debugEnabled);
+
+    TpBaseConnection *baseConn = TP_BASE_CONNECTION(mConn->service());
+    QBENCHMARK_ONCE {
+        for (int i = 0; i < count; ++i) {
+            TpMessage *msg = tp_cm_message_new_text(baseConn, mContact->handle()[0],
+                    TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, "Hello");
+            tp_message_mixin_take_received(G_OBJECT(mMessagesChanService), msg);
+        }
+
+        QVERIFY(waitForMessageQueue(count));
+    }
+
+    Tp::enableDebug(true);
+
+    QCOMPARE(mChan->messageQueue().size(), count);
+    mChan->acknowledge(mChan->messageQueue());
+    processDBusQueue(mChan.data());
+}
+
 void TestTextChan::cleanup()
 {
     received.clear();
@@ -0,0 +1,157 @@
+#include <QtTest/QtTest>
+
+#include <TelepathyQt/Debug>
+#include "TelepathyQt/debug-internal.h"
+
+using namespace Tp;
+
+namespace
+{
+
+QStringList messages;
+int evaluations = 0;
+
+void collectMessages(const QString &libraryName, const QString &libraryVersion,
+        QtMsgType type, const QString &msg)
+{
+    Q_UNUSED(libraryName);
+    Q_UNUSED(libraryVersion);
+    Q_UNUSED(type);
+
+    messages << msg;
+}
+
+int evaluate()
+{
+    return ++evaluations;
+}
+
+}
+
+class TestDebugCategories : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestDebugCategories(QObject *parent = 0);
+
+private Q_SLOTS:
+    void init();
+
+    void testCategories();
+    void testCategories_data();
+    void testDisabledNotEvaluated();
+    void testElseBinding();
+
+    void cleanup();
+};
+
+TestDebugCategories::TestDebugCategories(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void TestDebugCategories::init()
+{
+    messages.clear();
+    evaluations = 0;
+    Tp::setDebugCallback(collectMessages);
+}
+
+void TestDebugCategories::testCategories()
+{
+    QFETCH(QByteArray, variable);
+    QFETCH(bool, enabled);
+    QFETCH(bool, generalEnabled);
+    QFETCH(bool, avatarsEnabled);
+    QFETCH(bool, messagesEnabled);
+
+    // The variable is only read when debug output is enabled or disabled
+    qputenv("TP_QT_DEBUG", variable);
+    Tp::enableDebug(!enabled);
+    Tp::enableDebug(enabled);
+
+    QCOMPARE(debugCategoryEnabled[DebugGeneral], generalEnabled);
+    QCOMPARE(debugCategoryEnabled[DebugAvatars], avatarsEnabled);
+    QCOMPARE(debugCategoryEnabled[DebugMessages], messagesEnabled);
+
+    qputenv("TP_QT_DEBUG", "messages");
+    QCOMPARE(debugCategoryEnabled[DebugAvatars], avatarsEnabled);
+    QCOMPARE(debugCategoryEnabled[DebugMessages], messagesEnabled);
+}
+
+void TestDebugCategories::testCategories_data()
+{
+    QTest::addColumn<QByteArray>("variable");
+    QTest::addColumn<bool>("enabled");
+    QTest::addColumn<bool>("generalEnabled");
+    QTest::addColumn<bool>("avatarsEnabled");
+    QTest::addColumn<bool>("messagesEnabled");
+
+    QTest::newRow("unset") << QByteArray() << true << true << true << true;
+    QTest::newRow("unset, disabled") << QByteArray() << false << false << false << false;
+    QTest::newRow("all") << QByteArray("all") << true << true << true << true;
+    QTest::newRow("all, disabled") << QByteArray("all") << false << false << false << false;
+    QTest::newRow("one") << QByteArray("messages") << true << false << false << true;
+    QTest::newRow("one, disabled") << QByteArray("messages") << false << false << false << false;
+    QTest::newRow("two") << QByteArray("avatars,general") << true << true << true << false;
+    QTest::newRow("spaces") << QByteArray(" avatars , messages ") << true << false << true << true;
+    QTest::newRow("all among others") << QByteArray("avatars,all") << true << true << true << true;
+    QTest::newRow("empty items") << QByteArray(",,") << true << true << true << true;
+    QTest::newRow("unknown") << QByteArray("telepathy") << true << false << false << false;
+    QTest::newRow("unknown among others") << QByteArray("telepathy,avatars") << true
+        << false << true << false;
+    QTest::newRow("case sensitive") << QByteArray("Avatars") << true << false << false << false;
+}
+
+void TestDebugCategories::testDisabledNotEvaluated()
+{
+    qputenv("TP_QT_DEBUG", "avatars");
+    Tp::enableDebug(true);
+
+    debugCategory(DebugMessages) << "messages" << evaluate();
+    QCOMPARE(evaluations, 0);
+    QVERIFY(messages.isEmpty());
+
+    debugCategory(DebugAvatars) << "avatars" << evaluate();
+    QCOMPARE(evaluations, 1);
+    QCOMPARE(messages.size(), 1);
+    QVERIFY(messages.first().contains(QLatin1String("avatars")));
+
+    // Nothing is evaluated either when debug output is disabled altogether
+    Tp::enableDebug(false);
+    debugCategory(DebugAvatars) << "avatars" << evaluate();
+    QCOMPARE(evaluations, 1);
+    QCOMPARE(messages.size(), 1);
+}
+
+void TestDebugCategories::testElseBinding()
+{
+    qputenv("TP_QT_DEBUG", "all");
+    Tp::enableDebug(true);
+
+    // The macro must not take the else of an unbraced if around it
+    bool elseTaken = false;
+    if (evaluations != 0)
+        debugCategory(DebugGeneral) << "not reached";
+    else
+        elseTaken = true;
+    QVERIFY(elseTaken);
+    QVERIFY(messages.isEmpty());
+
+    // Nor run its statement more than once
+    for (int i = 0; i < 3; ++i)
+        debugCategory(DebugGeneral) << "reached" << evaluate();
+    QCOMPARE(evaluations, 3);
+    QCOMPARE(messages.size(), 3);
+}
+
+void TestDebugCategories::cleanup()
+{
+    Tp::setDebugCallback(0);
+    qputenv("TP_QT_DEBUG", QByteArray());
+    Tp::enableDebug(false);
+}
+
+QTEST_MAIN(TestDebugCategories)
+#include "_gen/debug-categories.cpp.moc.hpp"
@@ -4,6 +4,7 @@
 #include <TelepathyQt/Debug>
 #include <TelepathyQt/Feature>
 #include <TelepathyQt/Types>
+#include "TelepathyQt/feature-internal.h"
 
 using namespace Tp;
 
@@ -29,6 +30,8 @@ public:
 
 private Q_SLOTS:
     void testFeaturesHash();
+    void testAssignment();
+    void testFeatureSet();
 };
 
 TestFeatures::TestFeatures(QObject *parent)
@@ -68,6 +71,131 @@ void TestFeatures::testFeaturesHash()
     QVERIFY(qHash(fs1.toSet()) != qHash(fs2.toSet()));
 }
 
+void TestFeatures::testAssignment()
+{
+    Feature feature;
+    QVERIFY(!feature.isValid());
+
+    feature = Feature(QLatin1String("Tp::Test"), 1, true);
+    QVERIFY(feature.isValid());
+    QVERIFY(feature.isCritical());
+    QCOMPARE(feature.first, QLatin1String("Tp::Test"));
+    QCOMPARE(feature.second, 1u);
+
+    // The same feature constructed twice is still the same feature
+    Features features = Features() << Feature(QLatin1String("Tp::Test"), 1) <<
+        Feature(QLatin1String("Tp::Test"), 2);
+    QVERIFY(features.contains(feature));
+    features -= Features(Feature(QLatin1String("Tp::Test"), 1));
+    QCOMPARE(features.size(), 1);
+    QVERIFY(!features.contains(feature));
+}
+
+void TestFeatures::testFeatureSet()
+{
+    // Enough features for their indexes to span several words
+    QList<Feature> fs;
+    for (int i = 0; i < 70; ++i) {
+        fs << Feature(QLatin1String("Tp::TestFeatureSet"), i, i == 65);
+    }
+
+    FeatureSet empty;
+    QVERIFY(empty.isEmpty());
+    QCOMPARE(empty.count(), 0);
+    QVERIFY(empty.toFeatures().isEmpty());
+
+    // Invalid features are ignored
+    FeatureSet set = FeatureSet(Feature());
+    QVERIFY(set.isEmpty());
+    QVERIFY(!set.contains(Feature()));
+
+    // unite
+    FeatureSet low = FeatureSet() << fs[0] << fs[1] << fs[31];
+    FeatureSet high = FeatureSet() << fs[32] << fs[64] << fs[65];
+    FeatureSet all = low | high;
+    QCOMPARE(all.count(), 6);
+    QCOMPARE(FeatureSet(low).unite(high), all);
+    QCOMPARE(FeatureSet(high).unite(low), all);
+    QCOMPARE(FeatureSet(all).unite(low), all);
+    set = low;
+    set |= high;
+    QCOMPARE(set, all);
+    set = low;
+    set += high;
+    QCOMPARE(set, all);
+    QCOMPARE(FeatureSet(empty).unite(all), all);
+
+    // contains
+    foreach (const Feature &feature, QList<Feature>() << fs[0] << fs[31] << fs[32] << fs[65]) {
+        QVERIFY(all.contains(feature));
+    }
+    QVERIFY(!all.contains(fs[2]));
+    QVERIFY(!all.contains(fs[69]));
+    QVERIFY(!low.contains(fs[64]));
+    QVERIFY(all.contains(low));
+    QVERIFY(all.contains(high));
+    QVERIFY(all.contains(empty));
+    QVERIFY(empty.contains(empty));
+    QVERIFY(!low.contains(all));
+    QVERIFY(!empty.contains(low));
+    QVERIFY(!(FeatureSet() << fs[0]).contains(FeatureSet() << fs[0] << fs[64]));
+
+    // intersect
+    QVERIFY(all.intersects(low));
+    QVERIFY(!low.intersects(high));
+    QVERIFY(!empty.intersects(all));
+    QCOMPARE(all & low, low);
+    QCOMPARE(low & high, empty);
+    QCOMPARE(high & all, high);
+    set = all;
+    set &= FeatureSet() << fs[1] << fs[64] << fs[69];
+    QCOMPARE(set, FeatureSet() << fs[1] << fs[64]);
+
+    // subtract, including sets spanning a different number of words
+    QCOMPARE(all - high, low);
+    QCOMPARE(all - low, high);
+    QCOMPARE(low - high, low);
+    QCOMPARE(low - all, empty);
+    QCOMPARE(empty - all, empty);
+    QCOMPARE(all - empty, all);
+    QCOMPARE(FeatureSet(all).subtract(FeatureSet() << fs[0] << fs[65]),
+            FeatureSet() << fs[1] << fs[31] << fs[32] << fs[64]);
+    set = all;
+    set -= low;
+    QCOMPARE(set, high);
+    QCOMPARE(FeatureSet(all).remove(fs[31]).remove(fs[69]).count(), 5);
+
+    // Trailing empty words do not matter for equality
+    set = FeatureSet(fs[64]);
+    set.remove(fs[64]);
+    QVERIFY(set.isEmpty());
+    QCOMPARE(set, empty);
+    QCOMPARE(empty, set);
+    QCOMPARE((FeatureSet() << fs[0] << fs[64]) - FeatureSet(fs[64]), FeatureSet(fs[0]));
+    QCOMPARE(FeatureSet(fs[0]), (FeatureSet() << fs[0] << fs[64]) - FeatureSet(fs[64]));
+    QVERIFY((FeatureSet() << fs[0] << fs[64]) != FeatureSet(fs[0]));
+    QVERIFY(FeatureSet(fs[0]) != (FeatureSet() << fs[0] << fs[64]));
+    set = all;
+    set.clear();
+    QCOMPARE(set, empty);
+
+    // Round trip through Features
+    Features features = all.toFeatures();
+    QCOMPARE(features.size(), 6);
+    QVERIFY(features == (Features() << fs[0] << fs[1] << fs[31] << fs[32] << fs[64] << fs[65]));
+    QCOMPARE(FeatureSet(features), all);
+    QCOMPARE(FeatureSet(Features() << fs[0] << Feature() << fs[64]),
+            FeatureSet() << fs[0] << fs[64]);
+
+    // Features constructed again map to the same bits, and come back with their flags
+    FeatureSet again = FeatureSet() << Feature(QLatin1String("Tp::TestFeatureSet"), 65)
+        << Feature(QLatin1String("Tp::TestFeatureSet"), 64);
+    QCOMPARE(again, FeatureSet() << fs[64] << fs[65]);
+    foreach (const Feature &feature, again.toFeatures()) {
+        QCOMPARE(feature.isCritical(), feature.second == 65);
+    }
+}
+
 QTEST_MAIN(TestFeatures)
 
 #include "_gen/features.cpp.moc.hpp"
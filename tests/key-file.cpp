@@ -9,9 +9,36 @@ class TestKeyFile : public QObject
     Q_OBJECT
 
 private Q_SLOTS:
+    void initTestCase();
+
     void testKeyFile();
+    void testParse();
+    void testValues();
+    void testFileChanged();
+
+private:
+    QTemporaryFile mLargeFile;
 };
 
+void TestKeyFile::initTestCase()
+{
+    // A manager file with many protocols and parameters, as installed by the bigger CMs
+    QVERIFY(mLargeFile.open());
+    QTextStream out(&mLargeFile);
+    out << "[ConnectionManager]\nName=large\nBusName=org.freedesktop.Telepathy.ConnectionManager.large\n";
+    for (int protocol = 0; protocol < 50; ++protocol) {
+        out << "\n[Protocol proto" << protocol << "]\n";
+        out << "# parameters\n";
+        for (int param = 0; param < 100; ++param) {
+            out << "param-p" << param << " = as\n";
+            out << "default-p" << param << " = list\\;" << param << ";of;misc\\sitems;\n";
+        }
+    }
+    out.flush();
+    mLargeFile.close();
+}
+
+
 void TestKeyFile::testKeyFile()
 {
     QString top_srcdir = QString::fromLocal8Bit(::getenv("abs_top_srcdir"));
@@ -108,6 +135,71 @@ void TestKeyFile::testKeyFile()
     QCOMPARE(keyFile.value(QLatin1String("default-escaped-semicolon")), QString(QLatin1String("foo;bar")));
 }
 
+void TestKeyFile::testParse()
+{
+    QBENCHMARK {
+        KeyFile keyFile(mLargeFile.fileName());
+        QCOMPARE(keyFile.status(), KeyFile::NoError);
+    }
+}
+
+void TestKeyFile::testValues()
+{
+    KeyFile keyFile(mLargeFile.fileName());
+    QCOMPARE(keyFile.status(), KeyFile::NoError);
+    QCOMPARE(keyFile.allGroups().size(), 51);
+
+    keyFile.setGroup(QLatin1String("Protocol proto7"));
+    QCOMPARE(keyFile.valueAsStringList(QLatin1String("default-p3")),
+             QStringList() << QLatin1String("list;3") << QLatin1String("of") <<
+                              QLatin1String("misc items"));
+
+    QBENCHMARK {
+        foreach (const QString &group, keyFile.allGroups()) {
+            keyFile.setGroup(group);
+            foreach (const QString &key, keyFile.keys()) {
+                if (key.startsWith(QLatin1String("default-"))) {
+                    keyFile.valueAsStringList(key);
+                } else {
+                    keyFile.value(key);
+                }
+            }
+        }
+    }
+}
+
+void TestKeyFile::testFileChanged()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QCOMPARE(file.write("[Group]\nname = first value\nlist = a;b;c;\n"), qint64(41));
+    file.close();
+
+    KeyFile keyFile(file.fileName());
+    QCOMPARE(keyFile.status(), KeyFile::NoError);
+    KeyFile copy(keyFile);
+
+    // The values are read lazily, but not from the file, which may change in the meantime
+    QVERIFY(file.open());
+    QVERIFY(file.resize(0));
+    QCOMPARE(file.write("[Other]\nx=y\n"), qint64(12));
+    file.close();
+
+    keyFile.setGroup(QLatin1String("Group"));
+    QCOMPARE(keyFile.value(QLatin1String("name")), QString(QLatin1String("first value")));
+    QCOMPARE(keyFile.rawValue(QLatin1String("name")), QString(QLatin1String("first value")));
+    QCOMPARE(keyFile.valueAsStringList(QLatin1String("list")),
+             QStringList() << QLatin1String("a") << QLatin1String("b") << QLatin1String("c"));
+
+    copy.setGroup(QLatin1String("Group"));
+    QCOMPARE(copy.value(QLatin1String("name")), QString(QLatin1String("first value")));
+
+    // Reading the file again picks up the new contents
+    keyFile.setFileName(file.fileName());
+    QCOMPARE(keyFile.status(), KeyFile::NoError);
+    QCOMPARE(keyFile.allGroups(), QStringList() << QLatin1String("Other"));
+}
+
 QTEST_MAIN(TestKeyFile)
 
 #include "_gen/key-file.cpp.moc.hpp"
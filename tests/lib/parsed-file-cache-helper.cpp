@@ -0,0 +1,9 @@
+#include "tests/lib/parsed-file-cache-helper.h"
+
+#include <QByteArray>
+#include <QtGlobal>
+
+void setParsedFileCacheEnabled(bool enabled)
+{
+    qputenv("TP_QT_DISABLE_PARSED_FILE_CACHE", enabled ? QByteArray() : QByteArray("1"));
+}
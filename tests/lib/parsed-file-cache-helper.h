@@ -0,0 +1,7 @@
+#ifndef _TelepathyQt_tests_lib_parsed_file_cache_helper_h_HEADER_GUARD_
+#define _TelepathyQt_tests_lib_parsed_file_cache_helper_h_HEADER_GUARD_
+
+// Turn the cache of parsed .manager and .profile files on or off for the files loaded next
+void setParsedFileCacheEnabled(bool enabled);
+
+#endif // _TelepathyQt_tests_lib_parsed_file_cache_helper_h_HEADER_GUARD_
@@ -3,6 +3,9 @@
 #include <TelepathyQt/Constants>
 #include <TelepathyQt/Debug>
 #include "TelepathyQt/manager-file.h"
+#include "TelepathyQt/test-backdoors.h"
+
+#include <tests/lib/parsed-file-cache-helper.h>
 
 using namespace Tp;
 
@@ -50,6 +53,9 @@ public:
 
 private Q_SLOTS:
     void testManagerFile();
+    void testManagerFile_data();
+    void testStartup();
+    void testStartup_data();
 };
 
 TestManagerFile::TestManagerFile(QObject *parent)
@@ -61,6 +67,17 @@ TestManagerFile::TestManagerFile(QObject *parent)
 
 void TestManagerFile::testManagerFile()
 {
+    QFETCH(bool, cached);
+
+    setParsedFileCacheEnabled(cached);
+    if (cached) {
+        // Make sure the cache entry exists, so the file is loaded from it below. Invalid
+        // files are never cached, they are parsed again each time.
+        ManagerFile warmUp(QLatin1String("test-manager-file"));
+        QVERIFY(warmUp.isValid());
+    }
+    int hits = TestBackdoors::parsedFileCacheHits();
+
     ManagerFile notFoundManagerFile(QLatin1String("test-manager-file-not-found"));
     QCOMPARE(notFoundManagerFile.isValid(), false);
 
@@ -225,6 +242,44 @@ void TestManagerFile::testManagerFile()
     QCOMPARE(param->signature, QString(QLatin1String("as")));
     QCOMPARE(param->defaultValue.variant().toStringList(),
              QStringList() << QString());
+
+    // Only the valid file comes from the cache, the invalid ones are parsed again
+    QCOMPARE(TestBackdoors::parsedFileCacheHits() - hits, cached ? 1 : 0);
+}
+
+void TestManagerFile::testManagerFile_data()
+{
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("parsed") << false;
+    QTest::newRow("cached") << true;
+}
+
+void TestManagerFile::testStartup()
+{
+    QFETCH(bool, cached);
+
+    setParsedFileCacheEnabled(cached);
+    if (cached) {
+        ManagerFile warmUp(QLatin1String("test-manager-file"));
+        QVERIFY(warmUp.isValid());
+    }
+    int hits = TestBackdoors::parsedFileCacheHits();
+
+    QBENCHMARK {
+        ManagerFile managerFile(QLatin1String("test-manager-file"));
+        QVERIFY(managerFile.isValid());
+    }
+
+    QCOMPARE(TestBackdoors::parsedFileCacheHits() > hits, cached);
+}
+
+void TestManagerFile::testStartup_data()
+{
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("cold") << false;
+    QTest::newRow("warm") << true;
 }
 
 QTEST_MAIN(TestManagerFile)
@@ -2,9 +2,46 @@
 
 #include <TelepathyQt/Debug>
 #include <TelepathyQt/Profile>
+#include "TelepathyQt/test-backdoors.h"
+
+#include <tests/lib/parsed-file-cache-helper.h>
+
+#include <utime.h>
 
 using namespace Tp;
 
+namespace
+{
+
+bool writeProfile(const QString &fileName, const char *name)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    file.write("<service xmlns=\"http://telepathy.freedesktop.org/wiki/service-profile-v1\"\n"
+               "         id=\"test-profile-changing\"\n"
+               "         type=\"IM\"\n"
+               "         manager=\"testprofilecm\"\n"
+               "         protocol=\"testprofileproto\">\n"
+               "  <name>");
+    file.write(name);
+    file.write("</name>\n"
+               "</service>\n");
+    return true;
+}
+
+bool setModificationTime(const QString &fileName, uint time)
+{
+    struct utimbuf times;
+    times.actime = time;
+    times.modtime = time;
+    return utime(QFile::encodeName(fileName).constData(), &times) == 0;
+}
+
+}
+
 class TestProfile : public QObject
 {
     Q_OBJECT
@@ -14,6 +51,13 @@ public:
 
 private Q_SLOTS:
     void testProfile();
+    void testProfile_data();
+    void testCacheInvalidation();
+    void testCorruptedCache();
+
+private:
+    QString changingProfileFileName() const;
+    void removeChangingProfile();
 };
 
 TestProfile::TestProfile(QObject *parent)
@@ -23,13 +67,42 @@ TestProfile::TestProfile(QObject *parent)
     Tp::enableWarnings(true);
 }
 
+QString TestProfile::changingProfileFileName() const
+{
+    // The service name comes from the file name, so the file lives in a directory of its own
+    QString dirName = QString(QLatin1String("%1/tp-qt-test-profile-%2"))
+        .arg(QDir::tempPath()).arg(QCoreApplication::applicationPid());
+    QDir().mkpath(dirName);
+    return dirName + QLatin1String("/test-profile-changing.profile");
+}
+
+void TestProfile::removeChangingProfile()
+{
+    QString fileName = changingProfileFileName();
+    QFile::remove(TestBackdoors::parsedFileCacheFileName(QLatin1String("profiles"), fileName));
+    QFile::remove(fileName);
+    QDir().rmdir(QFileInfo(fileName).absolutePath());
+}
+
 void TestProfile::testProfile()
 {
+    QFETCH(bool, cached);
+
     QString top_srcdir = QString::fromLocal8Bit(::getenv("abs_top_srcdir"));
     if (!top_srcdir.isEmpty()) {
         QDir::setCurrent(top_srcdir + QLatin1String("/tests"));
     }
 
+    setParsedFileCacheEnabled(cached);
+    if (cached) {
+        // Make sure the cache entries exist, so the files are loaded from them below. Invalid
+        // files are never cached, they are parsed again each time.
+        QVERIFY(Profile::createForServiceName(QLatin1String("test-profile"))->isValid());
+        QVERIFY(Profile::createForServiceName(QLatin1String("test-profile-no-icon-and-provider"))->isValid());
+        QVERIFY(Profile::createForFileName(QLatin1String("telepathy/profiles/test-profile-non-im-type.profile"))->isValid());
+    }
+    int hits = TestBackdoors::parsedFileCacheHits();
+
     ProfilePtr profile = Profile::createForServiceName(QLatin1String("test-profile-file-not-found"));
     QCOMPARE(profile->isValid(), false);
 
@@ -128,6 +201,115 @@ void TestProfile::testProfile()
     QCOMPARE(profile->cmName(), QLatin1String("testprofilecm"));
     QCOMPARE(profile->protocolName(), QLatin1String("testprofileproto"));
     QCOMPARE(profile->iconName().isEmpty(), true);
+
+    // Only the three valid profiles come from the cache, the others are parsed again
+    QCOMPARE(TestBackdoors::parsedFileCacheHits() - hits, cached ? 3 : 0);
+}
+
+void TestProfile::testProfile_data()
+{
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("parsed") << false;
+    QTest::newRow("cached") << true;
+}
+
+void TestProfile::testCacheInvalidation()
+{
+    setParsedFileCacheEnabled(true);
+    removeChangingProfile();
+
+    QString fileName = changingProfileFileName();
+    QVERIFY(writeProfile(fileName, "First"));
+
+    int hits = TestBackdoors::parsedFileCacheHits();
+    int misses = TestBackdoors::parsedFileCacheMisses();
+    ProfilePtr profile = Profile::createForFileName(fileName);
+    QVERIFY(profile->isValid());
+    QCOMPARE(profile->name(), QLatin1String("First"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits);
+    QCOMPARE(TestBackdoors::parsedFileCacheMisses(), misses + 1);
+
+    profile = Profile::createForFileName(fileName);
+    QCOMPARE(profile->name(), QLatin1String("First"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits + 1);
+
+    // A change of size invalidates the entry
+    QVERIFY(writeProfile(fileName, "Second name"));
+    profile = Profile::createForFileName(fileName);
+    QVERIFY(profile->isValid());
+    QCOMPARE(profile->name(), QLatin1String("Second name"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits + 1);
+    QCOMPARE(TestBackdoors::parsedFileCacheMisses(), misses + 2);
+
+    profile = Profile::createForFileName(fileName);
+    QCOMPARE(profile->name(), QLatin1String("Second name"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits + 2);
+
+    // So does a change of mtime alone. The new mtime is set explicitly, rewriting the file
+    // within the same second may not change it.
+    uint mtime = QFileInfo(fileName).lastModified().toTime_t();
+    QVERIFY(writeProfile(fileName, "Third name!"));
+    QVERIFY(setModificationTime(fileName, mtime + 10));
+    profile = Profile::createForFileName(fileName);
+    QVERIFY(profile->isValid());
+    QCOMPARE(profile->name(), QLatin1String("Third name!"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits + 2);
+    QCOMPARE(TestBackdoors::parsedFileCacheMisses(), misses + 3);
+
+    profile = Profile::createForFileName(fileName);
+    QCOMPARE(profile->name(), QLatin1String("Third name!"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits + 3);
+
+    removeChangingProfile();
+}
+
+void TestProfile::testCorruptedCache()
+{
+    setParsedFileCacheEnabled(true);
+    removeChangingProfile();
+
+    QString fileName = changingProfileFileName();
+    QVERIFY(writeProfile(fileName, "Corrupted"));
+    QVERIFY(Profile::createForFileName(fileName)->isValid());
+
+    QString cacheFileName = TestBackdoors::parsedFileCacheFileName(QLatin1String("profiles"),
+            fileName);
+    QFile cacheFile(cacheFileName);
+    QVERIFY(cacheFile.open(QIODevice::ReadOnly));
+    QByteArray entry = cacheFile.readAll();
+    cacheFile.close();
+    QVERIFY(entry.size() > 10);
+
+    // A garbled entry is ignored, and replaced by the parsed file
+    QVERIFY(cacheFile.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    cacheFile.write("garbage");
+    cacheFile.close();
+
+    int hits = TestBackdoors::parsedFileCacheHits();
+    int misses = TestBackdoors::parsedFileCacheMisses();
+    ProfilePtr profile = Profile::createForFileName(fileName);
+    QVERIFY(profile->isValid());
+    QCOMPARE(profile->name(), QLatin1String("Corrupted"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits);
+    QCOMPARE(TestBackdoors::parsedFileCacheMisses(), misses + 1);
+
+    profile = Profile::createForFileName(fileName);
+    QCOMPARE(profile->name(), QLatin1String("Corrupted"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits + 1);
+
+    // So is a truncated one, even though its header is still valid
+    QVERIFY(cacheFile.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    cacheFile.write(entry.left(entry.size() - 10));
+    cacheFile.close();
+
+    profile = Profile::createForFileName(fileName);
+    QVERIFY(profile->isValid());
+    QCOMPARE(profile->name(), QLatin1String("Corrupted"));
+    QCOMPARE(TestBackdoors::parsedFileCacheHits(), hits + 1);
+    QCOMPARE(TestBackdoors::parsedFileCacheMisses(), misses + 2);
+
+    removeChangingProfile();
 }
 
 QTEST_MAIN(TestProfile)
@@ -0,0 +1,347 @@
+#include <QtTest/QtTest>
+
+#include <QEventLoop>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include <TelepathyQt/StreamTubeRelay>
+#include "TelepathyQt/test-backdoors.h"
+
+using namespace Tp;
+
+class Backend : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    Backend(bool echo)
+        : mEcho(echo),
+          mReceived(0)
+    {
+        connect(this, SIGNAL(newConnection()), SLOT(onNewConnection()));
+    }
+
+    qint64 received() const { return mReceived; }
+
+Q_SIGNALS:
+    void dataReceived();
+
+private Q_SLOTS:
+    void onNewConnection()
+    {
+        while (hasPendingConnections()) {
+            QTcpSocket *socket = nextPendingConnection();
+            connect(socket, SIGNAL(readyRead()), SLOT(onReadyRead()));
+            connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        }
+    }
+
+    void onReadyRead()
+    {
+        QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+        QByteArray data = socket->readAll();
+        mReceived += data.size();
+        if (mEcho) {
+            socket->write(data);
+        }
+        emit dataReceived();
+    }
+
+private:
+    bool mEcho;
+    qint64 mReceived;
+};
+
+class TestStreamTubeRelay : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestStreamTubeRelay(QObject *parent = 0)
+        : QObject(parent),
+          mLoop(new QEventLoop(this)),
+          mClosedId(0),
+          mClosedToBackend(-1),
+          mClosedFromBackend(-1)
+    { }
+
+protected Q_SLOTS:
+    void onNewConnection(uint connectionId);
+    void onConnectionClosed(uint connectionId, qint64 bytesToBackend, qint64 bytesFromBackend,
+            const QString &errorMessage);
+    void onDataReceived();
+
+private Q_SLOTS:
+    void init();
+
+    void testListen();
+    void testEcho();
+    void testBackendRefused();
+    void testUnixSocket();
+    void testSlowBackend();
+    void testThroughput();
+
+private:
+    StreamTubeRelayPtr createRelay(const Backend &backend);
+
+    QEventLoop *mLoop;
+    QList<uint> mNewIds;
+    uint mClosedId;
+    qint64 mClosedToBackend;
+    qint64 mClosedFromBackend;
+    QString mClosedError;
+};
+
+void TestStreamTubeRelay::onNewConnection(uint connectionId)
+{
+    mNewIds << connectionId;
+    mLoop->exit(0);
+}
+
+void TestStreamTubeRelay::onConnectionClosed(uint connectionId, qint64 bytesToBackend,
+        qint64 bytesFromBackend, const QString &errorMessage)
+{
+    mClosedId = connectionId;
+    mClosedToBackend = bytesToBackend;
+    mClosedFromBackend = bytesFromBackend;
+    mClosedError = errorMessage;
+    mLoop->exit(0);
+}
+
+void TestStreamTubeRelay::onDataReceived()
+{
+    mLoop->exit(0);
+}
+
+StreamTubeRelayPtr TestStreamTubeRelay::createRelay(const Backend &backend)
+{
+    StreamTubeRelayPtr relay = StreamTubeRelay::create(QHostAddress(QHostAddress::LocalHost),
+            backend.serverPort());
+    connect(relay.data(), SIGNAL(newConnection(uint)), SLOT(onNewConnection(uint)));
+    connect(relay.data(), SIGNAL(connectionClosed(uint,qint64,qint64,QString)),
+            SLOT(onConnectionClosed(uint,qint64,qint64,QString)));
+    return relay;
+}
+
+void TestStreamTubeRelay::init()
+{
+    mNewIds.clear();
+    mClosedId = 0;
+    mClosedToBackend = -1;
+    mClosedFromBackend = -1;
+    mClosedError.clear();
+}
+
+void TestStreamTubeRelay::testListen()
+{
+    Backend backend(true);
+    QVERIFY(backend.listen(QHostAddress::LocalHost));
+
+    StreamTubeRelayPtr relay = createRelay(backend);
+    QCOMPARE(relay->backendAddress(), QHostAddress(QHostAddress::LocalHost));
+    QCOMPARE(relay->backendPort(), backend.serverPort());
+    QVERIFY(relay->backendSocket().isEmpty());
+    QVERIFY(!relay->isListening());
+    QCOMPARE(relay->bufferSize(), 64 * 1024);
+
+    QVERIFY(relay->listenTcp());
+    QVERIFY(relay->isListening());
+    QCOMPARE(relay->listenAddress(), QHostAddress(QHostAddress::LocalHost));
+    QVERIFY(relay->listenPort() != 0);
+    QVERIFY(!relay->listenTcp());
+
+    relay->close();
+    QVERIFY(!relay->isListening());
+    QCOMPARE(relay->listenPort(), quint16(0));
+    QVERIFY(relay->listenTcp());
+}
+
+void TestStreamTubeRelay::testEcho()
+{
+    Backend backend(true);
+    QVERIFY(backend.listen(QHostAddress::LocalHost));
+
+    StreamTubeRelayPtr relay = createRelay(backend);
+    // A small buffer makes the relay apply back-pressure many times over
+    relay->setBufferSize(4096);
+    QCOMPARE(relay->bufferSize(), 4096);
+    QVERIFY(relay->listenTcp());
+
+    QByteArray data;
+    for (int i = 0; i < 1024 * 1024; ++i) {
+        data.append(char(i % 251));
+    }
+
+    QTcpSocket client;
+    client.connectToHost(relay->listenAddress(), relay->listenPort());
+    QVERIFY(client.waitForConnected());
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mNewIds.size(), 1);
+    QCOMPARE(relay->connections(), mNewIds);
+
+    // The backend lives in this thread too, so wait with the event loop running
+    connect(&client, SIGNAL(readyRead()), SLOT(onDataReceived()));
+    client.write(data);
+    QByteArray echoed;
+    while (echoed.size() < data.size()) {
+        QVERIFY(client.state() == QAbstractSocket::ConnectedState);
+        QCOMPARE(mLoop->exec(), 0);
+        echoed += client.readAll();
+    }
+    QVERIFY(echoed == data);
+    QVERIFY(relay->bytesToBackend(mNewIds.first()) > 0);
+
+    client.disconnectFromHost();
+    while (!mClosedId) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+    QCOMPARE(mClosedId, mNewIds.first());
+    QCOMPARE(mClosedToBackend, qint64(data.size()));
+    QCOMPARE(mClosedFromBackend, qint64(data.size()));
+    QVERIFY(mClosedError.isEmpty());
+    QVERIFY(relay->connections().isEmpty());
+    QCOMPARE(relay->bytesToBackend(mNewIds.first()), qint64(0));
+}
+
+void TestStreamTubeRelay::testBackendRefused()
+{
+    Backend backend(true);
+    QVERIFY(backend.listen(QHostAddress::LocalHost));
+
+    StreamTubeRelayPtr relay = createRelay(backend);
+    backend.close();
+    QVERIFY(relay->listenTcp());
+
+    QTcpSocket client;
+    client.connectToHost(relay->listenAddress(), relay->listenPort());
+    QVERIFY(client.waitForConnected());
+    while (!mClosedId) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+    QCOMPARE(mNewIds, QList<uint>() << mClosedId);
+    QCOMPARE(mClosedToBackend, qint64(0));
+    QVERIFY(!mClosedError.isEmpty());
+
+    // The client side is closed along with the connection
+    if (client.state() == QAbstractSocket::ConnectedState) {
+        QVERIFY(client.waitForDisconnected());
+    }
+}
+
+void TestStreamTubeRelay::testUnixSocket()
+{
+    Backend backend(true);
+    QVERIFY(backend.listen(QHostAddress::LocalHost));
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QString socketAddress = file.fileName() + QLatin1String(".socket");
+
+    // One relay listening on a Unix socket, another one in front of it
+    StreamTubeRelayPtr unixRelay = createRelay(backend);
+    QVERIFY(unixRelay->listenUnix(socketAddress));
+    QCOMPARE(unixRelay->listenSocket(), socketAddress);
+    QCOMPARE(unixRelay->listenPort(), quint16(0));
+    QVERIFY(QFile::exists(socketAddress));
+
+    StreamTubeRelayPtr relay = StreamTubeRelay::create(socketAddress);
+    QCOMPARE(relay->backendSocket(), socketAddress);
+    QVERIFY(relay->listenTcp());
+
+    QTcpSocket client;
+    client.connectToHost(relay->listenAddress(), relay->listenPort());
+    QVERIFY(client.waitForConnected());
+    connect(&client, SIGNAL(readyRead()), SLOT(onDataReceived()));
+    client.write("ping");
+    QByteArray echoed;
+    while (echoed.size() < 4) {
+        QCOMPARE(mLoop->exec(), 0);
+        echoed += client.readAll();
+    }
+    QCOMPARE(echoed, QByteArray("ping"));
+
+    unixRelay->close();
+    QVERIFY(!QFile::exists(socketAddress));
+}
+
+void TestStreamTubeRelay::testSlowBackend()
+{
+    Backend backend(false);
+    QVERIFY(backend.listen(QHostAddress::LocalHost));
+    // The kernel still completes the connections, but nothing ever reads them
+    backend.pauseAccepting();
+
+    StreamTubeRelayPtr relay = createRelay(backend);
+    relay->setBufferSize(1024 * 1024);
+    QVERIFY(relay->listenTcp());
+
+    QTcpSocket client;
+    client.connectToHost(relay->listenAddress(), relay->listenPort());
+    QVERIFY(client.waitForConnected());
+    QCOMPARE(mLoop->exec(), 0);
+    client.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    // Small segments each take a page of the relay pipe, so it fills up long before the buffer
+    // size is reached. Keep going until the backend and the relay have stopped taking data.
+    QByteArray chunk(100, 'x');
+    for (int i = 0; i < 200000 && client.bytesToWrite() < 1024 * 1024; ++i) {
+        client.write(chunk);
+        client.flush();
+    }
+    QVERIFY(client.bytesToWrite() >= 1024 * 1024);
+    QVERIFY(relay->bytesToBackend(mNewIds.first()) > 0);
+    QTest::qWait(100);
+
+    // Nothing can move, so the I/O thread must be blocked in poll() instead of being woken up
+    // over and over by a client it can't read from
+    int wakeUps = TestBackdoors::streamTubeRelayPollWakeUps(relay);
+    QTest::qWait(500);
+    int extraWakeUps = TestBackdoors::streamTubeRelayPollWakeUps(relay) - wakeUps;
+    QVERIFY2(extraWakeUps < 10,
+            qPrintable(QString(QLatin1String("The I/O thread woke up %1 times while stalled"))
+                .arg(extraWakeUps)));
+
+    // The stalled connection is closed along with the relay
+    relay->close();
+}
+
+void TestStreamTubeRelay::testThroughput()
+{
+    const qint64 total = 64 * 1024 * 1024;
+
+    Backend backend(false);
+    QVERIFY(backend.listen(QHostAddress::LocalHost));
+    connect(&backend, SIGNAL(dataReceived()), SLOT(onDataReceived()));
+
+    StreamTubeRelayPtr relay = createRelay(backend);
+    QVERIFY(relay->listenTcp());
+
+    QTcpSocket client;
+    client.connectToHost(relay->listenAddress(), relay->listenPort());
+    QVERIFY(client.waitForConnected());
+
+    QByteArray chunk(256 * 1024, 'x');
+    QBENCHMARK_ONCE {
+        qint64 written = 0;
+        while (backend.received() < total) {
+            // Keep the amount queued in the client bounded, like a real producer would
+            while (written < total && client.bytesToWrite() < 4 * chunk.size()) {
+                client.write(chunk);
+                written += chunk.size();
+            }
+            QCOMPARE(mLoop->exec(), 0);
+        }
+    }
+
+    QCOMPARE(backend.received(), total);
+
+    client.disconnectFromHost();
+    while (!mClosedId) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+    QCOMPARE(mClosedToBackend, total);
+    QVERIFY(mClosedError.isEmpty());
+}
+
+QTEST_MAIN(TestStreamTubeRelay)
+#include "_gen/stream-tube-relay.cpp.moc.hpp"